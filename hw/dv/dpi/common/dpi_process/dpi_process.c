@@ -0,0 +1,38 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "dpi_process.h"
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+static long long token;
+
+long long dpi_process_token(void) {
+  if (token) {
+    return token;
+  }
+
+  // Mix the PID with the time the first context was created and an address
+  // (which changes between runs with ASLR). The PID alone isn't enough: a
+  // simulation restored in a fresh container can easily get the same PID as
+  // the one that saved the checkpoint.
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  uint64_t val = ((uint64_t)getpid() << 32) ^
+                 ((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec) ^
+                 (uint64_t)(uintptr_t)&token;
+
+  // Finish with the splitmix64 mixer, so that nearby inputs give unrelated
+  // tokens.
+  val ^= val >> 30;
+  val *= 0xbf58476d1ce4e5b9u;
+  val ^= val >> 27;
+  val *= 0x94d049bb133111ebu;
+  val ^= val >> 31;
+
+  token = val ? (long long)val : 1;
+  return token;
+}
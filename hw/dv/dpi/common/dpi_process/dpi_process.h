@@ -0,0 +1,38 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_DPI_COMMON_DPI_PROCESS_DPI_PROCESS_H_
+#define OPENTITAN_HW_DV_DPI_COMMON_DPI_PROCESS_DPI_PROCESS_H_
+
+/**
+ * Detect DPI contexts that were created by another process
+ *
+ * DPI modules keep their host-side state behind a chandle, which is a pointer
+ * into the process that created it. If the simulator saves the model state
+ * and restores it in a new process (see --save-checkpoint in
+ * VerilatorSimCtrl), these chandles come back as dangling pointers and the
+ * initial blocks that created them don't run again.
+ *
+ * To handle this, a DPI module stores dpi_process_token() next to its chandle
+ * when it creates a context, and compares the two before using the context.
+ * If they differ, the context belongs to another process and the module must
+ * create a new one.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Return a token that identifies this run of the simulator
+ *
+ * The token is never zero and is very unlikely to match the token of any
+ * other process, including one that had the same PID.
+ */
+long long dpi_process_token(void);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+#endif  // OPENTITAN_HW_DV_DPI_COMMON_DPI_PROCESS_DPI_PROCESS_H_
@@ -13,68 +13,136 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
-#include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 /**
- * Simple buffer for passing data between TCP sockets and DPI modules
+ * Single-producer, single-consumer ring buffer for passing data between TCP
+ * sockets and DPI modules
+ *
+ * rptr and wptr are free-running byte counters: the buffer holds wptr - rptr
+ * bytes, starting at buf[rptr % BUFSIZE_BYTE]. Only the consumer writes rptr
+ * and only the producer writes wptr, so no lock is needed. Each side publishes
+ * its pointer with a release store after it has finished with the data and
+ * reads the other side's pointer with an acquire load.
+ *
+ * Wakeups between the DPI side and the server thread use a "publish, fence,
+ * then check the other side" handshake, so that at least one of the two
+ * threads sees the other's update and no wakeup is lost.
+ *
+ * BUFSIZE_BYTE must be a power of two.
  */
-#define BUFSIZE_BYTE 256
+#define BUFSIZE_BYTE 16384
 
 struct tcp_buf {
-  unsigned int rptr;
-  unsigned int wptr;
+  size_t rptr;
+  size_t wptr;
   char buf[BUFSIZE_BYTE];
 };
 
+static size_t tcp_buffer_used(struct tcp_buf *buf) {
+  return __atomic_load_n(&buf->wptr, __ATOMIC_ACQUIRE) -
+         __atomic_load_n(&buf->rptr, __ATOMIC_ACQUIRE);
+}
+
 /**
- * TCP Server thread context structure
+ * Find the free space in a buffer
+ *
+ * The free space is returned as up to two contiguous regions in iov. Fill in
+ * some prefix of these and then call tcp_buffer_commit_put() to make the data
+ * visible to the consumer.
+ *
+ * @param buf buffer (only to be called by the producer)
+ * @param iov filled in with the free regions
+ * @return the number of regions (0 if the buffer is full)
  */
-struct tcp_server_ctx {
-  // Writeable by the host thread
-  char *display_name;
-  uint16_t listen_port;
-  volatile bool socket_run;
-  // Writeable by the server thread
-  struct tcp_buf *buf_in;
-  struct tcp_buf *buf_out;
-  int sfd;  // socket fd
-  int cfd;  // client fd
-  pthread_t sock_thread;
-};
+static int tcp_buffer_put_iov(struct tcp_buf *buf, struct iovec iov[2]) {
+  size_t wptr = __atomic_load_n(&buf->wptr, __ATOMIC_RELAXED);
+  size_t rptr = __atomic_load_n(&buf->rptr, __ATOMIC_ACQUIRE);
+  size_t space = BUFSIZE_BYTE - (wptr - rptr);
+  size_t off = wptr & (BUFSIZE_BYTE - 1);
+  size_t first = BUFSIZE_BYTE - off < space ? BUFSIZE_BYTE - off : space;
+
+  iov[0].iov_base = &buf->buf[off];
+  iov[0].iov_len = first;
+  iov[1].iov_base = &buf->buf[0];
+  iov[1].iov_len = space - first;
+  return !space ? 0 : (space == first ? 1 : 2);
+}
 
-static bool tcp_buffer_is_full(struct tcp_buf *buf) {
-  if (buf->wptr >= buf->rptr) {
-    return (buf->wptr - buf->rptr) == (BUFSIZE_BYTE - 1);
-  } else {
-    return (buf->rptr - buf->wptr) == 1;
-  }
+static void tcp_buffer_commit_put(struct tcp_buf *buf, size_t len) {
+  size_t wptr = __atomic_load_n(&buf->wptr, __ATOMIC_RELAXED);
+  __atomic_store_n(&buf->wptr, wptr + len, __ATOMIC_RELEASE);
 }
 
-static bool tcp_buffer_is_empty(struct tcp_buf *buf) {
-  return (buf->wptr == buf->rptr);
+/**
+ * Find the data in a buffer
+ *
+ * The data is returned as up to two contiguous regions in iov. Consume some
+ * prefix of these and then call tcp_buffer_commit_get() to free the space for
+ * the producer.
+ *
+ * @param buf buffer (only to be called by the consumer)
+ * @param iov filled in with the regions holding data
+ * @return the number of regions (0 if the buffer is empty)
+ */
+static int tcp_buffer_get_iov(struct tcp_buf *buf, struct iovec iov[2]) {
+  size_t rptr = __atomic_load_n(&buf->rptr, __ATOMIC_RELAXED);
+  size_t wptr = __atomic_load_n(&buf->wptr, __ATOMIC_ACQUIRE);
+  size_t used = wptr - rptr;
+  size_t off = rptr & (BUFSIZE_BYTE - 1);
+  size_t first = BUFSIZE_BYTE - off < used ? BUFSIZE_BYTE - off : used;
+
+  iov[0].iov_base = &buf->buf[off];
+  iov[0].iov_len = first;
+  iov[1].iov_base = &buf->buf[0];
+  iov[1].iov_len = used - first;
+  return !used ? 0 : (used == first ? 1 : 2);
 }
 
-static void tcp_buffer_put_byte(struct tcp_buf *buf, char dat) {
-  bool done = false;
-  while (!done) {
-    if (!tcp_buffer_is_full(buf)) {
-      buf->buf[buf->wptr++] = dat;
-      buf->wptr %= BUFSIZE_BYTE;
-      done = true;
-    }
+static void tcp_buffer_commit_get(struct tcp_buf *buf, size_t len) {
+  size_t rptr = __atomic_load_n(&buf->rptr, __ATOMIC_RELAXED);
+  __atomic_store_n(&buf->rptr, rptr + len, __ATOMIC_RELEASE);
+}
+
+/**
+ * Copy up to len bytes into a buffer without blocking
+ *
+ * @return the number of bytes copied
+ */
+static size_t tcp_buffer_put(struct tcp_buf *buf, const char *dat, size_t len) {
+  struct iovec iov[2];
+  int num_iov = tcp_buffer_put_iov(buf, iov);
+  size_t done = 0;
+  for (int i = 0; i < num_iov && done < len; ++i) {
+    size_t n = len - done < iov[i].iov_len ? len - done : iov[i].iov_len;
+    memcpy(iov[i].iov_base, dat + done, n);
+    done += n;
   }
+  tcp_buffer_commit_put(buf, done);
+  return done;
 }
 
-static bool tcp_buffer_get_byte(struct tcp_buf *buf, char *dat) {
-  if (tcp_buffer_is_empty(buf)) {
-    return false;
+/**
+ * Copy up to len bytes out of a buffer without blocking
+ *
+ * @return the number of bytes copied
+ */
+static size_t tcp_buffer_get(struct tcp_buf *buf, char *dat, size_t len) {
+  struct iovec iov[2];
+  int num_iov = tcp_buffer_get_iov(buf, iov);
+  size_t done = 0;
+  for (int i = 0; i < num_iov && done < len; ++i) {
+    size_t n = len - done < iov[i].iov_len ? len - done : iov[i].iov_len;
+    memcpy(dat + done, iov[i].iov_base, n);
+    done += n;
   }
-  *dat = buf->buf[buf->rptr++];
-  buf->rptr %= BUFSIZE_BYTE;
-  return true;
+  tcp_buffer_commit_get(buf, done);
+  return done;
 }
 
 static struct tcp_buf *tcp_buffer_new(void) {
@@ -90,6 +158,41 @@ static void tcp_buffer_free(struct tcp_buf **buf) {
   *buf = NULL;
 }
 
+/**
+ * TCP Server thread context structure
+ */
+struct tcp_server_ctx {
+  // Writeable by the host thread
+  char *display_name;
+  uint16_t listen_port;
+  volatile bool socket_run;
+  // Writeable by the server thread
+  struct tcp_buf *buf_in;
+  struct tcp_buf *buf_out;
+  int sfd;  // socket fd
+  int cfd;  // client fd
+  int epfd;  // epoll fd
+  uint32_t cfd_events;  // events for cfd registered with epfd (0 if none)
+  bool sfd_armed;       // whether epfd is watching sfd for new connections
+  pthread_t sock_thread;
+  // Writeable by both threads
+  int efd;         // eventfd used to wake up the server thread
+  int in_stalled;  // set by the server thread when buf_in is full
+};
+
+/**
+ * Wake up the server thread
+ *
+ * @param ctx context object
+ */
+static void wake(struct tcp_server_ctx *ctx) {
+  uint64_t one = 1;
+  // This can only fail if the counter would overflow, in which case the server
+  // thread has a wakeup pending anyway.
+  ssize_t rv = write(ctx->efd, &one, sizeof(one));
+  (void)rv;
+}
+
 /**
  * Start a TCP server
  *
@@ -199,7 +302,20 @@ static int client_tryaccept(struct tcp_server_ctx *ctx) {
     return -1;
   }
 
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = cfd;
+  rv = epoll_ctl(ctx->epfd, EPOLL_CTL_ADD, cfd, &ev);
+  if (rv != 0) {
+    fprintf(stderr, "%s: Unable to watch client socket: %s (%d)\n",
+            ctx->display_name, strerror(errno), errno);
+    close(cfd);
+    return -1;
+  }
+
   ctx->cfd = cfd;
+  ctx->cfd_events = EPOLLIN;
   assert(ctx->cfd > 0);
 
   printf("%s: Accepted client connection\n", ctx->display_name);
@@ -222,24 +338,34 @@ static void stop(struct tcp_server_ctx *ctx) {
 }
 
 /**
- * Receive a byte from a connected client
+ * Receive as much data from a connected client as fits in buf_in
+ *
+ * The data is read straight into the free space of the buffer with a single
+ * readv() call.
  *
  * @param ctx context object
- * @param cmd byte received
- * @return true if a byte was read
+ * @return true if any data was read
  */
-static bool get_byte(struct tcp_server_ctx *ctx, char *cmd) {
+static bool get_data(struct tcp_server_ctx *ctx) {
   assert(ctx);
 
-  ssize_t num_read = read(ctx->cfd, cmd, 1);
+  struct iovec iov[2];
+  int num_iov = tcp_buffer_put_iov(ctx->buf_in, iov);
+  if (num_iov == 0) {
+    return false;
+  }
+
+  ssize_t num_read = readv(ctx->cfd, iov, num_iov);
 
   if (num_read == 0) {
+    printf("%s: Remote disconnected.\n", ctx->display_name);
+    tcp_server_client_close(ctx);
     return false;
   }
   if (num_read == -1) {
     if (errno == EAGAIN || errno == EWOULDBLOCK) {
       return false;
-    } else if (errno == EBADF) {
+    } else if (errno == EBADF || errno == ECONNRESET) {
       // Possibly client went away? Accept a new connection.
       fprintf(stderr, "%s: Client disappeared.\n", ctx->display_name);
       tcp_server_client_close(ctx);
@@ -250,36 +376,45 @@ static bool get_byte(struct tcp_server_ctx *ctx, char *cmd) {
       assert(0 && "Error reading from client");
     }
   }
-  assert(num_read == 1);
+  tcp_buffer_commit_put(ctx->buf_in, num_read);
   return true;
 }
 
 /**
- * Send a byte to a connected client
+ * Send the contents of buf_out to a connected client
+ *
+ * The data is sent straight from the buffer with a single sendmsg() call. If
+ * the socket can't take all of it, the rest stays in the buffer and is sent on
+ * a later call.
  *
  * @param ctx context object
- * @param cmd byte to send
  */
-static void put_byte(struct tcp_server_ctx *ctx, char cmd) {
-  while (1) {
-    ssize_t num_written = send(ctx->cfd, &cmd, sizeof(cmd), MSG_NOSIGNAL);
-    if (num_written == -1) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        continue;
-      } else if (errno == EPIPE) {
-        printf("%s: Remote disconnected.\n", ctx->display_name);
-        tcp_server_client_close(ctx);
-        break;
-      } else {
-        fprintf(stderr, "%s: Error while writing to client: %s (%d)\n",
-                ctx->display_name, strerror(errno), errno);
-        assert(0 && "Error writing to client.");
-      }
-    }
-    if (num_written >= 1) {
-      break;
+static void put_data(struct tcp_server_ctx *ctx) {
+  struct msghdr msg;
+  struct iovec iov[2];
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = tcp_buffer_get_iov(ctx->buf_out, iov);
+  if (msg.msg_iovlen == 0) {
+    return;
+  }
+
+  // sendmsg() is writev() with flags, which we need for MSG_NOSIGNAL
+  ssize_t num_written = sendmsg(ctx->cfd, &msg, MSG_NOSIGNAL);
+  if (num_written == -1) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return;
+    } else if (errno == EPIPE || errno == ECONNRESET) {
+      printf("%s: Remote disconnected.\n", ctx->display_name);
+      tcp_server_client_close(ctx);
+      return;
+    } else {
+      fprintf(stderr, "%s: Error while writing to client: %s (%d)\n",
+              ctx->display_name, strerror(errno), errno);
+      assert(0 && "Error writing to client.");
     }
   }
+  tcp_buffer_commit_get(ctx->buf_out, num_written);
 }
 
 /**
@@ -288,6 +423,13 @@ static void put_byte(struct tcp_server_ctx *ctx, char cmd) {
  * @param ctx context object
  */
 static void ctx_free(struct tcp_server_ctx *ctx) {
+  // Close the wakeup and epoll fds
+  if (ctx->efd > 0) {
+    close(ctx->efd);
+  }
+  if (ctx->epfd > 0) {
+    close(ctx->epfd);
+  }
   // Free the buffers
   tcp_buffer_free(&ctx->buf_in);
   tcp_buffer_free(&ctx->buf_out);
@@ -298,6 +440,74 @@ static void ctx_free(struct tcp_server_ctx *ctx) {
   ctx = NULL;
 }
 
+/**
+ * Update the events that epfd watches for on sfd and cfd
+ *
+ * The listening socket is only watched while there is no client, and the
+ * client socket is only watched for input while there is space in buf_in and
+ * for output while there is something in buf_out. This means that the server
+ * thread sleeps until there is some work that it can actually do.
+ *
+ * epoll always reports EPOLLHUP and EPOLLERR, whatever events an fd is
+ * registered for. If the client hung up while buf_in was full, cfd would wake
+ * us on every call to epoll_wait() until the DPI side made space. So when
+ * there is nothing to wait for on cfd, it is removed from epfd altogether.
+ *
+ * @param ctx context object
+ */
+static void update_events(struct tcp_server_ctx *ctx) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+
+  bool want_sfd = ctx->cfd == 0;
+  if (want_sfd != ctx->sfd_armed) {
+    ev.events = want_sfd ? EPOLLIN : 0;
+    ev.data.fd = ctx->sfd;
+    epoll_ctl(ctx->epfd, EPOLL_CTL_MOD, ctx->sfd, &ev);
+    ctx->sfd_armed = want_sfd;
+  }
+
+  if (ctx->cfd == 0) {
+    return;
+  }
+
+  uint32_t events = 0;
+  if (tcp_buffer_used(ctx->buf_in) < BUFSIZE_BYTE) {
+    events |= EPOLLIN;
+  } else {
+    // Ask the DPI side to wake us once it has read something, then check again
+    // in case it did so before seeing the flag.
+    __atomic_store_n(&ctx->in_stalled, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (tcp_buffer_used(ctx->buf_in) < BUFSIZE_BYTE) {
+      __atomic_store_n(&ctx->in_stalled, 0, __ATOMIC_RELAXED);
+      events |= EPOLLIN;
+    }
+  }
+
+  // put_data() has just tried to send everything. Check again for data that
+  // the DPI side might have added without waking us (see
+  // tcp_server_write_bulk()).
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (tcp_buffer_used(ctx->buf_out) != 0) {
+    events |= EPOLLOUT;
+  }
+
+  if (events != ctx->cfd_events) {
+    int op = EPOLL_CTL_MOD;
+    if (!events) {
+      op = EPOLL_CTL_DEL;
+    } else if (!ctx->cfd_events) {
+      op = EPOLL_CTL_ADD;
+    }
+    ev.events = events;
+    ev.data.fd = ctx->cfd;
+    // This fails if the DPI side has just closed the client, which is fine.
+    epoll_ctl(ctx->epfd, op, ctx->cfd, &ev);
+    ctx->cfd_events = events;
+  }
+}
+
 /**
  * Thread function to create a new server instance
  *
@@ -307,7 +517,7 @@ static void ctx_free(struct tcp_server_ctx *ctx) {
 static void *server_create(void *ctx_void) {
   // Cast to a server struct
   struct tcp_server_ctx *ctx = (struct tcp_server_ctx *)ctx_void;
-  struct timeval timeout;
+  struct epoll_event ev;
 
   // Start the server
   int rv = start(ctx);
@@ -317,55 +527,58 @@ static void *server_create(void *ctx_void) {
     goto err_cleanup_return;
   }
 
-  // Initialise timeout
-  timeout.tv_sec = 0;
-
-  // Initialise fd_set
+  // Watch the eventfd (for wakeups from the DPI side) and the listening socket
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = ctx->efd;
+  rv = epoll_ctl(ctx->epfd, EPOLL_CTL_ADD, ctx->efd, &ev);
+  if (rv == 0) {
+    ev.data.fd = ctx->sfd;
+    rv = epoll_ctl(ctx->epfd, EPOLL_CTL_ADD, ctx->sfd, &ev);
+    ctx->sfd_armed = true;
+  }
+  if (rv != 0) {
+    fprintf(stderr, "%s: Unable to set up epoll: %s (%d)\n", ctx->display_name,
+            strerror(errno), errno);
+    goto err_cleanup_return;
+  }
 
-  // Start waiting for connection / data
-  char xfer_data;
+  // Start waiting for connection / data / wakeups
   while (ctx->socket_run) {
-    // Initialise structure of fds
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    if (ctx->sfd) {
-      FD_SET(ctx->sfd, &read_fds);
-    }
-    if (ctx->cfd) {
-      FD_SET(ctx->cfd, &read_fds);
-    }
-    // max fd num
-    int mfd = (ctx->cfd > ctx->sfd) ? ctx->cfd : ctx->sfd;
-
-    // Set timeout - 50us gives good performance
-    timeout.tv_usec = 50;
-
-    // Wait for socket activity or timeout
-    rv = select(mfd + 1, &read_fds, NULL, NULL, &timeout);
-
-    if (rv < 0) {
-      printf("%s: Socket read failed, port: %d\n", ctx->display_name,
-             ctx->listen_port);
-      tcp_server_client_close(ctx);
-    }
-
-    // New connection
-    if (FD_ISSET(ctx->sfd, &read_fds)) {
-      client_tryaccept(ctx);
+    struct epoll_event events[4];
+    int num_events = epoll_wait(ctx->epfd, events, 4, -1);
+    if (num_events < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "%s: Waiting for socket activity failed: %s (%d)\n",
+              ctx->display_name, strerror(errno), errno);
+      break;
     }
 
-    // New client data
-    if (FD_ISSET(ctx->cfd, &read_fds)) {
-      while (get_byte(ctx, &xfer_data)) {
-        tcp_buffer_put_byte(ctx->buf_in, xfer_data);
+    for (int i = 0; i < num_events; ++i) {
+      int fd = events[i].data.fd;
+      if (fd == ctx->efd) {
+        uint64_t count;
+        rv = read(ctx->efd, &count, sizeof(count));
+        (void)rv;
+      } else if (fd == ctx->sfd) {
+        // New connection
+        if (ctx->cfd == 0) {
+          client_tryaccept(ctx);
+        }
+      } else if (fd == ctx->cfd) {
+        // New client data (or the client went away, which get_data() spots)
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+          get_data(ctx);
+        }
       }
     }
 
     if (ctx->cfd != 0) {
-      while (tcp_buffer_get_byte(ctx->buf_out, &xfer_data)) {
-        put_byte(ctx, xfer_data);
-      }
+      put_data(ctx);
     }
+    update_events(ctx);
   }
 
 err_cleanup_return:
@@ -400,28 +613,74 @@ struct tcp_server_ctx *tcp_server_create(const char *display_name,
   ctx->display_name = strdup(display_name);
   assert(ctx->display_name);
 
+  ctx->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ctx->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (ctx->efd < 0 || ctx->epfd < 0) {
+    fprintf(stderr, "%s: Unable to create eventfd or epoll instance: %s (%d)\n",
+            ctx->display_name, strerror(errno), errno);
+    ctx_free(ctx);
+    return NULL;
+  }
+
   if (pthread_create(&ctx->sock_thread, NULL, server_create, (void *)ctx) !=
       0) {
     fprintf(stderr, "%s: Unable to create TCP socket thread\n",
             ctx->display_name);
     ctx_free(ctx);
-    free(ctx);
     return NULL;
   }
   return ctx;
 }
 
 bool tcp_server_read(struct tcp_server_ctx *ctx, char *dat) {
-  return tcp_buffer_get_byte(ctx->buf_in, dat);
+  return tcp_server_read_bulk(ctx, dat, 1) == 1;
+}
+
+size_t tcp_server_read_bulk(struct tcp_server_ctx *ctx, char *buf,
+                            size_t len) {
+  size_t done = tcp_buffer_get(ctx->buf_in, buf, len);
+
+  // If the server thread stopped reading from the client because buf_in was
+  // full, tell it that there is space again.
+  if (done) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ctx->in_stalled, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&ctx->in_stalled, 0, __ATOMIC_RELAXED)) {
+      wake(ctx);
+    }
+  }
+  return done;
 }
 
 void tcp_server_write(struct tcp_server_ctx *ctx, char dat) {
-  tcp_buffer_put_byte(ctx->buf_out, dat);
+  tcp_server_write_bulk(ctx, &dat, 1);
+}
+
+void tcp_server_write_bulk(struct tcp_server_ctx *ctx, const char *buf,
+                           size_t len) {
+  // Block (spinning, as the server thread drains the buffer) until all the
+  // data has been queued.
+  while (len) {
+    size_t old_wptr = __atomic_load_n(&ctx->buf_out->wptr, __ATOMIC_RELAXED);
+    size_t done = tcp_buffer_put(ctx->buf_out, buf, len);
+
+    // If the server thread had already sent everything before this data, it
+    // may be asleep: wake it. Otherwise, it will spot the new data itself when
+    // it checks buf_out after sending (see update_events()).
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (done && __atomic_load_n(&ctx->buf_out->rptr, __ATOMIC_RELAXED) ==
+                    old_wptr) {
+      wake(ctx);
+    }
+    buf += done;
+    len -= done;
+  }
 }
 
 void tcp_server_close(struct tcp_server_ctx *ctx) {
   // Shut down the socket thread
   ctx->socket_run = false;
+  wake(ctx);
   pthread_join(ctx->sock_thread, NULL);
   ctx_free(ctx);
 }
@@ -435,4 +694,8 @@ void tcp_server_client_close(struct tcp_server_ctx *ctx) {
 
   close(ctx->cfd);
   ctx->cfd = 0;
+
+  // If this was called from the DPI side, the server thread needs to start
+  // listening for new connections again.
+  wake(ctx);
 }
@@ -17,6 +17,7 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 struct tcp_server_ctx;
@@ -30,6 +31,16 @@ struct tcp_server_ctx;
  */
 bool tcp_server_read(struct tcp_server_ctx *ctx, char *dat);
 
+/**
+ * Non-blocking read of up to len bytes from a connected client
+ *
+ * @param ctx tcp server context object
+ * @param buf buffer for the bytes received
+ * @param len size of buf
+ * @return the number of bytes read (which may be zero)
+ */
+size_t tcp_server_read_bulk(struct tcp_server_ctx *ctx, char *buf, size_t len);
+
 /**
  * Write a byte to a connected client
  *
@@ -41,6 +52,19 @@ bool tcp_server_read(struct tcp_server_ctx *ctx, char *dat);
  */
 void tcp_server_write(struct tcp_server_ctx *ctx, char dat);
 
+/**
+ * Write len bytes to a connected client
+ *
+ * This behaves like calling tcp_server_write() for each byte, but copies the
+ * data into the internal buffer in one go.
+ *
+ * @param ctx tcp server context object
+ * @param buf bytes to send
+ * @param len number of bytes in buf
+ */
+void tcp_server_write_bulk(struct tcp_server_ctx *ctx, const char *buf,
+                           size_t len);
+
 /**
  * Create a new TCP server instance
  *
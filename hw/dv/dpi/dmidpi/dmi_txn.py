@@ -0,0 +1,266 @@
+#!/usr/bin/env python3
+# Copyright lowRISC contributors.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+r"""Host-side client for the transaction-level DMI interface of dmidpi
+
+This talks to the socket that dmidpi opens when it is given a transaction
+port (with the TxnListenPort parameter or the +DMIDPI_TXN_PORT_<Name> plusarg).
+It can load a binary file into memory or dump memory to a file, using the
+debug module's system bus access registers.
+
+Example:
+
+  dmi_txn.py --port 44854 load 0x10000000 image.bin
+  dmi_txn.py --port 44854 dump 0x10000000 0x1000 dump.bin
+"""
+
+import argparse
+import socket
+import struct
+import sys
+from typing import List, Tuple
+
+# DMI operations and responses
+DMI_OP_READ = 1
+DMI_OP_WRITE = 2
+DMI_RESP_SUCCESS = 0
+DMI_RESP_BUSY = 3
+
+# Debug module registers (RISC-V debug spec 0.13)
+DM_DMCONTROL = 0x10
+DM_SBCS = 0x38
+DM_SBADDRESS0 = 0x39
+DM_SBDATA0 = 0x3c
+
+# SBCS fields
+SBCS_SBBUSYERROR = 1 << 22
+SBCS_SBBUSY = 1 << 21
+SBCS_SBREADONADDR = 1 << 20
+SBCS_SBACCESS_32 = 2 << 17
+SBCS_SBAUTOINCREMENT = 1 << 16
+SBCS_SBREADONDATA = 1 << 15
+SBCS_SBERROR_SHIFT = 12
+SBCS_SBERROR_MASK = 0x7 << SBCS_SBERROR_SHIFT
+
+# The maximum number of requests to send before reading their responses
+BATCH_SIZE = 1024
+
+Txn = Tuple[int, int, int]
+
+
+class DmiTxnError(Exception):
+    pass
+
+
+class DmiTxnClient:
+    '''A connection to the transaction-level DMI socket of dmidpi'''
+
+    def __init__(self, host: str, port: int) -> None:
+        self._sock = socket.create_connection((host, port))
+        self._sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        # The number of sbcs reads to put after each request that starts a
+        # system bus access, to give the bus time to finish it. This starts
+        # at zero and goes up each time the debug module reports that the
+        # bus was still busy.
+        self._sb_spacing = 0
+
+    def close(self) -> None:
+        self._sock.close()
+
+    def _recv_exact(self, length: int) -> bytes:
+        buf = bytearray()
+        while len(buf) < length:
+            chunk = self._sock.recv(length - len(buf))
+            if not chunk:
+                raise DmiTxnError('Connection closed by simulation.')
+            buf += chunk
+        return bytes(buf)
+
+    def batch(self, txns: List[Txn]) -> List[Tuple[int, int]]:
+        '''Run a list of (op, addr, data) transactions
+
+        Returns a list of (resp, data) pairs, one for each transaction. The
+        requests are sent in groups of BATCH_SIZE before reading the
+        responses.
+
+        If a group gets a busy response, the remaining groups aren't sent (a
+        busy system bus access sets the sticky sbbusyerror flag, so they would
+        fail too) and the returned list stops at the end of that group.
+
+        '''
+        rsps = []  # type: List[Tuple[int, int]]
+        for start in range(0, len(txns), BATCH_SIZE):
+            group = txns[start:start + BATCH_SIZE]
+            self._sock.sendall(b''.join(
+                struct.pack('<BBI', op, addr, data & 0xffffffff)
+                for op, addr, data in group))
+            raw = self._recv_exact(5 * len(group))
+            group_rsps = [struct.unpack_from('<BI', raw, 5 * i)
+                          for i in range(len(group))]
+            rsps += group_rsps
+            if any(resp == DMI_RESP_BUSY for resp, _ in group_rsps):
+                break
+        return rsps
+
+    def read(self, addr: int) -> int:
+        resp, data = self.batch([(DMI_OP_READ, addr, 0)])[0]
+        if resp != DMI_RESP_SUCCESS:
+            raise DmiTxnError('DMI read of 0x{:02x} failed with response {}.'
+                              .format(addr, resp))
+        return data
+
+    def write(self, addr: int, data: int) -> None:
+        resp, _ = self.batch([(DMI_OP_WRITE, addr, data)])[0]
+        if resp != DMI_RESP_SUCCESS:
+            raise DmiTxnError('DMI write of 0x{:02x} failed with response {}.'
+                              .format(addr, resp))
+
+    def _sb_wait(self) -> int:
+        '''Wait for any system bus access to finish and return SBCS'''
+        while True:
+            sbcs = self.read(DM_SBCS)
+            if not sbcs & SBCS_SBBUSY:
+                return sbcs
+
+    def _sb_setup(self, flags: int) -> None:
+        '''Activate the debug module and configure system bus access
+
+        This also clears any sticky system bus errors. SBCS can't be written
+        while a bus access is in flight, so wait for that to finish first.
+
+        '''
+        self.write(DM_DMCONTROL, 1)
+        self._sb_wait()
+        self.write(DM_SBCS, (SBCS_SBACCESS_32 | SBCS_SBBUSYERROR |
+                             SBCS_SBERROR_MASK | flags))
+
+    def _sb_check(self) -> None:
+        sberror = (self._sb_wait() & SBCS_SBERROR_MASK) >> SBCS_SBERROR_SHIFT
+        if sberror:
+            raise DmiTxnError('System bus access failed with sberror={}.'
+                              .format(sberror))
+
+    def _sb_pad(self) -> List[Txn]:
+        '''Return padding to go after a transaction that starts a bus access
+
+        The debug module answers busy if we start a system bus access (or
+        read sbdata0) while the last one is still in flight. We can't poll
+        sbbusy without waiting for a response, so instead we space the
+        accesses out with reads of sbcs (which have no side effects).
+
+        '''
+        return [(DMI_OP_READ, DM_SBCS, 0)] * self._sb_spacing
+
+    def _sb_run(self, txns: List[Txn]) -> List[int]:
+        '''Run txns, stopping at the first busy response
+
+        Returns the values written to or read from sbdata0 by the
+        transactions before any busy response. If there was a busy response,
+        this also spaces out later sbdata0 accesses further.
+
+        '''
+        rsps = self.batch(txns)
+        sbdata = []
+        for (op, addr, data), (resp, rsp_data) in zip(txns, rsps):
+            if resp == DMI_RESP_BUSY:
+                self._sb_spacing = max(1, 2 * self._sb_spacing)
+                return sbdata
+            if resp != DMI_RESP_SUCCESS:
+                raise DmiTxnError('DMI access failed with response {}.'
+                                  .format(resp))
+            if addr == DM_SBDATA0:
+                sbdata.append(rsp_data if op == DMI_OP_READ else data)
+        return sbdata
+
+    def sysbus_write(self, addr: int, data: bytes) -> None:
+        '''Write data to memory at addr (both must be word aligned)'''
+        assert addr % 4 == 0 and len(data) % 4 == 0
+        words = list(struct.unpack('<{}I'.format(len(data) // 4), data))
+
+        done = 0
+        while done < len(words):
+            # Send the rest of the data as one stream of sbdata0 writes, with
+            # the address auto-incrementing. If the bus can't keep up, the
+            # debug module answers busy and ignores further accesses, so we
+            # start again from the first word that didn't make it.
+            self._sb_setup(SBCS_SBAUTOINCREMENT)
+            txns = [(DMI_OP_WRITE, DM_SBADDRESS0, addr + 4 * done)]
+            for word in words[done:]:
+                txns.append((DMI_OP_WRITE, DM_SBDATA0, word))
+                txns += self._sb_pad()
+            done += len(self._sb_run(txns))
+
+        self._sb_check()
+
+    def sysbus_read(self, addr: int, length: int) -> bytes:
+        '''Read length bytes of memory at addr (both must be word aligned)'''
+        assert addr % 4 == 0 and length % 4 == 0
+        num_words = length // 4
+        words = []  # type: List[int]
+
+        while len(words) < num_words:
+            # Writing sbaddress0 starts the first bus read and each read of
+            # sbdata0 starts the next one. We clear sbreadondata before
+            # reading the last word, so that we don't start a bus read past
+            # the end of the range. As with writes, a busy response means we
+            # start again from the first word that we didn't get.
+            left = num_words - len(words)
+            flags = SBCS_SBAUTOINCREMENT | SBCS_SBREADONADDR
+            self._sb_setup(flags | (SBCS_SBREADONDATA if left > 1 else 0))
+            txns = [(DMI_OP_WRITE, DM_SBADDRESS0, addr + 4 * len(words))]
+            txns += self._sb_pad()
+            for _ in range(left - 1):
+                txns.append((DMI_OP_READ, DM_SBDATA0, 0))
+                txns += self._sb_pad()
+            if left > 1:
+                txns.append((DMI_OP_WRITE, DM_SBCS,
+                             SBCS_SBACCESS_32 | flags))
+            txns.append((DMI_OP_READ, DM_SBDATA0, 0))
+            words += self._sb_run(txns)
+
+        self._sb_check()
+        return struct.pack('<{}I'.format(num_words), *words)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        description=__doc__)
+    parser.add_argument('--host', default='localhost',
+                        help='Host running the simulation')
+    parser.add_argument('--port', type=int, required=True,
+                        help='Transaction-level DMI port of dmidpi')
+    subparsers = parser.add_subparsers(dest='cmd', required=True)
+
+    load = subparsers.add_parser('load', help='Load a binary file to memory')
+    load.add_argument('addr', type=lambda x: int(x, 0))
+    load.add_argument('file', type=argparse.FileType('rb'))
+
+    dump = subparsers.add_parser('dump', help='Dump memory to a binary file')
+    dump.add_argument('addr', type=lambda x: int(x, 0))
+    dump.add_argument('length', type=lambda x: int(x, 0))
+    dump.add_argument('file', type=argparse.FileType('wb'))
+
+    args = parser.parse_args()
+
+    client = DmiTxnClient(args.host, args.port)
+    try:
+        if args.cmd == 'load':
+            data = args.file.read()
+            # Pad to a whole number of words
+            data += b'\0' * (-len(data) % 4)
+            client.sysbus_write(args.addr, data)
+        else:
+            args.file.write(client.sysbus_read(args.addr, args.length))
+    except DmiTxnError as err:
+        print('ERROR: {}'.format(err), file=sys.stderr)
+        return 1
+    finally:
+        client.close()
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
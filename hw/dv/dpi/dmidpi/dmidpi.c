@@ -82,12 +82,151 @@ struct dmi_sig_values {
   uint8_t dmi_rst_n;
 };
 
+/**
+ * Transaction-level DMI protocol
+ *
+ * As well as the remote_bitbang JTAG socket, dmidpi can listen on a second
+ * port for DMI transactions, skipping the JTAG TAP entirely. The client sends
+ * a stream of request records and gets back one response record for each, in
+ * order. Multi-byte fields are little-endian.
+ *
+ * Request (6 bytes):  uint8_t op (1: read, 2: write), uint8_t addr,
+ *                     uint32_t data (ignored for reads)
+ * Response (5 bytes): uint8_t resp (DMI response, 0: success), uint32_t data
+ *
+ * A client can batch transactions by sending many requests before reading the
+ * responses.
+ */
+#define DMI_TXN_REQ_BYTES 6
+#define DMI_TXN_RSP_BYTES 5
+
+enum dmi_txn_op_t { DmiTxnRead = 1, DmiTxnWrite = 2 };
+
+struct dmi_txn_ctx {
+  struct tcp_server_ctx *sock;
+  // Partially received request
+  uint8_t req[DMI_TXN_REQ_BYTES];
+  uint8_t req_len;
+};
+
+/**
+ * DMI request queue
+ *
+ * Requests from both sockets go through a single queue, so that a new request
+ * can be presented to the debug module as soon as it accepts the previous one
+ * rather than waiting for its response. The debug module responds in order,
+ * so we keep the owners of accepted requests in a second queue to route the
+ * responses back.
+ *
+ * The total number of queued and in-flight requests is at most
+ * DMI_QUEUE_SIZE, which must be a power of two.
+ */
+#define DMI_QUEUE_SIZE 16
+
+enum dmi_owner_t { DmiOwnerJtag, DmiOwnerTxn };
+
+struct dmi_req {
+  uint32_t addr;
+  uint32_t op;
+  uint32_t data;
+  enum dmi_owner_t owner;
+};
+
+struct dmi_queue {
+  // Requests waiting to be accepted by the debug module. Indices are
+  // free-running counters.
+  struct dmi_req reqs[DMI_QUEUE_SIZE];
+  unsigned req_head;
+  unsigned req_tail;
+  // Owners of accepted requests that are waiting for a response
+  enum dmi_owner_t inflight[DMI_QUEUE_SIZE];
+  unsigned inflight_head;
+  unsigned inflight_tail;
+
+  // Statistics, reported by dmidpi_close()
+  uint64_t busy_cycles;   // Ticks with any queued or in-flight requests
+  uint64_t num_reqs;      // Number of requests accepted by the debug module
+  uint64_t depth_sum;     // Sum over ticks of queued + in-flight requests
+  unsigned max_depth;     // Maximum of queued + in-flight requests
+  uint64_t stall_cycles;  // Ticks where a request was waiting for dmi_req_ready
+};
+
 struct dmidpi_ctx {
   struct tcp_server_ctx *sock;
   struct jtag_ctx jtag;
   struct dmi_sig_values sig;
+  struct dmi_txn_ctx txn;
+  struct dmi_queue queue;
 };
 
+/**
+ * Number of queued and in-flight DMI requests
+ *
+ * @param ctx dmidpi context object
+ */
+static unsigned dmi_queue_depth(struct dmidpi_ctx *ctx) {
+  struct dmi_queue *q = &ctx->queue;
+  return (q->req_tail - q->req_head) + (q->inflight_tail - q->inflight_head);
+}
+
+/**
+ * Add a request to the DMI request queue, which must not be full
+ *
+ * @param ctx dmidpi context object
+ * @param owner where the response should go
+ */
+static void push_dmi_req(struct dmidpi_ctx *ctx, uint32_t addr, uint32_t op,
+                         uint32_t data, enum dmi_owner_t owner) {
+  struct dmi_queue *q = &ctx->queue;
+  assert(dmi_queue_depth(ctx) < DMI_QUEUE_SIZE);
+
+  struct dmi_req *req = &q->reqs[q->req_tail++ % DMI_QUEUE_SIZE];
+  req->addr = addr;
+  req->op = op;
+  req->data = data;
+  req->owner = owner;
+}
+
+/**
+ * Send a DMI response to the transaction-level socket
+ *
+ * @param ctx dmidpi context object
+ */
+static void send_txn_rsp(struct dmidpi_ctx *ctx, uint32_t resp,
+                         uint32_t data) {
+  char rsp[DMI_TXN_RSP_BYTES] = {(char)(resp & 0x3), (char)data,
+                                 (char)(data >> 8), (char)(data >> 16),
+                                 (char)(data >> 24)};
+  tcp_server_write_bulk(ctx->txn.sock, rsp, DMI_TXN_RSP_BYTES);
+}
+
+/**
+ * Drop all queued and in-flight DMI requests
+ *
+ * This is called when the debug module is put into reset, which also clears
+ * its response FIFO. Transaction-level requests get a "failed" response so
+ * that the client doesn't wait forever.
+ *
+ * @param ctx dmidpi context object
+ */
+static void flush_dmi_queue(struct dmidpi_ctx *ctx) {
+  struct dmi_queue *q = &ctx->queue;
+
+  for (; q->inflight_head != q->inflight_tail; ++q->inflight_head) {
+    if (q->inflight[q->inflight_head % DMI_QUEUE_SIZE] == DmiOwnerTxn) {
+      send_txn_rsp(ctx, 2, 0);
+    }
+  }
+  for (; q->req_head != q->req_tail; ++q->req_head) {
+    if (q->reqs[q->req_head % DMI_QUEUE_SIZE].owner == DmiOwnerTxn) {
+      send_txn_rsp(ctx, 2, 0);
+    }
+  }
+
+  ctx->jtag.dmi_outstanding = 0;
+  ctx->sig.dmi_req_valid = 0;
+}
+
 /**
  * Setup the correct shift register data
  *
@@ -115,16 +254,15 @@ static void set_dr_data(struct dmidpi_ctx *ctx) {
 }
 
 /**
- * Drive a new DMI transaction to the DPI interface
+ * Queue a new DMI transaction from the JTAG DMI access register
  *
  * @param ctx dmidpi context object
  */
 static void issue_dmi_req(struct dmidpi_ctx *ctx) {
   ctx->jtag.dmi_outstanding = 1;
-  ctx->sig.dmi_req_valid = 1;
-  ctx->sig.dmi_req_addr = (ctx->jtag.dr_captured >> 34) & 0x7F;
-  ctx->sig.dmi_req_op = ctx->jtag.dr_captured & 0x3;
-  ctx->sig.dmi_req_data = (ctx->jtag.dr_captured >> 2) & 0xFFFFFFFF;
+  push_dmi_req(ctx, (ctx->jtag.dr_captured >> 34) & 0x7F,
+               ctx->jtag.dr_captured & 0x3,
+               (ctx->jtag.dr_captured >> 2) & 0xFFFFFFFF, DmiOwnerJtag);
 }
 
 /**
@@ -151,6 +289,7 @@ static bool process_jtag_cmd(struct dmidpi_ctx *ctx, bool tdi, bool tms,
     case TestLogicReset:
       // reset design
       ctx->sig.dmi_rst_n = 0;
+      flush_dmi_queue(ctx);
       ctx->jtag.ir_captured = 1;
       if (!tms) {
         ctx->jtag.jtag_state = RunTestIdle;
@@ -300,6 +439,7 @@ static bool process_cmd_byte(struct dmidpi_ctx *ctx, char cmd) {
     char trst = ((cmd_bit >> 1) & 0x1);
     if (trst) {
       ctx->sig.dmi_rst_n = 0;
+      flush_dmi_queue(ctx);
       ctx->jtag.jtag_state = RunTestIdle;
     }
     return true;
@@ -331,34 +471,84 @@ static bool process_cmd_byte(struct dmidpi_ctx *ctx, char cmd) {
  * @param ctx dmidpi context object
  */
 static void process_dmi_inputs(struct dmidpi_ctx *ctx) {
-  // Deassert dmi_req_valid when acked
-  if (ctx->sig.dmi_req_ready) {
-    ctx->sig.dmi_req_valid = 0;
+  struct dmi_queue *q = &ctx->queue;
+
+  // The request at the head of the queue has been accepted if we were
+  // presenting it and the debug module was ready.
+  if (ctx->sig.dmi_req_valid && ctx->sig.dmi_req_ready) {
+    assert(q->req_head != q->req_tail);
+    enum dmi_owner_t owner = q->reqs[q->req_head++ % DMI_QUEUE_SIZE].owner;
+    q->inflight[q->inflight_tail++ % DMI_QUEUE_SIZE] = owner;
+    ++q->num_reqs;
+  } else if (ctx->sig.dmi_req_valid) {
+    ++q->stall_cycles;
   }
+
   // Always ready for a resp
   ctx->sig.dmi_rsp_ready = 1;
-  if (ctx->sig.dmi_rsp_valid) {
-    ctx->jtag.dr_captured = (uint64_t)ctx->sig.dmi_rsp_data << 2;
-    ctx->jtag.dr_captured |= (uint64_t)ctx->sig.dmi_rsp_resp & 0x3;
-    // Clear req outstanding flag
-    ctx->jtag.dmi_outstanding = 0;
+  if (ctx->sig.dmi_rsp_valid && q->inflight_head != q->inflight_tail) {
+    enum dmi_owner_t owner = q->inflight[q->inflight_head++ % DMI_QUEUE_SIZE];
+    if (owner == DmiOwnerTxn) {
+      send_txn_rsp(ctx, ctx->sig.dmi_rsp_resp, ctx->sig.dmi_rsp_data);
+    } else {
+      ctx->jtag.dr_captured = (uint64_t)ctx->sig.dmi_rsp_data << 2;
+      ctx->jtag.dr_captured |= (uint64_t)ctx->sig.dmi_rsp_resp & 0x3;
+      // Clear req outstanding flag
+      ctx->jtag.dmi_outstanding = 0;
+    }
   }
 }
 
 /**
- * Advance DMI internal state
+ * Queue as many DMI requests from the transaction-level socket as possible
  *
  * @param ctx dmidpi context object
  */
-static void update_dmi_state(struct dmidpi_ctx *ctx) {
-  assert(ctx);
+static void process_txn_reqs(struct dmidpi_ctx *ctx) {
+  struct dmi_txn_ctx *txn = &ctx->txn;
+  if (!txn->sock) {
+    return;
+  }
 
-  // read input from design
-  process_dmi_inputs(ctx);
+  while (dmi_queue_depth(ctx) < DMI_QUEUE_SIZE) {
+    txn->req_len +=
+        tcp_server_read_bulk(txn->sock, (char *)txn->req + txn->req_len,
+                             DMI_TXN_REQ_BYTES - txn->req_len);
+    if (txn->req_len < DMI_TXN_REQ_BYTES) {
+      return;
+    }
+    txn->req_len = 0;
+
+    uint8_t op = txn->req[0];
+    if (op != DmiTxnRead && op != DmiTxnWrite) {
+      fprintf(stderr,
+              "DMI DPI: Protocol violation detected: unsupported DMI "
+              "transaction op %d\n",
+              op);
+      exit(1);
+    }
+
+    // A transaction-level client doesn't drive the TAP, so take the debug
+    // module out of reset here.
+    ctx->sig.dmi_rst_n = 1;
 
-  // If we are waiting for a previous transaction to complete, do not attempt
-  // a new one
-  if (ctx->jtag.dmi_outstanding) {
+    uint32_t data = (uint32_t)txn->req[2] | ((uint32_t)txn->req[3] << 8) |
+                    ((uint32_t)txn->req[4] << 16) |
+                    ((uint32_t)txn->req[5] << 24);
+    push_dmi_req(ctx, txn->req[1] & 0x7F, op, data, DmiOwnerTxn);
+  }
+}
+
+/**
+ * Process command bytes from the JTAG socket
+ *
+ * @param ctx dmidpi context object
+ */
+static void process_jtag_bytes(struct dmidpi_ctx *ctx) {
+  // If we are waiting for a previous JTAG transaction to complete, do not
+  // attempt a new one: the next DR capture needs its response. We also need
+  // space in the queue in case this command issues a request.
+  if (ctx->jtag.dmi_outstanding || dmi_queue_depth(ctx) >= DMI_QUEUE_SIZE) {
     return;
   }
 
@@ -374,7 +564,41 @@ static void update_dmi_state(struct dmidpi_ctx *ctx) {
   }
 }
 
-void *dmidpi_create(const char *display_name, int listen_port) {
+/**
+ * Advance DMI internal state
+ *
+ * @param ctx dmidpi context object
+ */
+static void update_dmi_state(struct dmidpi_ctx *ctx) {
+  assert(ctx);
+  struct dmi_queue *q = &ctx->queue;
+
+  // read input from design
+  process_dmi_inputs(ctx);
+
+  // queue new requests
+  process_txn_reqs(ctx);
+  process_jtag_bytes(ctx);
+
+  // present the request at the head of the queue
+  ctx->sig.dmi_req_valid = q->req_head != q->req_tail;
+  if (ctx->sig.dmi_req_valid) {
+    struct dmi_req *req = &q->reqs[q->req_head % DMI_QUEUE_SIZE];
+    ctx->sig.dmi_req_addr = req->addr;
+    ctx->sig.dmi_req_op = req->op;
+    ctx->sig.dmi_req_data = req->data;
+  }
+
+  unsigned depth = dmi_queue_depth(ctx);
+  q->busy_cycles += depth != 0;
+  q->depth_sum += depth;
+  if (depth > q->max_depth) {
+    q->max_depth = depth;
+  }
+}
+
+void *dmidpi_create(const char *display_name, int listen_port,
+                    int txn_listen_port) {
   // Create context
   struct dmidpi_ctx *ctx =
       (struct dmidpi_ctx *)calloc(1, sizeof(struct dmidpi_ctx));
@@ -392,6 +616,14 @@ void *dmidpi_create(const char *display_name, int listen_port) {
       "  remote_bitbang_port %d\n",
       display_name, listen_port, listen_port);
 
+  if (txn_listen_port) {
+    ctx->txn.sock = tcp_server_create(display_name, txn_listen_port);
+    printf(
+        "DMI: Transaction-level DMI interface %s is listening on port %d.\n"
+        "Connect to it with hw/dv/dpi/dmidpi/dmi_txn.py.\n",
+        display_name, txn_listen_port);
+  }
+
   return (void *)ctx;
 }
 
@@ -401,8 +633,21 @@ void dmidpi_close(void *ctx_void) {
     return;
   }
 
-  // Shut down the server
+  struct dmi_queue *q = &ctx->queue;
+  if (q->num_reqs) {
+    printf(
+        "DMI DPI: %llu DMI requests in %llu busy cycles. Mean queue depth "
+        "%.2f (max %u), %llu cycles stalled on dmi_req_ready.\n",
+        (unsigned long long)q->num_reqs, (unsigned long long)q->busy_cycles,
+        (double)q->depth_sum / q->busy_cycles, q->max_depth,
+        (unsigned long long)q->stall_cycles);
+  }
+
+  // Shut down the servers
   tcp_server_close(ctx->sock);
+  if (ctx->txn.sock) {
+    tcp_server_close(ctx->txn.sock);
+  }
 
   free(ctx);
 }
@@ -18,9 +18,12 @@ extern "C" {
  *
  * @param display_name Name of the interface (for display purposes only)
  * @param listen_port Port to listen on
+ * @param txn_listen_port Port to listen on for transaction-level DMI requests
+ *                        (see dmidpi.c), or 0 to disable this interface
  * @return an initialized struct dmidpi_ctx context object
  */
-void *dmidpi_create(const char *display_name, int listen_port);
+void *dmidpi_create(const char *display_name, int listen_port,
+                    int txn_listen_port);
 
 /**
  * Destructor: Close all connections and free all resources
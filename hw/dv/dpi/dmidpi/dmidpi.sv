@@ -4,7 +4,10 @@
 
 module dmidpi #(
   parameter string Name = "dmi0", // name of the interface (display only)
-  parameter int ListenPort = 44853 // TCP port to listen on
+  parameter int ListenPort = 44853, // TCP port to listen on
+  // TCP port to listen on for transaction-level DMI requests (0: disabled).
+  // Can be overridden with the +DMIDPI_TXN_PORT_<Name>=<port> plusarg.
+  parameter int TxnListenPort = 0
 )(
   input  bit        clk_i,
   input  bit        rst_ni,
@@ -22,7 +25,8 @@ module dmidpi #(
 );
 
   import "DPI-C"
-  function chandle dmidpi_create(input string name, input int listen_port);
+  function chandle dmidpi_create(input string name, input int listen_port,
+                                 input int txn_listen_port);
 
   import "DPI-C"
   function void dmidpi_tick(input chandle ctx, output bit dmi_req_valid,
@@ -35,19 +39,39 @@ module dmidpi #(
   import "DPI-C"
   function void dmidpi_close(input chandle ctx);
 
+  import "DPI-C" function
+    longint dpi_process_token();
+
   chandle ctx;
+  longint ctx_token;
+  int txn_listen_port = TxnListenPort;
+
+  // Get the DPI context, creating it if it hasn't been created by this process
+  // (see dpi_process.h: this happens when the simulation has been restored
+  // from a checkpoint).
+  function automatic chandle get_ctx();
+    if (ctx_token !== dpi_process_token()) begin
+      ctx = dmidpi_create(Name, ListenPort, txn_listen_port);
+      ctx_token = dpi_process_token();
+    end
+    return ctx;
+  endfunction
 
   initial begin
-    ctx = dmidpi_create(Name, ListenPort);
+    void'($value$plusargs({"DMIDPI_TXN_PORT_", Name, "=%d"}, txn_listen_port));
+    void'(get_ctx());
   end
 
   final begin
-    dmidpi_close(ctx);
+    // Don't close a context that belongs to another process
+    if (ctx_token === dpi_process_token()) begin
+      dmidpi_close(ctx);
+    end
     ctx = null;
   end
 
   always_ff @(posedge clk_i, negedge rst_ni) begin
-    dmidpi_tick(ctx, dmi_req_valid, dmi_req_ready, dmi_req_addr, dmi_req_op,
+    dmidpi_tick(get_ctx(), dmi_req_valid, dmi_req_ready, dmi_req_addr, dmi_req_op,
                 dmi_req_data, dmi_rsp_valid, dmi_rsp_ready, dmi_rsp_data,
                 dmi_rsp_resp, dmi_rst_n);
   end
@@ -32,21 +32,39 @@ module gpiodpi
                                      input [N_GPIO-1:0] gpio_pull_en,
                                      input [N_GPIO-1:0] gpio_pull_sel);
 
+   import "DPI-C" function
+     longint dpi_process_token();
+
    chandle ctx;
+   longint ctx_token;
+
+   // Get the DPI context, creating it if it hasn't been created by this process
+   // (see dpi_process.h: this happens when the simulation has been restored
+   // from a checkpoint).
+   function automatic chandle get_ctx();
+     if (ctx_token !== dpi_process_token()) begin
+       ctx = gpiodpi_create(NAME, N_GPIO);
+       ctx_token = dpi_process_token();
+     end
+     return ctx;
+   endfunction
 
    initial begin
-     ctx = gpiodpi_create(NAME, N_GPIO);
+     void'(get_ctx());
    end
 
    final begin
-     gpiodpi_close(ctx);
+     // Don't close a context that belongs to another process
+     if (ctx_token === dpi_process_token()) begin
+       gpiodpi_close(ctx);
+     end
    end
 
    logic [N_GPIO-1:0] gpio_d2p_r;
    always_ff @(posedge clk_i) begin
      gpio_d2p_r <= gpio_d2p;
      if (gpio_d2p_r != gpio_d2p) begin
-       gpiodpi_device_to_host(ctx, gpio_d2p, gpio_en_d2p);
+       gpiodpi_device_to_host(get_ctx(), gpio_d2p, gpio_en_d2p);
      end
    end
 
@@ -56,7 +74,7 @@ module gpiodpi
      if (!rst_ni) begin
        gpio_p2d <= '0; // default value
      end else begin
-       gpio_p2d <= gpiodpi_host_to_device_tick(ctx, gpio_en_d2p, gpio_pull_en, gpio_pull_sel);
+       gpio_p2d <= gpiodpi_host_to_device_tick(get_ctx(), gpio_en_d2p, gpio_pull_en, gpio_pull_sel);
      end
    end
 
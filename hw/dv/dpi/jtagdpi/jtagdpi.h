@@ -5,7 +5,13 @@
 #ifndef OPENTITAN_HW_DV_DPI_JTAGDPI_JTAGDPI_H_
 #define OPENTITAN_HW_DV_DPI_JTAGDPI_JTAGDPI_H_
 
+#if JTAGDPI_STANDALONE
+// For building the benchmark without a simulator
+#include <stdint.h>
+typedef uint8_t svBit;
+#else
 #include <svdpi.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
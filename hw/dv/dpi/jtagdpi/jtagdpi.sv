@@ -28,19 +28,37 @@ module jtagdpi #(
   import "DPI-C"
   function void jtagdpi_close(input chandle ctx);
 
+  import "DPI-C" function
+    longint dpi_process_token();
+
   chandle ctx;
+  longint ctx_token;
+
+  // Get the DPI context, creating it if it hasn't been created by this process
+  // (see dpi_process.h: this happens when the simulation has been restored
+  // from a checkpoint).
+  function automatic chandle get_ctx();
+    if (ctx_token !== dpi_process_token()) begin
+      ctx = jtagdpi_create(Name, ListenPort);
+      ctx_token = dpi_process_token();
+    end
+    return ctx;
+  endfunction
 
   initial begin
-    ctx = jtagdpi_create(Name, ListenPort);
+    void'(get_ctx());
   end
 
   final begin
-    jtagdpi_close(ctx);
+    // Don't close a context that belongs to another process
+    if (ctx_token === dpi_process_token()) begin
+      jtagdpi_close(ctx);
+    end
     ctx = null;
   end
 
   always_ff @(posedge clk_i, negedge rst_ni) begin
-    jtagdpi_tick(ctx, jtag_tck, jtag_tms, jtag_tdi, jtag_trst_n, jtag_srst_n,
+    jtagdpi_tick(get_ctx(), jtag_tck, jtag_tms, jtag_tdi, jtag_trst_n, jtag_srst_n,
                  jtag_tdo);
   end
 
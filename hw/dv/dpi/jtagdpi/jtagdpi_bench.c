@@ -0,0 +1,151 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Latency benchmark for a request/response ping through jtagdpi.
+//
+// The main thread plays the part of the simulator, calling jtagdpi_tick() in a
+// loop. A client thread connects like OpenOCD's remote_bitbang driver would,
+// sends a read command ('R') and waits for the TDO reply, and records how long
+// each round trip takes.
+//
+// Build it with bazel build //hw/dv/dpi/jtagdpi:jtagdpi_bench and run it with
+// an optional number of pings (default 20000) and port (default 44853).
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "jtagdpi.h"
+
+struct client_args {
+  int port;
+  unsigned num_pings;
+  double *latencies;  // Round trip times, in microseconds
+  int failed;
+  volatile int done;
+};
+
+static double now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int connect_to_server(int port) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+
+  // The server thread might not be listening yet
+  for (int tries = 0; tries < 1000; ++tries) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+      return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      return fd;
+    }
+    close(fd);
+    usleep(1000);
+  }
+  return -1;
+}
+
+static void *client_thread(void *args_void) {
+  struct client_args *args = (struct client_args *)args_void;
+
+  int fd = connect_to_server(args->port);
+  if (fd < 0) {
+    fprintf(stderr, "ERROR: Could not connect to port %d.\n", args->port);
+    args->failed = 1;
+    args->done = 1;
+    return NULL;
+  }
+
+  for (unsigned i = 0; i < args->num_pings; ++i) {
+    char cmd = 'R', resp;
+    double start = now_us();
+    if (send(fd, &cmd, 1, 0) != 1 || recv(fd, &resp, 1, MSG_WAITALL) != 1 ||
+        (resp != '0' && resp != '1')) {
+      fprintf(stderr, "ERROR: Ping %u failed.\n", i);
+      args->failed = 1;
+      break;
+    }
+    args->latencies[i] = now_us() - start;
+  }
+
+  char quit = 'Q';
+  send(fd, &quit, 1, 0);
+  close(fd);
+  args->done = 1;
+  return NULL;
+}
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned num_pings = (argc > 1) ? strtoul(argv[1], NULL, 0) : 20000;
+  int port = (argc > 2) ? atoi(argv[2]) : 44853;
+  if (num_pings == 0) {
+    fprintf(stderr, "Usage: %s [NUM_PINGS [PORT]]\n", argv[0]);
+    return 1;
+  }
+
+  struct client_args args;
+  memset(&args, 0, sizeof(args));
+  args.port = port;
+  args.num_pings = num_pings;
+  args.latencies = (double *)calloc(num_pings, sizeof(double));
+
+  void *jtag = jtagdpi_create("jtag_bench", port);
+
+  pthread_t client;
+  pthread_create(&client, NULL, client_thread, &args);
+
+  // Simulate the clock, toggling TDO so that both response values are seen.
+  unsigned long ticks = 0;
+  double start = now_us();
+  while (!args.done) {
+    svBit tck, tms, tdi, trst_n, srst_n;
+    jtagdpi_tick(jtag, &tck, &tms, &tdi, &trst_n, &srst_n, ticks & 1);
+    ++ticks;
+  }
+  double elapsed = now_us() - start;
+
+  pthread_join(client, NULL);
+  jtagdpi_close(jtag);
+
+  if (args.failed) {
+    return 1;
+  }
+
+  qsort(args.latencies, num_pings, sizeof(double), cmp_double);
+  double total = 0;
+  for (unsigned i = 0; i < num_pings; ++i) {
+    total += args.latencies[i];
+  }
+
+  printf("%u pings in %.3f s (%lu ticks)\n", num_pings, elapsed / 1e6, ticks);
+  printf("  round trip: min %.1f us, median %.1f us, p99 %.1f us, "
+         "mean %.1f us\n",
+         args.latencies[0], args.latencies[num_pings / 2],
+         args.latencies[(size_t)(num_pings * 0.99)], total / num_pings);
+
+  free(args.latencies);
+  return 0;
+}
@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "spidpi.h"
 
@@ -214,3 +215,55 @@ void monitor_spi(void *mon_void, FILE *mon_file, int loglevel, int tick,
   mon->prev_p2d = p2d;
   mon->prev_d2p = d2p;
 }
+
+/**
+ * Write the header of an SPI monitor capture (see spidpi.h)
+ *
+ * @param cap_file - FILE * for the capture
+ * @param mode - SPI mode
+ * @param loglevel - details to log when decoding
+ */
+void monitor_spi_capture_header(FILE *cap_file, int mode, int loglevel) {
+  unsigned char hdr[SPI_CAP_HEADER_BYTES];
+  memset(hdr, 0, sizeof(hdr));
+  memcpy(hdr, "OTSPICAP", 8);
+  hdr[8] = SPI_CAP_VERSION;
+  hdr[9] = mode;
+  hdr[10] = loglevel & ~SPI_LOG_CAPTURE;
+  size_t rv = fwrite(hdr, 1, sizeof(hdr), cap_file);
+  assert(rv == sizeof(hdr));
+  (void)rv;
+}
+
+/**
+ * SPI device monitor, binary capture version
+ *
+ * This records the calls to monitor_spi() that would produce any output, so
+ * they can be replayed later by spicap_decode.cc.
+ *
+ * @param mon_void - monitor context structure
+ * @param cap_file - FILE * for the capture
+ * @param tick - simulation time
+ * @param p2d - bits of signals from pins to device
+ * @param d2p - bits of signals from device to pins
+ */
+void monitor_spi_capture(void *mon_void, FILE *cap_file, int tick, int p2d,
+                         int d2p) {
+  struct mon_ctx *mon = (struct mon_ctx *)mon_void;
+
+  // This must match the early return in monitor_spi(). Tick 1 is always
+  // recorded, because that's where monitor_spi() prints a header.
+  if ((tick != 1) && (p2d == mon->prev_p2d) && (d2p == mon->prev_d2p) &&
+      (p2d & P2D_CSB)) {
+    return;
+  }
+  mon->prev_p2d = p2d;
+  mon->prev_d2p = d2p;
+
+  unsigned char frame[8] = {SPI_CAP_SIGNALS,     6,
+                            (unsigned char)tick, (unsigned char)(tick >> 8),
+                            (unsigned char)(tick >> 16),
+                            (unsigned char)(tick >> 24),
+                            (unsigned char)p2d,  (unsigned char)d2p};
+  fwrite(frame, 1, sizeof(frame), cap_file);
+}
@@ -0,0 +1,71 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Decoder for the binary captures written by the SPI monitor when spidpi is
+// given a loglevel with SPI_LOG_CAPTURE set (see spidpi.h for the format).
+//
+// This replays the captured signals through monitor_spi(), so the output is
+// the same text log that the monitor would have written during simulation.
+// Build it with bazel build //hw/dv/dpi/spidpi:spicap_decode and run it as
+// spicap_decode CAPTURE [LOGLEVEL], where LOGLEVEL overrides the one stored in
+// the capture.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spidpi.h"
+
+static uint32_t get_le32(const unsigned char *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s CAPTURE [LOGLEVEL]\n", argv[0]);
+    return 1;
+  }
+
+  FILE *cap = fopen(argv[1], "rb");
+  if (cap == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  unsigned char hdr[SPI_CAP_HEADER_BYTES];
+  if (fread(hdr, 1, sizeof(hdr), cap) != sizeof(hdr) ||
+      memcmp(hdr, "OTSPICAP", 8) != 0) {
+    fprintf(stderr, "%s is not an SPI monitor capture.\n", argv[1]);
+    return 1;
+  }
+  if (hdr[8] != SPI_CAP_VERSION) {
+    fprintf(stderr, "%s has unsupported capture version %d.\n", argv[1],
+            hdr[8]);
+    return 1;
+  }
+
+  int mode = hdr[9];
+  int loglevel = (argc > 2) ? strtol(argv[2], NULL, 0) : hdr[10];
+  void *mon = monitor_spi_init(mode);
+
+  unsigned char frame[2 + 255];
+  while (fread(frame, 1, 2, cap) == 2) {
+    size_t len = frame[1];
+    if (fread(frame + 2, 1, len, cap) != len) {
+      fprintf(stderr, "%s: truncated frame at end of capture.\n", argv[1]);
+      break;
+    }
+    if (frame[0] != SPI_CAP_SIGNALS || len < 6) {
+      continue;
+    }
+    monitor_spi(mon, stdout, loglevel, (int)get_le32(frame + 2), frame[6],
+                frame[7]);
+  }
+
+  free(mon);
+  fclose(cap);
+  return 0;
+}
@@ -76,20 +76,33 @@ void *spidpi_create(const char *name, int mode, int loglevel) {
       "NOTE: a SPI transaction is run for every 4 characters entered.\n",
       ctx->ptyname, name, ctx->ptyname);
 
-  rv = snprintf(ctx->mon_pathname, PATH_MAX, "%s/%s.log", cwd, name);
+  bool capture = (loglevel & SPI_LOG_CAPTURE) != 0;
+  rv = snprintf(ctx->mon_pathname, PATH_MAX, "%s/%s.%s", cwd, name,
+                capture ? "spicap" : "log");
   assert(rv <= PATH_MAX && rv > 0);
-  ctx->mon_file = fopen(ctx->mon_pathname, "w");
+  ctx->mon_file = fopen(ctx->mon_pathname, capture ? "wb" : "w");
   if (ctx->mon_file == NULL) {
     fprintf(stderr, "SPI: Unable to open file at %s: %s\n", ctx->mon_pathname,
             strerror(errno));
     return NULL;
   }
-  // more useful for tail -f
-  setlinebuf(ctx->mon_file);
-  printf(
-      "SPI: Monitor output file created at %s. Works well with tail:\n"
-      "$ tail -f %s\n",
-      ctx->mon_pathname, ctx->mon_pathname);
+  if (capture) {
+    // Captures are written in large blocks, so each event is just a copy into
+    // the stdio buffer.
+    setvbuf(ctx->mon_file, NULL, _IOFBF, 1 << 20);
+    monitor_spi_capture_header(ctx->mon_file, mode, loglevel);
+    printf(
+        "SPI: Monitor capture file created at %s. Decode it with\n"
+        "hw/dv/dpi/spidpi/spicap_decode.cc.\n",
+        ctx->mon_pathname);
+  } else {
+    // more useful for tail -f
+    setlinebuf(ctx->mon_file);
+    printf(
+        "SPI: Monitor output file created at %s. Works well with tail:\n"
+        "$ tail -f %s\n",
+        ctx->mon_pathname, ctx->mon_pathname);
+  }
 
   return (void *)ctx;
 }
@@ -108,8 +121,12 @@ char spidpi_tick(void *ctx_void, const svLogicVecVal *d2p_data) {
   }
 #endif
 
-  monitor_spi(ctx->mon, ctx->mon_file, ctx->loglevel, ctx->tick, ctx->driving,
-              d2p);
+  if (ctx->loglevel & SPI_LOG_CAPTURE) {
+    monitor_spi_capture(ctx->mon, ctx->mon_file, ctx->tick, ctx->driving, d2p);
+  } else {
+    monitor_spi(ctx->mon, ctx->mon_file, ctx->loglevel, ctx->tick,
+                ctx->driving, d2p);
+  }
 
   if (ctx->state == SP_IDLE) {
     int n = read(ctx->host, &(ctx->buf[ctx->nin]), ctx->nmax - ctx->nin);
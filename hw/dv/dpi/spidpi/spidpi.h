@@ -6,9 +6,20 @@
 #define OPENTITAN_HW_DV_DPI_SPIDPI_SPIDPI_H_
 
 #include <limits.h>
+#if SPIDPI_STANDALONE
+// For building the capture decoder without a simulator
+#include <stdint.h>
+typedef struct {
+  uint32_t aval;
+  uint32_t bval;
+} svLogicVecVal;
+#else
 #include <svdpi.h>
+#endif
 
+#ifdef __cplusplus
 extern "C" {
+#endif
 
 #define MAX_TRANSACTION 4
 struct spidpi_ctx {
@@ -51,6 +62,37 @@ struct spidpi_ctx {
 #define P2D_CSB 0x2
 #define P2D_SDI 0x4
 
+// Bits in loglevel (see spidpi.sv). If SPI_LOG_CAPTURE is set, the monitor
+// writes a binary capture file instead of a text log, and the other bits are
+// stored in the capture for the decoder to use.
+#define SPI_LOG_CAPTURE 0x10
+
+/**
+ * SPI monitor capture format
+ *
+ * A capture file starts with a 16-byte header:
+ *
+ *   char     magic[8]   "OTSPICAP"
+ *   uint8_t  version    SPI_CAP_VERSION
+ *   uint8_t  mode       SPI mode (CPOL << 1 | CPHA)
+ *   uint8_t  loglevel   loglevel used when decoding (without SPI_LOG_CAPTURE)
+ *   uint8_t  reserved[5]
+ *
+ * followed by a sequence of frames. Each frame is a uint8_t type and a uint8_t
+ * payload length, followed by the payload. Decoders should skip frames with an
+ * unknown type. Multi-byte fields are little-endian. The only frame type so far
+ * is:
+ *
+ *   SPI_CAP_SIGNALS (payload 6 bytes): uint32_t tick, uint8_t p2d, uint8_t d2p
+ *
+ * which records the inputs of a call to monitor_spi() that would have produced
+ * output. spicap_decode.cc replays these through monitor_spi() to get the text
+ * log.
+ */
+#define SPI_CAP_VERSION 1
+#define SPI_CAP_HEADER_BYTES 16
+#define SPI_CAP_SIGNALS 1
+
 void *spidpi_create(const char *name, int mode, int loglevel);
 char spidpi_tick(void *ctx_void, const svLogicVecVal *d2p_data);
 void spidpi_close(void *ctx_void);
@@ -59,5 +101,11 @@ void spidpi_close(void *ctx_void);
 void monitor_spi(void *mon_void, FILE *mon_file, int loglevel, int tick,
                  int p2d, int d2p);
 void *monitor_spi_init(int mode);
-}
+void monitor_spi_capture_header(FILE *cap_file, int mode, int loglevel);
+void monitor_spi_capture(void *mon_void, FILE *cap_file, int tick, int p2d,
+                         int d2p);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
 #endif  // OPENTITAN_HW_DV_DPI_SPIDPI_SPIDPI_H_
@@ -7,6 +7,7 @@
 // Bits in LOG_LEVEL sets what is output on info socket
 // 0x01 -- monitor packets
 // 0x08 -- bit level
+// 0x10 -- write a binary capture (<NAME>.spicap) instead of a text log
 
 module spidpi
   #(
@@ -32,14 +33,32 @@ module spidpi
   import "DPI-C" function
     byte spidpi_tick(input chandle ctx_void, input [1:0] d2p_data);
 
+  import "DPI-C" function
+    longint dpi_process_token();
+
   chandle ctx;
+  longint ctx_token;
+
+  // Get the DPI context, creating it if it hasn't been created by this process
+  // (see dpi_process.h: this happens when the simulation has been restored
+  // from a checkpoint).
+  function automatic chandle get_ctx();
+    if (ctx_token !== dpi_process_token()) begin
+      ctx = spidpi_create(NAME, MODE, LOG_LEVEL);
+      ctx_token = dpi_process_token();
+    end
+    return ctx;
+  endfunction
 
   initial begin
-    ctx = spidpi_create(NAME, MODE, LOG_LEVEL);
+    void'(get_ctx());
   end
 
   final begin
-    spidpi_close(ctx);
+    // Don't close a context that belongs to another process
+    if (ctx_token === dpi_process_token()) begin
+      spidpi_close(ctx);
+    end
   end
 
   logic       unused_rst = rst_ni;
@@ -48,7 +67,7 @@ module spidpi
 
   assign d2p = { spi_device_sdo_i, spi_device_sdo_en_i};
   always_ff @(posedge clk_i) begin
-    automatic byte p2d = spidpi_tick(ctx, d2p);
+    automatic byte p2d = spidpi_tick(get_ctx(), d2p);
     spi_device_sck_o <= p2d[0];
     spi_device_csb_o <= p2d[1];
     spi_device_sdi_o <= p2d[2];
@@ -19,11 +19,50 @@
 #include <string.h>
 #include <unistd.h>
 
-void *uartdpi_create(const char *name, const char *log_file_path) {
+/**
+ * Send any buffered output to the pseudo-terminal and the log file
+ *
+ * Both get the same bytes in the same order. If nothing is reading from the
+ * pseudo-terminal and its buffer is full, the output that doesn't fit is
+ * dropped there (but still written to the log file).
+ */
+static void uartdpi_flush(struct uartdpi_ctx *ctx) {
+  if (!ctx->tx_len) {
+    return;
+  }
+
+  int done = 0;
+  while (done < ctx->tx_len) {
+    ssize_t rv = write(ctx->host, ctx->tx_buf + done, ctx->tx_len - done);
+    if (rv < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      assert((errno == EAGAIN || errno == EWOULDBLOCK) &&
+             "Write to pseudo-terminal failed.");
+      break;
+    }
+    done += rv;
+  }
+
+  if (ctx->log_file) {
+    size_t rv = fwrite(ctx->tx_buf, sizeof(char), ctx->tx_len, ctx->log_file);
+    assert(rv == (size_t)ctx->tx_len && "Write to log file failed.");
+    (void)rv;
+  }
+
+  ctx->tx_len = 0;
+}
+
+void *uartdpi_create(const char *name, const char *log_file_path,
+                     int poll_interval) {
   struct uartdpi_ctx *ctx =
-      (struct uartdpi_ctx *)malloc(sizeof(struct uartdpi_ctx));
+      (struct uartdpi_ctx *)calloc(1, sizeof(struct uartdpi_ctx));
   assert(ctx);
 
+  assert(poll_interval >= 0);
+  ctx->poll_interval = poll_interval;
+
   int rv;
 
   // Initialize UART pseudo-terminal
@@ -84,6 +123,8 @@ void uartdpi_close(void *ctx_void) {
     return;
   }
 
+  uartdpi_flush(ctx);
+
   close(ctx->host);
   close(ctx->device);
 
@@ -102,26 +143,52 @@ void uartdpi_close(void *ctx_void) {
 int uartdpi_can_read(void *ctx_void) {
   struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
 
-  int rv = read(ctx->host, &ctx->tmp_read, 1);
-  return (rv == 1);
+  if (ctx->rx_pos < ctx->rx_len) {
+    return 1;
+  }
+
+  // This is called every cycle that the transmitter is idle, so only go to
+  // the pseudo-terminal every poll_interval calls. The SystemVerilog side sets
+  // this to a fraction of the time it takes to send a character, so polling
+  // doesn't noticeably slow down input.
+  if (ctx->poll_countdown > 0) {
+    --ctx->poll_countdown;
+    return 0;
+  }
+  ctx->poll_countdown = ctx->poll_interval;
+
+  uartdpi_flush(ctx);
+
+  ssize_t rv = read(ctx->host, ctx->rx_buf, UARTDPI_BUF_SIZE);
+  ctx->rx_pos = 0;
+  ctx->rx_len = rv > 0 ? rv : 0;
+  return ctx->rx_len > 0;
 }
 
 char uartdpi_read(void *ctx_void) {
   struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
 
-  return ctx->tmp_read;
+  assert(ctx->rx_pos < ctx->rx_len);
+  char c = ctx->rx_buf[ctx->rx_pos++];
+
+  // Check for more data as soon as this has been sent, so that a burst of
+  // input isn't slowed down by the poll interval.
+  if (ctx->rx_pos == ctx->rx_len) {
+    ctx->poll_countdown = 0;
+  }
+  return c;
 }
 
 void uartdpi_write(void *ctx_void, char c) {
-  int rv;
-
   struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
 
-  rv = write(ctx->host, &c, 1);
-  assert(rv == 1 && "Write to pseudo-terminal failed.");
+  ctx->tx_buf[ctx->tx_len++] = c;
 
-  if (ctx->log_file) {
-    rv = fwrite(&c, sizeof(char), 1, ctx->log_file);
-    assert(rv == 1 && "Write to log file failed.");
+  // Flush complete lines straight away so that output shows up (in order with
+  // anything else written to STDOUT) as soon as it would have done before.
+  // Partial lines are flushed from uartdpi_can_read(), or when the buffer
+  // fills up.
+  if (c == '\n' || ctx->tx_len == UARTDPI_BUF_SIZE) {
+    uartdpi_flush(ctx);
   }
 }
@@ -9,15 +9,34 @@ extern "C" {
 
 #include <stdio.h>
 
+// Size of the buffers for data in each direction
+#define UARTDPI_BUF_SIZE 256
+
 struct uartdpi_ctx {
   char ptyname[64];
   int host;
   int device;
-  char tmp_read;
   FILE *log_file;
+
+  // Data read from the pseudo-terminal that hasn't been passed to the
+  // simulation yet: rx_buf[rx_pos] to rx_buf[rx_len - 1].
+  char rx_buf[UARTDPI_BUF_SIZE];
+  int rx_pos;
+  int rx_len;
+  // Number of calls to uartdpi_can_read() between attempts to read from the
+  // pseudo-terminal (and to flush any pending output to it) while idle
+  int poll_interval;
+  // Calls to uartdpi_can_read() left until we next poll the pseudo-terminal
+  int poll_countdown;
+
+  // Data written by the simulation that hasn't been sent to the
+  // pseudo-terminal and log file yet.
+  char tx_buf[UARTDPI_BUF_SIZE];
+  int tx_len;
 };
 
-void *uartdpi_create(const char *name, const char *log_file_path);
+void *uartdpi_create(const char *name, const char *log_file_path,
+                     int poll_interval);
 void uartdpi_close(void *ctx_void);
 int uartdpi_can_read(void *ctx_void);
 char uartdpi_read(void *ctx_void);
@@ -19,8 +19,14 @@ module uartdpi #(
   // Min cycles is 2 for fast test mode
   localparam int CYCLES_PER_SYMBOL = FREQ / BAUD;
 
+  // While the transmitter is idle, only check the pseudo-terminal for input
+  // once every POLL_INTERVAL cycles. A character takes 10 symbols to send, so
+  // polling once per symbol delays input by at most a tenth of a character.
+  localparam int POLL_INTERVAL = CYCLES_PER_SYMBOL;
+
   import "DPI-C" function
-    chandle uartdpi_create(input string name, input string log_file_path);
+    chandle uartdpi_create(input string name, input string log_file_path,
+                           input int poll_interval);
 
   import "DPI-C" function
     void uartdpi_close(input chandle ctx);
@@ -34,16 +40,34 @@ module uartdpi #(
   import "DPI-C" function
     void uartdpi_write(input chandle ctx, int data);
 
+  import "DPI-C" function
+    longint dpi_process_token();
+
   chandle ctx;
+  longint ctx_token;
   string log_file_path = DEFAULT_LOG_FILE;
 
+  // Get the DPI context, creating it if it hasn't been created by this process
+  // (see dpi_process.h: this happens when the simulation has been restored
+  // from a checkpoint).
+  function automatic chandle get_ctx();
+    if (ctx_token !== dpi_process_token()) begin
+      ctx = uartdpi_create(NAME, log_file_path, POLL_INTERVAL);
+      ctx_token = dpi_process_token();
+    end
+    return ctx;
+  endfunction
+
   initial begin
     $value$plusargs({"UARTDPI_LOG_", NAME, "=%s"}, log_file_path);
-    ctx = uartdpi_create(NAME, log_file_path);
+    void'(get_ctx());
   end
 
   final begin
-    uartdpi_close(ctx);
+    // Don't close a context that belongs to another process
+    if (ctx_token === dpi_process_token()) begin
+      uartdpi_close(ctx);
+    end
     ctx = null;
   end
 
@@ -61,7 +85,7 @@ module uartdpi #(
     end else begin
       if (!txactive) begin
         tx_o <= 1;
-        if (uartdpi_can_read(ctx)) begin
+        if (uartdpi_can_read(get_ctx())) begin
           automatic int c = uartdpi_read(ctx);
           txsymbol <= {1'b1, c[7:0], 1'b0};
           txactive <= 1;
@@ -127,7 +151,7 @@ module uartdpi #(
           if (rxcyccount == CYCLES_PER_SYMBOL - 1) begin
             rxactive <= 0;
             if (rx_i) begin
-              uartdpi_write(ctx, rxsymbol);
+              uartdpi_write(get_ctx(), rxsymbol);
             end
           end
         end
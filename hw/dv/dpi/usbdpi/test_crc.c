@@ -2,17 +2,166 @@
 // Licensed under the Apache License, Version 2.0, see LICENSE for details.
 // SPDX-License-Identifier: Apache-2.0
 
+// Compile with something like:
+//
+//   gcc -O2 test_crc.c -o test_crc
+//
+// Usage:
+//   test_crc VALUE            CRC5 of an 11 bit token value
+//   test_crc -[x] BYTE...     CRC16 of a list of bytes (hex with -x)
+//   test_crc -t               check the table driven CRCs against the
+//                             bit-serial ones and compare their throughput
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #define TESTING_CRC
 #include "usb_crc.c"
 
 unsigned char buf[1024];
 
+// Bit-serial reference versions of CRC5() and CRC16()
+static uint32_t CRC5_serial(uint32_t dwInput, int iBitcnt) {
+  uint32_t crc5 = 0x1f;
+  uint32_t udata = dwInput;
+
+  if ((iBitcnt < 1) || (iBitcnt > INT_SIZE)) {
+    return 0xffffffff;
+  }
+
+  while (iBitcnt--) {
+    if ((udata ^ crc5) & 0x01) {
+      crc5 >>= 1;
+      crc5 ^= CRC5_POLY;
+    } else {
+      crc5 >>= 1;
+    }
+
+    udata >>= 1;
+  }
+
+  return crc5 ^ 0x1f;
+}
+
+static uint32_t CRC16_serial(const uint8_t *data, int bytes) {
+  uint32_t crc16 = 0xffff;
+
+  for (int i = 0; i < bytes; i++) {
+    uint32_t udata = data[i];
+    int bit = 8;
+
+    while (bit--) {
+      if ((udata ^ crc16) & 0x01) {
+        crc16 >>= 1;
+        crc16 ^= CRC16_POLY;
+      } else {
+        crc16 >>= 1;
+      }
+
+      udata >>= 1;
+    }
+  }
+
+  return crc16 ^ 0xffff;
+}
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int test_tables(void) {
+  int errors = 0;
+
+  // CRC5: every value of up to 16 bits at every bit count up to 16 (which
+  // includes all 11 bit tokens), then random values at the larger counts.
+  for (int bits = 1; bits <= 16; bits++) {
+    for (uint32_t val = 0; val < (1u << bits); val++) {
+      if (CRC5(val, bits) != CRC5_serial(val, bits)) {
+        printf("CRC5(0x%x, %d) mismatch\n", val, bits);
+        errors++;
+      }
+    }
+  }
+  srand(1);
+  for (int bits = 0; bits <= INT_SIZE + 1; bits++) {
+    for (int n = 0; n < 100000; n++) {
+      uint32_t val = (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+      if (CRC5(val, bits) != CRC5_serial(val, bits)) {
+        printf("CRC5(0x%x, %d) mismatch\n", val, bits);
+        errors++;
+      }
+    }
+  }
+
+  // CRC16: every one and two byte input, then random data at every length
+  // and alignment the buffer allows.
+  for (uint32_t val = 0; val < 0x10000; val++) {
+    buf[0] = val;
+    buf[1] = val >> 8;
+    for (int len = 0; len <= 2; len++) {
+      if (CRC16(buf, len) != CRC16_serial(buf, len)) {
+        printf("CRC16 of %d bytes %04x mismatch\n", len, val);
+        errors++;
+      }
+    }
+  }
+  for (int rep = 0; rep < 20; rep++) {
+    for (size_t i = 0; i < sizeof(buf); i++) {
+      buf[i] = rand();
+    }
+    for (int off = 0; off < 4; off++) {
+      for (int len = 0; len + off <= (int)sizeof(buf); len++) {
+        if (CRC16(buf + off, len) != CRC16_serial(buf + off, len)) {
+          printf("CRC16 of %d bytes at offset %d mismatch\n", len, off);
+          errors++;
+        }
+      }
+    }
+  }
+
+  printf("Equivalence: %s (%d errors)\n", errors ? "FAIL" : "PASS", errors);
+
+  // Throughput over max size (64 byte) data packets and 11 bit tokens
+  const int reps = 200000;
+  volatile uint32_t sink;
+  double t0 = now_s();
+  for (int n = 0; n < reps; n++) {
+    sink = CRC16_serial(buf + (n & 63), 64);
+  }
+  double t1 = now_s();
+  for (int n = 0; n < reps; n++) {
+    sink = CRC16(buf + (n & 63), 64);
+  }
+  double t2 = now_s();
+  for (int n = 0; n < reps * 10; n++) {
+    sink = CRC5_serial(n & 0x7ff, 11);
+  }
+  double t3 = now_s();
+  for (int n = 0; n < reps * 10; n++) {
+    sink = CRC5(n & 0x7ff, 11);
+  }
+  double t4 = now_s();
+  (void)sink;
+
+  double mbytes = reps * 64 / 1e6;
+  printf("CRC16: serial %.1f MB/s, table %.1f MB/s\n", mbytes / (t1 - t0),
+         mbytes / (t2 - t1));
+  printf("CRC5:  serial %.1f Mtoken/s, table %.1f Mtoken/s\n",
+         reps * 10 / 1e6 / (t3 - t2), reps * 10 / 1e6 / (t4 - t3));
+
+  return errors ? 1 : 0;
+}
+
 int main(int argc, char *argv[]) {
   int i;
   int base;
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s VALUE | -[x] BYTE... | -t\n", argv[0]);
+    exit(1);
+  }
   if (argv[1][0] != '-') {
     int val = strtol(argv[1], NULL, 0);
     int crc = CRC5(val, 11);
@@ -20,6 +169,9 @@ int main(int argc, char *argv[]) {
            val, crc, crc << 3, crc << 11 | val);
     exit(0);
   }
+  if (argv[1][1] == 't') {
+    exit(test_tables());
+  }
   if (argv[1][1] == 'x') {
     base = 16;
   } else {
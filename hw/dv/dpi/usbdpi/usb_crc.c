@@ -55,6 +55,41 @@ uint32_t CRC5_MSBfirst(uint32_t dwInput, int iBitcnt) {
   return crc5;
 }  // CRC5()
 
+/* The little endian CRCs below are table driven. Each table entry is the
+ * result of shifting the index through the bit-serial CRC eight times, so one
+ * lookup replaces eight iterations. CRC16 uses four tables ("slice-by-4") so
+ * that it can consume four bytes per step with independent lookups.
+ *
+ * The tables are built on first use; the bit-serial versions they replace are
+ * kept in test_crc.c, which checks the two against each other.
+ */
+#define CRC5_POLY 0x14
+#define CRC16_POLY 0xA001
+
+static uint8_t crc5_tab[256];
+static uint16_t crc16_tab[4][256];
+static int crc_tabs_ready;
+
+static void crc_tabs_init(void) {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc5 = i;
+    uint32_t crc16 = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc5 = (crc5 & 1) ? (crc5 >> 1) ^ CRC5_POLY : crc5 >> 1;
+      crc16 = (crc16 & 1) ? (crc16 >> 1) ^ CRC16_POLY : crc16 >> 1;
+    }
+    crc5_tab[i] = (uint8_t)crc5;
+    crc16_tab[0][i] = (uint16_t)crc16;
+  }
+  for (uint32_t i = 0; i < 256; i++) {
+    for (int t = 1; t < 4; t++) {
+      uint32_t prev = crc16_tab[t - 1][i];
+      crc16_tab[t][i] = (uint16_t)((prev >> 8) ^ crc16_tab[0][prev & 0xff]);
+    }
+  }
+  crc_tabs_ready = 1;
+}
+
 /* This is the little endian version, so you can feed an 11 bit data
  * value and get back 5 bits to OR in to the top to construct 16 bits
  *
@@ -62,18 +97,25 @@ uint32_t CRC5_MSBfirst(uint32_t dwInput, int iBitcnt) {
  */
 
 uint32_t CRC5(uint32_t dwInput, int iBitcnt) {
-  const uint32_t poly5 = 0x14;
   uint32_t crc5 = 0x1f;
   uint32_t udata = dwInput;
 
   if ((iBitcnt < 1) || (iBitcnt > INT_SIZE)) {  // Validate iBitcnt
     return 0xffffffff;
   }
+  if (!crc_tabs_ready) {
+    crc_tabs_init();
+  }
 
+  // Whole bytes by table lookup, then any remaining bits one at a time
+  for (; iBitcnt >= 8; iBitcnt -= 8) {
+    crc5 = crc5_tab[(crc5 ^ udata) & 0xff];
+    udata >>= 8;
+  }
   while (iBitcnt--) {
     if ((udata ^ crc5) & 0x01) {
       crc5 >>= 1;
-      crc5 ^= poly5;
+      crc5 ^= CRC5_POLY;
     } else {
       crc5 >>= 1;
     }
@@ -89,25 +131,22 @@ uint32_t CRC5(uint32_t dwInput, int iBitcnt) {
 
 // Added mdhayter
 uint32_t CRC16(const uint8_t *data, int bytes) {
-  const uint32_t poly16 = 0xA001;
   uint32_t crc16 = 0xffff;
-  int i;
+  int i = 0;
 
-  for (i = 0; i < bytes; i++) {
-    uint32_t udata = data[i];
-    int bit = 8;
-
-    while (bit--) {
-      if ((udata ^ crc16) & 0x01) {
-        crc16 >>= 1;
-        crc16 ^= poly16;
-      } else {
-        crc16 >>= 1;
-      }
+  if (!crc_tabs_ready) {
+    crc_tabs_init();
+  }
 
-      udata >>= 1;
-    }
+  for (; i + 4 <= bytes; i += 4) {
+    crc16 ^= data[i] | (data[i + 1] << 8);
+    crc16 = crc16_tab[3][crc16 & 0xff] ^ crc16_tab[2][crc16 >> 8] ^
+            crc16_tab[1][data[i + 2]] ^ crc16_tab[0][data[i + 3]];
+  }
+  for (; i < bytes; i++) {
+    crc16 = (crc16 >> 8) ^ crc16_tab[0][(crc16 ^ data[i]) & 0xff];
   }
+
   // Invert contents to generate crc field
   crc16 ^= 0xffff;
 
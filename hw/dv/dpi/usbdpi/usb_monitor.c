@@ -34,6 +34,14 @@ struct usb_monitor_ctx {
    * Log file
    */
   FILE *file;
+  /**
+   * Packet capture file, or NULL if not capturing
+   */
+  FILE *cap;
+  /**
+   * Number of packets captured
+   */
+  uint64_t cap_seq;
   /**
    * Monitor state, reflecting the current state of the USB
    */
@@ -78,7 +86,7 @@ static inline void data_callback(usb_monitor_ctx_t *mon,
 /**
  * Create and initialize a USB monitor instance
  */
-usb_monitor_ctx_t *usb_monitor_init(const char *filename,
+usb_monitor_ctx_t *usb_monitor_init(const char *filename, const char *capname,
                                     usb_monitor_data_callback_t data_cb,
                                     void *data_ctx) {
   usb_monitor_ctx_t *mon =
@@ -109,6 +117,31 @@ usb_monitor_ctx_t *usb_monitor_init(const char *filename,
       "$ tail -f %s\n",
       filename, filename);
 
+  if (capname) {
+    mon->cap = fopen(capname, "wb");
+    if (!mon->cap) {
+      fprintf(stderr, "USBDPI: Unable to open capture file at %s: %s\n",
+              capname, strerror(errno));
+      fclose(mon->file);
+      free(mon);
+      return NULL;
+    }
+    // Packets are written in large blocks, so each one is just a copy into
+    // the stdio buffer.
+    setvbuf(mon->cap, NULL, _IOFBF, 1 << 20);
+
+    // pcap global header
+    uint32_t hdr[6] = {0xa1b2c3d4u, 2u | (4u << 16), 0u, 0u, 65535u,
+                       USBMON_PCAP_LINKTYPE};
+    size_t written = fwrite(hdr, sizeof(hdr), 1, mon->cap);
+    assert(written == 1);
+    (void)written;
+    printf(
+        "USBDPI: Monitor capture file created at %s. Decode it with\n"
+        "hw/dv/dpi/usbdpi/usbcap_decode.cc or open it in Wireshark.\n",
+        capname);
+  }
+
   return mon;
 }
 
@@ -117,9 +150,53 @@ usb_monitor_ctx_t *usb_monitor_init(const char *filename,
  */
 void usb_monitor_fin(usb_monitor_ctx_t *mon) {
   fclose(mon->file);
+  if (mon->cap) {
+    fclose(mon->cap);
+  }
   free(mon);
 }
 
+/**
+ * Append a packet to the capture file
+ */
+static void usb_monitor_capture(usb_monitor_ctx_t *mon, uint32_t sop,
+                                uint32_t eop, bool host, uint8_t pid,
+                                bool got_pid, const uint8_t *bytes,
+                                unsigned nbytes) {
+  uint8_t rec[16 + USBMON_PCAP_HDR_BYTES + 1 + MON_BYTES_SIZE];
+  uint32_t len = 1u + nbytes;
+  uint32_t rec_len = USBMON_PCAP_HDR_BYTES + len;
+  uint32_t rec_hdr[4] = {eop / 12000000u, (eop % 12000000u) / 12u, rec_len,
+                         rec_len};
+  memcpy(rec, rec_hdr, sizeof(rec_hdr));
+
+  uint8_t *mh = &rec[16];
+  uint64_t id = mon->cap_seq++;
+  int64_t ts_sec = rec_hdr[0];
+  int32_t ts_usec = (int32_t)rec_hdr[1];
+  int32_t status = got_pid ? 0 : -EPROTO;
+  memcpy(&mh[0], &id, 8);
+  mh[8] = host ? 'S' : 'C';
+  mh[9] = 3;  // bulk
+  mh[10] = host ? 0u : 0x80u;
+  mh[11] = 0;
+  uint16_t busnum = 1;
+  memcpy(&mh[12], &busnum, 2);
+  mh[14] = '-';
+  mh[15] = 0;
+  memcpy(&mh[16], &ts_sec, 8);
+  memcpy(&mh[24], &ts_usec, 4);
+  memcpy(&mh[28], &status, 4);
+  memcpy(&mh[32], &len, 4);
+  memcpy(&mh[36], &len, 4);
+  memcpy(&mh[40], &sop, 4);
+  memcpy(&mh[44], &eop, 4);
+
+  mh[USBMON_PCAP_HDR_BYTES] = pid;
+  memcpy(&mh[USBMON_PCAP_HDR_BYTES + 1], bytes, nbytes);
+  fwrite(rec, 1, sizeof(rec_hdr) + rec_len, mon->cap);
+}
+
 /**
  * Append a formatted message to the USB monitor log file
  */
@@ -172,6 +249,54 @@ char *pid_2data(int pid, unsigned char d0, unsigned char d1) {
   return dr;
 }
 
+/**
+ * Write the log output for a packet that has ended with an EOP
+ */
+void usb_monitor_log_packet(FILE *out, bool log, bool compact, uint32_t sop,
+                            uint32_t eop, bool host, uint8_t pid, bool got_pid,
+                            const uint8_t *bytes, unsigned nbytes) {
+  char drv = host ? 'H' : 'D';
+  if ((log || compact) && got_pid && (nbytes > 0)) {
+    uint32_t pkt_crc16, comp_crc16;
+
+    if (compact && nbytes == 2) {
+      fprintf(out, "mon: %8d -- %8d: (%c) SOP, PID %s, EOP\n", sop, eop, drv,
+              pid_2data(pid, bytes[0], bytes[1]));
+    } else if (compact && nbytes == 1) {
+      fprintf(out, "mon: %8d -- %8d: (%c) SOP, PID %s %02x EOP\n", sop, eop,
+              drv, decode_pid(pid), bytes[0]);
+    } else {
+      if (compact) {
+        fprintf(out, "mon: %8d -- %8d: (%c) SOP, PID %s, EOP\n", sop, eop,
+                drv, decode_pid(pid));
+      }
+      // Too short to hold a CRC16; only reachable with verbose logging
+      if (nbytes < 2) {
+        return;
+      }
+      fprintf(out, "mon:     %s:\n", host ? "h->d" : "d->h");
+      comp_crc16 = CRC16(bytes, nbytes - 2);
+      pkt_crc16 = bytes[nbytes - 2] | (bytes[nbytes - 1] << 8);
+
+      dump_bytes(out, "mon:          ", bytes, nbytes - 2, 0u);
+
+      // Display the received CRC16 value
+      fprintf(out, "\nmon:          (CRC16 %02x %02x", bytes[nbytes - 2],
+              bytes[nbytes - 1]);
+      if (comp_crc16 == pkt_crc16) {
+        fprintf(out, "%s OK)\n", (nbytes == MON_BYTES_SIZE) ? "..." : "");
+      } else {
+        fprintf(out, "%s BAD)\nmon:           CRC16 %04x BAD expected %04x\n",
+                (nbytes == MON_BYTES_SIZE) ? "..." : "", pkt_crc16,
+                comp_crc16);
+      }
+    }
+  } else if (compact) {
+    fprintf(out, "mon: %8d -- %8d: (%c) SOP, PID %s EOP\n", sop, eop, drv,
+            decode_pid(pid));
+  }
+}
+
 /**
  * Per-cycle monitoring of the USB
  */
@@ -263,49 +388,17 @@ void usb_monitor(usb_monitor_ctx_t *mon, int loglevel, uint32_t tick_bits,
 
   // EOP detection, calculate and check the CRC16 on any data field
   if ((mon->line & 0x3f) == ((SE0 << 4) | (SE0 << 2) | (DJ << 0))) {
-    if ((log || compact) && (mon->state == MS_GET_BYTES) && (mon->byte > 0)) {
-      uint32_t pkt_crc16, comp_crc16;
-
-      if (compact && mon->byte == 2) {
-        fprintf(mon->file, "mon: %8d -- %8d: (%c) SOP, PID %s, EOP\n",
-                mon->sopAt, tick_bits, mon->driver == M_HOST ? 'H' : 'D',
-                pid_2data(mon->lastpid, mon->bytes[0], mon->bytes[1]));
-      } else if (compact && mon->byte == 1) {
-        fprintf(mon->file, "mon: %8d -- %8d: (%c) SOP, PID %s %02x EOP\n",
-                mon->sopAt, tick_bits, mon->driver == M_HOST ? 'H' : 'D',
-                decode_pid(mon->lastpid), mon->bytes[0]);
-      } else {
-        if (compact) {
-          fprintf(mon->file, "mon: %8d -- %8d: (%c) SOP, PID %s, EOP\n",
-                  mon->sopAt, tick_bits, mon->driver == M_HOST ? 'H' : 'D',
-                  decode_pid(mon->lastpid));
-        }
-        fprintf(mon->file, "mon:     %s:\n",
-                mon->driver == M_HOST ? "h->d" : "d->h");
-        comp_crc16 = CRC16(mon->bytes, mon->byte - 2);
-        pkt_crc16 =
-            mon->bytes[mon->byte - 2] | (mon->bytes[mon->byte - 1] << 8);
-
-        dump_bytes(mon->file, "mon:          ", mon->bytes, mon->byte - 2, 0u);
-
-        // Display the received CRC16 value
-        fprintf(mon->file, "\nmon:          (CRC16 %02x %02x",
-                mon->bytes[mon->byte - 2], mon->bytes[mon->byte - 1]);
-        if (comp_crc16 == pkt_crc16) {
-          fprintf(mon->file, "%s OK)\n",
-                  (mon->byte == MON_BYTES_SIZE) ? "..." : "");
-        } else {
-          fprintf(mon->file,
-                  "%s BAD)\nmon:           CRC16 %04x BAD expected %04x\n",
-                  (mon->byte == MON_BYTES_SIZE) ? "..." : "", pkt_crc16,
-                  comp_crc16);
-        }
-      }
-    } else if (compact) {
-      fprintf(mon->file, "mon: %8d -- %8d: (%c) SOP, PID %s EOP\n", mon->sopAt,
-              tick_bits, mon->driver == M_HOST ? 'H' : 'D',
-              decode_pid(mon->lastpid));
+    bool host = (mon->driver == M_HOST);
+    bool got_pid = (mon->state == MS_GET_BYTES);
+    unsigned nbytes = got_pid ? mon->byte : 0u;
+    if (mon->cap) {
+      // The packet level log is recreated from the capture by the decoder
+      usb_monitor_capture(mon, mon->sopAt, tick_bits, host, mon->lastpid,
+                          got_pid, mon->bytes, nbytes);
+      compact = false;
     }
+    usb_monitor_log_packet(mon->file, log, compact, mon->sopAt, tick_bits, host,
+                           mon->lastpid, got_pid, mon->bytes, nbytes);
     if (log) {
       fprintf(mon->file, "mon: %8d: (%c) EOP\n", tick_bits,
               mon->driver == M_HOST ? 'H' : 'D');
@@ -6,6 +6,11 @@
 #define OPENTITAN_HW_DV_DPI_USBDPI_USB_MONITOR_H_
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /**
  * USB monitor context
@@ -26,15 +31,44 @@ typedef enum {
 typedef void (*usb_monitor_data_callback_t)(void *ctx_v,
                                             usbmon_data_type_t type, uint8_t d);
 
+/**
+ * USB monitor capture format
+ *
+ * A capture is a classic pcap file (native byte order, microsecond timestamps)
+ * with link type LINKTYPE_USB_LINUX, so it can be opened by Wireshark and
+ * other pcap tools. Each record holds one packet seen on the bus, rather than
+ * a URB as usbmon would, with a 48-byte usbmon header:
+ *
+ *   id         sequence number of the packet
+ *   type       'S' if driven by the host, 'C' if driven by the device
+ *   xfer_type  3 (bulk)
+ *   epnum      0x80 if driven by the device, otherwise 0
+ *   devnum     0
+ *   busnum     1
+ *   flag_setup '-'
+ *   flag_data  0
+ *   ts_sec/ts_usec  time of the EOP
+ *   status     0, or -EPROTO if the packet ended before its PID was received
+ *   length/len_cap  number of bytes that follow
+ *   setup[8]   uint32_t time of the SOP, uint32_t time of the EOP
+ *
+ * The times in the setup field are in USB bit intervals (12Mbps), as used by
+ * the text log. The data is the PID followed by the rest of the packet,
+ * including any CRC.
+ */
+#define USBMON_PCAP_LINKTYPE 189
+#define USBMON_PCAP_HDR_BYTES 48
+
 /**
  * Create and initialize a USB monitor instance
  *
  * @param  filename  Filename to be used for log file
+ * @param  capname   Filename to be used for packet capture, or NULL for none
  * @param  data_cb   USB data callback function
  * @param  data_ctx  Context for data callback
  * @return           USB monitor context
  */
-usb_monitor_ctx_t *usb_monitor_init(const char *filename,
+usb_monitor_ctx_t *usb_monitor_init(const char *filename, const char *capname,
                                     usb_monitor_data_callback_t data_cb,
                                     void *data_ctx);
 
@@ -53,6 +87,27 @@ void usb_monitor_fin(usb_monitor_ctx_t *mon);
  */
 void usb_monitor_log(usb_monitor_ctx_t *mon, const char *fmt, ...);
 
+/**
+ * Write the log output for a packet that has ended with an EOP
+ *
+ * This is used by the monitor itself and by the capture decoder, so that both
+ * produce the same text.
+ *
+ * @param out        Log file
+ * @param log        Verbose logging
+ * @param compact    Packet level logging
+ * @param sop        Time of the SOP, in USB bit intervals
+ * @param eop        Time of the EOP, in USB bit intervals
+ * @param host       Indicates whether the host drove the packet
+ * @param pid        Most recently decoded PID
+ * @param got_pid    Indicates whether the packet's PID was received
+ * @param bytes      Bytes following the PID
+ * @param nbytes     Number of bytes following the PID
+ */
+void usb_monitor_log_packet(FILE *out, bool log, bool compact, uint32_t sop,
+                            uint32_t eop, bool host, uint8_t pid, bool got_pid,
+                            const uint8_t *bytes, unsigned nbytes);
+
 /**
  * Per-cycle monitoring of the USB
  *
@@ -75,4 +130,7 @@ void usb_monitor(usb_monitor_ctx_t *mon, int log, uint32_t tick_bits,
  */
 uint32_t usb_monitor_diags(usb_monitor_ctx_t *mon);
 
+#ifdef __cplusplus
+}  // extern "C"
+#endif
 #endif  // OPENTITAN_HW_DV_DPI_USBDPI_USB_MONITOR_H_
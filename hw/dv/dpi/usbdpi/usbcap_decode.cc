@@ -0,0 +1,71 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Decoder for the packet captures written by the USB monitor when usbdpi is
+// given a LOG_LEVEL with LOG_CAPTURE set (see usb_monitor.h for the format).
+//
+// This prints the packet level (LOG_MON) lines that the monitor would have
+// written to its log during simulation. Build it with
+// bazel build //hw/dv/dpi/usbdpi:usbcap_decode and run it as
+// usbcap_decode CAPTURE.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "usb_monitor.h"
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s CAPTURE\n", argv[0]);
+    return 1;
+  }
+
+  FILE *cap = fopen(argv[1], "rb");
+  if (cap == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  uint32_t hdr[6];
+  if (fread(hdr, sizeof(hdr), 1, cap) != 1 || hdr[0] != 0xa1b2c3d4u) {
+    fprintf(stderr, "%s is not a pcap file in native byte order.\n", argv[1]);
+    return 1;
+  }
+  if (hdr[5] != USBMON_PCAP_LINKTYPE) {
+    fprintf(stderr, "%s has link type %u, not %u.\n", argv[1], hdr[5],
+            USBMON_PCAP_LINKTYPE);
+    return 1;
+  }
+
+  static uint8_t data[65536];
+  uint32_t rec_hdr[4];
+  while (fread(rec_hdr, sizeof(rec_hdr), 1, cap) == 1) {
+    uint32_t incl_len = rec_hdr[2];
+    if (incl_len > sizeof(data) || fread(data, 1, incl_len, cap) != incl_len) {
+      fprintf(stderr, "%s: bad or truncated record at end of capture.\n",
+              argv[1]);
+      break;
+    }
+    if (incl_len < USBMON_PCAP_HDR_BYTES + 1) {
+      continue;
+    }
+
+    const uint8_t *mh = data;
+    int32_t status;
+    uint32_t sop, eop;
+    memcpy(&status, &mh[28], 4);
+    memcpy(&sop, &mh[40], 4);
+    memcpy(&eop, &mh[44], 4);
+    bool host = !(mh[10] & 0x80u);
+    const uint8_t *pkt = &mh[USBMON_PCAP_HDR_BYTES];
+    unsigned nbytes = incl_len - USBMON_PCAP_HDR_BYTES - 1;
+
+    usb_monitor_log_packet(stdout, false, true, sop, eop, host, pkt[0],
+                           status == 0, &pkt[1], nbytes);
+  }
+
+  fclose(cap);
+  return 0;
+}
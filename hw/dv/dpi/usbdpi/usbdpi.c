@@ -120,7 +120,16 @@ void *usbdpi_create(const char *name, int loglevel) {
   int rv = snprintf(ctx->mon_pathname, FILENAME_MAX, "%s/%s.log", cwd, name);
   assert(rv <= FILENAME_MAX && rv > 0);
 
-  ctx->mon = usb_monitor_init(ctx->mon_pathname, usbdpi_data_callback, ctx);
+  // Packet capture file
+  char cap_pathname[FILENAME_MAX];
+  if (loglevel & LOG_CAPTURE) {
+    rv = snprintf(cap_pathname, FILENAME_MAX, "%s/%s.pcap", cwd, name);
+    assert(rv <= FILENAME_MAX && rv > 0);
+  }
+
+  ctx->mon = usb_monitor_init(ctx->mon_pathname,
+                              (loglevel & LOG_CAPTURE) ? cap_pathname : NULL,
+                              usbdpi_data_callback, ctx);
 
   // Prepare the transfer descriptors for use
   usb_transfer_setup(ctx);
@@ -46,8 +46,9 @@ typedef uint32_t svBitVecVal;
 #define SENSE_AT 20 * 8
 
 // Logging level (parameter to module)
-#define LOG_MON 0x01  // USB monitor logging (packet level)
-#define LOG_BIT 0x08  // bit level
+#define LOG_MON 0x01      // USB monitor logging (packet level)
+#define LOG_BIT 0x08      // bit level
+#define LOG_CAPTURE 0x10  // packet capture (see usb_monitor.h)
 
 // Error insertion
 #define INSERT_ERR_CRC 0
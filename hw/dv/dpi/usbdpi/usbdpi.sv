@@ -8,6 +8,8 @@
 // 0x01 -- monitor_usb (packet level)
 // 0x02 -- more verbose monitor
 // 0x08 -- bit level
+// 0x10 -- capture packets to <NAME>.pcap; with this set, the packet level
+//         lines of 0x01 are only recreated offline, by usbcap_decode.cc
 
 module usbdpi #(
   parameter string NAME = "usb0",
@@ -51,14 +53,32 @@ module usbdpi #(
   import "DPI-C" function
     void usbdpi_diags(input chandle ctx, output bit [95:0] diags);
 
+  import "DPI-C" function
+    longint dpi_process_token();
+
   chandle ctx;
+  longint ctx_token;
+
+  // Get the DPI context, creating it if it hasn't been created by this process
+  // (see dpi_process.h: this happens when the simulation has been restored
+  // from a checkpoint).
+  function automatic chandle get_ctx();
+    if (ctx_token !== dpi_process_token()) begin
+      ctx = usbdpi_create(NAME, LOG_LEVEL);
+      ctx_token = dpi_process_token();
+    end
+    return ctx;
+  endfunction
 
   initial begin
-    ctx = usbdpi_create(NAME, LOG_LEVEL);
+    void'(get_ctx());
   end
 
   final begin
-    usbdpi_close(ctx);
+    // Don't close a context that belongs to another process
+    if (ctx_token === dpi_process_token()) begin
+      usbdpi_close(ctx);
+    end
   end
 
   // USB Packet IDentifier values, for waveform viewing
@@ -203,7 +223,7 @@ module usbdpi #(
   usbdpi_host_state_t c_hostSt;
   usbdpi_drv_state_t c_state;
   always @(posedge clk_48MHz_i)
-    usbdpi_diags(ctx, {c_spare1, c_mon_state, c_mon_bits, c_mon_byte, c_mon_pid,
+    usbdpi_diags(get_ctx(), {c_spare1, c_mon_state, c_mon_bits, c_mon_byte, c_mon_pid,
                        c_step, c_bus_state, c_tickbits, c_frame, c_hostSt,
                        c_state});
 
@@ -233,7 +253,7 @@ module usbdpi #(
       dn_int <= 0;
     end else if (enable) begin
       if (!sense_p2d || pullup_detect) begin
-        automatic byte p2d = usbdpi_host_to_device(ctx, d2p);
+        automatic byte p2d = usbdpi_host_to_device(get_ctx(), d2p);
         d_last <= d_p2d;
         dp_en_p2d <= p2d[4];
         dn_en_p2d <= p2d[4];
@@ -243,7 +263,7 @@ module usbdpi #(
         unused_dummy <= |p2d[7:5];
         d2p_r <= d2p;
         if (d2p_r != d2p) begin
-          usbdpi_device_to_host(ctx, d2p);
+          usbdpi_device_to_host(get_ctx(), d2p);
         end
       end else begin
         d_last <= 0;
@@ -4,11 +4,13 @@
 
 #include "dpi_memutil.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <fcntl.h>
 #include <iostream>
 #include <libelf.h>
+#include <list>
 #include <sstream>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -32,6 +34,33 @@ class ElfError : public std::exception {
   std::string msg_;
 };
 
+// Identifies a version of a file on disk without reading it. If the file is
+// rewritten, its size or one of its timestamps will change (or it will be a
+// new inode if the build system writes a new file and renames it into place).
+// Timestamps have nanosecond resolution, so a rewrite that keeps the inode,
+// size and both timestamps would have to happen within a single clock tick.
+struct FileId {
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtime, ctime;
+
+  explicit FileId(const struct stat &st)
+      : dev(st.st_dev),
+        ino(st.st_ino),
+        size(st.st_size),
+        mtime(st.st_mtim),
+        ctime(st.st_ctim) {}
+
+  bool operator==(const FileId &other) const {
+    return dev == other.dev && ino == other.ino && size == other.size &&
+           mtime.tv_sec == other.mtime.tv_sec &&
+           mtime.tv_nsec == other.mtime.tv_nsec &&
+           ctime.tv_sec == other.ctime.tv_sec &&
+           ctime.tv_nsec == other.ctime.tv_nsec;
+  }
+};
+
 // Class wrapping an open ELF file
 class ElfFile {
  public:
@@ -46,7 +75,9 @@ class ElfFile {
       throw ElfError(path, "could not open file.");
     }
 
-    ptr_ = elf_begin(fd_, ELF_C_READ, NULL);
+    // Map the file rather than reading it: we only look at the headers and the
+    // PT_LOAD segments, and elf_rawfile then points into the mapping.
+    ptr_ = elf_begin(fd_, ELF_C_READ_MMAP, NULL);
     if (!ptr_) {
       close(fd_);
       throw ElfError(path, elf_errmsg(-1));
@@ -79,10 +110,70 @@ class ElfFile {
     return phdrs;
   }
 
+  FileId GetFileId() {
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+      throw ElfError(path_, "could not stat file.");
+    }
+    return FileId(st);
+  }
+
+  // Return the contents of the file, which stay valid until the object is
+  // destroyed.
+  const uint8_t *GetRawFile(size_t *file_size) {
+    const char *file_data = elf_rawfile(ptr_, file_size);
+    assert(file_data);
+    return reinterpret_cast<const uint8_t *>(file_data);
+  }
+
   std::string path_;
   int fd_;
   Elf *ptr_;
 };
+
+// A small cache of images derived from files. This keeps the most recently
+// used kMaxEntries images and is shared between all DpiMemUtil objects.
+// Simulations load memories from a single thread, so there is no locking.
+//
+// An entry is keyed by the FileId of the file and by a context string (for
+// anything else that the image depends on). Looking up an image never reads
+// the file, and an entry holds nothing but the image itself. A copy of a file
+// (or a rewrite with the same contents) has a different FileId, so it misses
+// and gets staged again.
+template <typename T>
+class ImageCache {
+ public:
+  // Return the cached image for the file with this id and context, or null
+  // if there is none.
+  std::shared_ptr<const T> Find(const FileId &id, const std::string &context) {
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      if (it->id == id && it->context == context) {
+        // Move the entry to the front of the list (most recently used).
+        entries_.splice(entries_.begin(), entries_, it);
+        return it->image;
+      }
+    }
+    return nullptr;
+  }
+
+  void Insert(const FileId &id, const std::string &context,
+              std::shared_ptr<const T> image) {
+    entries_.push_front(Entry{id, context, std::move(image)});
+    if (entries_.size() > kMaxEntries) {
+      entries_.pop_back();
+    }
+  }
+
+ private:
+  struct Entry {
+    FileId id;
+    std::string context;
+    std::shared_ptr<const T> image;
+  };
+
+  static const size_t kMaxEntries = 8;
+  std::list<Entry> entries_;
+};
 }  // namespace
 
 // Convert a string to a MemImageType, throwing a std::runtime_error
@@ -92,6 +183,10 @@ static MemImageType GetMemImageTypeByName(const std::string &name) {
     return kMemImageElf;
   if (name == "vmem")
     return kMemImageVmem;
+  if (name == "vmem-logical")
+    return kMemImageLogicalVmem;
+  if (name == "memimg")
+    return kMemImageMemImg;
 
   std::ostringstream oss;
   oss << "Unknown image type: `" << name << "'.";
@@ -126,9 +221,23 @@ static MemImageType DetectMemImageType(const std::string &filepath) {
 // segment" whose first byte corresponds to the first byte of the lowest
 // addressed segment and whose last byte corresponds to the last byte of the
 // highest address.
-static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
+//
+// The result only depends on the file, so it is cached (see ImageCache).
+static std::shared_ptr<const std::vector<uint8_t>> FlattenElfFile(
+    const std::string &filepath) {
+  static ImageCache<std::vector<uint8_t>> cache;
+
   ElfFile elf(filepath);
 
+  FileId file_id = elf.GetFileId();
+  std::shared_ptr<const std::vector<uint8_t>> cached =
+      cache.Find(file_id, std::string());
+  if (cached)
+    return cached;
+
+  size_t file_size;
+  const uint8_t *file_data = elf.GetRawFile(&file_size);
+
   size_t phnum = elf.GetPhdrNum();
   const Elf32_Phdr *phdrs = elf.GetPhdrs();
 
@@ -175,17 +284,16 @@ static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
   // If any is false, there were no segments that contributed to the
   // file. Return nothing.
   if (!any)
-    return std::vector<uint8_t>();
+    return std::make_shared<std::vector<uint8_t>>();
 
   // Otherwise, we know every valid byte of data has an address in the
   // range [low, high] (inclusive).
   assert(low <= high);
 
-  size_t file_size;
-  const char *file_data = elf_rawfile(elf.ptr_, &file_size);
-  assert(file_data);
-
-  StagedMem ret;
+  // Copy each segment straight into place. Where segments overlap, later
+  // ones win (matching the merge order that StagedMem uses).
+  std::shared_ptr<std::vector<uint8_t>> ret =
+      std::make_shared<std::vector<uint8_t>>((size_t)1 + (high - low), 0);
 
   for (size_t i = 0; i < phnum; i++) {
     const Elf32_Phdr &phdr = phdrs[i];
@@ -195,7 +303,7 @@ static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
     }
 
     // Check the segment actually fits in the file
-    if (file_size < phdr.p_offset + phdr.p_filesz) {
+    if (file_size < (size_t)phdr.p_offset + phdr.p_filesz) {
       std::ostringstream oss;
       oss << "phdr for segment " << i << " claims to end at offset 0x"
           << std::hex << phdr.p_offset + phdr.p_filesz
@@ -207,12 +315,11 @@ static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
       continue;
 
     uint32_t off = phdr.p_paddr - low;
-    std::vector<uint8_t> seg(phdr.p_filesz, 0);
-    memcpy(&seg[0], file_data + phdr.p_offset, phdr.p_filesz);
-    ret.AddSegment(off, std::move(seg));
+    memcpy(&(*ret)[off], file_data + phdr.p_offset, phdr.p_filesz);
   }
 
-  return ret.GetFlat();
+  cache.Insert(file_id, std::string(), ret);
+  return ret;
 }
 
 // Merge seg0 and seg1, overwriting any overlapping data in seg0 with
@@ -401,10 +508,16 @@ void DpiMemUtil::LoadFileToNamedMem(bool verbose, const std::string &name,
   try {
     switch (type) {
       case kMemImageElf:
-        m.Write(0, FlattenElfFile(filepath));
+        m.Write(0, *FlattenElfFile(filepath));
         break;
       case kMemImageVmem:
-        m.LoadVmem(filepath);
+        m.LoadVmem(filepath, false);
+        break;
+      case kMemImageLogicalVmem:
+        m.LoadVmem(filepath, true);
+        break;
+      case kMemImageMemImg:
+        m.LoadMemImage(filepath);
         break;
       default:
         assert(0);
@@ -417,11 +530,45 @@ void DpiMemUtil::LoadFileToNamedMem(bool verbose, const std::string &name,
   }
 }
 
+void DpiMemUtil::BenchmarkMemAccess(const std::string &name) const {
+  auto it = name_to_mem_.find(name);
+  if (it == name_to_mem_.end()) {
+    std::ostringstream oss;
+    oss << "`" << name
+        << ("' is not the name of a known memory region. "
+            "Run with --meminit=list to get a list.");
+    throw std::runtime_error(oss.str());
+  }
+
+  mem_areas_[it->second]->BenchmarkAccess(std::cout);
+}
+
+void DpiMemUtil::SnapshotMemories(MemSnapshot *snapshot) const {
+  assert(snapshot);
+  snapshot->resize(mem_areas_.size());
+  for (size_t i = 0; i < mem_areas_.size(); ++i) {
+    const MemArea &mem_area = *mem_areas_[i];
+    std::vector<uint8_t> &data = (*snapshot)[i];
+    data.resize((size_t)mem_area.GetSizeWords() * SV_MEM_WIDTH_BYTES);
+    mem_area.ReadPhysWords(0, mem_area.GetSizeWords(), data.data());
+  }
+}
+
+void DpiMemUtil::RestoreMemories(const MemSnapshot &snapshot) const {
+  assert(snapshot.size() == mem_areas_.size());
+  for (size_t i = 0; i < mem_areas_.size(); ++i) {
+    const MemArea &mem_area = *mem_areas_[i];
+    assert(snapshot[i].size() ==
+           (size_t)mem_area.GetSizeWords() * SV_MEM_WIDTH_BYTES);
+    mem_area.WritePhysWords(0, mem_area.GetSizeWords(), snapshot[i].data());
+  }
+}
+
 void DpiMemUtil::LoadElfToMemories(bool verbose, const std::string &filepath) {
   // Load the contents of the ELF file into the staging area
   StageElf(verbose, filepath);
 
-  for (const auto &pr : staging_area_) {
+  for (const auto &pr : *staging_area_) {
     const std::string &mem_name = pr.first;
     const StagedMem &staged_mem = pr.second;
 
@@ -452,18 +599,35 @@ void DpiMemUtil::LoadElfToMemories(bool verbose, const std::string &filepath) {
 }
 
 void DpiMemUtil::StageElf(bool verbose, const std::string &path) {
+  static ImageCache<StagingArea> cache;
+
   // Clear out anything that was in the staging area before
-  staging_area_.clear();
+  staging_area_.reset();
+  staged_path_.clear();
 
   ElfFile elf(path);
 
   // Allow subclasses to get at the loaded ELF data if they need it
   OnElfLoaded(elf.ptr_);
 
-  size_t file_size;
-  const char *file_data = elf_rawfile(elf.ptr_, &file_size);
-  assert(file_data);
+  // Where segments get staged depends on the registered memories as well as
+  // the file, so the layout is part of the cache key.
+  FileId file_id = elf.GetFileId();
+  std::string layout = GetLayoutKey();
+  staging_area_ = cache.Find(file_id, layout);
+  if (staging_area_) {
+    if (verbose) {
+      std::cout << "Using cached segments for ELF file `" << path << "'."
+                << std::endl;
+    }
+    staged_path_ = path;
+    return;
+  }
 
+  std::shared_ptr<StagingArea> staging_area = std::make_shared<StagingArea>();
+
+  size_t file_size;
+  const uint8_t *file_data = elf.GetRawFile(&file_size);
   size_t phnum = elf.GetPhdrNum();
   const Elf32_Phdr *phdrs = elf.GetPhdrs();
 
@@ -514,19 +678,25 @@ void DpiMemUtil::StageElf(bool verbose, const std::string &path) {
 
     // Get the StagedMem object associated with this memory area. If
     // there isn't one, make a new empty one.
-    StagedMem &staged_mem = staging_area_[name];
+    StagedMem &staged_mem = (*staging_area)[name];
 
-    const char *seg_data = file_data + phdr.p_offset;
-    std::vector<uint8_t> vec(phdr.p_filesz, 0);
-    memcpy(&vec[0], seg_data, phdr.p_filesz);
-
-    staged_mem.AddSegment(local_base, std::move(vec));
+    const uint8_t *seg_data = file_data + phdr.p_offset;
+    staged_mem.AddSegment(
+        local_base,
+        std::vector<uint8_t>(seg_data, seg_data + phdr.p_filesz));
   }
+
+  staging_area_ = staging_area;
+  staged_path_ = path;
+  cache.Insert(file_id, layout, staging_area_);
 }
 
 const StagedMem &DpiMemUtil::GetMemoryData(const std::string &mem_name) const {
-  auto it = staging_area_.find(mem_name);
-  return (it == staging_area_.end()) ? empty_ : it->second;
+  if (!staging_area_)
+    return empty_;
+
+  auto it = staging_area_->find(mem_name);
+  return (it == staging_area_->end()) ? empty_ : it->second;
 }
 
 size_t DpiMemUtil::GetRegionForSegment(const std::string &path, int seg_idx,
@@ -571,3 +741,13 @@ size_t DpiMemUtil::GetRegionForSegment(const std::string &path, int seg_idx,
 
   return mem_area_it->second;
 }
+
+std::string DpiMemUtil::GetLayoutKey() const {
+  std::ostringstream oss;
+  for (size_t i = 0; i < mem_areas_.size(); ++i) {
+    oss << names_[i] << '\0' << base_addrs_[i] << ' '
+        << mem_areas_[i]->GetSizeBytes() << ' ' << mem_areas_[i]->GetWidth()
+        << '\0';
+  }
+  return oss.str();
+}
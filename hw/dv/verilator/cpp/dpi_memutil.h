@@ -20,6 +20,8 @@ enum MemImageType {
   kMemImageUnknown = 0,
   kMemImageElf,
   kMemImageVmem,
+  kMemImageLogicalVmem,
+  kMemImageMemImg,
 };
 
 // Staged data for a given memory area.
@@ -56,8 +58,10 @@ class StagedMem {
  * Provide various memory loading utilities for verilog simulations
  *
  * These utilities require the corresponding DPI functions:
- * simutil_memload()
  * simutil_set_mem()
+ * simutil_get_mem()
+ * simutil_set_mem_bulk()
+ * simutil_get_mem_bulk()
  * to be defined somewhere as SystemVerilog functions.
  */
 class DpiMemUtil {
@@ -112,6 +116,31 @@ class DpiMemUtil {
   void LoadFileToNamedMem(bool verbose, const std::string &name,
                           const std::string &filepath, MemImageType type);
 
+  /**
+   * Time backdoor accesses to the named memory, comparing one DPI call per
+   * word with the bulk DPI functions, and print the results to stdout. The
+   * memory contents are left unchanged.
+   *
+   * Throws a std::runtime_error if there is no memory with that name.
+   */
+  void BenchmarkMemAccess(const std::string &name) const;
+
+  /**
+   * Raw contents of all registered memories, as read by SnapshotMemories()
+   */
+  typedef std::vector<std::vector<uint8_t>> MemSnapshot;
+
+  /**
+   * Read the raw physical contents of all registered memories (including any
+   * ECC bits and scrambling, see MemArea::ReadPhysWords) into snapshot.
+   */
+  void SnapshotMemories(MemSnapshot *snapshot) const;
+
+  /**
+   * Write a snapshot taken by SnapshotMemories() back to the memories
+   */
+  void RestoreMemories(const MemSnapshot &snapshot) const;
+
   /**
    * Load an ELF file, placing segments in memories by LMA.
    *
@@ -123,6 +152,12 @@ class DpiMemUtil {
    * Load an ELF file into a staging area in this object, which can then be
    * accessed with GetMemoryData().
    *
+   * Staged images are cached, keyed by the file's identity on disk (device,
+   * inode, size and timestamps) and the registered memory layout. The cache
+   * is shared between all DpiMemUtil objects, so staging the same unchanged
+   * binary again (from this object or another one with the same memories)
+   * reuses the earlier result without reading the file's segments.
+   *
    * If the load fails, raises a std::exception with information about what
    * happened.
    */
@@ -133,6 +168,12 @@ class DpiMemUtil {
    */
   const StagedMem &GetMemoryData(const std::string &mem_name) const;
 
+  /**
+   * Get the path of the ELF file in the staging area (empty if nothing is
+   * staged)
+   */
+  const std::string &GetStagedElfPath() const { return staged_path_; }
+
  protected:
   /**
    * A hook for subclasses to do extra computations with loaded ELF data. This
@@ -156,7 +197,12 @@ class DpiMemUtil {
   // stored in name_to_mem_. We also ensure that every segment in a StagedMem
   // for a memory starts at an address that's aligned for the word width of
   // that memory. Note: we don't also check segments' lengths are aligned.
-  std::map<std::string, StagedMem> staging_area_;
+  //
+  // The staging area is immutable once loaded, so that it can be shared with
+  // the image cache (see StageElf). It is null if nothing is staged.
+  typedef std::map<std::string, StagedMem> StagingArea;
+  std::shared_ptr<const StagingArea> staging_area_;
+  std::string staged_path_;
   const StagedMem empty_;
 
   /**
@@ -165,6 +211,12 @@ class DpiMemUtil {
    */
   size_t GetRegionForSegment(const std::string &path, int seg_idx, uint32_t lma,
                              uint32_t mem_sz) const;
+
+  /**
+   * Return a string that describes the registered memory areas (names, base
+   * addresses and geometry). Used to key cached staging areas.
+   */
+  std::string GetLayoutKey() const;
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_CPP_DPI_MEMUTIL_H_
@@ -0,0 +1,57 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ecc32_secded.h"
+
+#include "secded_enc.h"
+
+namespace {
+struct Ecc32Tables {
+  // The check bits for a word that is zero apart from byte i, which is v,
+  // are by_byte[i][v] ^ inv_bits.
+  uint8_t by_byte[4][256];
+  uint8_t inv_bits;
+
+  Ecc32Tables() {
+    const uint8_t zero[4] = {0, 0, 0, 0};
+    inv_bits = enc_secded_inv_39_32(zero);
+
+    for (int i = 0; i < 4; ++i) {
+      for (int v = 0; v < 256; ++v) {
+        uint8_t bytes[4] = {0, 0, 0, 0};
+        bytes[i] = v;
+        by_byte[i][v] = enc_secded_inv_39_32(bytes) ^ inv_bits;
+      }
+    }
+  }
+};
+}  // namespace
+
+static const Ecc32Tables tables;
+
+uint8_t ecc32_check_bits(uint32_t word) {
+  return tables.by_byte[0][word & 0xff] ^
+         tables.by_byte[1][(word >> 8) & 0xff] ^
+         tables.by_byte[2][(word >> 16) & 0xff] ^
+         tables.by_byte[3][word >> 24] ^ tables.inv_bits;
+}
+
+void ecc32_encode(const uint32_t *words, uint8_t *check_bits, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    check_bits[i] = ecc32_check_bits(words[i]);
+  }
+}
+
+size_t ecc32_check(const uint32_t *words, const uint8_t *check_bits,
+                   bool *good, size_t count) {
+  size_t num_bad = 0;
+  for (size_t i = 0; i < count; ++i) {
+    bool word_good = ecc32_check_bits(words[i]) == check_bits[i];
+    num_bad += !word_good;
+    if (good) {
+      good[i] = word_good;
+    }
+  }
+  return num_bad;
+}
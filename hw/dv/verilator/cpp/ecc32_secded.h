@@ -0,0 +1,34 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_VERILATOR_CPP_ECC32_SECDED_H_
+#define OPENTITAN_HW_DV_VERILATOR_CPP_ECC32_SECDED_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Table-driven versions of the inverted 39/32 Hsiao SECDED code that
+// Ecc32MemArea uses for its integrity bits.
+//
+// These give the same results as enc_secded_inv_39_32 from secded_enc.h (and
+// the tables are built from that function). Since each check bit is a parity
+// over some of the data bits, the check bits for a word are the XOR of the
+// check bits for each of its bytes; this lets us do four table lookups per
+// word instead of seven masked parity computations.
+
+/** Compute the 7 inverted SECDED check bits for word */
+uint8_t ecc32_check_bits(uint32_t word);
+
+/** Compute check bits for count words, writing them to check_bits */
+void ecc32_encode(const uint32_t *words, uint8_t *check_bits, size_t count);
+
+/** Check count words against their check bits
+ *
+ * If good is not null, good[i] is set to whether words[i] matches
+ * check_bits[i]. Returns the number of words that don't match.
+ */
+size_t ecc32_check(const uint32_t *words, const uint8_t *check_bits,
+                   bool *good, size_t count);
+
+#endif  // OPENTITAN_HW_DV_VERILATOR_CPP_ECC32_SECDED_H_
@@ -6,16 +6,20 @@
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstring>
+#include <iostream>
 #include <sstream>
 
+#include "mem_image.h"
 #include "sv_scoped.h"
 
 // DPI exports, defined in prim_util_memload.svh
 extern "C" {
-void simutil_memload(const char *file);
 int simutil_set_mem(int index, const svBitVecVal *val);
 int simutil_get_mem(int index, svBitVecVal *val);
+int simutil_set_mem_bulk(int index, int count, const svBitVecVal *vals);
+int simutil_get_mem_bulk(int index, int count, svBitVecVal *vals);
 }
 
 MemArea::MemArea(const std::string &scope, uint32_t num_words,
@@ -34,20 +38,18 @@ void MemArea::Write(uint32_t word_offset,
   // the simulator may still read bits from minibuf it does not use, we must
   // use a fixed allocation of the full bit vector size to avoid an out of
   // bounds access.
-  uint8_t minibuf[SV_MEM_WIDTH_BYTES];
-  memset(minibuf, 0, sizeof minibuf);
-  assert(width_byte_ <= sizeof minibuf);
+  //
+  // Rather than making one DPI call per word, we fill a buffer of up to
+  // SV_MEM_BULK_WORDS of these slots at a time (see WriteWords).
+  assert(width_byte_ <= SV_MEM_WIDTH_BYTES);
 
   uint32_t data_words = (data.size() + width_byte_ - 1) / width_byte_;
   assert(word_offset + data_words <= num_words_);
 
-  for (uint32_t i = 0; i < data_words; ++i) {
-    uint32_t dst_word = word_offset + i;
-    uint32_t phys_addr = ToPhysAddr(dst_word);
-
-    WriteBuffer(minibuf, data, i * width_byte_, dst_word);
-    WriteFromMinibuf(phys_addr, minibuf, dst_word);
-  }
+  WriteWords(word_offset, data_words,
+             [&](uint8_t *buf, uint32_t i, uint32_t dst_word) {
+               WriteBuffer(buf, data, i * width_byte_, dst_word);
+             });
 }
 
 std::vector<uint8_t> MemArea::Read(uint32_t word_offset,
@@ -57,29 +59,174 @@ std::vector<uint8_t> MemArea::Read(uint32_t word_offset,
   uint32_t num_bytes = width_byte_ * num_words;
   assert(num_words <= num_bytes);
 
-  // See Write for an explanation for this buffer.
-  uint8_t minibuf[SV_MEM_WIDTH_BYTES];
-  memset(minibuf, 0, sizeof minibuf);
-  assert(width_byte_ <= sizeof minibuf);
-
   std::vector<uint8_t> ret;
   ret.reserve(num_bytes);
 
-  for (uint32_t i = 0; i < num_words; ++i) {
-    uint32_t src_word = word_offset + i;
-    uint32_t phys_addr = ToPhysAddr(src_word);
+  ReadWords(word_offset, num_words,
+            [&](const uint8_t *buf, uint32_t src_word) {
+              ReadBuffer(ret, buf, src_word);
+            });
+
+  return ret;
+}
 
-    ReadToMinibuf(minibuf, phys_addr);
-    ReadBuffer(ret, minibuf, src_word);
+void MemArea::LoadVmem(const std::string &path, bool logical) const {
+  if (!logical) {
+    WritePhysImage(ParseVmem(path, SV_MEM_WIDTH_BITS), path);
+    return;
   }
 
-  return ret;
+  // Logical words can be no wider than the memory's logical width
+  WriteLogicalImage(ParseVmem(path, GetWidth()), path);
+}
+
+void MemArea::LoadMemImage(const std::string &path) const {
+  MemImage image = ReadMemImage(path);
+  if (SV_MEM_WIDTH_BITS < 8 * image.word_bytes) {
+    std::ostringstream oss;
+    oss << "Memory image at `" << path << "' has " << image.word_bytes
+        << "-byte words, but the widest supported memory word is "
+        << SV_MEM_WIDTH_BITS << " bits.";
+    throw std::runtime_error(oss.str());
+  }
+  WritePhysImage(image, path);
+}
+
+// Throw a std::runtime_error unless a run of num_words words at addr fits in
+// a memory of mem_words words.
+static void CheckImageRun(const std::string &path, const std::string &scope,
+                          uint32_t addr, uint32_t num_words,
+                          uint32_t mem_words) {
+  if (addr <= mem_words && num_words <= mem_words - addr)
+    return;
+
+  std::ostringstream oss;
+  oss << "Image at `" << path << "' has " << num_words
+      << " words starting at word 0x" << std::hex << addr
+      << ", but the memory at `" << scope << "' only has 0x" << mem_words
+      << " words.";
+  throw std::runtime_error(oss.str());
+}
+
+void MemArea::WriteLogicalImage(const MemImage &image,
+                                const std::string &path) const {
+  assert(image.word_bytes <= width_byte_);
+
+  std::vector<uint8_t> data;
+  for (const MemImage::Run &run : image.runs) {
+    CheckImageRun(path, scope_, run.addr, run.num_words, num_words_);
+
+    // Zero-extend each word to the width of the memory
+    data.assign((size_t)run.num_words * width_byte_, 0);
+    for (uint32_t i = 0; i < run.num_words; ++i) {
+      memcpy(&data[(size_t)i * width_byte_],
+             &run.data[(size_t)i * image.word_bytes], image.word_bytes);
+    }
+    Write(run.addr, data);
+  }
+}
+
+void MemArea::WritePhysImage(const MemImage &image,
+                             const std::string &path) const {
+  assert(image.word_bytes <= SV_MEM_WIDTH_BYTES);
+
+  // Words are copied into the low bytes of each slot. Since all words have the
+  // same size, the bytes above them stay zero.
+  uint8_t bulkbuf[SV_MEM_BULK_BYTES] = {0};
+  for (const MemImage::Run &run : image.runs) {
+    CheckImageRun(path, scope_, run.addr, run.num_words, num_words_);
+
+    const uint8_t *src = run.data.data();
+    for (uint32_t done = 0; done < run.num_words; done += SV_MEM_BULK_WORDS) {
+      uint32_t count =
+          std::min(run.num_words - done, (uint32_t)SV_MEM_BULK_WORDS);
+      for (uint32_t i = 0; i < count; ++i) {
+        memcpy(&bulkbuf[i * SV_MEM_WIDTH_BYTES], src, image.word_bytes);
+        src += image.word_bytes;
+      }
+      WriteFromBulkbuf(run.addr + done, count, bulkbuf, run.addr + done);
+    }
+  }
+}
+
+void MemArea::Fill(const std::vector<uint8_t> &pattern, uint32_t word_offset,
+                   uint32_t num_words) const {
+  assert(word_offset <= num_words_ && num_words <= num_words_ - word_offset);
+
+  std::vector<uint8_t> word = ExpandFillPattern(pattern);
+
+  // Encode the word once and then copy the result into every slot.
+  uint8_t phys_word[SV_MEM_WIDTH_BYTES] = {0};
+  WriteBuffer(phys_word, word, 0, word_offset);
+
+  WriteWords(word_offset, num_words,
+             [&](uint8_t *buf, uint32_t i, uint32_t dst_word) {
+               memcpy(buf, phys_word, SV_MEM_WIDTH_BYTES);
+             });
 }
 
-void MemArea::LoadVmem(const std::string &path) const {
-  SVScoped scoped(scope_.c_str());
-  // TODO: Add error handling.
-  simutil_memload(path.c_str());
+void MemArea::WritePhysWords(uint32_t phys_addr, uint32_t num_words,
+                             const uint8_t *buf) const {
+  assert(phys_addr <= num_words_ && num_words <= num_words_ - phys_addr);
+
+  // Copy through a full-sized buffer: the simulator may read all of the bits
+  // in the vector, even if the final chunk is shorter.
+  uint8_t bulkbuf[SV_MEM_BULK_BYTES] = {0};
+  for (uint32_t done = 0; done < num_words; done += SV_MEM_BULK_WORDS) {
+    uint32_t count = std::min(num_words - done, (uint32_t)SV_MEM_BULK_WORDS);
+    memcpy(bulkbuf, buf + done * SV_MEM_WIDTH_BYTES,
+           count * SV_MEM_WIDTH_BYTES);
+    WriteFromBulkbuf(phys_addr + done, count, bulkbuf, phys_addr + done);
+  }
+}
+
+void MemArea::ReadPhysWords(uint32_t phys_addr, uint32_t num_words,
+                            uint8_t *buf) const {
+  assert(phys_addr <= num_words_ && num_words <= num_words_ - phys_addr);
+
+  uint8_t bulkbuf[SV_MEM_BULK_BYTES];
+  for (uint32_t done = 0; done < num_words; done += SV_MEM_BULK_WORDS) {
+    uint32_t count = std::min(num_words - done, (uint32_t)SV_MEM_BULK_WORDS);
+    ReadToBulkbuf(bulkbuf, phys_addr + done, count);
+    memcpy(buf + done * SV_MEM_WIDTH_BYTES, bulkbuf,
+           count * SV_MEM_WIDTH_BYTES);
+  }
+}
+
+void MemArea::BenchmarkAccess(std::ostream &os) const {
+  typedef std::chrono::steady_clock Clock;
+  auto to_us = [](Clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+  };
+
+  std::vector<uint8_t> data(num_words_ * SV_MEM_WIDTH_BYTES);
+  uint8_t minibuf[SV_MEM_WIDTH_BYTES] = {0};
+
+  // One DPI call per word, as the code did before the bulk functions existed.
+  auto t0 = Clock::now();
+  for (uint32_t i = 0; i < num_words_; ++i) {
+    ReadToMinibuf(minibuf, i);
+    memcpy(&data[i * SV_MEM_WIDTH_BYTES], minibuf, SV_MEM_WIDTH_BYTES);
+  }
+  auto t1 = Clock::now();
+  for (uint32_t i = 0; i < num_words_; ++i) {
+    memcpy(minibuf, &data[i * SV_MEM_WIDTH_BYTES], SV_MEM_WIDTH_BYTES);
+    WriteFromMinibuf(i, minibuf, i);
+  }
+  auto t2 = Clock::now();
+
+  // The same transfers using the bulk functions
+  ReadPhysWords(0, num_words_, data.data());
+  auto t3 = Clock::now();
+  WritePhysWords(0, num_words_, data.data());
+  auto t4 = Clock::now();
+
+  os << "Memory access benchmark for " << scope_ << " (" << num_words_
+     << " words of " << width_byte_ << " bytes):\n"
+     << "  Per-word read:  " << to_us(t1 - t0) << " us\n"
+     << "  Per-word write: " << to_us(t2 - t1) << " us\n"
+     << "  Bulk read:      " << to_us(t3 - t2) << " us\n"
+     << "  Bulk write:     " << to_us(t4 - t3) << " us" << std::endl;
 }
 
 void MemArea::WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
@@ -121,3 +268,44 @@ void MemArea::WriteFromMinibuf(uint32_t phys_addr, const uint8_t *minibuf,
     throw std::runtime_error(oss.str());
   }
 }
+
+std::vector<uint8_t> MemArea::ExpandFillPattern(
+    const std::vector<uint8_t> &pattern) const {
+  assert(!pattern.empty() && (width_byte_ % pattern.size()) == 0);
+
+  std::vector<uint8_t> word;
+  word.reserve(width_byte_);
+  while (word.size() < width_byte_) {
+    word.insert(word.end(), pattern.begin(), pattern.end());
+  }
+  return word;
+}
+
+void MemArea::ReadToBulkbuf(uint8_t *bulkbuf, uint32_t phys_addr,
+                            uint32_t num_words) const {
+  assert(0 < num_words && num_words <= SV_MEM_BULK_WORDS);
+
+  SVScoped scoped(scope_);
+  if (!simutil_get_mem_bulk(phys_addr, num_words, (svBitVecVal *)bulkbuf)) {
+    std::ostringstream oss;
+    oss << "Could not read " << num_words
+        << " memory words at physical index 0x" << std::hex << phys_addr
+        << ".";
+    throw std::runtime_error(oss.str());
+  }
+}
+
+void MemArea::WriteFromBulkbuf(uint32_t phys_addr, uint32_t num_words,
+                               const uint8_t *bulkbuf,
+                               uint32_t dst_word) const {
+  assert(0 < num_words && num_words <= SV_MEM_BULK_WORDS);
+
+  SVScoped scoped(scope_);
+  if (!simutil_set_mem_bulk(phys_addr, num_words,
+                            (const svBitVecVal *)bulkbuf)) {
+    std::ostringstream oss;
+    oss << "Could not set " << num_words << " memory words at byte offset 0x"
+        << std::hex << dst_word * width_byte_ << ".";
+    throw std::runtime_error(oss.str());
+  }
+}
@@ -6,9 +6,12 @@
 #define OPENTITAN_HW_DV_VERILATOR_CPP_MEM_AREA_H_
 
 #include <cstdint>
+#include <iosfwd>
 #include <string>
 #include <vector>
 
+struct MemImage;
+
 // This is the maximum width of a memory that's supported by the code in
 // prim_util_memload.svh
 #define SV_MEM_WIDTH_BITS 312
@@ -18,6 +21,12 @@
 // using the svBitVecVal type, we have to round up to the next 32-bit word.
 #define SV_MEM_WIDTH_BYTES (4 * ((SV_MEM_WIDTH_BITS + 31) / 32))
 
+// This is the maximum number of memory words that are passed in a single call
+// to simutil_set_mem_bulk or simutil_get_mem_bulk (see prim_util_memload.svh).
+// Each word takes up SV_MEM_WIDTH_BYTES bytes in the buffer.
+#define SV_MEM_BULK_WORDS 64
+#define SV_MEM_BULK_BYTES (SV_MEM_BULK_WORDS * SV_MEM_WIDTH_BYTES)
+
 /**
  * A "memory area", representing a memory in the simulated design.
  */
@@ -26,9 +35,8 @@ class MemArea {
   /** Constructor
    *
    * @param scope  The SystemVerilog scope where the instantiated memory can be
-   *               found. This needs to support the DPI-C interfaces \c
-   *               simutil_memload and \c simutil_set_mem (used for vmem and
-   *               ELF files, respectively).
+   *               found. This needs to support the DPI-C interfaces from
+   *               prim_util_memload.svh (\c simutil_set_mem and friends).
    *
    * @param size   The size of the memory in bytes (must be positive and a
    *               multiple of \p width_byte)
@@ -71,8 +79,82 @@ class MemArea {
   virtual std::vector<uint8_t> Read(uint32_t word_offset,
                                     uint32_t num_words) const;
 
-  /** Use \c simutil_memload to load a vmem file into the memory */
-  virtual void LoadVmem(const std::string &path) const;
+  /** Load a vmem file into the memory
+   *
+   * The file is parsed in C++ (see ParseVmem()) rather than with $readmemh.
+   * If logical is true, the words are logical data and are written with
+   * Write(), which adds any ECC bits or scrambling. Otherwise, they are
+   * physical memory words (such as a pre-scrambled image with ECC bits) and
+   * are copied into the memory array as-is, like LoadMemImage(). Addresses in
+   * the file are logical or physical word addresses, respectively.
+   *
+   * Throws a std::runtime_error if the file can't be parsed or doesn't fit in
+   * the memory.
+   */
+  virtual void LoadVmem(const std::string &path, bool logical) const;
+
+  /** Load a binary memory image (see ReadMemImage()) into the memory
+   *
+   * The image holds physical memory words, which are copied into the memory
+   * array as-is using the bulk DPI functions.
+   *
+   * Throws a std::runtime_error if the file can't be read or doesn't fit in
+   * the memory.
+   */
+  void LoadMemImage(const std::string &path) const;
+
+  /** Fill a range of words with a repeating pattern
+   *
+   * This has the same effect as calling Write() with a vector of
+   * <tt>num_words * width_byte_</tt> bytes that repeats \p pattern, but it
+   * doesn't need to allocate that vector. The base implementation encodes the
+   * pattern into a physical memory word once and then copies it into place
+   * with the bulk DPI functions. Subclasses where the physical word depends on
+   * the address must override this.
+   *
+   * @param pattern     The bytes to repeat. This must be nonempty and its
+   *                    length must divide the memory width in bytes (so a
+   *                    single 0xff byte is a valid way to "erase" memory).
+   *
+   * @param word_offset The offset, in words, of the first word to fill.
+   *
+   * @param num_words   The number of words to fill.
+   */
+  virtual void Fill(const std::vector<uint8_t> &pattern, uint32_t word_offset,
+                    uint32_t num_words) const;
+
+  /** Write raw physical words to a contiguous range of the memory
+   *
+   * This is a backdoor that bypasses any ECC or scrambling: the data is copied
+   * into the memory array as-is, using as few DPI calls as possible. If the
+   * scope cannot be set, this throws an SVScoped::Error. If a call to \c
+   * simutil_set_mem_bulk fails, this throws a \c std::runtime_error.
+   *
+   * @param phys_addr The physical index of the first word to write
+   *
+   * @param num_words The number of words to write
+   *
+   * @param buf       Source data. Word i is read from the
+   *                  SV_MEM_WIDTH_BYTES bytes starting at
+   *                  <tt>i * SV_MEM_WIDTH_BYTES</tt>.
+   */
+  void WritePhysWords(uint32_t phys_addr, uint32_t num_words,
+                      const uint8_t *buf) const;
+
+  /** Read raw physical words from a contiguous range of the memory
+   *
+   * This is the counterpart to WritePhysWords(), with \p buf using the same
+   * layout.
+   */
+  void ReadPhysWords(uint32_t phys_addr, uint32_t num_words,
+                     uint8_t *buf) const;
+
+  /** Time reading and writing the whole memory one word per DPI call and with
+   * the bulk DPI functions, printing the results to \p os.
+   *
+   * The memory contents are read and written back unchanged.
+   */
+  void BenchmarkAccess(std::ostream &os) const;
 
   const std::string &GetScope() const { return scope_; }
   uint32_t GetSizeWords() const { return num_words_; }
@@ -145,6 +227,104 @@ class MemArea {
    */
   void WriteFromMinibuf(uint32_t phys_addr, const uint8_t *minibuf,
                         uint32_t dst_word) const;
+
+  /** Write the words of image to the memory with Write(), treating them as
+   * logical data at logical addresses. path is used for error messages. */
+  void WriteLogicalImage(const MemImage &image, const std::string &path) const;
+
+  /** Copy the words of image into the memory array as-is, treating them as
+   * physical words at physical addresses. path is used for error messages. */
+  void WritePhysImage(const MemImage &image, const std::string &path) const;
+
+  /** Expand a fill pattern (see Fill()) to a single logical memory word */
+  std::vector<uint8_t> ExpandFillPattern(
+      const std::vector<uint8_t> &pattern) const;
+
+  /** Write num_words words from bulkbuf to the memory, starting at phys_addr
+   *
+   * bulkbuf should be SV_MEM_BULK_BYTES in size, with word i starting at byte
+   * <tt>i * SV_MEM_WIDTH_BYTES</tt>. dst_word is the logical address of the
+   * first word (used for error messages).
+   */
+  void WriteFromBulkbuf(uint32_t phys_addr, uint32_t num_words,
+                        const uint8_t *bulkbuf, uint32_t dst_word) const;
+
+  /** Read num_words words from the memory into bulkbuf, starting at phys_addr
+   *
+   * bulkbuf has the same layout as for WriteFromBulkbuf().
+   */
+  void ReadToBulkbuf(uint8_t *bulkbuf, uint32_t phys_addr,
+                     uint32_t num_words) const;
+
+  /** Write num_words logical words, starting at word_offset
+   *
+   * For each word, this calls <tt>fill(buf, i, dst_word)</tt> to generate the
+   * physical memory bits in buf for the i'th word, which will be written to
+   * logical address dst_word. Words that map to consecutive physical addresses
+   * are written with a single DPI call.
+   */
+  template <typename FillFn>
+  void WriteWords(uint32_t word_offset, uint32_t num_words, FillFn fill) const {
+    // See Write for an explanation of why this is zeroed first.
+    uint8_t bulkbuf[SV_MEM_BULK_BYTES] = {0};
+
+    uint32_t run_phys = 0, run_dst = 0, run_len = 0;
+    for (uint32_t i = 0; i < num_words; ++i) {
+      uint32_t dst_word = word_offset + i;
+      uint32_t phys_addr = ToPhysAddr(dst_word);
+
+      if (run_len &&
+          (run_len == SV_MEM_BULK_WORDS || phys_addr != run_phys + run_len)) {
+        WriteFromBulkbuf(run_phys, run_len, bulkbuf, run_dst);
+        run_len = 0;
+      }
+      if (!run_len) {
+        run_phys = phys_addr;
+        run_dst = dst_word;
+      }
+
+      fill(&bulkbuf[run_len * SV_MEM_WIDTH_BYTES], i, dst_word);
+      ++run_len;
+    }
+    if (run_len) {
+      WriteFromBulkbuf(run_phys, run_len, bulkbuf, run_dst);
+    }
+  }
+
+  /** Read num_words logical words, starting at word_offset
+   *
+   * This is the counterpart to WriteWords(): for each word, it calls
+   * <tt>extract(buf, src_word)</tt> in order of logical address.
+   */
+  template <typename ExtractFn>
+  void ReadWords(uint32_t word_offset, uint32_t num_words,
+                 ExtractFn extract) const {
+    uint8_t bulkbuf[SV_MEM_BULK_BYTES];
+
+    uint32_t run_phys = 0, run_src = 0, run_len = 0;
+    for (uint32_t i = 0; i <= num_words; ++i) {
+      uint32_t src_word = word_offset + i;
+      bool done = i == num_words;
+      uint32_t phys_addr = done ? 0 : ToPhysAddr(src_word);
+
+      if (run_len && (done || run_len == SV_MEM_BULK_WORDS ||
+                      phys_addr != run_phys + run_len)) {
+        ReadToBulkbuf(bulkbuf, run_phys, run_len);
+        for (uint32_t j = 0; j < run_len; ++j) {
+          extract(&bulkbuf[j * SV_MEM_WIDTH_BYTES], run_src + j);
+        }
+        run_len = 0;
+      }
+      if (done) {
+        break;
+      }
+      if (!run_len) {
+        run_phys = phys_addr;
+        run_src = src_word;
+      }
+      ++run_len;
+    }
+  }
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_CPP_MEM_AREA_H_
@@ -0,0 +1,307 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "mem_image.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+static const char kMemImageMagic[8] = {'O', 'T', 'M', 'E', 'M', 'I', 'M', 'G'};
+static const uint32_t kMemImageVersion = 1;
+static const size_t kMemImageHeaderBytes = 20;
+
+// Read the whole of the file at path. what is a description of the file for
+// error messages.
+static std::string ReadFile(const std::string &path, const char *what) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    std::ostringstream oss;
+    oss << "Could not open " << what << " at `" << path << "'.";
+    throw std::runtime_error(oss.str());
+  }
+
+  in.seekg(0, std::ios::end);
+  std::string ret(in.tellg(), '\0');
+  in.seekg(0, std::ios::beg);
+  in.read(&ret[0], ret.size());
+  if (!in) {
+    std::ostringstream oss;
+    oss << "Failed to read " << what << " at `" << path << "'.";
+    throw std::runtime_error(oss.str());
+  }
+  return ret;
+}
+
+// Return the value of a hex digit, 0 for an x or z digit (which is what a
+// 2-state simulator would load) or -1 if c is not a digit at all.
+static int HexDigitValue(char c) {
+  if ('0' <= c && c <= '9')
+    return c - '0';
+  if ('a' <= c && c <= 'f')
+    return 10 + c - 'a';
+  if ('A' <= c && c <= 'F')
+    return 10 + c - 'A';
+  if (c == 'x' || c == 'X' || c == 'z' || c == 'Z' || c == '?')
+    return 0;
+  return -1;
+}
+
+static bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+         c == '\v';
+}
+
+// Widen every word in image to new_bytes bytes.
+static void WidenWords(MemImage &image, uint32_t new_bytes) {
+  for (MemImage::Run &run : image.runs) {
+    std::vector<uint8_t> data((size_t)run.num_words * new_bytes, 0);
+    for (uint32_t i = 0; i < run.num_words; ++i) {
+      memcpy(&data[(size_t)i * new_bytes],
+             &run.data[(size_t)i * image.word_bytes], image.word_bytes);
+    }
+    run.data = std::move(data);
+  }
+  image.word_bytes = new_bytes;
+}
+
+namespace {
+// Convenience class for runtime errors when parsing a vmem file
+class VmemError : public std::runtime_error {
+ public:
+  VmemError(const std::string &path, unsigned line, const std::string &msg)
+      : std::runtime_error(Format(path, line, msg)) {}
+
+ private:
+  static std::string Format(const std::string &path, unsigned line,
+                            const std::string &msg) {
+    std::ostringstream oss;
+    oss << "Failed to parse vmem file at `" << path << "', line " << line
+        << ": " << msg;
+    return oss.str();
+  }
+};
+}  // namespace
+
+MemImage ParseVmem(const std::string &path, uint32_t max_bits) {
+  const std::string text = ReadFile(path, "vmem file");
+  const uint32_t max_digits = (max_bits + 3) / 4;
+
+  MemImage image;
+  MemImage::Run *run = nullptr;
+  uint64_t next_addr = 0;
+  unsigned line = 1;
+
+  const char *p = text.data();
+  const char *end = p + text.size();
+  while (p < end) {
+    char c = *p;
+    if (IsSpace(c)) {
+      line += c == '\n';
+      ++p;
+      continue;
+    }
+
+    // Comments
+    if (c == '/' && p + 1 < end && p[1] == '/') {
+      p = std::find(p, end, '\n');
+      continue;
+    }
+    if (c == '/' && p + 1 < end && p[1] == '*') {
+      unsigned start_line = line;
+      p += 2;
+      while (p + 1 < end && !(p[0] == '*' && p[1] == '/')) {
+        line += *p == '\n';
+        ++p;
+      }
+      if (p + 1 >= end) {
+        throw VmemError(path, start_line, "Unterminated block comment.");
+      }
+      p += 2;
+      continue;
+    }
+
+    // Everything else is a word or an address. These end at whitespace or at
+    // the start of a comment.
+    bool is_addr = c == '@';
+    const char *tok = is_addr ? p + 1 : p;
+    p = tok;
+    while (p < end && !IsSpace(*p) && *p != '/') {
+      ++p;
+    }
+
+    // Check the digits and count them. We'll read them afterwards from the
+    // least significant end.
+    uint32_t num_digits = 0;
+    for (const char *q = tok; q < p; ++q) {
+      if (*q == '_')
+        continue;
+      if (HexDigitValue(*q) < 0) {
+        std::ostringstream oss;
+        oss << "Unexpected character `" << *q << "'.";
+        throw VmemError(path, line, oss.str());
+      }
+      ++num_digits;
+    }
+    if (num_digits == 0) {
+      throw VmemError(path, line, is_addr ? "Empty address." : "Empty word.");
+    }
+
+    if (is_addr) {
+      uint64_t addr = 0;
+      for (const char *q = tok; q < p; ++q) {
+        if (*q != '_')
+          addr = (addr << 4) | HexDigitValue(*q);
+        if (addr > UINT32_MAX) {
+          throw VmemError(path, line, "Address doesn't fit in 32 bits.");
+        }
+      }
+      next_addr = addr;
+      if (run && next_addr != (uint64_t)run->addr + run->num_words) {
+        run = nullptr;
+      }
+      continue;
+    }
+
+    if (num_digits > max_digits) {
+      std::ostringstream oss;
+      oss << "Word has " << num_digits << " hex digits, but at most "
+          << max_digits << " are supported.";
+      throw VmemError(path, line, oss.str());
+    }
+    if (next_addr > UINT32_MAX) {
+      throw VmemError(path, line, "Word address doesn't fit in 32 bits.");
+    }
+
+    image.word_bits = std::max(image.word_bits, 4 * num_digits);
+    uint32_t word_bytes = (num_digits + 1) / 2;
+    if (word_bytes > image.word_bytes) {
+      WidenWords(image, word_bytes);
+    }
+
+    if (!run) {
+      image.runs.push_back({(uint32_t)next_addr, 0, {}});
+      run = &image.runs.back();
+    }
+
+    size_t off = run->data.size();
+    run->data.resize(off + image.word_bytes, 0);
+    uint8_t *word = &run->data[off];
+    uint32_t nibble = 0;
+    for (const char *q = p; q > tok;) {
+      --q;
+      if (*q == '_')
+        continue;
+      word[nibble / 2] |= HexDigitValue(*q) << (4 * (nibble % 2));
+      ++nibble;
+    }
+
+    ++run->num_words;
+    ++next_addr;
+  }
+
+  return image;
+}
+
+static uint32_t GetU32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static void PutU32(std::ostream &os, uint32_t val) {
+  const char bytes[4] = {(char)val, (char)(val >> 8), (char)(val >> 16),
+                         (char)(val >> 24)};
+  os.write(bytes, 4);
+}
+
+MemImage ReadMemImage(const std::string &path) {
+  const std::string contents = ReadFile(path, "memory image");
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(contents.data());
+  size_t size = contents.size();
+
+  auto fail = [&](const std::string &msg) {
+    std::ostringstream oss;
+    oss << "Failed to load memory image at `" << path << "': " << msg;
+    throw std::runtime_error(oss.str());
+  };
+
+  if (size < kMemImageHeaderBytes ||
+      memcmp(data, kMemImageMagic, sizeof(kMemImageMagic)) != 0) {
+    fail("not a memory image.");
+  }
+  if (GetU32(data + 8) != kMemImageVersion) {
+    std::ostringstream oss;
+    oss << "unsupported version " << GetU32(data + 8) << ".";
+    fail(oss.str());
+  }
+
+  MemImage image;
+  image.word_bytes = GetU32(data + 12);
+  image.word_bits = 8 * image.word_bytes;
+  if (image.word_bytes == 0 || image.word_bytes > 0x10000) {
+    std::ostringstream oss;
+    oss << "invalid word size of " << image.word_bytes << " bytes.";
+    fail(oss.str());
+  }
+
+  uint32_t num_runs = GetU32(data + 16);
+  size_t pos = kMemImageHeaderBytes;
+  for (uint32_t i = 0; i < num_runs; ++i) {
+    if (size - pos < 8) {
+      fail("file is truncated.");
+    }
+    uint32_t addr = GetU32(data + pos);
+    uint32_t num_words = GetU32(data + pos + 4);
+    pos += 8;
+
+    uint64_t run_bytes = (uint64_t)num_words * image.word_bytes;
+    if (size - pos < run_bytes) {
+      fail("file is truncated.");
+    }
+    if ((uint64_t)addr + num_words > (uint64_t)UINT32_MAX + 1) {
+      std::ostringstream oss;
+      oss << "run " << i << " overflows the address space.";
+      fail(oss.str());
+    }
+
+    image.runs.push_back(
+        {addr, num_words,
+         std::vector<uint8_t>(data + pos, data + pos + run_bytes)});
+    pos += run_bytes;
+  }
+
+  if (pos != size) {
+    fail("unexpected data after the last run.");
+  }
+
+  return image;
+}
+
+void WriteMemImage(const std::string &path, const MemImage &image) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    std::ostringstream oss;
+    oss << "Could not open `" << path << "' for writing.";
+    throw std::runtime_error(oss.str());
+  }
+
+  out.write(kMemImageMagic, sizeof(kMemImageMagic));
+  PutU32(out, kMemImageVersion);
+  PutU32(out, image.word_bytes);
+  PutU32(out, image.runs.size());
+  for (const MemImage::Run &run : image.runs) {
+    PutU32(out, run.addr);
+    PutU32(out, run.num_words);
+    out.write(reinterpret_cast<const char *>(run.data.data()), run.data.size());
+  }
+
+  out.close();
+  if (!out) {
+    std::ostringstream oss;
+    oss << "Failed to write memory image to `" << path << "'.";
+    throw std::runtime_error(oss.str());
+  }
+}
@@ -0,0 +1,79 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_VERILATOR_CPP_MEM_IMAGE_H_
+#define OPENTITAN_HW_DV_VERILATOR_CPP_MEM_IMAGE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A sparse memory image: runs of consecutive words, each of which is stored
+ * little-endian in word_bytes bytes.
+ *
+ * This is what ParseVmem() produces from a vmem file and is also the contents
+ * of a binary memory image (see ReadMemImage()).
+ */
+struct MemImage {
+  struct Run {
+    uint32_t addr;              ///< Word address of the first word in the run
+    uint32_t num_words;         ///< Number of words in the run
+    std::vector<uint8_t> data;  ///< num_words * word_bytes bytes
+  };
+
+  /** The number of bytes used to store each word */
+  uint32_t word_bytes;
+
+  /** The width (in bits) of the widest word in the source. For a vmem file,
+   * this is 4 times the largest number of hex digits in a word. */
+  uint32_t word_bits;
+
+  std::vector<Run> runs;
+
+  MemImage() : word_bytes(0), word_bits(0) {}
+};
+
+/**
+ * Parse the vmem file at path, as $readmemh would.
+ *
+ * Words are separated by whitespace and may contain '_' separators. An x or
+ * z digit is read as zero (as in a 2-state simulator). "@ADDR" sets the word
+ * address for the following words. Both // and block comments are supported.
+ *
+ * Throws a std::runtime_error if the file can't be read or is malformed, or
+ * if it contains a word wider than max_bits.
+ */
+MemImage ParseVmem(const std::string &path, uint32_t max_bits);
+
+/**
+ * Read a binary memory image from the file at path.
+ *
+ * A binary memory image holds pre-encoded physical memory words, so that it
+ * can be copied into the memory without any parsing or encoding. All fields
+ * are little-endian:
+ *
+ *   char     magic[8]     "OTMEMIMG"
+ *   uint32_t version      1
+ *   uint32_t word_bytes   Bytes per word
+ *   uint32_t num_runs
+ *
+ * followed by num_runs runs, each of which is:
+ *
+ *   uint32_t addr         Word address of the first word
+ *   uint32_t num_words
+ *   uint8_t  data[num_words * word_bytes]
+ *
+ * Throws a std::runtime_error if the file can't be read or is malformed.
+ */
+MemImage ReadMemImage(const std::string &path);
+
+/**
+ * Write image to the file at path in the format read by ReadMemImage().
+ *
+ * Throws a std::runtime_error if the file can't be written.
+ */
+void WriteMemImage(const std::string &path, const MemImage &image);
+
+#endif  // OPENTITAN_HW_DV_VERILATOR_CPP_MEM_IMAGE_H_
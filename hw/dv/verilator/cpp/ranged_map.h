@@ -6,11 +6,15 @@
 
 // Utility class representing disjoint segments of memory
 
+#include <algorithm>
 #include <cassert>
-#include <map>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
 
 // The type used to represent address ranges. This is essentially a std::pair,
-// but we need a operator< custom for the internal map.
+// but we need a operator< custom for sorting.
 template <typename addr_t>
 struct AddrRange {
   addr_t lo, hi;
@@ -21,10 +25,18 @@ bool operator<(const AddrRange<addr_t> &a, const AddrRange<addr_t> &b) {
   return a.lo < b.lo;
 }
 
+// The entries are kept sorted by their low address (which, since they are
+// disjoint, also sorts them by their high address) in a list of blocks, each
+// of which is a small sorted vector. This is a two-level B+ tree: a lookup is
+// a binary search over the first address of each block followed by a binary
+// search within a block, and everything it touches is stored contiguously.
+// Inserting an entry only has to shuffle the entries in one block, so it stays
+// cheap even when segments don't arrive in address order.
 template <typename addr_t, typename val_t>
 class RangedMap {
  public:
   using rng_t = AddrRange<addr_t>;
+  using entry_t = std::pair<rng_t, val_t>;
 
   // A function used to merge overlapping segments. When called by
   // Emplace(), val1 will be the newer value and val0 will be the
@@ -32,46 +44,37 @@ class RangedMap {
   typedef val_t (*MergeFun)(const rng_t &rng0, val_t &&val0, const rng_t &rng1,
                             val_t &&val1);
 
+  RangedMap() : size_(0) {}
+
   // Insert an entry that covers the address range [min_addr, max_addr]
   // (inclusive) with value val.
   void Emplace(addr_t min_addr, addr_t max_addr, val_t &&new_val,
                MergeFun merge) {
     assert(min_addr <= max_addr);
 
-    // Construct hit_lo / hit_hi, a pair of iterators that bound the
-    // segments that touch the new value.
-    auto hit_lo = map_.end();
-    auto hit_hi = map_.end();
-
     rng_t rng = {.lo = min_addr, .hi = max_addr};
 
-    if (!map_.empty()) {
-      // Start by finding the first region that starts strictly above min_addr.
-      auto right_it = map_.upper_bound(rng);
-      hit_hi = right_it;
-
-      // If hit_hi is map_.end(), every region starts at or below min_addr. If
-      // not, the region it points to overlaps with the range if hit_hi->first
-      // <= max_addr. Increment hit_hi until we get to the end or are no longer
-      // overlapping. The result is the end iterator for our range.
-      while (hit_hi != map_.end() && hit_hi->first.lo <= max_addr) {
-        ++hit_hi;
-      }
+    // Construct hit_lo / hit_hi, a pair of positions that bound the segments
+    // that touch the new value. Start by finding the first region that starts
+    // strictly above min_addr.
+    Pos right_pos = UpperBound(min_addr);
 
-      // Now we need to find the low end of the range. Start at right_it and
-      // decrement while we've not got to the beginning and while the previous
-      // iterator has a top >= min_addr.
-      hit_lo = right_it;
-      while (hit_lo != map_.begin() &&
-             min_addr <= std::prev(hit_lo)->first.hi) {
-        --hit_lo;
-      }
+    // Every region from right_pos up to the first one that starts strictly
+    // above max_addr overlaps with the range.
+    Pos hit_hi = UpperBound(max_addr);
+
+    // Now we need to find the low end of the range. Only the region
+    // immediately before right_pos can overlap from the left: any region below
+    // that ends before it starts.
+    Pos hit_lo = right_pos;
+    if (!IsBegin(hit_lo) && min_addr <= At(Prev(hit_lo)).first.hi) {
+      hit_lo = Prev(hit_lo);
     }
 
     // The entry is disjoint from all others iff hit_lo == hit_hi. In which
     // case, we can just insert it.
     if (hit_lo == hit_hi) {
-      map_.insert(std::make_pair(rng, std::move(new_val)));
+      InsertAt(hit_lo, std::make_pair(rng, std::move(new_val)));
       return;
     }
 
@@ -79,24 +82,29 @@ class RangedMap {
     // Accumulate into a new val_t and update min_addr / max_addr as we go.
     // Peel off the 1st iteration of the loop to avoid an unnecessary move/copy
     // of new_val.
-    val_t acc = merge(hit_lo->first, std::move(hit_lo->second), rng,
+    entry_t &lo_entry = At(hit_lo);
+    val_t acc = merge(lo_entry.first, std::move(lo_entry.second), rng,
                       std::move(new_val));
-    min_addr = std::min(min_addr, hit_lo->first.lo);
-    max_addr = std::max(max_addr, hit_lo->first.hi);
+    min_addr = std::min(min_addr, lo_entry.first.lo);
+    max_addr = std::max(max_addr, lo_entry.first.hi);
 
-    for (auto it = std::next(hit_lo); it != hit_hi; ++it) {
+    for (Pos pos = Next(hit_lo); pos != hit_hi; pos = Next(pos)) {
+      entry_t &entry = At(pos);
       rng_t rng1 = {.lo = min_addr, .hi = max_addr};
-      acc = merge(it->first, std::move(it->second), rng1, std::move(acc));
-      min_addr = std::min(min_addr, it->first.lo);
-      max_addr = std::max(max_addr, it->first.hi);
+      acc = merge(entry.first, std::move(entry.second), rng1, std::move(acc));
+      min_addr = std::min(min_addr, entry.first.lo);
+      max_addr = std::max(max_addr, entry.first.hi);
     }
 
-    // We've merged everything, and have possibly trashed the values pointed to
-    // by all the iterators in the range. Throw that lot away and finally
-    // insert the merged result.
-    map_.erase(hit_lo, hit_hi);
-    rng_t rng1 = {.lo = min_addr, .hi = max_addr};
-    map_.insert(std::make_pair(rng1, std::move(acc)));
+    // We've merged everything, and have possibly trashed the values of all the
+    // entries in the range. The merged range still sorts in the position of
+    // hit_lo, so store the result there and throw the rest away.
+    lo_entry.first = {.lo = min_addr, .hi = max_addr};
+    lo_entry.second = std::move(acc);
+    if (hit_lo.idx == 0) {
+      block_lo_[hit_lo.block] = min_addr;
+    }
+    EraseRange(Next(hit_lo), hit_hi);
   }
 
   // Try to insert an entry that covers the address range [min_addr, max_addr]
@@ -109,75 +117,266 @@ class RangedMap {
     assert(min_addr <= max_addr);
     rng_t rng = {.lo = min_addr, .hi = max_addr};
 
-    if (!map_.empty()) {
-      // We start by checking for an overlap "from the right". This would be a
-      // region that starts strictly above min_addr, but where it's low address
-      // is still <= max_addr. We can use std::map::upper_bound to find the
-      // first region strictly above min_addr (which returns the end iterator
-      // if there isn't one).
-      auto right_it = map_.upper_bound(rng);
-      if (right_it != map_.end()) {
-        addr_t right_min = right_it->first.lo;
-        if (right_min <= max_addr) {
-          return &right_it->second;
-        }
+    // We start by checking for an overlap "from the right". This would be a
+    // region that starts strictly above min_addr, but where it's low address
+    // is still <= max_addr. UpperBound finds the first region strictly above
+    // min_addr (returning the end position if there isn't one).
+    Pos right_pos = UpperBound(min_addr);
+    if (!IsEnd(right_pos)) {
+      const entry_t &right = At(right_pos);
+      if (right.first.lo <= max_addr) {
+        return &right.second;
       }
+    }
 
-      // We also need to check from the left side. This would be a region that
-      // starts at or before min_addr and extends past it. If right_it is
-      // mem_.begin(), there is no such region (because the lowest addressed
-      // region already starts above min_addr). Otherwise, decrement right_it
-      // to get the highest addressed region that starts at or before min_addr.
-      // Note this still works if right_it is the end iterator: we just pick up
-      // the last region, which we know exists because map_ is not empty.
-      if (right_it != map_.begin()) {
-        auto left_it = std::prev(right_it);
-        addr_t left_max = left_it->first.hi;
-
-        if (min_addr <= left_max) {
-          return &left_it->second;
-        }
+    // We also need to check from the left side. This would be a region that
+    // starts at or before min_addr and extends past it. If right_pos is the
+    // beginning, there is no such region (because the lowest addressed region
+    // already starts above min_addr). Otherwise, step back to get the highest
+    // addressed region that starts at or before min_addr. Note this still
+    // works if right_pos is the end: we just pick up the last region, which we
+    // know exists because the map is not empty.
+    if (!IsBegin(right_pos)) {
+      const entry_t &left = At(Prev(right_pos));
+      if (min_addr <= left.first.hi) {
+        return &left.second;
       }
     }
 
     // Phew, no overlap!
-    map_.insert(std::make_pair(rng, std::move(val)));
+    InsertAt(right_pos, std::make_pair(rng, std::move(val)));
     return nullptr;
   }
 
+ private:
+  using block_t = std::vector<entry_t>;
+
+  // The position of an entry: the index of its block and its index within
+  // that block. Every block is non-empty, so each entry has exactly one
+  // position and the end position is {blocks_.size(), 0}.
+  struct Pos {
+    size_t block, idx;
+
+    bool operator==(const Pos &other) const {
+      return block == other.block && idx == other.idx;
+    }
+    bool operator!=(const Pos &other) const { return !(*this == other); }
+  };
+
+ public:
   // Iteration interface
-  using map_t = std::map<rng_t, val_t>;
-  using const_iterator = typename map_t::const_iterator;
+  class const_iterator {
+   public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef entry_t value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const entry_t *pointer;
+    typedef const entry_t &reference;
+
+    const_iterator() : blocks_(nullptr), pos_({0, 0}) {}
+    const_iterator(const std::vector<block_t> *blocks, Pos pos)
+        : blocks_(blocks), pos_(pos) {}
 
-  const_iterator begin() const { return const_iterator(map_.begin()); }
-  const_iterator end() const { return const_iterator(map_.end()); }
-  size_t size() const { return map_.size(); }
+    reference operator*() const { return (*blocks_)[pos_.block][pos_.idx]; }
+    pointer operator->() const { return &**this; }
+
+    const_iterator &operator++() {
+      if (++pos_.idx == (*blocks_)[pos_.block].size()) {
+        ++pos_.block;
+        pos_.idx = 0;
+      }
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator ret = *this;
+      ++*this;
+      return ret;
+    }
+    const_iterator &operator--() {
+      if (pos_.idx == 0) {
+        --pos_.block;
+        pos_.idx = (*blocks_)[pos_.block].size();
+      }
+      --pos_.idx;
+      return *this;
+    }
+    const_iterator operator--(int) {
+      const_iterator ret = *this;
+      --*this;
+      return ret;
+    }
+
+    bool operator==(const const_iterator &other) const {
+      return pos_ == other.pos_;
+    }
+    bool operator!=(const const_iterator &other) const {
+      return pos_ != other.pos_;
+    }
+
+   private:
+    const std::vector<block_t> *blocks_;
+    Pos pos_;
+  };
+
+  const_iterator begin() const { return const_iterator(&blocks_, {0, 0}); }
+  const_iterator end() const {
+    return const_iterator(&blocks_, {blocks_.size(), 0});
+  }
+  size_t size() const { return size_; }
 
   // Try to find an entry hitting the given address. Returns end() if there is
   // none.
   const_iterator find(addr_t addr) const {
-    // To find the entry containing addr, use upper_bound to find the first
-    // region strictly after it, and then std::prev to step backwards. This
-    // fails if either the map is empty (obviously!) or if ub_it is already the
-    // beginning of the map.
-    if (map_.empty())
+    // To find the entry containing addr, find the first region strictly after
+    // it and then step backwards. This fails if that region is already the
+    // first one (which is always true if the map is empty).
+    Pos pos = UpperBound(addr);
+    if (IsBegin(pos))
       return end();
 
-    rng_t diag = {.lo = addr, .hi = addr};
-    auto it = map_.upper_bound(diag);
-    if (it == map_.begin())
-      return end();
-
-    --it;
+    pos = Prev(pos);
 
-    // At this point, it will point at the right region if there is one. We
-    // know that it->first.lo <= addr (because of how upper_bound works). We
-    // now just need to check that addr <= it->first.hi.
-    return (addr <= it->first.hi) ? const_iterator(it) : end();
+    // At this point, pos will point at the right region if there is one. We
+    // know that its low address is <= addr (because of how UpperBound works).
+    // We now just need to check that addr is at most its high address.
+    return (addr <= At(pos).first.hi) ? const_iterator(&blocks_, pos) : end();
   }
 
  private:
-  std::map<rng_t, val_t> map_;
+  // Blocks are split in two when they grow past this many entries.
+  static const size_t kMaxBlockSize = 128;
+
+  static bool LoLess(addr_t addr, const entry_t &entry) {
+    return addr < entry.first.lo;
+  }
+
+  bool IsBegin(Pos pos) const { return pos.block == 0 && pos.idx == 0; }
+  bool IsEnd(Pos pos) const { return pos.block == blocks_.size(); }
+
+  entry_t &At(Pos pos) { return blocks_[pos.block][pos.idx]; }
+  const entry_t &At(Pos pos) const { return blocks_[pos.block][pos.idx]; }
+
+  Pos Next(Pos pos) const {
+    if (++pos.idx == blocks_[pos.block].size()) {
+      ++pos.block;
+      pos.idx = 0;
+    }
+    return pos;
+  }
+
+  Pos Prev(Pos pos) const {
+    if (pos.idx == 0) {
+      --pos.block;
+      pos.idx = blocks_[pos.block].size();
+    }
+    --pos.idx;
+    return pos;
+  }
+
+  // Return the position of the first entry that starts strictly above addr
+  // (or the end position if there is none).
+  Pos UpperBound(addr_t addr) const {
+    // The entry we're looking for is either in the last block that starts at
+    // or below addr or (if every entry in that block starts at or below addr)
+    // is the first entry of the block after it.
+    size_t block =
+        std::upper_bound(block_lo_.begin(), block_lo_.end(), addr) -
+        block_lo_.begin();
+    if (block == 0)
+      return {0, 0};
+
+    const block_t &prev = blocks_[block - 1];
+    size_t idx =
+        std::upper_bound(prev.begin(), prev.end(), addr, LoLess) - prev.begin();
+    if (idx == prev.size())
+      return {block, 0};
+
+    return {block - 1, idx};
+  }
+
+  // Insert entry at pos, which must be where it sorts.
+  void InsertAt(Pos pos, entry_t &&entry) {
+    ++size_;
+
+    if (blocks_.empty()) {
+      block_lo_.push_back(entry.first.lo);
+      blocks_.push_back(block_t());
+      blocks_.back().push_back(std::move(entry));
+      return;
+    }
+
+    // Appending to the map adds to the end of the last block.
+    if (IsEnd(pos)) {
+      pos.block = blocks_.size() - 1;
+      pos.idx = blocks_.back().size();
+    }
+
+    block_t &block = blocks_[pos.block];
+    if (pos.idx == 0) {
+      block_lo_[pos.block] = entry.first.lo;
+    }
+    block.insert(block.begin() + pos.idx, std::move(entry));
+
+    if (block.size() > kMaxBlockSize) {
+      // Split the block in two, moving its top half to a new block after it.
+      size_t half = block.size() / 2;
+      block_t upper(std::make_move_iterator(block.begin() + half),
+                    std::make_move_iterator(block.end()));
+      block.erase(block.begin() + half, block.end());
+
+      block_lo_.insert(block_lo_.begin() + pos.block + 1, upper[0].first.lo);
+      blocks_.insert(blocks_.begin() + pos.block + 1, std::move(upper));
+    }
+  }
+
+  // Erase the entries in the range [from, to), which must not start at the
+  // beginning of the map.
+  void EraseRange(Pos from, Pos to) {
+    assert(!IsBegin(from));
+
+    if (from == to)
+      return;
+
+    if (from.block == to.block) {
+      // Since to isn't the end position, this leaves at least one entry in
+      // the block. Since from isn't the first entry, the block's first entry
+      // doesn't change unless from.idx is zero.
+      block_t &block = blocks_[from.block];
+      size_ -= to.idx - from.idx;
+      block.erase(block.begin() + from.idx, block.begin() + to.idx);
+      if (from.idx == 0) {
+        block_lo_[from.block] = block[0].first.lo;
+      }
+      return;
+    }
+
+    // Trim the head of the last block (if to is not the end position) and the
+    // tail of the first block.
+    if (!IsEnd(to)) {
+      block_t &last = blocks_[to.block];
+      size_ -= to.idx;
+      last.erase(last.begin(), last.begin() + to.idx);
+      block_lo_[to.block] = last[0].first.lo;
+    }
+
+    block_t &first = blocks_[from.block];
+    size_ -= first.size() - from.idx;
+    first.erase(first.begin() + from.idx, first.end());
+
+    // Throw away the blocks in between, together with the first block if it
+    // is now empty.
+    size_t del_lo = first.empty() ? from.block : from.block + 1;
+    for (size_t i = from.block + 1; i < to.block; ++i) {
+      size_ -= blocks_[i].size();
+    }
+    blocks_.erase(blocks_.begin() + del_lo, blocks_.begin() + to.block);
+    block_lo_.erase(block_lo_.begin() + del_lo, block_lo_.begin() + to.block);
+  }
+
+  // The blocks of entries and the low address of the first entry in each.
+  std::vector<block_t> blocks_;
+  std::vector<addr_t> block_lo_;
+  size_t size_;
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_CPP_RANGED_MAP_H_
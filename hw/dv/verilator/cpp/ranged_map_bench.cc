@@ -0,0 +1,222 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Microbenchmark and cross-check for RangedMap against the std::map based
+// implementation that it replaced. An optional argument gives the number of
+// segments to insert (default 20000).
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "ranged_map.h"
+
+namespace ref {
+// The original RangedMap, which kept its entries in a std::map and found
+// overlapping entries with a linear scan.
+template <typename addr_t, typename val_t>
+class RangedMap {
+ public:
+  using rng_t = AddrRange<addr_t>;
+  typedef val_t (*MergeFun)(const rng_t &rng0, val_t &&val0, const rng_t &rng1,
+                            val_t &&val1);
+
+  void Emplace(addr_t min_addr, addr_t max_addr, val_t &&new_val,
+               MergeFun merge) {
+    auto hit_lo = map_.end();
+    auto hit_hi = map_.end();
+    rng_t rng = {.lo = min_addr, .hi = max_addr};
+
+    if (!map_.empty()) {
+      auto right_it = map_.upper_bound(rng);
+      hit_hi = right_it;
+      while (hit_hi != map_.end() && hit_hi->first.lo <= max_addr) {
+        ++hit_hi;
+      }
+      hit_lo = right_it;
+      while (hit_lo != map_.begin() &&
+             min_addr <= std::prev(hit_lo)->first.hi) {
+        --hit_lo;
+      }
+    }
+
+    if (hit_lo == hit_hi) {
+      map_.insert(std::make_pair(rng, std::move(new_val)));
+      return;
+    }
+
+    val_t acc = merge(hit_lo->first, std::move(hit_lo->second), rng,
+                      std::move(new_val));
+    min_addr = std::min(min_addr, hit_lo->first.lo);
+    max_addr = std::max(max_addr, hit_lo->first.hi);
+
+    for (auto it = std::next(hit_lo); it != hit_hi; ++it) {
+      rng_t rng1 = {.lo = min_addr, .hi = max_addr};
+      acc = merge(it->first, std::move(it->second), rng1, std::move(acc));
+      min_addr = std::min(min_addr, it->first.lo);
+      max_addr = std::max(max_addr, it->first.hi);
+    }
+
+    map_.erase(hit_lo, hit_hi);
+    rng_t rng1 = {.lo = min_addr, .hi = max_addr};
+    map_.insert(std::make_pair(rng1, std::move(acc)));
+  }
+
+  using map_t = std::map<rng_t, val_t>;
+  using const_iterator = typename map_t::const_iterator;
+
+  const_iterator begin() const { return map_.begin(); }
+  const_iterator end() const { return map_.end(); }
+  size_t size() const { return map_.size(); }
+
+  const_iterator find(addr_t addr) const {
+    if (map_.empty())
+      return end();
+
+    rng_t diag = {.lo = addr, .hi = addr};
+    auto it = map_.upper_bound(diag);
+    if (it == map_.begin())
+      return end();
+
+    --it;
+    return (addr <= it->first.hi) ? it : end();
+  }
+
+ private:
+  map_t map_;
+};
+}  // namespace ref
+
+typedef AddrRange<uint32_t> Rng;
+typedef std::vector<uint8_t> Seg;
+
+// Merge two overlapping segments, with seg1 taking priority. This has the
+// same semantics as StagedMem's MergeSegments, but doesn't try to avoid
+// copies.
+static Seg MergeSegs(const Rng &rng0, Seg &&seg0, const Rng &rng1,
+                     Seg &&seg1) {
+  uint32_t lo = std::min(rng0.lo, rng1.lo);
+  uint32_t hi = std::max(rng0.hi, rng1.hi);
+  Seg ret((size_t)1 + (hi - lo));
+  memcpy(&ret[rng0.lo - lo], seg0.data(), seg0.size());
+  memcpy(&ret[rng1.lo - lo], seg1.data(), seg1.size());
+  return ret;
+}
+
+struct SegDesc {
+  uint32_t lo;
+  Seg data;
+};
+
+static double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Stage segs into a map of type map_t, then do lookups for each address in
+// addrs. Returns the number of lookups that hit, and sets the timings.
+template <typename map_t>
+static size_t Run(const std::vector<SegDesc> &segs,
+                  const std::vector<uint32_t> &addrs, map_t *map,
+                  double *emplace_secs, double *find_secs) {
+  auto start = std::chrono::steady_clock::now();
+  for (const SegDesc &desc : segs) {
+    Seg seg(desc.data);
+    uint32_t hi = desc.lo + seg.size() - 1;
+    map->Emplace(desc.lo, hi, std::move(seg), MergeSegs);
+  }
+  *emplace_secs = SecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  size_t hits = 0;
+  for (uint32_t addr : addrs) {
+    hits += map->find(addr) != map->end();
+  }
+  *find_secs = SecondsSince(start);
+  return hits;
+}
+
+template <typename map0_t, typename map1_t>
+static bool SameContents(const map0_t &map0, const map1_t &map1) {
+  if (map0.size() != map1.size())
+    return false;
+
+  auto it1 = map1.begin();
+  for (auto it0 = map0.begin(); it0 != map0.end(); ++it0, ++it1) {
+    if (it0->first.lo != it1->first.lo || it0->first.hi != it1->first.hi ||
+        it0->second != it1->second)
+      return false;
+  }
+  return true;
+}
+
+// Run both implementations on a set of segments, printing timings and
+// returning whether the results match.
+static bool Compare(const char *name, const std::vector<SegDesc> &segs,
+                    const std::vector<uint32_t> &addrs) {
+  ref::RangedMap<uint32_t, Seg> ref_map;
+  RangedMap<uint32_t, Seg> new_map;
+  double ref_emplace, ref_find, new_emplace, new_find;
+
+  size_t ref_hits = Run(segs, addrs, &ref_map, &ref_emplace, &ref_find);
+  size_t new_hits = Run(segs, addrs, &new_map, &new_emplace, &new_find);
+
+  printf("%s: %zu segments -> %zu entries, %zu lookups\n", name, segs.size(),
+         new_map.size(), addrs.size());
+  printf("  std::map:  emplace %8.4f s, find %8.4f s\n", ref_emplace,
+         ref_find);
+  printf("  RangedMap: emplace %8.4f s, find %8.4f s\n", new_emplace,
+         new_find);
+
+  if (ref_hits != new_hits || !SameContents(ref_map, new_map)) {
+    printf("ERROR: Results differ from std::map implementation.\n");
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  size_t num_segs = (argc > 1) ? strtoul(argv[1], NULL, 0) : 20000;
+
+  std::mt19937 rng(1234);
+
+  // Sections from an ELF file: small and in ascending order, with gaps.
+  std::vector<SegDesc> ascending;
+  uint32_t addr = 0x10000000;
+  for (size_t i = 0; i < num_segs; ++i) {
+    size_t len = 4 + rng() % 64;
+    ascending.push_back({addr, Seg(len, (uint8_t)i)});
+    addr += len + 4 * (rng() % 4);
+  }
+
+  // Randomly placed segments in a small window, so that many of them overlap
+  // and have to be merged. Every so often, add a large segment that swallows
+  // lots of others.
+  std::vector<SegDesc> overlapping;
+  uint32_t window = num_segs * 32;
+  for (size_t i = 0; i < num_segs; ++i) {
+    size_t len = (i % 101 == 100) ? 4096 : 1 + rng() % 64;
+    overlapping.push_back({(uint32_t)(rng() % window), Seg(len, (uint8_t)i)});
+  }
+
+  std::vector<uint32_t> lookups(num_segs * 16);
+  uint32_t span = addr - 0x10000000;
+  for (uint32_t &lookup : lookups) {
+    lookup = 0x10000000 + rng() % span;
+  }
+
+  std::vector<uint32_t> overlapping_lookups(num_segs * 16);
+  for (uint32_t &lookup : overlapping_lookups) {
+    lookup = rng() % window;
+  }
+
+  bool ok = Compare("ascending", ascending, lookups);
+  ok &= Compare("overlapping", overlapping, overlapping_lookups);
+  return ok ? 0 : 1;
+}
@@ -6,10 +6,11 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <sstream>
+#include <thread>
 
-#include "scramble_model.h"
 #include "sv_scoped.h"
 
 // This is the maximum width of a nonce that's supported by the code in
@@ -17,34 +18,6 @@
 static const uint32_t kScrMaxNonceWidth = 320;
 static const uint32_t kScrMaxNonceWidthByte = (kScrMaxNonceWidth + 7) / 8;
 
-// Functions to convert from integer address to/from a little-endian vector of
-// bytes, addr_width is given in bits
-static std::vector<uint8_t> AddrIntToBytes(uint32_t addr, uint32_t addr_width) {
-  uint32_t addr_width_bytes = (addr_width + 7) / 8;
-  std::vector<uint8_t> addr_bytes(addr_width_bytes);
-
-  for (uint32_t i = 0; i < addr_width_bytes; ++i) {
-    addr_bytes[i] = addr & 0xff;
-    addr >>= 8;
-  }
-
-  return addr_bytes;
-}
-
-static uint32_t AddrBytesToInt(const std::vector<uint8_t> &addr) {
-  assert(addr.size() <= 4);
-
-  uint32_t addr_out = 0;
-  int cur_shift = 0;
-
-  for (uint8_t byte : addr) {
-    addr_out |= ((uint32_t)byte << cur_shift);
-    cur_shift += 8;
-  }
-
-  return addr_out;
-}
-
 // Converts svBitVecVal (bit[m:n] SV type) into a byte vector
 static std::vector<uint8_t> ByteVecFromSV(svBitVecVal sv_val[],
                                           uint32_t bytes) {
@@ -81,6 +54,32 @@ static uint32_t vbits(uint32_t size) {
   return width;
 }
 
+// Run fn(begin, end) over [0, count), split into contiguous chunks on up to
+// one thread per core. Small jobs just run on the calling thread.
+static void ParallelFor(uint32_t count,
+                        const std::function<void(uint32_t, uint32_t)> &fn) {
+  const uint32_t kMinItemsPerThread = 256;
+
+  uint32_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+  num_threads = std::min(
+      num_threads, (count + kMinItemsPerThread - 1) / kMinItemsPerThread);
+  if (num_threads <= 1) {
+    fn(0, count);
+    return;
+  }
+
+  uint32_t per_thread = (count + num_threads - 1) / num_threads;
+  std::vector<std::thread> threads;
+  for (uint32_t begin = per_thread; begin < count; begin += per_thread) {
+    threads.emplace_back(fn, begin, std::min(count, begin + per_thread));
+  }
+  fn(0, per_thread);
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
 extern "C" {
 int simutil_get_scramble_key(svBitVecVal *key);
 int simutil_get_scramble_nonce(svBitVecVal *nonce);
@@ -159,12 +158,50 @@ void ScrambledEcc32MemArea::WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
   ScrambleBuffer(buf, dst_word);
 }
 
+void ScrambledEcc32MemArea::SyncKeystreamCache() const {
+  std::vector<uint8_t> key = GetScrambleKey();
+  std::vector<uint8_t> nonce = GetScrambleNonce();
+
+  if (ks_model_ && key == ks_cache_key_ && nonce == ks_cache_nonce_) {
+    return;
+  }
+
+  ks_model_.reset(new ScrambleModel(addr_width_, GetPhysWidth(), 39, nonce,
+                                    GetNonceWidth(), key, repeat_keystream_));
+  KeystreamCacheEntry invalid;
+  invalid.valid = false;
+  ks_cache_.assign(num_words_, invalid);
+  ks_cache_key_ = key;
+  ks_cache_nonce_ = nonce;
+}
+
+const ScrambledEcc32MemArea::KeystreamCacheEntry &
+ScrambledEcc32MemArea::GetKeystreamEntry(uint32_t addr) const {
+  // The public entry points sync the cache before touching any words, but
+  // ToPhysAddr() and the buffer hooks can also be called directly. Sync here
+  // if that has never happened, rather than dereferencing a null ks_model_.
+  // This can't race with the threads in WriteScrambled(), because that has
+  // already synced.
+  if (!ks_model_) {
+    SyncKeystreamCache();
+  }
+  assert(addr < ks_cache_.size());
+
+  KeystreamCacheEntry &entry = ks_cache_[addr];
+  if (!entry.valid) {
+    entry.phys_addr = ks_model_->ScrambleAddr(addr);
+    ks_model_->GenKeystream(addr, entry.keystream);
+    entry.valid = true;
+  }
+  return entry;
+}
+
 std::vector<uint8_t> ScrambledEcc32MemArea::ReadUnscrambled(
     const uint8_t buf[SV_MEM_WIDTH_BYTES], uint32_t src_word) const {
-  std::vector<uint8_t> scrambled_data(buf, buf + GetPhysWidthByte());
-  return scramble_decrypt_data(
-      scrambled_data, GetPhysWidth(), 39, AddrIntToBytes(src_word, addr_width_),
-      addr_width_, GetScrambleNonce(), GetScrambleKey(), repeat_keystream_);
+  const KeystreamCacheEntry &entry = GetKeystreamEntry(src_word);
+  std::vector<uint8_t> unscrambled(GetPhysWidthByte());
+  ks_model_->DecryptDataWithKeystream(buf, &unscrambled[0], entry.keystream);
+  return unscrambled;
 }
 
 void ScrambledEcc32MemArea::ReadBuffer(std::vector<uint8_t> &data,
@@ -191,20 +228,102 @@ void ScrambledEcc32MemArea::WriteBufferWithIntegrity(
 
 void ScrambledEcc32MemArea::ScrambleBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
                                            uint32_t dst_word) const {
-  std::vector<uint8_t> scramble_buf(buf, buf + GetPhysWidthByte());
+  // Scramble data with integrity, in place
+  const KeystreamCacheEntry &entry = GetKeystreamEntry(dst_word);
+  ks_model_->EncryptDataWithKeystream(buf, buf, entry.keystream);
+}
 
-  // Scramble data with integrity
-  scramble_buf = scramble_encrypt_data(
-      scramble_buf, GetPhysWidth(), 39, AddrIntToBytes(dst_word, addr_width_),
-      addr_width_, GetScrambleNonce(), GetScrambleKey(), repeat_keystream_);
+uint32_t ScrambledEcc32MemArea::ToPhysAddr(uint32_t logical_addr) const {
+  return GetKeystreamEntry(logical_addr).phys_addr;
+}
 
-  // Copy scrambled data to write buffer
-  std::copy(scramble_buf.begin(), scramble_buf.end(), &buf[0]);
+std::vector<uint8_t> ScrambledEcc32MemArea::Read(uint32_t word_offset,
+                                                 uint32_t num_words) const {
+  SyncKeystreamCache();
+  return Ecc32MemArea::Read(word_offset, num_words);
 }
 
-uint32_t ScrambledEcc32MemArea::ToPhysAddr(uint32_t logical_addr) const {
-  // Scramble logical address to get physical address
-  return AddrBytesToInt(scramble_addr(AddrIntToBytes(logical_addr, addr_width_),
-                                      addr_width_, GetScrambleNonce(),
-                                      GetNonceWidth()));
+Ecc32MemArea::EccWords ScrambledEcc32MemArea::ReadWithIntegrity(
+    uint32_t word_offset, uint32_t num_words) const {
+  SyncKeystreamCache();
+  return Ecc32MemArea::ReadWithIntegrity(word_offset, num_words);
+}
+
+void ScrambledEcc32MemArea::WriteWithIntegrity(uint32_t word_offset,
+                                               const EccWords &data) const {
+  SyncKeystreamCache();
+  Ecc32MemArea::WriteWithIntegrity(word_offset, data);
+}
+
+void ScrambledEcc32MemArea::Write(uint32_t word_offset,
+                                  const std::vector<uint8_t> &data) const {
+  uint32_t data_words = (data.size() + width_byte_ - 1) / width_byte_;
+  assert(word_offset + data_words <= num_words_);
+
+  WriteScrambled(word_offset, data_words,
+                 [&](uint8_t *buf, uint32_t i, uint32_t dst_word) {
+                   Ecc32MemArea::WriteBuffer(buf, data, i * width_byte_,
+                                             dst_word);
+                 });
+}
+
+void ScrambledEcc32MemArea::Fill(const std::vector<uint8_t> &pattern,
+                                 uint32_t word_offset,
+                                 uint32_t num_words) const {
+  assert(word_offset <= num_words_ && num_words <= num_words_ - word_offset);
+
+  // The integrity bits only depend on the data, so compute them once.
+  std::vector<uint8_t> word = ExpandFillPattern(pattern);
+  uint8_t ecc_buf[SV_MEM_WIDTH_BYTES] = {0};
+  Ecc32MemArea::WriteBuffer(ecc_buf, word, 0, word_offset);
+
+  WriteScrambled(word_offset, num_words,
+                 [&](uint8_t *buf, uint32_t i, uint32_t dst_word) {
+                   memcpy(buf, ecc_buf, SV_MEM_WIDTH_BYTES);
+                 });
+}
+
+void ScrambledEcc32MemArea::WriteScrambled(uint32_t word_offset,
+                                           uint32_t num_words,
+                                           const EncodeFn &encode) const {
+  SyncKeystreamCache();
+
+  // Compute the scrambled physical word for each logical word, together with
+  // its physical address.
+  std::vector<uint8_t> phys_words(num_words * SV_MEM_WIDTH_BYTES, 0);
+  std::vector<std::pair<uint32_t, uint32_t>> addrs(num_words);
+  ParallelFor(num_words, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; ++i) {
+      uint32_t dst_word = word_offset + i;
+      const KeystreamCacheEntry &entry = GetKeystreamEntry(dst_word);
+
+      uint8_t *buf = &phys_words[i * SV_MEM_WIDTH_BYTES];
+      encode(buf, i, dst_word);
+      ks_model_->EncryptDataWithKeystream(buf, buf, entry.keystream);
+      addrs[i] = std::make_pair(entry.phys_addr, i);
+    }
+  });
+
+  // Address scrambling permutes the words in the memory. Sort the words by
+  // physical address so that we can write consecutive physical words with a
+  // single DPI call.
+  std::sort(addrs.begin(), addrs.end());
+
+  uint8_t bulkbuf[SV_MEM_BULK_BYTES] = {0};
+  uint32_t run_len = 0;
+  for (size_t i = 0; i < addrs.size(); ++i) {
+    memcpy(&bulkbuf[run_len * SV_MEM_WIDTH_BYTES],
+           &phys_words[addrs[i].second * SV_MEM_WIDTH_BYTES],
+           SV_MEM_WIDTH_BYTES);
+    ++run_len;
+
+    bool run_done = (i + 1 == addrs.size()) || run_len == SV_MEM_BULK_WORDS ||
+                    addrs[i + 1].first != addrs[i].first + 1;
+    if (run_done) {
+      uint32_t first = i + 1 - run_len;
+      WriteFromBulkbuf(addrs[first].first, run_len, bulkbuf,
+                       word_offset + addrs[first].second);
+      run_len = 0;
+    }
+  }
 }
@@ -5,9 +5,12 @@
 #ifndef OPENTITAN_HW_DV_VERILATOR_CPP_SCRAMBLED_ECC32_MEM_AREA_H_
 #define OPENTITAN_HW_DV_VERILATOR_CPP_SCRAMBLED_ECC32_MEM_AREA_H_
 
+#include <functional>
+#include <memory>
 #include <vector>
 
 #include "ecc32_mem_area.h"
+#include "scramble_model.h"
 
 /**
  * A memory that implements scrambling over a 32-bit ECC integrity protection
@@ -32,6 +35,34 @@ class ScrambledEcc32MemArea : public Ecc32MemArea {
   ScrambledEcc32MemArea(const std::string &scope, uint32_t size,
                         uint32_t width_32, bool repeat_keystream = true);
 
+  /** Write data to this memory area at the given word offset
+   *
+   * This has the same effect as MemArea::Write, but prepares the whole image
+   * before sending it to the simulator. The words are given integrity bits and
+   * scrambled in parallel on several threads, using cached keystreams where
+   * possible (see WriteScrambled), and then written in order of physical
+   * address with the bulk DPI functions.
+   */
+  void Write(uint32_t word_offset,
+             const std::vector<uint8_t> &data) const override;
+
+  /** Fill a range of words with a repeating pattern (see MemArea::Fill)
+   *
+   * The integrity bits are computed once for the pattern and the rest of the
+   * work is done like Write.
+   */
+  void Fill(const std::vector<uint8_t> &pattern, uint32_t word_offset,
+            uint32_t num_words) const override;
+
+  // The read and write methods below check the key and nonce once and then
+  // use the cached keystreams and physical addresses for each word.
+  std::vector<uint8_t> Read(uint32_t word_offset,
+                            uint32_t num_words) const override;
+  EccWords ReadWithIntegrity(uint32_t word_offset,
+                             uint32_t num_words) const override;
+  void WriteWithIntegrity(uint32_t word_offset,
+                          const EccWords &data) const override;
+
  private:
   void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
                    const std::vector<uint8_t> &data, size_t start_idx,
@@ -65,6 +96,40 @@ class ScrambledEcc32MemArea : public Ecc32MemArea {
   std::vector<uint8_t> GetScrambleKey() const;
   std::vector<uint8_t> GetScrambleNonce() const;
 
+  // Compute physical words for num_words logical words starting at
+  // word_offset and write them to the memory. encode(buf, i, dst_word) should
+  // fill buf with the unscrambled physical bits (data and integrity) for the
+  // i'th word. It will be called from several threads at once.
+  typedef std::function<void(uint8_t *, uint32_t, uint32_t)> EncodeFn;
+  void WriteScrambled(uint32_t word_offset, uint32_t num_words,
+                      const EncodeFn &encode) const;
+
+  // A cached keystream and scrambled address for a logical address
+  struct KeystreamCacheEntry {
+    bool valid;
+    uint32_t phys_addr;
+    uint64_t keystream[ScrambleModel::kKeystreamWords];
+  };
+
+  // Read the current key and nonce from the simulation. If either has
+  // changed, rebuild ks_model_ and throw away the cached keystreams. Each
+  // public read or write calls this once before touching any words.
+  void SyncKeystreamCache() const;
+
+  // Get the cache entry for a logical address, computing it if necessary
+  // (and building ks_model_ if the cache has never been synced). Different
+  // threads may call this at once for different addresses once the cache has
+  // been synced.
+  const KeystreamCacheEntry &GetKeystreamEntry(uint32_t addr) const;
+
+  // The keystream and scrambled address for a word only depend on the key,
+  // nonce and logical address. ks_cache_ is indexed by logical address and
+  // is valid for ks_cache_key_ and ks_cache_nonce_, which were used to build
+  // ks_model_.
+  mutable std::vector<KeystreamCacheEntry> ks_cache_;
+  mutable std::vector<uint8_t> ks_cache_key_, ks_cache_nonce_;
+  mutable std::unique_ptr<ScrambleModel> ks_model_;
+
   std::string scr_scope_;
   uint32_t addr_width_;
   bool repeat_keystream_;
@@ -66,20 +66,25 @@ static LoadArg ParseMemArg(std::string mem_argument) {
 static void PrintHelp() {
   std::cout << "Simulation memory utilities:\n\n"
                "-r|--rominit=FILE\n"
-               "  Initialize the ROM with FILE (elf/vmem)\n\n"
+               "  Initialize the ROM with FILE (elf/vmem/memimg)\n\n"
                "-m|--raminit=FILE\n"
-               "  Initialize the RAM with FILE (elf/vmem)\n\n"
+               "  Initialize the RAM with FILE (elf/vmem/memimg)\n\n"
                "-f|--flashinit=FILE\n"
-               "  Initialize the FLASH with FILE (elf/vmem)\n\n"
+               "  Initialize the FLASH with FILE (elf/vmem/memimg)\n\n"
                "-l|--meminit=NAME,FILE[,TYPE]\n"
                "  Initialize memory region NAME with FILE [of TYPE]\n"
-               "  TYPE is either 'elf' or 'vmem'\n\n"
+               "  TYPE is one of 'elf', 'vmem', 'vmem-logical' or 'memimg'\n"
+               "  ('vmem' holds physical memory words, including any ECC\n"
+               "  bits and scrambling; 'vmem-logical' holds logical data)\n\n"
                "-E|--load-elf=FILE\n"
                "  Load ELF file, using segment LMAs to pick memory regions\n\n"
                "-l list|--meminit=list\n"
                "  Print registered memory regions\n\n"
                "--verbose-mem-load\n"
                "  Print a message for each memory load\n\n"
+               "--bench-mem-access=NAME\n"
+               "  After loading memories, time per-word and bulk backdoor\n"
+               "  accesses to memory region NAME\n\n"
                "-h|--help\n"
                "  Show help\n\n";
 }
@@ -102,10 +107,12 @@ bool VerilatorMemUtil::ParseCLIArguments(int argc, char **argv,
       {"meminit", required_argument, nullptr, 'l'},
       {"verbose-mem-load", no_argument, nullptr, 'V'},
       {"load-elf", required_argument, nullptr, 'E'},
+      {"bench-mem-access", required_argument, nullptr, 'A'},
       {"help", no_argument, nullptr, 'h'},
       {nullptr, no_argument, nullptr, 0}};
 
   std::vector<LoadArg> load_args;
+  std::vector<std::string> bench_mems;
   bool verbose = false;
 
   // Reset the command parsing index in-case other utils have already parsed
@@ -162,6 +169,9 @@ bool VerilatorMemUtil::ParseCLIArguments(int argc, char **argv,
         load_args.push_back(
             {.name = "", .filepath = optarg, .type = kMemImageElf});
         break;
+      case 'A':
+        bench_mems.push_back(optarg);
+        break;
       case 'h':
         PrintHelp();
         return true;
@@ -190,5 +200,56 @@ bool VerilatorMemUtil::ParseCLIArguments(int argc, char **argv,
     }
   }
 
+  for (const std::string &name : bench_mems) {
+    try {
+      mem_util_->BenchmarkMemAccess(name);
+    } catch (const std::exception &err) {
+      std::cerr << "ERROR: " << err.what() << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool VerilatorMemUtil::SaveState(std::ostream &os) {
+  os << mem_util_->GetStagedElfPath() << "\n";
+  return os.good();
+}
+
+bool VerilatorMemUtil::RestoreState(std::istream &is) {
+  std::string path;
+  if (!std::getline(is, path)) {
+    std::cerr << "ERROR: Truncated memory utility state in checkpoint."
+              << std::endl;
+    return false;
+  }
+  if (path.empty()) {
+    return true;
+  }
+
+  // Stage the ELF file again without writing it to memory: the memories
+  // already hold whatever was loaded when the checkpoint was saved.
+  try {
+    mem_util_->StageElf(false, path);
+  } catch (const std::exception &err) {
+    std::cerr << "ERROR: Failed to stage ELF file from checkpoint: "
+              << err.what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool VerilatorMemUtil::OnBatchEntry(bool first) {
+  try {
+    if (first) {
+      mem_util_->SnapshotMemories(&batch_snapshot_);
+    } else {
+      mem_util_->RestoreMemories(batch_snapshot_);
+    }
+  } catch (const std::exception &err) {
+    std::cerr << "ERROR: " << err.what() << std::endl;
+    return false;
+  }
   return true;
 }
@@ -22,6 +22,19 @@ class VerilatorMemUtil : public SimCtrlExtension {
 
   // Declared in SimCtrlExtension
   bool ParseCLIArguments(int argc, char **argv, bool &exit_app) override;
+  std::string GetName() const override { return "memutil"; }
+
+  // Save and restore the path of the staged ELF file. The loaded memories are
+  // part of the model state, but the staging area (and anything a subclass
+  // computes from the ELF file in OnElfLoaded) is not.
+  bool SaveState(std::ostream &os) override;
+  bool RestoreState(std::istream &is) override;
+
+  // Snapshot all registered memories at the start of the first batch entry
+  // and restore them at the start of every later one, so that memories an
+  // entry doesn't load (like an erased flash bank) don't keep the previous
+  // entry's contents.
+  bool OnBatchEntry(bool first) override;
 
   // Get underlying DpiMemUtil object
   DpiMemUtil *GetUnderlying() { return mem_util_; }
@@ -35,6 +48,7 @@ class VerilatorMemUtil : public SimCtrlExtension {
  private:
   DpiMemUtil *mem_util_;
   std::unique_ptr<DpiMemUtil> allocation_;
+  DpiMemUtil::MemSnapshot batch_snapshot_;
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_CPP_VERILATOR_MEMUTIL_H_
@@ -0,0 +1,39 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Convert a vmem file to a binary memory image (see mem_image.h), which can
+// then be loaded with --meminit=NAME,FILE,memimg.
+//
+// Memory images are copied into the memory array as-is, so the vmem file
+// should contain physical memory words (for example, a flash or OTP image that
+// already has its ECC bits and scrambling applied), as for a 'vmem' load.
+
+#include <cstdio>
+#include <stdexcept>
+
+#include "mem_area.h"
+#include "mem_image.h"
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s IN.vmem OUT.memimg\n", argv[0]);
+    return 1;
+  }
+
+  try {
+    MemImage image = ParseVmem(argv[1], SV_MEM_WIDTH_BITS);
+    WriteMemImage(argv[2], image);
+
+    size_t num_words = 0;
+    for (const MemImage::Run &run : image.runs) {
+      num_words += run.num_words;
+    }
+    printf("Wrote %zu %u-bit words in %zu runs to `%s'.\n", num_words,
+           image.word_bits, image.runs.size(), argv[2]);
+  } catch (const std::exception &err) {
+    fprintf(stderr, "ERROR: %s\n", err.what());
+    return 1;
+  }
+  return 0;
+}
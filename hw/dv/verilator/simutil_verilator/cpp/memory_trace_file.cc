@@ -0,0 +1,51 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// This is defined by Verilator and passed through the command line
+#ifndef VM_TRACE
+#define VM_TRACE 0
+#endif
+
+// Only VCD traces let us replace the file layer. The FST writer opens and
+// writes its own files.
+#if VM_TRACE == 1 && !defined(VM_TRACE_FMT_FST)
+
+#include "memory_trace_file.h"
+
+#include <cassert>
+#include <fstream>
+
+MemoryTraceFile::MemoryTraceFile() : cur_(0), num_segs_(0) {}
+
+bool MemoryTraceFile::open(const std::string &name) {
+  if (num_segs_) {
+    cur_ ^= 1;
+  }
+  if (num_segs_ < 2) {
+    ++num_segs_;
+  }
+  // clear() keeps the capacity, so the segment being overwritten donates its
+  // buffer to the new one.
+  segs_[cur_].clear();
+  return true;
+}
+
+ssize_t MemoryTraceFile::write(const char *bufp, ssize_t len) {
+  assert(len >= 0);
+  segs_[cur_].insert(segs_[cur_].end(), bufp, bufp + len);
+  return len;
+}
+
+bool MemoryTraceFile::WriteSegment(bool prev, const std::string &path) const {
+  if (num_segs_ < (prev ? 2u : 1u)) {
+    return true;
+  }
+
+  const std::vector<char> &seg = segs_[prev ? cur_ ^ 1 : cur_];
+  std::ofstream os(path, std::ios::binary | std::ios::trunc);
+  os.write(seg.data(), seg.size());
+  return os.good();
+}
+
+#endif  // VM_TRACE == 1 && !defined(VM_TRACE_FMT_FST)
@@ -0,0 +1,53 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_MEMORY_TRACE_FILE_H_
+#define OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_MEMORY_TRACE_FILE_H_
+
+#include <string>
+#include <vector>
+
+#include "verilated_vcd_c.h"
+
+/**
+ * A VCD output file that keeps the last two files in memory
+ *
+ * This is used by the flight recorder (see --trace-flight-recorder in
+ * VerilatorSimCtrl). Each open() starts a new segment, which replaces the
+ * older of the two segments held. Nothing goes to disk until WriteSegment()
+ * is called, so a passing run only pays for formatting value changes.
+ *
+ * Memory usage is bounded by the size of two segments. Buffers are reused, so
+ * once both segments have been filled, the steady state doesn't allocate.
+ */
+class MemoryTraceFile : public VerilatedVcdFile {
+ public:
+  MemoryTraceFile();
+
+  MemoryTraceFile(const MemoryTraceFile &) = delete;
+  void operator=(const MemoryTraceFile &) = delete;
+
+  bool open(const std::string &name) override;
+  void close() override {}
+  ssize_t write(const char *bufp, ssize_t len) override;
+
+  /**
+   * Write a segment to a file
+   *
+   * @param prev If true, write the segment before the current one
+   * @param path The file to write
+   * @return false if the file couldn't be written. Returns true without
+   *         creating a file if there is no such segment.
+   */
+  bool WriteSegment(bool prev, const std::string &path) const;
+
+ private:
+  std::vector<char> segs_[2];
+  // The index in segs_ of the current segment
+  unsigned int cur_;
+  // The number of segments that have been opened (capped at 2)
+  unsigned int num_segs_;
+};
+
+#endif  // OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_MEMORY_TRACE_FILE_H_
@@ -5,6 +5,9 @@
 #ifndef OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_EXTENSION_H_
 #define OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_EXTENSION_H_
 
+#include <iosfwd>
+#include <string>
+
 class SimCtrlExtension {
  public:
   virtual ~SimCtrlExtension() = default;
@@ -29,6 +32,13 @@ class SimCtrlExtension {
     return true;
   }
 
+  /**
+   * Get a short name for the extension, used to label it in profiles
+   *
+   * If this is empty, the extension is labelled with its index instead.
+   */
+  virtual std::string GetName() const { return ""; }
+
   /**
    * Function to be called prior to executing the simulation
    */
@@ -43,6 +53,44 @@ class SimCtrlExtension {
    * Function to be called after executing the simulation
    */
   virtual void PostExec() {}
+
+  /**
+   * Function to be called at the start of each entry of a batch run (see
+   * --batch in VerilatorSimCtrl), before the entry's arguments are passed to
+   * ParseCLIArguments()
+   *
+   * For every entry but the first, the design is held in reset. An extension
+   * should put anything the previous entry might have changed (such as memory
+   * contents) back to how it was at the start of the first entry, so that
+   * entries don't depend on each other.
+   *
+   * @param first Whether this is the first entry of the batch
+   * @return Return code, true == success
+   */
+  virtual bool OnBatchEntry(bool first) { return true; }
+
+  /**
+   * Save any state held outside of the verilated model to a checkpoint
+   *
+   * State stored in the design itself (including memories loaded by the
+   * extension) is saved with the model and doesn't need handling here.
+   *
+   * @param os Stream to write the state to
+   * @return Return code, true == success
+   */
+  virtual bool SaveState(std::ostream &os) { return true; }
+
+  /**
+   * Restore state written by SaveState()
+   *
+   * This is called before ParseCLIArguments(), so anything loaded in response
+   * to command line arguments will take priority over restored state. If it
+   * returns false, the checkpoint is not used and the simulation doesn't run.
+   *
+   * @param is Stream to read the state from
+   * @return Return code, true == success
+   */
+  virtual bool RestoreState(std::istream &is) { return true; }
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_EXTENSION_H_
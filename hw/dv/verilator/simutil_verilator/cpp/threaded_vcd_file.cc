@@ -0,0 +1,131 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// This is defined by Verilator and passed through the command line
+#ifndef VM_TRACE
+#define VM_TRACE 0
+#endif
+
+// The threaded writer only makes sense for VCD traces: the FST writer does its
+// own buffering and compression (on a separate thread if Verilator was run
+// with --trace-threads).
+#if VM_TRACE == 1 && !defined(VM_TRACE_FMT_FST)
+
+#include "threaded_vcd_file.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+ThreadedVcdFile::ThreadedVcdFile(size_t max_queued_bufs)
+    : fd_(-1),
+      max_queued_bufs_(max_queued_bufs),
+      stopping_(false),
+      bytes_queued_(0),
+      max_depth_seen_(0),
+      stall_time_(0) {
+  assert(max_queued_bufs > 0);
+}
+
+ThreadedVcdFile::~ThreadedVcdFile() { close(); }
+
+bool ThreadedVcdFile::open(const std::string &name) {
+  assert(fd_ < 0);
+
+  fd_ = ::open(name.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0666);
+  if (fd_ < 0) {
+    return false;
+  }
+
+  stopping_ = false;
+  thread_ = std::thread(&ThreadedVcdFile::WriterThread, this);
+  return true;
+}
+
+void ThreadedVcdFile::close() {
+  if (fd_ < 0) {
+    return;
+  }
+
+  // Tell the writer thread to finish off anything that's still queued and
+  // then wait for it to exit.
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  not_empty_.notify_one();
+  thread_.join();
+
+  ::close(fd_);
+  fd_ = -1;
+}
+
+ssize_t ThreadedVcdFile::write(const char *bufp, ssize_t len) {
+  assert(len >= 0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  if (queue_.size() >= max_queued_bufs_) {
+    auto stall_begin = std::chrono::steady_clock::now();
+    not_full_.wait(lock, [this] { return queue_.size() < max_queued_bufs_; });
+    stall_time_ += std::chrono::steady_clock::now() - stall_begin;
+  }
+
+  std::vector<char> buf;
+  if (!free_bufs_.empty()) {
+    buf = std::move(free_bufs_.back());
+    free_bufs_.pop_back();
+  }
+  buf.assign(bufp, bufp + len);
+
+  queue_.push_back(std::move(buf));
+  bytes_queued_ += len;
+  max_depth_seen_ = std::max(max_depth_seen_, queue_.size());
+
+  lock.unlock();
+  not_empty_.notify_one();
+
+  // Report the whole buffer as written. Any error from the writer thread is
+  // reported there: Verilator would only close the trace in response anyway.
+  return len;
+}
+
+void ThreadedVcdFile::WriterThread() {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (true) {
+    not_empty_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      // We only get here if stopping_ is set and there's nothing left to do.
+      return;
+    }
+
+    std::vector<char> buf = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    not_full_.notify_one();
+
+    const char *wp = buf.data();
+    size_t remaining = buf.size();
+    while (remaining) {
+      ssize_t got = ::write(fd_, wp, remaining);
+      if (got > 0) {
+        wp += got;
+        remaining -= got;
+      } else if (got < 0 && errno != EINTR) {
+        std::cerr << "ERROR: Failed to write trace data (errno " << errno
+                  << "). Dropping the rest of this buffer." << std::endl;
+        break;
+      }
+    }
+
+    lock.lock();
+    free_bufs_.push_back(std::move(buf));
+  }
+}
+
+#endif  // VM_TRACE == 1 && !defined(VM_TRACE_FMT_FST)
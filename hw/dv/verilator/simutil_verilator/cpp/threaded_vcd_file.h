@@ -0,0 +1,78 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_THREADED_VCD_FILE_H_
+#define OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_THREADED_VCD_FILE_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "verilated_vcd_c.h"
+
+/**
+ * A VCD output file that writes from a background thread
+ *
+ * Verilator's VCD tracer formats value changes into an internal buffer and
+ * hands that buffer to a VerilatedVcdFile whenever it fills up. The default
+ * implementation calls write() on the simulation thread. This class copies
+ * each buffer into a bounded queue instead and returns immediately; a
+ * separate writer thread drains the queue to disk.
+ *
+ * If the writer thread falls behind and the queue already holds
+ * max_queued_bufs buffers, write() blocks until there is space again. This
+ * bounds memory usage; the time spent blocking is reported by
+ * GetStallTime().
+ */
+class ThreadedVcdFile : public VerilatedVcdFile {
+ public:
+  explicit ThreadedVcdFile(size_t max_queued_bufs);
+  ~ThreadedVcdFile() override;
+
+  ThreadedVcdFile(const ThreadedVcdFile &) = delete;
+  void operator=(const ThreadedVcdFile &) = delete;
+
+  bool open(const std::string &name) override;
+  void close() override;
+  ssize_t write(const char *bufp, ssize_t len) override;
+
+  /** Total number of bytes handed to the writer thread */
+  uint64_t GetBytesQueued() const { return bytes_queued_; }
+
+  /** Largest number of buffers that were waiting at any time */
+  size_t GetMaxQueueDepth() const { return max_depth_seen_; }
+
+  /** Configured maximum number of waiting buffers */
+  size_t GetQueueLimit() const { return max_queued_bufs_; }
+
+  /** Time the simulation thread spent waiting for space in the queue */
+  std::chrono::nanoseconds GetStallTime() const { return stall_time_; }
+
+ private:
+  void WriterThread();
+
+  int fd_;
+  size_t max_queued_bufs_;
+
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::deque<std::vector<char>> queue_;
+  // Buffers that have been written out and can be reused, so that the
+  // steady state doesn't allocate.
+  std::vector<std::vector<char>> free_bufs_;
+  bool stopping_;
+  std::thread thread_;
+
+  uint64_t bytes_queued_;
+  size_t max_depth_seen_;
+  std::chrono::nanoseconds stall_time_;
+};
+
+#endif  // OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_THREADED_VCD_FILE_H_
@@ -43,6 +43,13 @@
 #endif
 #endif
 
+// VM_SAVABLE must be set by the user when calling Verilator with --savable.
+// It enables saving and restoring the model state (see VerilatedToplevel::save
+// and VerilatedToplevel::restore).
+#ifdef VM_SAVABLE
+#include "verilated_save.h"
+#endif
+
 #if VM_TRACE == 1
 /**
  * "Base" for all tracers in Verilator with common functionality
@@ -67,6 +74,20 @@ class VerilatedTracer {
 
   void dump(vluint64_t timeui) { impl_->dump(timeui); }
 
+#ifndef VM_TRACE_FMT_FST
+  /**
+   * Write the trace through a custom file object (which is not owned).
+   *
+   * This replaces the underlying tracer, so must be called before the tracer
+   * is attached to the toplevel with trace().
+   */
+  void setFile(VerilatedVcdFile *filep) {
+    assert(!impl_->isOpen());
+    delete impl_;
+    impl_ = new VM_TRACE_CLASS_NAME(filep);
+  }
+#endif
+
   operator VM_TRACE_CLASS_NAME *() const {
     assert(impl_);
     return impl_;
@@ -123,6 +144,18 @@ class VerilatedToplevel {
   virtual const char *name() const = 0;
   virtual void trace(VerilatedTracer &tfp, int levels, int options) = 0;
 
+#ifdef VM_SAVABLE
+  /**
+   * Serialize the complete state of the model to os
+   */
+  virtual void save(VerilatedSerialize &os) = 0;
+
+  /**
+   * Replace the state of the model with one previously written by save()
+   */
+  virtual void restore(VerilatedDeserialize &os) = 0;
+#endif
+
   /**
    * Get the Verilator-generated device under test
    *
@@ -150,6 +183,14 @@ class TOPLEVEL_NAME : public VERILATED_TOPLEVEL_NAME, public VerilatedToplevel {
     assert(0 && "Tracing not enabled.");
 #endif
   }
+#ifdef VM_SAVABLE
+  void save(VerilatedSerialize &os) {
+    os << static_cast<VERILATED_TOPLEVEL_NAME &>(*this);
+  }
+  void restore(VerilatedDeserialize &os) {
+    os >> static_cast<VERILATED_TOPLEVEL_NAME &>(*this);
+  }
+#endif
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_VERILATED_TOPLEVEL_H_
@@ -4,10 +4,13 @@
 
 #include "verilator_sim_ctrl.h"
 
+#include <fstream>
 #include <getopt.h>
 #include <iostream>
 #include <signal.h>
+#include <sstream>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <verilated.h>
 
 // This is defined by Verilator and passed through the command line
@@ -110,10 +113,18 @@ static bool read_ul_arg(unsigned long *arg_val, const char *arg_name,
 bool VerilatorSimCtrl::ParseCommandArgs(int argc, char **argv, bool &exit_app) {
   const struct option long_options[] = {
       {"term-after-cycles", required_argument, nullptr, 'c'},
+      {"save-checkpoint", required_argument, nullptr, 's'},
+      {"restore-checkpoint", required_argument, nullptr, 'R'},
       {"trace", optional_argument, nullptr, 't'},
+      {"trace-threaded", optional_argument, nullptr, 'T'},
+      {"trace-flight-recorder", required_argument, nullptr, 'F'},
+      {"profile", optional_argument, nullptr, 'P'},
+      {"batch", required_argument, nullptr, 'B'},
       {"help", no_argument, nullptr, 'h'},
       {nullptr, no_argument, nullptr, 0}};
 
+  std::string restore_path;
+
   while (1) {
     int c = getopt_long(argc, argv, "-:c:th", long_options, nullptr);
     if (c == -1) {
@@ -139,12 +150,82 @@ bool VerilatorSimCtrl::ParseCommandArgs(int argc, char **argv, bool &exit_app) {
         }
         TraceOn();
         break;
+      case 'T':
+        if (optarg != nullptr &&
+            !read_ul_arg(&trace_queue_depth_, "trace-threaded", optarg)) {
+          exit_app = true;
+          return false;
+        }
+        if (trace_queue_depth_ == 0) {
+          std::cerr << "ERROR: The trace queue depth must be positive."
+                    << std::endl;
+          exit_app = true;
+          return false;
+        }
+#ifdef VM_TRACE_FMT_FST
+        std::cout << "WARNING: --trace-threaded has no effect on FST traces. "
+                     "Verilate with --trace-threads to compress FST traces on "
+                     "a separate thread."
+                  << std::endl;
+#endif
+        trace_threaded_ = true;
+        break;
+      case 'F':
+        if (!tracing_possible_) {
+          std::cerr << "ERROR: Tracing has not been enabled at compile time."
+                    << std::endl;
+          exit_app = true;
+          return false;
+        }
+#ifdef VM_TRACE_FMT_FST
+        std::cerr << "ERROR: The flight recorder only supports VCD traces. The "
+                     "FST writer manages its own files, so it can't keep "
+                     "segments in memory."
+                  << std::endl;
+        exit_app = true;
+        return false;
+#endif
+        if (!read_ul_arg(&flight_recorder_cycles_, "trace-flight-recorder",
+                         optarg)) {
+          exit_app = true;
+          return false;
+        }
+        if (flight_recorder_cycles_ == 0) {
+          std::cerr << "ERROR: The flight recorder needs a positive number of "
+                       "cycles."
+                    << std::endl;
+          exit_app = true;
+          return false;
+        }
+        TraceOn();
+        break;
+      case 'B':
+        if (!ParseBatchManifest(optarg)) {
+          exit_app = true;
+          return false;
+        }
+        break;
+      case 'P':
+        profiling_ = true;
+        if (optarg != nullptr) {
+          profile_path_.assign(optarg);
+        }
+        break;
       case 'c':
         if (!read_ul_arg(&term_after_cycles_, "term-after-cycles", optarg)) {
           exit_app = true;
           return false;
         }
         break;
+      case 's':
+        if (!ParseSaveCheckpointArg(optarg)) {
+          exit_app = true;
+          return false;
+        }
+        break;
+      case 'R':
+        restore_path.assign(optarg);
+        break;
       case 'h':
         PrintHelp();
         exit_app = true;
@@ -163,6 +244,14 @@ bool VerilatorSimCtrl::ParseCommandArgs(int argc, char **argv, bool &exit_app) {
   // Pass args to verilator
   Verilated::commandArgs(argc, argv);
 
+  // Restore from a checkpoint before the extensions see their arguments: the
+  // checkpoint contains the contents of all memories, which would otherwise
+  // overwrite anything loaded by the memory utilities.
+  if (!restore_path.empty() && !RestoreCheckpoint(restore_path)) {
+    exit_app = true;
+    return false;
+  }
+
   // Parse arguments for all registered extensions
   for (auto it = extension_array_.begin(); it != extension_array_.end(); ++it) {
     if (!(*it)->ParseCLIArguments(argc, argv, exit_app)) {
@@ -190,15 +279,36 @@ void VerilatorSimCtrl::RunSimulation() {
     (*it)->PreExec();
   }
   // Run the simulation
-  Run();
+  if (batch_entries_.empty()) {
+    Run();
+  } else {
+    RunBatch();
+  }
   // Call all extension post-exec methods
   for (auto it = extension_array_.begin(); it != extension_array_.end(); ++it) {
     (*it)->PostExec();
   }
   // Print simulation speed info
   PrintStatistics();
+  if (profiling_) {
+    PrintProfile();
+    if (!WriteProfileJson()) {
+      std::cerr << "ERROR: Could not write profile to `" << profile_path_
+                << "'." << std::endl;
+    }
+  }
   // Print helper message for tracing
-  if (TracingEverEnabled()) {
+  if (flight_recorder_cycles_) {
+    if (flight_recorder_kept_) {
+      std::cout << std::endl
+                << "The flight recorder kept the last cycles of the failing "
+                   "simulation. View them by calling"
+                << std::endl
+                << "$ gtkwave " << GetTraceFileName() << std::endl
+                << "(Earlier cycles, if any, are in " << GetPrevTraceFileName()
+                << ")" << std::endl;
+    }
+  } else if (TracingEverEnabled()) {
     std::cout << std::endl
               << "You can view the simulation traces by calling" << std::endl
               << "$ gtkwave " << GetTraceFileName() << std::endl;
@@ -222,6 +332,8 @@ void VerilatorSimCtrl::RequestStop(bool simulation_success) {
   simulation_success_ &= simulation_success;
 }
 
+void VerilatorSimCtrl::RequestCheckpoint() { checkpoint_requested_ = true; }
+
 void VerilatorSimCtrl::RegisterExtension(SimCtrlExtension *ext) {
   extension_array_.push_back(ext);
 }
@@ -242,8 +354,25 @@ VerilatorSimCtrl::VerilatorSimCtrl()
       reset_duration_cycles_(2),
       request_stop_(false),
       simulation_success_(true),
+      traced_eval_time_(0),
+      trace_time_(0),
+      profiling_(false),
+      profile_path_("sim_profile.json"),
+      eval_time_(0),
+      trace_threaded_(false),
+      trace_queue_depth_(64),
+      flight_recorder_cycles_(0),
+      segment_start_cycle_(0),
+      flight_recorder_kept_(false),
       tracer_(VerilatedTracer()),
-      term_after_cycles_(0) {
+      term_after_cycles_(0),
+      checkpoint_save_path_("sim.ckpt"),
+      checkpoint_save_at_cycle_(false),
+      checkpoint_save_after_reset_(false),
+      checkpoint_save_cycle_(0),
+      checkpoint_requested_(false),
+      restored_from_checkpoint_(false),
+      interrupted_(false) {
 }
 
 void VerilatorSimCtrl::RegisterSignalHandler() {
@@ -262,6 +391,7 @@ void VerilatorSimCtrl::SignalHandler(int sig) {
 
   switch (sig) {
     case SIGINT:
+      simctrl.interrupted_ = true;
       simctrl.RequestStop(true);
       break;
     case SIGUSR1:
@@ -280,9 +410,51 @@ void VerilatorSimCtrl::PrintHelp() const {
     std::cout << "-t|--trace\n"
                  "   --trace=FILE\n"
                  "  Write a trace file from the start\n\n";
+#ifndef VM_TRACE_FMT_FST
+    std::cout << "--trace-threaded\n"
+                 "--trace-threaded=N\n"
+                 "  Write trace data from a background thread, queueing at "
+                 "most N buffers\n"
+                 "  (default 64) before the simulation waits for the "
+                 "writer\n\n";
+#endif
+    std::cout << "--trace-flight-recorder=N\n"
+                 "  Trace the whole run in memory, but only keep (at least) "
+                 "the last N cycles,\n"
+                 "  and only write them if the simulation fails or times out. "
+                 "Only supported\n"
+                 "  for VCD traces, not FST\n\n";
   }
-  std::cout << "-c|--term-after-cycles=N\n"
+  std::cout << "--profile\n"
+               "--profile=FILE\n"
+               "  Measure the time spent evaluating the design, in each "
+               "extension and in\n"
+               "  tracing. Print a summary and write it as JSON to FILE "
+               "(default\n"
+               "  sim_profile.json)\n\n"
+               "--batch=FILE\n"
+               "  Run each entry of the manifest FILE in turn, with a full "
+               "reset in between.\n"
+               "  Each line has the form `NAME TIMEOUT EXPECTED [ARG...]', "
+               "where TIMEOUT is\n"
+               "  in cycles (0 for none), EXPECTED is pass, fail or timeout "
+               "and the ARGs\n"
+               "  are passed to the extensions (e.g. --load-elf=FILE). "
+               "Images are loaded\n"
+               "  while the design is in reset, and memories go back to their "
+               "contents at\n"
+               "  the start of the first entry before that.\n\n"
+               "-c|--term-after-cycles=N\n"
                "  Terminate simulation after N cycles. 0 means no timeout.\n\n"
+               "--save-checkpoint=WHEN[,FILE]\n"
+               "  Save a checkpoint to FILE (default sim.ckpt). WHEN is either "
+               "a cycle\n"
+               "  number or 'reset' (the cycle where reset is released).\n\n"
+               "--restore-checkpoint=FILE\n"
+               "  Start the simulation from the checkpoint in FILE. Memory "
+               "images given\n"
+               "  on the command line are loaded on top of the restored "
+               "state.\n\n"
                "-h|--help\n"
                "  Show help\n\n"
                "All arguments are passed to the design and can be used "
@@ -309,6 +481,11 @@ bool VerilatorSimCtrl::TraceOff() {
   return tracing_enabled_;
 }
 
+// Convert a duration to (floating point) seconds
+static double ToSeconds(std::chrono::steady_clock::duration d) {
+  return std::chrono::duration_cast<std::chrono::duration<double>>(d).count();
+}
+
 void VerilatorSimCtrl::PrintStatistics() const {
   double speed_hz = time_ / 2 / (GetExecutionTimeMs() / 1000.0);
   double speed_khz = speed_hz / 1000.0;
@@ -323,20 +500,170 @@ void VerilatorSimCtrl::PrintStatistics() const {
             << "(" << speed_khz << " kHz)" << std::endl;
 
   int trace_size_byte;
-  if (tracing_enabled_ && FileSize(GetTraceFileName(), trace_size_byte)) {
+  if (tracing_enabled_ && (!flight_recorder_cycles_ || flight_recorder_kept_) &&
+      FileSize(GetTraceFileName(), trace_size_byte)) {
     std::cout << "Trace file size:  " << trace_size_byte << " B" << std::endl;
   }
+
+  if (TracingEverEnabled()) {
+    std::cout << "Tracing time:     " << ToSeconds(trace_time_) << " s (vs. "
+              << ToSeconds(traced_eval_time_) << " s in eval while tracing)"
+              << std::endl;
+  }
+
+#if VM_TRACE == 1 && !defined(VM_TRACE_FMT_FST)
+  if (trace_file_) {
+    std::cout << "Trace writer:     " << trace_file_->GetBytesQueued()
+              << " B queued, max depth " << trace_file_->GetMaxQueueDepth()
+              << "/" << trace_file_->GetQueueLimit() << ", stalled for "
+              << ToSeconds(trace_file_->GetStallTime()) << " s" << std::endl;
+  }
+#endif
+}
+
+std::string VerilatorSimCtrl::GetExtensionName(size_t idx) const {
+  std::string name = extension_array_[idx]->GetName();
+  if (name.empty()) {
+    name = "extension" + std::to_string(idx);
+  }
+  return name;
+}
+
+void VerilatorSimCtrl::PrintProfile() const {
+  double wallclock_s = ToSeconds(time_end_ - time_begin_);
+  double other_s = wallclock_s - ToSeconds(eval_time_) - ToSeconds(trace_time_);
+
+  std::cout << std::endl
+            << "Simulation profile" << std::endl
+            << "==================" << std::endl;
+
+  auto print_phase = [wallclock_s](const std::string &name, double secs) {
+    std::cout << "  " << name << ": " << secs << " s";
+    if (wallclock_s > 0) {
+      std::cout << " (" << 100.0 * secs / wallclock_s << " %)";
+    }
+    std::cout << std::endl;
+  };
+
+  print_phase("eval", ToSeconds(eval_time_));
+  print_phase("tracing", ToSeconds(trace_time_));
+  for (size_t i = 0; i < extension_array_.size(); ++i) {
+    double ext_s = ToSeconds(ext_on_clock_time_[i]);
+    print_phase(GetExtensionName(i) + " OnClock", ext_s);
+    other_s -= ext_s;
+  }
+  print_phase("other", other_s);
+}
+
+// Write s as a JSON string literal
+static void WriteJsonString(std::ostream &os, const std::string &s) {
+  os << '"';
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      os << '\\';
+    }
+    os << c;
+  }
+  os << '"';
+}
+
+bool VerilatorSimCtrl::WriteProfileJson() const {
+  std::ofstream os(profile_path_);
+  if (!os) {
+    return false;
+  }
+
+  os << "{\n"
+     << "  \"top\": ";
+  WriteJsonString(os, GetName());
+  os << ",\n"
+     << "  \"cycles\": " << time_ / 2 << ",\n"
+     << "  \"wallclock_s\": " << ToSeconds(time_end_ - time_begin_) << ",\n"
+     << "  \"eval_s\": " << ToSeconds(eval_time_) << ",\n"
+     << "  \"trace_s\": " << ToSeconds(trace_time_) << ",\n"
+     << "  \"extensions\": [";
+  for (size_t i = 0; i < extension_array_.size(); ++i) {
+    os << (i ? ",\n" : "\n") << "    {\"name\": ";
+    WriteJsonString(os, GetExtensionName(i));
+    os << ", \"on_clock_s\": " << ToSeconds(ext_on_clock_time_[i]) << "}";
+  }
+  os << "\n  ]\n"
+     << "}\n";
+
+  return os.good();
 }
 
 std::string VerilatorSimCtrl::GetTraceFileName() const {
   return trace_file_path_;
 }
 
+std::string VerilatorSimCtrl::GetPrevTraceFileName() const {
+  // Insert ".prev" before the extension (sim.vcd -> sim.prev.vcd), or append
+  // it if there is no extension.
+  size_t stem_pos = trace_file_path_.find_last_of('/');
+  size_t ext_pos = trace_file_path_.find_last_of('.');
+  if (ext_pos == std::string::npos ||
+      (stem_pos != std::string::npos && ext_pos < stem_pos)) {
+    return trace_file_path_ + ".prev";
+  }
+  return trace_file_path_.substr(0, ext_pos) + ".prev" +
+         trace_file_path_.substr(ext_pos);
+}
+
+void VerilatorSimCtrl::RotateFlightRecorder() {
+  if (time_ / 2 - segment_start_cycle_ < flight_recorder_cycles_) {
+    return;
+  }
+
+  // Closing the tracer and opening the next segment (which overwrites the
+  // oldest one) makes the new segment start with a full dump of all signals.
+  // The segments are kept in memory, so the file name is unused.
+  tracer_.close();
+  segment_start_cycle_ = time_ / 2;
+  tracer_.open(GetTraceFileName().c_str());
+}
+
+void VerilatorSimCtrl::FinishFlightRecorder(bool keep) {
+  flight_recorder_kept_ = keep;
+  if (!keep) {
+    return;
+  }
+
+#if VM_TRACE == 1 && !defined(VM_TRACE_FMT_FST)
+  if (!flight_recorder_file_->WriteSegment(false, GetTraceFileName())) {
+    std::cerr << "ERROR: Could not write flight recorder trace to `"
+              << GetTraceFileName() << "'." << std::endl;
+  }
+  if (!flight_recorder_file_->WriteSegment(true, GetPrevTraceFileName())) {
+    std::cerr << "ERROR: Could not write flight recorder trace to `"
+              << GetPrevTraceFileName() << "'." << std::endl;
+  }
+#endif
+}
+
 void VerilatorSimCtrl::Run() {
+  StartRun();
+  bool timed_out =
+      RunCycles(initial_reset_delay_cycles_, 0, term_after_cycles_);
+  FinishRun(!simulation_success_ || timed_out);
+}
+
+void VerilatorSimCtrl::StartRun() {
   assert(top_ && "Use SetTop() first.");
 
   // We always need to enable this as tracing can be enabled at runtime
   if (tracing_possible_) {
+#if VM_TRACE == 1 && !defined(VM_TRACE_FMT_FST)
+    // The flight recorder keeps its segments in memory, so there's nothing
+    // for a writer thread to do.
+    if (flight_recorder_cycles_) {
+      flight_recorder_file_.reset(new MemoryTraceFile());
+      tracer_.setFile(flight_recorder_file_.get());
+    } else if (trace_threaded_) {
+      trace_file_.reset(new ThreadedVcdFile(trace_queue_depth_));
+      tracer_.setFile(trace_file_.get());
+    }
+#endif
     Verilated::traceEverOn(true);
     top_->trace(tracer_, 99, 0);
   }
@@ -348,59 +675,311 @@ void VerilatorSimCtrl::Run() {
             << "Simulation running, end by pressing CTRL-c." << std::endl;
 
   time_begin_ = std::chrono::steady_clock::now();
-  UnsetReset();
+  // A restored model already has the reset signal in the right state
+  if (!restored_from_checkpoint_) {
+    UnsetReset();
+  }
   Trace();
 
-  unsigned long start_reset_cycle_ = initial_reset_delay_cycles_;
-  unsigned long end_reset_cycle_ = start_reset_cycle_ + reset_duration_cycles_;
+  ext_on_clock_time_.assign(extension_array_.size(),
+                            std::chrono::steady_clock::duration(0));
 
-  while (1) {
-    unsigned long cycle_ = time_ / 2;
+  if (checkpoint_save_after_reset_) {
+    checkpoint_save_at_cycle_ = true;
+    checkpoint_save_cycle_ =
+        initial_reset_delay_cycles_ + reset_duration_cycles_;
+  }
+}
 
-    if (cycle_ == start_reset_cycle_) {
-      SetReset();
-    } else if (cycle_ == end_reset_cycle_) {
-      UnsetReset();
-    }
+bool VerilatorSimCtrl::RunCycles(unsigned long start_reset_cycle,
+                                 unsigned long timeout_base_cycle,
+                                 unsigned long timeout_cycles) {
+  unsigned long end_reset_cycle = start_reset_cycle + reset_duration_cycles_;
 
-    *sig_clk_ = !*sig_clk_;
+  while (1) {
+    unsigned long cycle_ = time_ / 2;
 
-    // Call all extension on-clock methods
-    if (*sig_clk_) {
-      for (auto it = extension_array_.begin(); it != extension_array_.end();
-           ++it) {
-        (*it)->OnClock(time_);
+    if (checkpoint_requested_ ||
+        (checkpoint_save_at_cycle_ && time_ == 2 * checkpoint_save_cycle_)) {
+      checkpoint_requested_ = false;
+      checkpoint_save_at_cycle_ = false;
+      if (!SaveCheckpoint(checkpoint_save_path_)) {
+        RequestStop(false);
       }
     }
 
-    top_->eval();
-    time_++;
+    if (cycle_ == start_reset_cycle) {
+      SetReset();
+    } else if (cycle_ == end_reset_cycle) {
+      UnsetReset();
+    }
 
-    Trace();
+    StepHalfCycle();
 
     if (request_stop_) {
       std::cout << "Received stop request, shutting down simulation."
                 << std::endl;
-      break;
+      return false;
     }
     if (Verilated::gotFinish()) {
       std::cout << "Received $finish() from Verilog, shutting down simulation."
                 << std::endl;
-      break;
+      return false;
     }
-    if (term_after_cycles_ && (time_ / 2 >= term_after_cycles_)) {
-      std::cout << "Simulation timeout of " << term_after_cycles_
+    if (timeout_cycles &&
+        (time_ / 2 - timeout_base_cycle >= timeout_cycles)) {
+      std::cout << "Simulation timeout of " << timeout_cycles
                 << " cycles reached, shutting down simulation." << std::endl;
-      break;
+      return true;
+    }
+  }
+}
+
+void VerilatorSimCtrl::StepHalfCycle() {
+  *sig_clk_ = !*sig_clk_;
+
+  // Call all extension on-clock methods
+  if (*sig_clk_) {
+    if (profiling_) {
+      for (size_t i = 0; i < extension_array_.size(); ++i) {
+        auto ext_begin = std::chrono::steady_clock::now();
+        extension_array_[i]->OnClock(time_);
+        ext_on_clock_time_[i] += std::chrono::steady_clock::now() - ext_begin;
+      }
+    } else {
+      for (auto it = extension_array_.begin(); it != extension_array_.end();
+           ++it) {
+        (*it)->OnClock(time_);
+      }
     }
   }
 
+  // Only time eval() while tracing or profiling so that we can report the
+  // relative cost of each phase without slowing down normal runs.
+  if (profiling_ || TracingEnabled()) {
+    auto eval_begin = std::chrono::steady_clock::now();
+    top_->eval();
+    auto eval_duration = std::chrono::steady_clock::now() - eval_begin;
+    eval_time_ += eval_duration;
+    if (TracingEnabled()) {
+      traced_eval_time_ += eval_duration;
+    }
+  } else {
+    top_->eval();
+  }
+  time_++;
+
+  Trace();
+}
+
+void VerilatorSimCtrl::FinishRun(bool failed) {
   top_->final();
   time_end_ = std::chrono::steady_clock::now();
 
   if (TracingEverEnabled()) {
     tracer_.close();
+    if (flight_recorder_cycles_) {
+      FinishFlightRecorder(failed);
+    }
+  }
+}
+
+// Parse a batch outcome name, returning false if it isn't known.
+static bool ParseBatchOutcome(const std::string &name,
+                              VerilatorSimCtrl::BatchOutcome &outcome) {
+  if (name == "pass") {
+    outcome = VerilatorSimCtrl::kBatchPass;
+  } else if (name == "fail") {
+    outcome = VerilatorSimCtrl::kBatchFail;
+  } else if (name == "timeout") {
+    outcome = VerilatorSimCtrl::kBatchTimeout;
+  } else {
+    return false;
   }
+  return true;
+}
+
+static const char *BatchOutcomeName(VerilatorSimCtrl::BatchOutcome outcome) {
+  switch (outcome) {
+    case VerilatorSimCtrl::kBatchPass:
+      return "pass";
+    case VerilatorSimCtrl::kBatchFail:
+      return "fail";
+    case VerilatorSimCtrl::kBatchTimeout:
+      return "timeout";
+    case VerilatorSimCtrl::kBatchLoadError:
+      return "load error";
+  }
+  return "unknown";
+}
+
+bool VerilatorSimCtrl::ParseBatchManifest(const std::string &path) {
+  std::ifstream is(path);
+  if (!is) {
+    std::cerr << "ERROR: Could not open batch manifest `" << path << "'."
+              << std::endl;
+    return false;
+  }
+
+  batch_entries_.clear();
+
+  std::string line;
+  unsigned line_no = 0;
+  while (std::getline(is, line)) {
+    ++line_no;
+
+    // Strip comments
+    size_t hash_pos = line.find('#');
+    if (hash_pos != std::string::npos) {
+      line.erase(hash_pos);
+    }
+
+    std::istringstream line_is(line);
+    BatchEntry entry;
+    std::string timeout_str, expected_str;
+    if (!(line_is >> entry.name)) {
+      // Blank line
+      continue;
+    }
+
+    if (!(line_is >> timeout_str >> expected_str)) {
+      std::cerr << "ERROR: " << path << ":" << line_no
+                << ": Expected `NAME TIMEOUT EXPECTED [ARG...]'." << std::endl;
+      return false;
+    }
+    if (!read_ul_arg(&entry.timeout_cycles, "batch timeout",
+                     timeout_str.c_str())) {
+      return false;
+    }
+    if (!ParseBatchOutcome(expected_str, entry.expected)) {
+      std::cerr << "ERROR: " << path << ":" << line_no
+                << ": Unknown expected result `" << expected_str
+                << "' (should be pass, fail or timeout)." << std::endl;
+      return false;
+    }
+
+    std::string arg;
+    while (line_is >> arg) {
+      entry.args.push_back(arg);
+    }
+
+    batch_entries_.push_back(entry);
+  }
+
+  if (batch_entries_.empty()) {
+    std::cerr << "ERROR: Batch manifest `" << path << "' has no entries."
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+VerilatorSimCtrl::BatchOutcome VerilatorSimCtrl::RunBatchEntry(
+    const BatchEntry &entry, bool first) {
+  std::cout << std::endl
+            << "Running batch entry `" << entry.name << "'." << std::endl;
+
+  request_stop_ = false;
+  simulation_success_ = true;
+  Verilated::gotFinish(false);
+
+  // Stop the previous entry's program before touching the memories: assert
+  // reset and keep it asserted until the new images are loaded. This also
+  // means that anything derived from the design state at load time (such as
+  // memory scrambling keys) sees the values after reset.
+  unsigned long start_cycle = time_ / 2;
+  if (!first) {
+    SetReset();
+    for (unsigned long i = 0; i < 2 * reset_duration_cycles_; ++i) {
+      StepHalfCycle();
+    }
+  }
+
+  for (auto it = extension_array_.begin(); it != extension_array_.end(); ++it) {
+    if (!(*it)->OnBatchEntry(first)) {
+      return kBatchLoadError;
+    }
+  }
+
+  // Pass the entry's arguments to the extensions, which load the images. The
+  // arguments are wrapped in a C-style argv with a dummy program name.
+  std::vector<std::string> args(1, "batch");
+  args.insert(args.end(), entry.args.begin(), entry.args.end());
+  std::vector<char *> argv;
+  for (std::string &arg : args) {
+    argv.push_back(&arg[0]);
+  }
+  argv.push_back(nullptr);
+
+  for (auto it = extension_array_.begin(); it != extension_array_.end(); ++it) {
+    bool exit_app = false;
+    if (!(*it)->ParseCLIArguments(argv.size() - 1, argv.data(), exit_app)) {
+      return kBatchLoadError;
+    }
+    // Options like --meminit=list or --help are fine on the command line,
+    // but in a batch entry they mean the entry won't load what it should.
+    if (exit_app) {
+      std::cerr << "ERROR: The arguments of batch entry `" << entry.name
+                << "' ask to exit instead of running." << std::endl;
+      return kBatchLoadError;
+    }
+  }
+
+  // The first entry uses the normal reset sequence (which is relative to cycle
+  // 0, so that a run restored from a checkpoint isn't reset again). Later
+  // entries are already in reset and are released after the usual reset
+  // duration.
+  if (RunCycles(first ? initial_reset_delay_cycles_ : time_ / 2, start_cycle,
+                entry.timeout_cycles)) {
+    return kBatchTimeout;
+  }
+  return simulation_success_ ? kBatchPass : kBatchFail;
+}
+
+void VerilatorSimCtrl::RunBatch() {
+  StartRun();
+
+  std::vector<BatchOutcome> outcomes;
+  std::vector<unsigned long> entry_cycles;
+  bool all_expected = true;
+
+  for (size_t i = 0; i < batch_entries_.size(); ++i) {
+    unsigned long start_cycle = time_ / 2;
+    BatchOutcome outcome = RunBatchEntry(batch_entries_[i], i == 0);
+    outcomes.push_back(outcome);
+    entry_cycles.push_back(time_ / 2 - start_cycle);
+    all_expected &= (outcome == batch_entries_[i].expected);
+
+    // A Ctrl-C stops the whole batch, not just the current entry.
+    if (interrupted_) {
+      break;
+    }
+  }
+
+  FinishRun(!all_expected);
+
+  std::cout << std::endl
+            << "Batch results" << std::endl
+            << "=============" << std::endl;
+  for (size_t i = 0; i < outcomes.size(); ++i) {
+    const BatchEntry &entry = batch_entries_[i];
+    bool ok = outcomes[i] == entry.expected;
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << entry.name << ": "
+              << BatchOutcomeName(outcomes[i]) << " after " << entry_cycles[i]
+              << " cycles";
+    if (!ok) {
+      std::cout << " (expected " << BatchOutcomeName(entry.expected) << ")";
+    }
+    std::cout << std::endl;
+  }
+  if (outcomes.size() < batch_entries_.size()) {
+    std::cout << "Interrupted: " << batch_entries_.size() - outcomes.size()
+              << " entries were not run." << std::endl;
+    all_expected = false;
+  }
+
+  // Report the batch as a whole through the usual success flag.
+  simulation_success_ = all_expected;
 }
 
 std::string VerilatorSimCtrl::GetName() const {
@@ -460,11 +1039,150 @@ void VerilatorSimCtrl::Trace() {
     return;
   }
 
-  if (!tracer_.isOpen()) {
+  if (flight_recorder_cycles_) {
+    if (!tracer_.isOpen()) {
+      segment_start_cycle_ = time_ / 2;
+      tracer_.open(GetTraceFileName().c_str());
+      std::cout << "Flight recorder keeping the last "
+                << flight_recorder_cycles_ << " cycles of traces in memory."
+                << std::endl;
+    } else {
+      RotateFlightRecorder();
+    }
+  } else if (!tracer_.isOpen()) {
     tracer_.open(GetTraceFileName().c_str());
     std::cout << "Writing simulation traces to " << GetTraceFileName()
               << std::endl;
   }
 
+  auto dump_begin = std::chrono::steady_clock::now();
   tracer_.dump(GetTime());
+  trace_time_ += std::chrono::steady_clock::now() - dump_begin;
+}
+
+bool VerilatorSimCtrl::ParseSaveCheckpointArg(const std::string &arg) {
+  size_t comma_pos = arg.find(',');
+  std::string when = arg.substr(0, comma_pos);
+  if (comma_pos != std::string::npos) {
+    checkpoint_save_path_ = arg.substr(comma_pos + 1);
+    if (checkpoint_save_path_.empty()) {
+      std::cerr << "ERROR: Empty file name in save-checkpoint argument: `"
+                << arg << "'." << std::endl;
+      return false;
+    }
+  }
+
+#ifdef VM_SAVABLE
+  if (when == "reset") {
+    checkpoint_save_after_reset_ = true;
+    return true;
+  }
+
+  if (!read_ul_arg(&checkpoint_save_cycle_, "save-checkpoint", when.c_str())) {
+    return false;
+  }
+  checkpoint_save_at_cycle_ = true;
+  return true;
+#else
+  // Fail early rather than running the simulation up to the checkpoint.
+  return SaveCheckpoint(checkpoint_save_path_);
+#endif
+}
+
+#ifdef VM_SAVABLE
+bool VerilatorSimCtrl::SaveCheckpoint(const std::string &path) {
+  VerilatedSave os;
+  os.open(path.c_str());
+  if (!os.isOpen()) {
+    std::cerr << "ERROR: Could not open `" << path
+              << "' to write a checkpoint." << std::endl;
+    return false;
+  }
+
+  vluint64_t time = time_;
+  os << time;
+  top_->save(os);
+
+  // Extensions save their state into a string stream, which we then write out
+  // as a single length-prefixed blob each.
+  vluint32_t num_extensions = extension_array_.size();
+  os << num_extensions;
+  for (size_t i = 0; i < extension_array_.size(); ++i) {
+    std::ostringstream ext_os;
+    if (!extension_array_[i]->SaveState(ext_os)) {
+      std::cerr << "ERROR: Simulation extension `" << GetExtensionName(i)
+                << "' failed to save its state. The checkpoint at `" << path
+                << "' is incomplete." << std::endl;
+      os.close();
+      return false;
+    }
+    std::string ext_state = ext_os.str();
+    os << ext_state;
+  }
+  os.close();
+
+  std::cout << "Saved checkpoint at cycle " << time_ / 2 << " to `" << path
+            << "'." << std::endl;
+  return true;
+}
+
+bool VerilatorSimCtrl::RestoreCheckpoint(const std::string &path) {
+  assert(top_ && "Use SetTop() first.");
+
+  VerilatedRestore is;
+  is.open(path.c_str());
+  if (!is.isOpen()) {
+    std::cerr << "ERROR: Could not open checkpoint file `" << path << "'."
+              << std::endl;
+    return false;
+  }
+
+  vluint64_t time;
+  is >> time;
+  top_->restore(is);
+
+  vluint32_t num_extensions;
+  is >> num_extensions;
+  if (num_extensions != extension_array_.size()) {
+    std::cerr << "ERROR: Checkpoint `" << path << "' was saved with "
+              << num_extensions << " simulation extensions, but "
+              << extension_array_.size() << " are registered." << std::endl;
+    return false;
+  }
+  for (size_t i = 0; i < extension_array_.size(); ++i) {
+    std::string ext_state;
+    is >> ext_state;
+    std::istringstream ext_is(ext_state);
+    if (!extension_array_[i]->RestoreState(ext_is)) {
+      std::cerr << "ERROR: Simulation extension `" << GetExtensionName(i)
+                << "' failed to restore its state from checkpoint `" << path
+                << "'." << std::endl;
+      return false;
+    }
+  }
+  is.close();
+
+  time_ = time;
+  restored_from_checkpoint_ = true;
+
+  std::cout << "Restored checkpoint from `" << path << "' at cycle "
+            << time_ / 2 << "." << std::endl;
+  return true;
+}
+#else
+static void PrintCheckpointsUnsupported() {
+  std::cerr << "ERROR: Checkpoints are not supported by this simulation. "
+               "Verilate with --savable and define VM_SAVABLE."
+            << std::endl;
+}
+
+bool VerilatorSimCtrl::SaveCheckpoint(const std::string &path) {
+  PrintCheckpointsUnsupported();
+  return false;
+}
+
+bool VerilatorSimCtrl::RestoreCheckpoint(const std::string &path) {
+  PrintCheckpointsUnsupported();
+  return false;
 }
+#endif  // VM_SAVABLE
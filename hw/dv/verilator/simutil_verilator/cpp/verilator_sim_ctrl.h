@@ -6,12 +6,18 @@
 #define OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_VERILATOR_SIM_CTRL_H_
 
 #include <chrono>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "sim_ctrl_extension.h"
 #include "verilated_toplevel.h"
 
+#if VM_TRACE == 1 && !defined(VM_TRACE_FMT_FST)
+#include "memory_trace_file.h"
+#include "threaded_vcd_file.h"
+#endif
+
 enum VerilatorSimCtrlFlags {
   Defaults = 0,
   ResetPolarityNegative = 1,
@@ -22,6 +28,16 @@ enum VerilatorSimCtrlFlags {
  */
 class VerilatorSimCtrl {
  public:
+  /**
+   * The outcome of one entry of a batch run (see --batch)
+   */
+  enum BatchOutcome {
+    kBatchPass,
+    kBatchFail,
+    kBatchTimeout,
+    kBatchLoadError,
+  };
+
   /**
    * Get the simulation controller instance
    *
@@ -111,6 +127,16 @@ class VerilatorSimCtrl {
    */
   void RequestStop(bool simulation_success);
 
+  /**
+   * Request a checkpoint to be saved at the start of the next cycle
+   *
+   * This allows saving a checkpoint on an event in the design, such as
+   * software reporting that it has finished booting. The checkpoint is written
+   * to the file given with --save-checkpoint (sim.ckpt by default). Saving
+   * checkpoints needs the model to be verilated with --savable.
+   */
+  void RequestCheckpoint();
+
   /**
    * Register an extension to be called automatically
    */
@@ -138,9 +164,47 @@ class VerilatorSimCtrl {
   volatile bool simulation_success_;
   std::chrono::steady_clock::time_point time_begin_;
   std::chrono::steady_clock::time_point time_end_;
+  // Time spent in eval() and in dumping traces while tracing was enabled
+  std::chrono::steady_clock::duration traced_eval_time_;
+  std::chrono::steady_clock::duration trace_time_;
+  // Profiling mode: time every phase of the main loop, not just tracing
+  bool profiling_;
+  std::string profile_path_;
+  std::chrono::steady_clock::duration eval_time_;
+  std::vector<std::chrono::steady_clock::duration> ext_on_clock_time_;
+  bool trace_threaded_;
+  unsigned long trace_queue_depth_;
+  // Flight recorder mode: trace into two alternating in-memory segments
+  // (flight_recorder_file_) of flight_recorder_cycles_ cycles each, only
+  // writing them out on failure. This is only supported for VCD traces.
+  unsigned long flight_recorder_cycles_;
+  unsigned long segment_start_cycle_;
+  bool flight_recorder_kept_;
+#if VM_TRACE == 1 && !defined(VM_TRACE_FMT_FST)
+  // Declared before tracer_, which might still refer to them when destroyed.
+  std::unique_ptr<ThreadedVcdFile> trace_file_;
+  std::unique_ptr<MemoryTraceFile> flight_recorder_file_;
+#endif
   VerilatedTracer tracer_;
   unsigned long term_after_cycles_;
   std::vector<SimCtrlExtension *> extension_array_;
+  std::string checkpoint_save_path_;
+  bool checkpoint_save_at_cycle_;
+  bool checkpoint_save_after_reset_;
+  unsigned long checkpoint_save_cycle_;
+  volatile bool checkpoint_requested_;
+  bool restored_from_checkpoint_;
+  volatile bool interrupted_;
+
+  // An entry of a batch manifest: the arguments are passed to the extensions
+  // to load the entry's images.
+  struct BatchEntry {
+    std::string name;
+    unsigned long timeout_cycles;
+    BatchOutcome expected;
+    std::vector<std::string> args;
+  };
+  std::vector<BatchEntry> batch_entries_;
 
   /**
    * Default constructor
@@ -205,11 +269,48 @@ class VerilatorSimCtrl {
    */
   void PrintStatistics() const;
 
+  /**
+   * Print the time spent in each phase of the main loop
+   */
+  void PrintProfile() const;
+
+  /**
+   * Write the profile printed by PrintProfile() as JSON to profile_path_
+   *
+   * @return Return code, true == success
+   */
+  bool WriteProfileJson() const;
+
+  /**
+   * Get the label for the extension at idx in profiles
+   */
+  std::string GetExtensionName(size_t idx) const;
+
   /**
    * Get the file name of the trace file
    */
   std::string GetTraceFileName() const;
 
+  /**
+   * Start a new flight recorder segment if the current one is full
+   */
+  void RotateFlightRecorder();
+
+  /**
+   * Close the flight recorder at the end of the simulation
+   *
+   * If keep is true, the last two segments are written to the trace file name
+   * (most recent cycles) and a ".prev" variant of it (the cycles before).
+   * Otherwise they are dropped.
+   */
+  void FinishFlightRecorder(bool keep);
+
+  /**
+   * Get the name of the trace file holding the flight recorder segment before
+   * the last one
+   */
+  std::string GetPrevTraceFileName() const;
+
   /**
    * Run the main loop of the simulation
    *
@@ -217,6 +318,65 @@ class VerilatorSimCtrl {
    */
   void Run();
 
+  /**
+   * Set up tracing, evaluate initial blocks and start the wallclock timer
+   */
+  void StartRun();
+
+  /**
+   * Simulate until a stop is requested, $finish() is called or the timeout
+   * expires.
+   *
+   * @param start_reset_cycle  The cycle where reset is asserted. It is
+   *                           released reset_duration_cycles_ later.
+   * @param timeout_base_cycle The timeout is counted from this cycle
+   * @param timeout_cycles     Number of cycles before the timeout expires (0
+   *                           for no timeout)
+   * @return true if the timeout expired
+   */
+  bool RunCycles(unsigned long reset_base_cycle,
+                 unsigned long timeout_base_cycle,
+                 unsigned long timeout_cycles);
+
+  /**
+   * Toggle the clock, call the extensions' OnClock() on a rising edge,
+   * evaluate the design and trace it
+   */
+  void StepHalfCycle();
+
+  /**
+   * Call final blocks, stop the wallclock timer and close traces
+   *
+   * @param failed Whether the simulation failed (see FinishFlightRecorder())
+   */
+  void FinishRun(bool failed);
+
+  /**
+   * Read a batch manifest into batch_entries_
+   *
+   * @return Return code, true == success
+   */
+  bool ParseBatchManifest(const std::string &path);
+
+  /**
+   * Run all entries of the batch manifest and print a result for each
+   *
+   * The simulation is successful if every entry had its expected outcome.
+   */
+  void RunBatch();
+
+  /**
+   * Load the images for a batch entry and simulate it
+   *
+   * Every entry but the first asserts reset before calling the extensions'
+   * OnBatchEntry() and loading its images, and releases it once they are
+   * loaded.
+   *
+   * @param first Whether this is the first entry (which uses the same reset
+   *              sequence as a normal run)
+   */
+  BatchOutcome RunBatchEntry(const BatchEntry &entry, bool first);
+
   /**
    * Get a name for this simulation
    *
@@ -248,6 +408,39 @@ class VerilatorSimCtrl {
    * Perform tracing in Verilator if required
    */
   void Trace();
+
+  /**
+   * Parse the argument of --save-checkpoint (WHEN[,FILE])
+   *
+   * @return Return code, true == success
+   */
+  bool ParseSaveCheckpointArg(const std::string &arg);
+
+  /**
+   * Save the model, the simulation time and the state of all registered
+   * extensions to a checkpoint file.
+   *
+   * Host-side state of DPI models that isn't owned by an extension (such as
+   * the context behind a chandle) is not part of the checkpoint. The chandle
+   * itself is saved with the model, but points into this process. Modules
+   * holding one must create a new context when they find that it belongs to
+   * another process (as the DPI modules in hw/dv/dpi do, see dpi_process.h).
+   * Their host-side state then starts afresh, so they should be idle or
+   * reconnectable when the checkpoint is taken.
+   *
+   * @return Return code, true == success
+   */
+  bool SaveCheckpoint(const std::string &path);
+
+  /**
+   * Restore a checkpoint written by SaveCheckpoint()
+   *
+   * This must be called before memories are loaded, since the model state in
+   * the checkpoint includes the contents of all memories.
+   *
+   * @return Return code, true == success
+   */
+  bool RestoreCheckpoint(const std::string &path);
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_VERILATOR_SIM_CTRL_H_
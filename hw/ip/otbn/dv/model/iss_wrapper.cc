@@ -17,11 +17,25 @@
 #include <regex>
 #include <signal.h>
 #include <sstream>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
 #include "otbn_trace_checker.h"
 
+// Opcodes for the binary protocol (see stepped.py)
+enum { kBinOpStep = 0, kBinOpCmd = 1, kBinOpPost = 2 };
+
+// External registers in BIN_OP_STEP records (BIN_EXT_REGS in stepped.py)
+enum {
+  kExtStatus = 0,
+  kExtInsnCnt = 1,
+  kExtErrBits = 2,
+  kExtStopPc = 3,
+  kExtRndReq = 4,
+  kExtWipeStart = 5
+};
+
 // Guard class to safely delete C strings
 namespace {
 struct CStrDeleter {
@@ -105,6 +119,119 @@ struct TmpDir {
   }
 };
 
+// A region of memory that is shared with the ISS, used to pass the contents
+// of DMEM and IMEM. The layout (see stepped.py) is DMEM then IMEM. Each
+// memory is an array of little-endian 32-bit words followed by an array of
+// validity bytes (0 or 1), one for each word.
+//
+// The region is backed by a file in the temporary directory. The file is
+// unlinked once the ISS has mapped it too, so it doesn't stay around.
+struct SharedMems {
+  uint32_t dmem_words;
+  uint32_t imem_words;
+  size_t size;
+  uint8_t *base;
+  std::string path;
+
+  SharedMems(const std::string &tmp_path, uint32_t dmem_words,
+             uint32_t imem_words)
+      : dmem_words(dmem_words),
+        imem_words(imem_words),
+        size(5 * ((size_t)dmem_words + imem_words)),
+        base(nullptr),
+        path(tmp_path) {
+    int fd = mkstemp(&path.at(0));
+    if (fd < 0) {
+      std::ostringstream oss;
+      oss << "Cannot create shared memory file with template " << path << ": "
+          << strerror(errno);
+      throw std::runtime_error(oss.str());
+    }
+
+    void *ptr = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+      ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int err = errno;
+    close(fd);
+
+    if (ptr == MAP_FAILED) {
+      unlink(path.c_str());
+      std::ostringstream oss;
+      oss << "Cannot map shared memory file at " << path << ": "
+          << strerror(err);
+      throw std::runtime_error(oss.str());
+    }
+    base = (uint8_t *)ptr;
+  }
+
+  ~SharedMems() {
+    munmap(base, size);
+    unlink_file();
+  }
+
+  // Remove the backing file. The mappings stay valid.
+  void unlink_file() {
+    if (!path.empty()) {
+      unlink(path.c_str());
+      path.clear();
+    }
+  }
+
+  uint32_t num_words(bool is_imem) const {
+    return is_imem ? imem_words : dmem_words;
+  }
+
+  uint8_t *words_ptr(bool is_imem) const {
+    return base + (is_imem ? 5 * (size_t)dmem_words : 0);
+  }
+
+  uint8_t *valid_ptr(bool is_imem) const {
+    return words_ptr(is_imem) + 4 * (size_t)num_words(is_imem);
+  }
+
+  // Copy words into the start of the DMEM or IMEM area. Throws a
+  // std::runtime_error if there are too many.
+  void write(bool is_imem, const ISSWrapper::EccWords &words) const {
+    if (words.size() > num_words(is_imem)) {
+      std::ostringstream oss;
+      oss << "Cannot load " << words.size() << " words into "
+          << (is_imem ? "IMEM" : "DMEM") << ", which has "
+          << num_words(is_imem) << ".";
+      throw std::runtime_error(oss.str());
+    }
+
+    uint8_t *wp = words_ptr(is_imem);
+    uint8_t *vp = valid_ptr(is_imem);
+    for (const auto &word : words) {
+      uint32_t w32 = word.second;
+      wp[0] = w32;
+      wp[1] = w32 >> 8;
+      wp[2] = w32 >> 16;
+      wp[3] = w32 >> 24;
+      wp += 4;
+      *vp++ = word.first ? 1 : 0;
+    }
+  }
+
+  // Read the whole DMEM or IMEM area into dst
+  void read(bool is_imem, ISSWrapper::EccWords *dst) const {
+    assert(dst);
+
+    uint32_t n = num_words(is_imem);
+    const uint8_t *wp = words_ptr(is_imem);
+    const uint8_t *vp = valid_ptr(is_imem);
+
+    dst->resize(n);
+    for (uint32_t i = 0; i < n; ++i) {
+      uint32_t w32 = wp[0] | (wp[1] << 8) | (wp[2] << 16) |
+                     ((uint32_t)wp[3] << 24);
+      wp += 4;
+      (*dst)[i] = std::make_pair(vp[i] != 0, w32);
+    }
+  }
+};
+
 // Find the top of the OpenTitan repository
 //
 // If REPO_TOP is defined, use that. Otherwise, this will only work if we're
@@ -235,28 +362,53 @@ static void read_ext_reg(const std::string &reg_name,
   }
 }
 
-// A specialized version of read_ext_reg that updates a boolean flag
-// (assuming that the ISS will always signal the register as having
-// value 0 or 1). Prints a message to stderr and returns false on
-// error.
-static bool read_ext_flag(const std::string &reg_name,
-                          const std::vector<std::string> &lines, bool *dest) {
+// Update a boolean flag from an external register update (assuming that the
+// ISS will always signal the register as having value 0 or 1). Prints a
+// message to stderr and returns false on error.
+static bool read_ext_flag(const char *reg_name, uint32_t value, bool *dest) {
   assert(dest);
 
-  uint32_t dest32 = *dest ? 1 : 0;
-  read_ext_reg(reg_name, lines, &dest32);
-
-  if (dest32 > 1) {
+  if (value > 1) {
     std::cerr << "ERROR: Unexpected update to " << reg_name << " with value 0x"
-              << std::hex << dest32 << std::dec
+              << std::hex << value << std::dec
               << " when we expected a boolean flag.";
     return false;
   }
 
-  *dest = dest32 != 0;
+  *dest = value != 0;
   return true;
 }
 
+// A cursor for reading fields from a binary response frame. Reading past the
+// end raises a runtime_error.
+namespace {
+struct FrameReader {
+  const uint8_t *ptr;
+  const uint8_t *end;
+
+  explicit FrameReader(const std::vector<uint8_t> &frame)
+      : ptr(frame.data()), end(frame.data() + frame.size()) {}
+
+  const uint8_t *take(size_t len) {
+    if ((size_t)(end - ptr) < len)
+      throw std::runtime_error("Truncated response frame from ISS.");
+    const uint8_t *ret = ptr;
+    ptr += len;
+    return ret;
+  }
+
+  uint32_t get_u8() { return *take(1); }
+  uint32_t get_u16() {
+    const uint8_t *p = take(2);
+    return p[0] | (p[1] << 8);
+  }
+  uint32_t get_u32() {
+    const uint8_t *p = take(4);
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+};
+}  // namespace
+
 void MirroredRegs::reset() {
   status = 0x04;
   insn_cnt = 0;
@@ -316,7 +468,7 @@ ISSWrapper::ISSWrapper() : tmpdir(new TmpDir()) {
     }
     // Finally, exec the ISS
     execl("/usr/bin/env", "/usr/bin/env", "python3", "-u", model_path.c_str(),
-          NULL);
+          "--binary", NULL);
   }
 
   // We are the parent process and pid is the PID of the child. Close the pipe
@@ -363,16 +515,56 @@ void ISSWrapper::load_i(const std::string &path) {
   run_command(oss.str(), nullptr);
 }
 
+void ISSWrapper::map_mems(uint32_t dmem_words, uint32_t imem_words) {
+  assert(!shared_mems);
+
+  std::unique_ptr<SharedMems> mems(new SharedMems(
+      make_tmp_path("mems_XXXXXX"), dmem_words, imem_words));
+
+  std::ostringstream oss;
+  oss << "attach_shm " << mems->path << " " << dmem_words << " "
+      << imem_words << "\n";
+  run_command(oss.str(), nullptr);
+
+  // The ISS has mapped the file, so we don't need it any more.
+  mems->unlink_file();
+  shared_mems = std::move(mems);
+}
+
+void ISSWrapper::load_d(const EccWords &words) {
+  if (!shared_mems)
+    throw std::runtime_error("Cannot load DMEM: shared memory not mapped.");
+
+  shared_mems->write(false, words);
+
+  // This waits for a response so that the caller can safely write to shared
+  // memory again as soon as we return.
+  std::ostringstream oss;
+  oss << "load_d_shm " << words.size() << "\n";
+  run_command(oss.str(), nullptr);
+}
+
+void ISSWrapper::load_i(const EccWords &words) {
+  if (!shared_mems)
+    throw std::runtime_error("Cannot load IMEM: shared memory not mapped.");
+
+  shared_mems->write(true, words);
+
+  std::ostringstream oss;
+  oss << "load_i_shm " << words.size() << "\n";
+  run_command(oss.str(), nullptr);
+}
+
 void ISSWrapper::add_loop_warp(uint32_t addr, uint32_t from_cnt,
                                uint32_t to_cnt) {
   std::ostringstream oss;
   oss << "add_loop_warp 0x" << std::hex << addr << std::dec << " " << from_cnt
       << " " << to_cnt << "\n";
-  run_command(oss.str(), nullptr);
+  post_command(oss.str());
 }
 
 void ISSWrapper::clear_loop_warps() {
-  run_command("clear_loop_warps\n", nullptr);
+  post_command("clear_loop_warps\n");
 }
 
 void ISSWrapper::dump_d(const std::string &path) const {
@@ -381,6 +573,14 @@ void ISSWrapper::dump_d(const std::string &path) const {
   run_command(oss.str(), nullptr);
 }
 
+void ISSWrapper::dump_d(EccWords *dst) const {
+  if (!shared_mems)
+    throw std::runtime_error("Cannot dump DMEM: shared memory not mapped.");
+
+  run_command("dump_d_shm\n", nullptr);
+  shared_mems->read(false, dst);
+}
+
 void ISSWrapper::start_operation(command_t command) {
   std::ostringstream cmd_stream;
 
@@ -402,34 +602,34 @@ void ISSWrapper::start_operation(command_t command) {
       assert(0);
   }
 
-  run_command(cmd_stream.str(), nullptr);
+  post_command(cmd_stream.str());
 }
 
 void ISSWrapper::otp_key_cdc_done() {
-  run_command("otp_key_cdc_done\n", nullptr);
+  post_command("otp_key_cdc_done\n");
 }
 
 void ISSWrapper::edn_rnd_cdc_done() {
-  run_command("edn_rnd_cdc_done\n", nullptr);
+  post_command("edn_rnd_cdc_done\n");
 }
 
 void ISSWrapper::edn_urnd_cdc_done() {
-  run_command("edn_urnd_cdc_done\n", nullptr);
+  post_command("edn_urnd_cdc_done\n");
 }
 
-void ISSWrapper::edn_flush() { run_command("edn_flush\n", nullptr); }
+void ISSWrapper::edn_flush() { post_command("edn_flush\n"); }
 
 void ISSWrapper::edn_rnd_step(uint32_t edn_rnd_data, bool fips_err) {
   std::ostringstream oss;
   oss << "edn_rnd_step " << std::hex << "0x" << edn_rnd_data;
   oss << " " << fips_err << "\n";
-  run_command(oss.str(), nullptr);
+  post_command(oss.str());
 }
 
 void ISSWrapper::edn_urnd_step(uint32_t edn_urnd_data) {
   std::ostringstream oss;
   oss << "edn_urnd_step " << std::hex << "0x" << edn_urnd_data << "\n";
-  run_command(oss.str(), nullptr);
+  post_command(oss.str());
 }
 
 void ISSWrapper::set_keymgr_value(const std::array<uint32_t, 12> &key0_arr,
@@ -447,48 +647,138 @@ void ISSWrapper::set_keymgr_value(const std::array<uint32_t, 12> &key0_arr,
   }
   oss << " " << valid << "\n";
 
-  run_command(oss.str(), nullptr);
+  post_command(oss.str());
 }
 
-int ISSWrapper::step(bool gen_trace) {
-  std::vector<std::string> lines;
+int ISSWrapper::run_cycles(uint32_t max_cycles, bool gen_trace,
+                           uint32_t *cycles_run) {
+  uint8_t arg[4] = {(uint8_t)max_cycles, (uint8_t)(max_cycles >> 8),
+                    (uint8_t)(max_cycles >> 16), (uint8_t)(max_cycles >> 24)};
+  std::vector<uint8_t> rsp;
 
-  run_command("step\n", &lines);
-  if (gen_trace && lines.size()) {
-    if (!OtbnTraceChecker::get().OnIssTrace(lines)) {
-      return -1;
-    }
+  send_frame(kBinOpStep, arg, sizeof(arg));
+  fflush(child_write_file);
+  if (!read_frame(&rsp)) {
+    // Posted commands don't get a response, so an EOF here might actually be
+    // because one of those failed.
+    throw std::runtime_error(
+        "Failed to step: EOF from ISS. This might be because an earlier "
+        "posted command failed (see the ISS output above).");
   }
 
-  // Try to read STATUS, which is written when execution ends. Execution has
-  // finished if status_ is either 0 (IDLE) or 0xff (LOCKED)
+  // Execution has finished if status_ is either 0 (IDLE) or 0xff (LOCKED)
   bool was_stopped = mirrored_.stopped();
-  read_ext_reg("STATUS", lines, &mirrored_.status);
-  bool is_stopped = mirrored_.stopped();
-  bool done = is_stopped && !was_stopped;
 
-  // Also try to read INSN_CNT, ERR_BITS and STOP_PC plus some associated
-  // flags. Some of these flags only get updated around the end of an operation
-  // but the precise timing is slightly fiddly, so it's easiest to just allow
-  // updates whenever they arrive.
-  read_ext_reg("INSN_CNT", lines, &mirrored_.insn_cnt);
-  read_ext_reg("ERR_BITS", lines, &mirrored_.err_bits);
-  read_ext_reg("STOP_PC", lines, &mirrored_.stop_pc);
+  // If something goes wrong, we still read the rest of the response (so that
+  // trace_locs_ stays in step with the ISS), but stop tracing and return -1 at
+  // the end.
+  bool failed = false;
+
+  FrameReader rd(rsp);
+  uint32_t num_cycles = rd.get_u32();
+  for (uint32_t cycle = 0; cycle < num_cycles; ++cycle) {
+    // The trace for this cycle comes in parts (see stepped.py), which go
+    // straight into trace_entry_ without any parsing. First, the header and
+    // the instruction that executed, if any.
+    uint32_t hdr_len = rd.get_u8();
+    const char *hdr = (const char *)rd.take(hdr_len);
+    uint32_t insn_addr = 0;
+    const char *mnemonic = nullptr;
+    uint32_t mnemonic_len = 0;
+    if (rd.get_u8()) {
+      insn_addr = rd.get_u32();
+      mnemonic_len = rd.get_u8();
+      mnemonic = (const char *)rd.take(mnemonic_len);
+    }
 
-  if (!read_ext_flag("RND_REQ", lines, &mirrored_.rnd_req))
-    return -1;
-  if (!read_ext_flag("WIPE_START", lines, &mirrored_.wipe_start))
+    bool tracing = gen_trace && hdr_len && !failed;
+    if (tracing && !trace_entry_.start_iss_trace(hdr, hdr_len, insn_addr,
+                                                 mnemonic, mnemonic_len)) {
+      failed = true;
+      tracing = false;
+    }
+
+    // Then the names of any locations that the ISS hasn't used before, which
+    // we intern here once and for all. This happens even if we're not
+    // tracing, so that trace_locs_ stays in step with the ISS.
+    uint32_t num_new_locs = rd.get_u8();
+    for (uint32_t i = 0; i < num_new_locs; ++i) {
+      uint32_t name_len = rd.get_u8();
+      const char *name = (const char *)rd.take(name_len);
+      trace_locs_.push_back(OtbnTraceBodyLine::intern_loc(name, name_len));
+    }
+
+    // Then the register writes, with locations numbered by the ISS.
+    uint32_t num_writes = rd.get_u16();
+    for (uint32_t i = 0; i < num_writes; ++i) {
+      uint32_t loc = rd.get_u8();
+      uint32_t value_len = rd.get_u8();
+      const char *value = (const char *)rd.take(value_len);
+      if (loc >= trace_locs_.size()) {
+        throw std::runtime_error("Unknown location in ISS step record.");
+      }
+      if (tracing &&
+          !trace_entry_.add_iss_write(trace_locs_[loc], value, value_len)) {
+        failed = true;
+        tracing = false;
+      }
+    }
+
+    if (tracing && !OtbnTraceChecker::get().OnIssTrace(&trace_entry_)) {
+      failed = true;
+    }
+
+    // Apply any updates to external registers. STATUS is written when
+    // execution ends. Some of the other registers and flags only get updated
+    // around the end of an operation but the precise timing is slightly
+    // fiddly, so it's easiest to just allow updates whenever they arrive.
+    uint32_t num_updates = rd.get_u8();
+    for (uint32_t i = 0; i < num_updates; ++i) {
+      uint32_t reg = rd.get_u8();
+      uint32_t value = rd.get_u32();
+      switch (reg) {
+        case kExtStatus:
+          mirrored_.status = value;
+          break;
+        case kExtInsnCnt:
+          mirrored_.insn_cnt = value;
+          break;
+        case kExtErrBits:
+          mirrored_.err_bits = value;
+          break;
+        case kExtStopPc:
+          mirrored_.stop_pc = value;
+          break;
+        case kExtRndReq:
+          if (!read_ext_flag("RND_REQ", value, &mirrored_.rnd_req))
+            failed = true;
+          break;
+        case kExtWipeStart:
+          if (!read_ext_flag("WIPE_START", value, &mirrored_.wipe_start))
+            failed = true;
+          break;
+        default:
+          throw std::runtime_error("Unknown register in ISS step record.");
+      }
+    }
+  }
+
+  if (failed)
     return -1;
 
-  return done ? 1 : 0;
+  if (cycles_run)
+    *cycles_run = num_cycles;
+
+  bool is_stopped = mirrored_.stopped();
+  return (is_stopped && !was_stopped) ? 1 : 0;
 }
 
 void ISSWrapper::invalidate_imem() {
-  run_command("invalidate_imem\n", nullptr);
+  post_command("invalidate_imem\n");
 }
 
 void ISSWrapper::invalidate_dmem() {
-  run_command("invalidate_dmem\n", nullptr);
+  post_command("invalidate_dmem\n");
 }
 
 void ISSWrapper::set_software_errs_fatal(bool new_val) {
@@ -496,11 +786,11 @@ void ISSWrapper::set_software_errs_fatal(bool new_val) {
 
   oss << "set_software_errs_fatal " << new_val << "\n";
 
-  run_command(oss.str(), nullptr);
+  post_command(oss.str());
 }
 
 void ISSWrapper::initial_secure_wipe() {
-  run_command("initial_secure_wipe\n", nullptr);
+  post_command("initial_secure_wipe\n");
 }
 
 uint32_t ISSWrapper::step_crc(const std::array<uint8_t, 6> &item,
@@ -523,7 +813,7 @@ void ISSWrapper::reset(bool gen_trace) {
   if (gen_trace)
     OtbnTraceChecker::get().Flush();
 
-  run_command("reset\n", nullptr);
+  post_command("reset\n");
 
   // Reset all mirrored registers.
   mirrored_.reset();
@@ -533,13 +823,13 @@ void ISSWrapper::send_err_escalation(uint32_t err_val, bool lock_immediately) {
   std::ostringstream oss;
   oss << "send_err_escalation " << std::hex << "0x" << err_val << " "
       << lock_immediately << "\n";
-  run_command(oss.str(), nullptr);
+  post_command(oss.str());
 }
 
 void ISSWrapper::send_rma_req() {
   std::ostringstream oss;
   oss << "send_rma_req\n";
-  run_command(oss.str(), nullptr);
+  post_command(oss.str());
 }
 
 void ISSWrapper::get_regs(std::array<uint32_t, 32> *gprs,
@@ -664,53 +954,25 @@ std::string ISSWrapper::make_tmp_path(const std::string &relative) const {
   return tmpdir->path + "/" + relative;
 }
 
-bool ISSWrapper::read_child_response(std::vector<std::string> *dst) const {
-  char buf[256];
-  bool continuation = false;
-
-  for (;;) {
-    // fgets reads a line, or fills buf, whichever happens first. It always
-    // writes the terminating null, so setting the second last position to \0
-    // beforehand can detect whether we filled buf without needing a call to
-    // strlen: buf is full if and only if this gets written with something
-    // other than a null.
-    buf[sizeof buf - 2] = '\0';
-
-    if (!fgets(buf, sizeof buf, child_read_file)) {
-      // Failed to read from child, or EOF
-      return false;
-    }
-
-    // If buf is ".\n", and we're not continuing another line, we're done.
-    if (!continuation && (0 == strcmp(buf, ".\n"))) {
-      return true;
-    }
+void ISSWrapper::send_frame(uint8_t op, const void *data, size_t len) const {
+  uint32_t frame_len = 1 + len;
+  uint8_t hdr[5] = {(uint8_t)frame_len, (uint8_t)(frame_len >> 8),
+                    (uint8_t)(frame_len >> 16), (uint8_t)(frame_len >> 24), op};
+  fwrite(hdr, 1, sizeof(hdr), child_write_file);
+  fwrite(data, 1, len, child_write_file);
+}
 
-    // Have we read an entire line? If not, fgets will have written something
-    // other than \0 or \n to the second last entry in buf.
-    char canary = buf[sizeof buf - 2];
-    bool next_continuation = !(canary == '\0' || canary == '\n');
-
-    // We have some informative response from the child. Take a copy if dst is
-    // not null, stripping any trailing newline.
-    if (dst) {
-      if (continuation) {
-        assert(dst->size());
-        dst->back() += buf;
-      } else {
-        dst->push_back(std::string(buf));
-      }
+bool ISSWrapper::read_frame(std::vector<uint8_t> *dst) const {
+  assert(dst);
 
-      // If !next_continuation then we read an entire line. If we didn't get to
-      // EOF, the last character of dst->back() is a newline. Drop it.
-      if (!next_continuation && dst->back().back() == '\n') {
-        dst->back().pop_back();
-      }
-    }
+  uint8_t hdr[4];
+  if (fread(hdr, 1, sizeof(hdr), child_read_file) != sizeof(hdr))
+    return false;
 
-    // Set the continuation flag if we filled buf without a newline.
-    continuation = next_continuation;
-  }
+  uint32_t len =
+      hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) | ((uint32_t)hdr[3] << 24);
+  dst->resize(len);
+  return fread(dst->data(), 1, len, child_read_file) == len;
 }
 
 void ISSWrapper::run_command(const std::string &cmd,
@@ -718,12 +980,37 @@ void ISSWrapper::run_command(const std::string &cmd,
   assert(cmd.size() > 0);
   assert(cmd.back() == '\n');
 
-  fputs(cmd.c_str(), child_write_file);
+  std::vector<uint8_t> rsp;
+
+  send_frame(kBinOpCmd, cmd.data(), cmd.size());
   fflush(child_write_file);
-  if (!read_child_response(dst)) {
+  if (!read_frame(&rsp)) {
     std::ostringstream oss;
     std::string cmd_line = cmd.substr(0, cmd.size() - 1);
-    oss << "Failed to run command '" << cmd_line << "': EOF from ISS.";
+    // As in run_cycles, the ISS might have died on an earlier posted command.
+    oss << "Failed to run command '" << cmd_line
+        << "': EOF from ISS. This might be because an earlier posted command "
+           "failed (see the ISS output above).";
     throw std::runtime_error(oss.str());
   }
+
+  if (!dst)
+    return;
+
+  // The response is the text that the command printed, one line at a time.
+  size_t pos = 0;
+  while (pos < rsp.size()) {
+    const char *start = (const char *)&rsp[pos];
+    const char *nl = (const char *)memchr(start, '\n', rsp.size() - pos);
+    size_t len = nl ? (size_t)(nl - start) : rsp.size() - pos;
+    dst->emplace_back(start, len);
+    pos += len + 1;
+  }
+}
+
+void ISSWrapper::post_command(const std::string &cmd) {
+  assert(cmd.size() > 0);
+  assert(cmd.back() == '\n');
+
+  send_frame(kBinOpPost, cmd.data(), cmd.size());
 }
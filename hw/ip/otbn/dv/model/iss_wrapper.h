@@ -10,10 +10,14 @@
 #include <memory>
 #include <string>
 #include <unistd.h>
+#include <utility>
 #include <vector>
 
-// Forward declaration (the implementation is private in iss_wrapper.cc)
+#include "otbn_trace_entry.h"
+
+// Forward declarations (the implementations are private in iss_wrapper.cc)
 struct TmpDir;
+struct SharedMems;
 
 // OTBN has some externally visible CSRs that can be updated by hardware
 // (without explicit writes from software). The ISSWrapper mirrors the ISS's
@@ -54,6 +58,10 @@ struct ISSWrapper {
 
   enum command_t { Execute, DmemWipe, ImemWipe };
 
+  // Memory contents as (valid, data) pairs, one for each 32-bit word. This
+  // matches Ecc32MemArea::EccWords.
+  typedef std::vector<std::pair<bool, uint32_t>> EccWords;
+
   ISSWrapper();
   ~ISSWrapper();
 
@@ -61,6 +69,18 @@ struct ISSWrapper {
   void load_d(const std::string &path);
   void load_i(const std::string &path);
 
+  // Set up a region of memory that is shared with the ISS and used to pass
+  // the contents of DMEM and IMEM without going through files. dmem_words and
+  // imem_words are the sizes of the two memories in 32-bit words and must
+  // match the ISS. This must be called once, before any of the EccWords
+  // versions of load_d, load_i and dump_d.
+  void map_mems(uint32_t dmem_words, uint32_t imem_words);
+
+  // Load new contents of DMEM / IMEM through shared memory. If there are
+  // fewer words than the memory size, this replaces the start of memory.
+  void load_d(const EccWords &words);
+  void load_i(const EccWords &words);
+
   // Add a loop warp instruction to the simulation
   void add_loop_warp(uint32_t addr, uint32_t from_cnt, uint32_t to_cnt);
 
@@ -70,6 +90,9 @@ struct ISSWrapper {
   // Dump the contents of DMEM to a file
   void dump_d(const std::string &path) const;
 
+  // Read the contents of DMEM through shared memory, replacing dst
+  void dump_d(EccWords *dst) const;
+
   // Start an operation (execute, dmem wipe or imem wipe)
   void start_operation(command_t command);
 
@@ -112,7 +135,17 @@ struct ISSWrapper {
   // Updates mirrored versions of STATUS and INSN_CNT registers. If execution
   // finishes (so we return 1), also updates mirrored versions of ERR_BITS and
   // the final PC (see get_stop_pc()).
-  int step(bool gen_trace);
+  int step(bool gen_trace) { return run_cycles(1, gen_trace, nullptr); }
+
+  // Run simulation for between 1 and max_cycles cycles.
+  //
+  // The ISS stops early after a cycle that makes an externally visible change
+  // (updating anything mirrored except INSN_CNT), leaves it idle or ends with
+  // an EDN request in flight. Inputs can only be sent between calls, so only
+  // use max_cycles > 1 when it doesn't matter if they arrive late. If
+  // cycles_run is not null, it is set to the number of cycles that actually
+  // ran. The return code and mirrored registers are as for step().
+  int run_cycles(uint32_t max_cycles, bool gen_trace, uint32_t *cycles_run);
 
   // Mark all of IMEM as invalid so that any fetch causes an integrity error.
   void invalidate_imem();
@@ -155,15 +188,25 @@ struct ISSWrapper {
   std::string make_tmp_path(const std::string &relative) const;
 
  private:
-  // Read line by line from the child process until we get ".\n".
-  // Return true if we got the ".\n" terminator, false if EOF. If dst
-  // is not null, append to it each line that was read.
-  bool read_child_response(std::vector<std::string> *dst) const;
+  // Write a binary request frame to the child (see stepped.py). This doesn't
+  // flush the pipe.
+  void send_frame(uint8_t op, const void *data, size_t len) const;
+
+  // Read a binary response frame from the child into dst. Return false on
+  // EOF.
+  bool read_frame(std::vector<uint8_t> *dst) const;
 
   // Send a command to the child and wait for its response. If no
-  // response, raise a runtime_error.
+  // response, raise a runtime_error. If dst is not null, append each line of
+  // the response to it.
   void run_command(const std::string &cmd, std::vector<std::string> *dst) const;
 
+  // Send a command to the child without waiting for a response. Such commands
+  // are only written to the pipe along with the next command that needs a
+  // response, so they cost no extra round trips. If one fails, the ISS exits
+  // and the next call to run_command or run_cycles raises a runtime_error.
+  void post_command(const std::string &cmd);
+
   pid_t child_pid;
   FILE *child_write_file;
   FILE *child_read_file;
@@ -171,8 +214,19 @@ struct ISSWrapper {
   // A temporary directory for communicating with the child process
   std::unique_ptr<TmpDir> tmpdir;
 
+  // Memory shared with the child process (null until map_mems is called)
+  std::unique_ptr<SharedMems> shared_mems;
+
   // Mirrored copies of registers
   MirroredRegs mirrored_;
+
+  // The interned trace locations (see OtbnTraceBodyLine::intern_loc) for the
+  // location numbers that the ISS uses in step records
+  std::vector<uint16_t> trace_locs_;
+
+  // Scratch space for the ISS trace entry for a cycle, which is kept so that
+  // its storage can be reused
+  OtbnIssTraceEntry trace_entry_;
 };
 
 #endif  // OPENTITAN_HW_IP_OTBN_DV_MODEL_ISS_WRAPPER_H_
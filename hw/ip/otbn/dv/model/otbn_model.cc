@@ -7,7 +7,6 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring>
-#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
@@ -40,85 +39,6 @@ int otbn_stack_element_peek(int index, svBitVecVal *val);
 #define STATUS_BUSY_SEC_WIPE_INT 0x04
 #define STATUS_LOCKED 0xFF
 
-// Read (the start of) the contents of a file at path as a vector of bytes.
-// Expects num_bytes bytes of data. On failure, throws a std::runtime_error.
-static Ecc32MemArea::EccWords read_words_from_file(const std::string &path,
-                                                   size_t num_words) {
-  std::filebuf fb;
-  if (!fb.open(path.c_str(), std::ios::in | std::ios::binary)) {
-    std::ostringstream oss;
-    oss << "Cannot open the file '" << path << "'.";
-    throw std::runtime_error(oss.str());
-  }
-
-  Ecc32MemArea::EccWords ret;
-  ret.reserve(num_words);
-
-  char minibuf[5];
-  for (size_t i = 0; i < num_words; ++i) {
-    std::streamsize chars_in = fb.sgetn(minibuf, 5);
-    if (chars_in != 5) {
-      std::ostringstream oss;
-      oss << "Cannot read word " << i << " from " << path
-          << " (expected 5 bytes, but actually got " << chars_in << ").";
-      throw std::runtime_error(oss.str());
-    }
-
-    // The layout should be a validity byte (either 0 or 1), followed
-    // by 4 bytes with a little-endian 32-bit word.
-    uint8_t vld_byte = minibuf[0];
-    if (vld_byte > 2) {
-      std::ostringstream oss;
-      oss << "Word " << i << " at " << path
-          << " had a validity byte with value " << (int)vld_byte
-          << "; not 0 or 1.";
-      throw std::runtime_error(oss.str());
-    }
-    bool valid = vld_byte == 1;
-
-    uint32_t word = 0;
-    for (int j = 0; j < 4; ++j) {
-      word |= (uint32_t)(uint8_t)minibuf[j + 1] << 8 * j;
-    }
-
-    ret.push_back(std::make_pair(valid, word));
-  }
-
-  return ret;
-}
-
-// Write some words to a new file at path. On failure, throws a
-// std::runtime_error.
-static void write_words_to_file(const std::string &path,
-                                const Ecc32MemArea::EccWords &words) {
-  std::filebuf fb;
-  if (!fb.open(path.c_str(), std::ios::out | std::ios::binary)) {
-    std::ostringstream oss;
-    oss << "Cannot open the file '" << path << "'.";
-    throw std::runtime_error(oss.str());
-  }
-
-  for (const Ecc32MemArea::EccWord &word : words) {
-    uint8_t bytes[5];
-
-    bool valid = word.first;
-    uint32_t w32 = word.second;
-
-    bytes[0] = valid ? 1 : 0;
-    for (int j = 0; j < 4; ++j) {
-      bytes[j + 1] = (w32 >> (8 * j)) & 0xff;
-    }
-
-    std::streamsize chars_out =
-        fb.sputn(reinterpret_cast<const char *>(&bytes), 5);
-    if (chars_out != 5) {
-      std::ostringstream oss;
-      oss << "Failed to write to " << path << ".";
-      throw std::runtime_error(oss.str());
-    }
-  }
-}
-
 template <typename T>
 static std::array<T, 32> get_rtl_regs(const std::string &reg_scope) {
   std::array<T, 32> ret;
@@ -239,14 +159,8 @@ int OtbnModel::start_operation(command_t command) {
         cmd_desc = "execute";
         iss_command = ISSWrapper::Execute;
 
-        std::string dfname(iss->make_tmp_path("dmem"));
-        std::string ifname(iss->make_tmp_path("imem"));
-
-        write_words_to_file(dfname, get_sim_memory(false));
-        write_words_to_file(ifname, get_sim_memory(true));
-
-        iss->load_d(dfname);
-        iss->load_i(ifname);
+        iss->load_d(get_sim_memory(false));
+        iss->load_i(get_sim_memory(true));
       } break;
 
       case DmemWipe:
@@ -495,14 +409,11 @@ int OtbnModel::load_dmem() {
     return -1;
   }
 
-  const MemArea &dmem = mem_util_.GetMemArea(false);
-
-  std::string dfname(iss->make_tmp_path("dmem_out"));
   try {
     // Read DMEM from the ISS
-    iss->dump_d(dfname);
-    set_sim_memory(false,
-                   read_words_from_file(dfname, dmem.GetSizeBytes() / 4));
+    Ecc32MemArea::EccWords words;
+    iss->dump_d(&words);
+    set_sim_memory(false, words);
   } catch (const std::exception &err) {
     std::cerr << "Error when loading dmem from ISS: " << err.what() << "\n";
     return -1;
@@ -657,9 +568,12 @@ ISSWrapper *OtbnModel::ensure_wrapper() {
   if (!iss_) {
     try {
       iss_.reset(new ISSWrapper());
+      iss_->map_mems(mem_util_.GetMemArea(false).GetSizeBytes() / 4,
+                     mem_util_.GetMemArea(true).GetSizeBytes() / 4);
     } catch (const std::runtime_error &err) {
       std::cerr << "Error when constructing ISS wrapper: " << err.what()
                 << "\n";
+      iss_.reset();
       return nullptr;
     }
   }
@@ -681,11 +595,8 @@ bool OtbnModel::check_dmem(ISSWrapper &iss) const {
   const MemArea &dmem = mem_util_.GetMemArea(false);
   uint32_t dmem_bytes = dmem.GetSizeBytes();
 
-  std::string dfname(iss.make_tmp_path("dmem_out"));
-
-  iss.dump_d(dfname);
-  Ecc32MemArea::EccWords iss_words =
-      read_words_from_file(dfname, dmem_bytes / 4);
+  Ecc32MemArea::EccWords iss_words;
+  iss.dump_d(&iss_words);
   assert(iss_words.size() == dmem_bytes / 4);
 
   Ecc32MemArea::EccWords rtl_words = get_sim_memory(false);
@@ -48,8 +48,8 @@ void OtbnTraceChecker::AcceptTraceString(const std::string &trace,
     return;
 
   done_ = false;
-  OtbnTraceEntry trace_entry;
-  if (!trace_entry.from_rtl_trace(trace)) {
+  OtbnTraceEntry &trace_entry = rtl_scratch_;
+  if (!trace_entry.from_rtl_trace(trace.data(), trace.size())) {
     seen_err_ = true;
     return;
   }
@@ -104,7 +104,7 @@ void OtbnTraceChecker::AcceptTraceString(const std::string &trace,
       // This is the first partial entry. Set the rtl_started_ flag and save
       // trace_entry.
       rtl_started_ = true;
-      rtl_entry_ = trace_entry;
+      rtl_entry_.swap(trace_entry);
     }
     return;
   }
@@ -132,27 +132,22 @@ void OtbnTraceChecker::AcceptTraceString(const std::string &trace,
 
   rtl_pending_ = true;
   rtl_started_ = false;
-  rtl_entry_ = trace_entry;
+  rtl_entry_.swap(trace_entry);
 
   if (!MatchPair()) {
     seen_err_ = true;
   }
 }
 
-bool OtbnTraceChecker::OnIssTrace(const std::vector<std::string> &lines) {
+bool OtbnTraceChecker::OnIssTrace(OtbnIssTraceEntry *entry) {
+  assert(entry);
   assert(!(rtl_pending_ && iss_pending_));
 
   if (seen_err_) {
     return false;
   }
 
-  OtbnIssTraceEntry trace_entry;
-  if (!trace_entry.from_iss_trace(lines)) {
-    // Error parsing ISS trace. This has already printed a message to stderr.
-    // Just return false to pass the error code along.
-    return false;
-  }
-
+  OtbnIssTraceEntry &trace_entry = *entry;
   done_ = false;
 
   if (iss_pending_) {
@@ -178,7 +173,7 @@ bool OtbnTraceChecker::OnIssTrace(const std::vector<std::string> &lines) {
   }
 
   iss_started_ = true;
-  iss_entry_ = trace_entry;
+  iss_entry_.swap(trace_entry);
 
   // Set the pending flag if we've got the end of an event (either E or V).
   if (iss_entry_.is_final()) {
@@ -253,10 +248,11 @@ bool OtbnTraceChecker::MatchPair() {
       no_sec_wipe_data_chk_ = false;
     }
   }
-  // We've got a matching pair of entries. Move the ISS data out of the (now
-  // defunct) iss_entry_ and into last_data_.
+  // We've got a matching pair of entries. Copy the ISS data out of the (now
+  // defunct) iss_entry_ and into last_data_. This is a copy, rather than a
+  // move, so that both keep their storage.
   if (rtl_entry_.trace_type() == OtbnTraceEntry::Exec) {
-    last_data_ = std::move(iss_entry_.data_);
+    last_data_ = iss_entry_.data_;
     last_data_vld_ = true;
   }
 
@@ -37,7 +37,6 @@
 
 #include <iosfwd>
 #include <string>
-#include <vector>
 
 #include "otbn_trace_entry.h"
 #include "otbn_trace_listener.h"
@@ -52,13 +51,18 @@ class OtbnTraceChecker : public OtbnTraceListener {
 
   // Take a trace entry from the wrapped RTL. Any mismatch error is stored
   // until the next call to an API function that can respond with the error.
+  //
+  // Unlike entries from the ISS, this arrives as the text that otbn_tracer.sv
+  // formats, so it is parsed here (into a scratch entry that is reused).
   void AcceptTraceString(const std::string &trace,
                          unsigned int cycle_count) override;
 
-  // Take a trace entry from the wrapped ISS.
+  // Take a trace entry from the wrapped ISS. To avoid a copy, this may swap
+  // the contents of *entry with an older entry, so the caller should treat it
+  // as scratch space afterwards.
   //
   // Prints an error message to stderr and returns false on mismatch.
-  bool OnIssTrace(const std::vector<std::string> &lines);
+  bool OnIssTrace(OtbnIssTraceEntry *entry);
 
   // Flush any pending entries. We need to do this on reset, to handle
   // the case where we reset the processor in the middle of a stall.
@@ -95,6 +99,10 @@ class OtbnTraceChecker : public OtbnTraceListener {
   bool iss_pending_;
   OtbnIssTraceEntry iss_entry_;
 
+  // An entry that is used to parse incoming RTL traces. This is kept between
+  // calls so that its storage can be reused.
+  OtbnTraceEntry rtl_scratch_;
+
   bool done_;
   bool seen_err_;
 
@@ -5,89 +5,208 @@
 #include "otbn_trace_entry.h"
 
 #include <cassert>
+#include <cstring>
 #include <iostream>
-#include <regex>
 #include <sstream>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+// The table of interned trace locations
+struct LocTable {
+  std::vector<std::string> names;
+  std::unordered_map<std::string, uint16_t> ids;
+};
+
+LocTable &get_loc_table() {
+  static LocTable table;
+  return table;
+}
+
+// Take the next line from the text in [*pos, end), splitting on newlines.
+// Returns false if there are no more lines.
+bool next_line(const char **pos, const char *end, const char **line,
+               size_t *len) {
+  if (*pos >= end)
+    return false;
+
+  const char *nl = (const char *)memchr(*pos, '\n', end - *pos);
+  *line = *pos;
+  *len = (nl ? nl : end) - *pos;
+  *pos = nl ? nl + 1 : end;
+  return true;
+}
+}  // namespace
+
+const size_t OtbnTraceBodyLine::kMaxValueLen;
+
+uint16_t OtbnTraceBodyLine::intern_loc(const char *loc, size_t len) {
+  LocTable &table = get_loc_table();
 
-bool OtbnTraceBodyLine::fill_from_string(const std::string &src,
-                                         const std::string &line) {
-  // A valid line matches the following regex
-  std::regex re("(.) ([^:]+): (.+)");
-  std::smatch match;
+  // Location names are short enough that this doesn't need a heap allocation.
+  std::string name(loc, len);
+  auto it = table.ids.find(name);
+  if (it != table.ids.end())
+    return it->second;
+
+  assert(table.names.size() <= UINT16_MAX);
+  uint16_t id = table.names.size();
+  table.names.push_back(name);
+  table.ids.insert(std::make_pair(name, id));
+  return id;
+}
 
-  if (!std::regex_match(line, match, re)) {
+const std::string &OtbnTraceBodyLine::loc_name(uint16_t loc) {
+  const LocTable &table = get_loc_table();
+  assert(loc < table.names.size());
+  return table.names[loc];
+}
+
+bool OtbnTraceBodyLine::fill_from_string(const char *src, const char *line,
+                                         size_t len) {
+  // A valid line has a type character, a space, then a location (with no
+  // colons), then ": " and a non-empty value.
+  const char *colon = len > 2 ? (const char *)memchr(line + 2, ':', len - 2)
+                              : nullptr;
+  size_t loc_len = colon ? colon - (line + 2) : 0;
+  size_t value_pos = 2 + loc_len + 2;
+
+  if (!colon || line[1] != ' ' || loc_len == 0 || value_pos >= len ||
+      colon[1] != ' ') {
     std::cerr << "OTBN trace body line from " << src
-              << " does not have expected format. Saw: `" << line << "'.\n";
+              << " does not have expected format. Saw: `"
+              << std::string(line, len) << "'.\n";
     return false;
   }
 
-  assert(match.size() == 4);
-
-  raw_ = line;
-  type_ = match[1].str()[0];
-  loc_ = match[2].str();
-  value_ = match[3].str();
-  return true;
+  return fill(src, line[0], intern_loc(line + 2, loc_len), line + value_pos,
+              len - value_pos);
 }
 
-bool OtbnTraceBodyLine::operator==(const OtbnTraceBodyLine &other) const {
-  // If the raw lines are identical, the two objects are identical and no
-  // further checks are required.
-  if (raw_ == other.raw_) {
-    return true;
+bool OtbnTraceBodyLine::fill(const char *src, char type, uint16_t loc,
+                             const char *value, size_t value_len) {
+  if (value_len > kMaxValueLen) {
+    std::cerr << "OTBN trace body line from " << src << " for `"
+              << loc_name(loc) << "' has a value that is longer than "
+              << kMaxValueLen << " characters. Saw: `"
+              << std::string(value, value_len) << "'.\n";
+    return false;
   }
 
-  // If the raw lines are not identical, the two objects can be identical if one
-  // of them contains unknown values.
+  type_ = type;
+  loc_ = loc;
+  value_len_ = value_len;
+  memcpy(value_, value, value_len);
+  return true;
+}
 
-  // Type and location have to be identical, though.
+bool OtbnTraceBodyLine::operator==(const OtbnTraceBodyLine &other) const {
+  // Type and location have to be identical.
   if (type_ != other.type_ || loc_ != other.loc_) {
     return false;
   }
 
   // The values have to be of identical length.
-  if (value_.size() != other.value_.size()) {
+  if (value_len_ != other.value_len_) {
     return false;
   }
 
-  // Compare values digit by digit and treat `x` as unknown value, which is
-  // identical to any other value.
-  std::string::const_iterator other_it = other.value_.begin();
-  for (std::string::const_iterator it = value_.begin(); it != value_.end();
-       it++) {
-    if (*it != *other_it && !(*it == 'x' || *other_it == 'x')) {
+  // If the values are identical, the two objects are identical and no further
+  // checks are required.
+  if (0 == memcmp(value_, other.value_, value_len_)) {
+    return true;
+  }
+
+  // Otherwise, the two objects can be identical if one of them contains
+  // unknown values. Compare values digit by digit and treat `x` as unknown
+  // value, which is identical to any other value.
+  for (size_t i = 0; i < value_len_; ++i) {
+    char a = value_[i], b = other.value_[i];
+    if (a != b && !(a == 'x' || b == 'x')) {
       return false;
     }
-    other_it++;
   }
   return true;
 }
 
-bool OtbnTraceEntry::from_rtl_trace(const std::string &trace) {
-  size_t eol = trace.find('\n');
-  hdr_ = trace.substr(0, eol);
-  trace_type_ = hdr_to_trace_type(hdr_);
+void OtbnTraceBodyLine::print(std::ostream &os) const {
+  os << type_ << ' ' << loc_name(loc_) << ": ";
+  os.write(value_, value_len_);
+}
+
+bool OtbnTraceEntry::add_write(const char *src, const char *line,
+                               size_t len) {
+  writes_.emplace_back();
+  if (!writes_.back().fill_from_string(src, line, len)) {
+    writes_.pop_back();
+    return false;
+  }
+  return true;
+}
+
+bool OtbnTraceEntry::from_rtl_trace(const char *trace, size_t len) {
+  const char *pos = trace, *end = trace + len;
+  const char *line;
+  size_t line_len;
 
-  while (eol != std::string::npos) {
-    size_t bol = eol + 1;
-    eol = trace.find('\n', bol);
-    size_t line_len =
-        (eol == std::string::npos) ? std::string::npos : eol - bol;
-    std::string line = trace.substr(bol, line_len);
+  writes_.clear();
+  if (next_line(&pos, end, &line, &line_len)) {
+    hdr_.assign(line, line_len);
+  } else {
+    hdr_.clear();
+  }
+  trace_type_ = hdr_to_trace_type(hdr_);
 
+  while (next_line(&pos, end, &line, &line_len)) {
     // We're only interested in register writes
-    if (!(line.size() > 0 && line[0] == '>'))
+    if (!(line_len > 0 && line[0] == '>'))
       continue;
 
-    OtbnTraceBodyLine parsed_line;
-    if (!parsed_line.fill_from_string("RTL", line)) {
+    if (!add_write("RTL", line, line_len)) {
       return false;
     }
-    writes_[parsed_line.get_loc()].push_back(parsed_line);
   }
   return true;
 }
 
+namespace {
+// Find the writes to loc in writes. Return the number of them and set *first
+// and *last to point at the first and last (which are not changed if there
+// are no writes).
+size_t find_writes(const std::vector<OtbnTraceBodyLine> &writes, uint16_t loc,
+                   const OtbnTraceBodyLine **first,
+                   const OtbnTraceBodyLine **last) {
+  size_t count = 0;
+  for (const OtbnTraceBodyLine &line : writes) {
+    if (line.get_loc() != loc)
+      continue;
+    if (count == 0)
+      *first = &line;
+    *last = &line;
+    ++count;
+  }
+  return count;
+}
+
+// Return true if writes[idx] is the first write to its location
+bool is_first_write(const std::vector<OtbnTraceBodyLine> &writes, size_t idx) {
+  for (size_t i = 0; i < idx; ++i) {
+    if (writes[i].get_loc() == writes[idx].get_loc())
+      return false;
+  }
+  return true;
+}
+
+// Count the number of distinct locations written
+size_t count_locs(const std::vector<OtbnTraceBodyLine> &writes) {
+  size_t count = 0;
+  for (size_t i = 0; i < writes.size(); ++i) {
+    count += is_first_write(writes, i) ? 1 : 0;
+  }
+  return count;
+}
+}  // namespace
+
 bool OtbnTraceEntry::compare_rtl_iss_entries(const OtbnTraceEntry &other,
                                              bool no_sec_wipe_data_chk,
                                              std::string *err_desc) const {
@@ -98,26 +217,22 @@ bool OtbnTraceEntry::compare_rtl_iss_entries(const OtbnTraceEntry &other,
     return false;
   }
 
-  for (const auto &rtlptr : writes_) {
-    auto isskey = other.writes_.find(rtlptr.first);
-    if (isskey == other.writes_.end()) {
-      std::ostringstream oss;
-      oss << "RTL had a write to `" << rtlptr.first
-          << "', but the ISS doesn't have a write to that location.";
-      *err_desc = oss.str();
-      return false;
-    }
-    // compare rtlptr.second and isskey.second
-    if (!check_entries_compatible(trace_type_, rtlptr.first, rtlptr.second,
-                                  isskey->second, no_sec_wipe_data_chk,
-                                  err_desc))
+  for (size_t i = 0; i < writes_.size(); ++i) {
+    if (!is_first_write(writes_, i))
+      continue;
+
+    uint16_t loc = writes_[i].get_loc();
+    if (!check_entries_compatible(trace_type_, loc, *this, other,
+                                  no_sec_wipe_data_chk, err_desc))
       return false;
   }
 
-  if (writes_.size() != other.writes_.size()) {
+  size_t rtl_locs = count_locs(writes_);
+  size_t iss_locs = count_locs(other.writes_);
+  if (rtl_locs != iss_locs) {
     std::ostringstream oss;
-    oss << "RTL wrote to " << writes_.size() << " locations; the ISS wrote to "
-        << other.writes_.size() << ".";
+    oss << "RTL wrote to " << rtl_locs << " locations; the ISS wrote to "
+        << iss_locs << ".";
     *err_desc = oss.str();
     return false;
   }
@@ -127,30 +242,25 @@ bool OtbnTraceEntry::compare_rtl_iss_entries(const OtbnTraceEntry &other,
 
 void OtbnTraceEntry::print(const std::string &indent, std::ostream &os) const {
   os << indent << hdr_ << "\n";
-  for (const auto &pr : writes_) {
-    for (const auto &line : pr.second) {
-      os << indent << line.get_string() << "\n";
-    }
+  for (const auto &line : writes_) {
+    os << indent;
+    line.print(os);
+    os << "\n";
   }
 }
 
 void OtbnTraceEntry::take_writes(const OtbnTraceEntry &other,
                                  bool other_first) {
-  for (const auto &pr : other.writes_) {
-    std::vector<OtbnTraceBodyLine> &so_far = writes_[pr.first];
-    if (other_first) {
-      // If other_first is true, we should prepend the writes from other. We do
-      // so by creating a temporary vector (with a copy of the writes from
-      // other) and then appending any writes we had before.
-      std::vector<OtbnTraceBodyLine> tmp(pr.second);
-      tmp.insert(tmp.end(), so_far.begin(), so_far.end());
-      writes_[pr.first] = tmp;
-    } else {
-      // If other_first is false, we should append the writes from other. We
-      // can do that with just a call to insert.
-      so_far.insert(so_far.end(), pr.second.begin(), pr.second.end());
-    }
-  }
+  // Writes are kept in order, so the writes from other go either before or
+  // after the ones we have already.
+  auto pos = other_first ? writes_.begin() : writes_.end();
+  writes_.insert(pos, other.writes_.begin(), other.writes_.end());
+}
+
+void OtbnTraceEntry::swap(OtbnTraceEntry &other) {
+  std::swap(trace_type_, other.trace_type_);
+  hdr_.swap(other.hdr_);
+  writes_.swap(other.writes_);
 }
 
 bool OtbnTraceEntry::is_compatible(const OtbnTraceEntry &prev) const {
@@ -220,24 +330,38 @@ bool OtbnTraceEntry::is_final() const {
           (trace_type_ == OtbnTraceEntry::WipeComplete));
 }
 
-bool OtbnTraceEntry::check_entries_compatible(
-    trace_type_t type, const std::string &key,
-    const std::vector<OtbnTraceBodyLine> &rtl_lines,
-    const std::vector<OtbnTraceBodyLine> &iss_lines, bool no_sec_wipe_data_chk,
-    std::string *err_desc) {
-  assert(rtl_lines.size() && iss_lines.size());
+bool OtbnTraceEntry::check_entries_compatible(trace_type_t type, uint16_t loc,
+                                              const OtbnTraceEntry &rtl,
+                                              const OtbnTraceEntry &iss,
+                                              bool no_sec_wipe_data_chk,
+                                              std::string *err_desc) {
   assert(type == WipeComplete || type == Exec);
   assert(err_desc);
 
+  const std::string &key = OtbnTraceBodyLine::loc_name(loc);
+
+  const OtbnTraceBodyLine *rtl_first = nullptr, *rtl_last = nullptr;
+  size_t rtl_count = find_writes(rtl.writes_, loc, &rtl_first, &rtl_last);
+  assert(rtl_count);
+
+  const OtbnTraceBodyLine *iss_first = nullptr, *iss_last = nullptr;
+  if (!find_writes(iss.writes_, loc, &iss_first, &iss_last)) {
+    std::ostringstream oss;
+    oss << "RTL had a write to `" << key
+        << "', but the ISS doesn't have a write to that location.";
+    *err_desc = oss.str();
+    return false;
+  }
+
   if (type == WipeComplete && key != "FLAGS0" && key != "FLAGS1") {
-    if (rtl_lines.size() != 2) {
+    if (rtl_count != 2) {
       std::ostringstream oss;
-      oss << "There are " << rtl_lines.size() << "RTL lines for key `" << key
+      oss << "There are " << rtl_count << "RTL lines for key `" << key
           << "'; we expected 2.";
       *err_desc = oss.str();
       return false;
     }
-    if (!no_sec_wipe_data_chk && rtl_lines.front() == rtl_lines.back()) {
+    if (!no_sec_wipe_data_chk && *rtl_first == *rtl_last) {
       std::ostringstream oss;
       oss << "Repeated identical RTL lines for key `" << key << "'.";
       *err_desc = oss.str();
@@ -245,7 +369,7 @@ bool OtbnTraceEntry::check_entries_compatible(
     }
   }
 
-  if (!(rtl_lines.back() == iss_lines.back())) {
+  if (!(*rtl_last == *iss_last)) {
     std::ostringstream oss;
     oss << "Final values of ISS and RTL don't match for key `" << key << "'.";
     *err_desc = oss.str();
@@ -275,66 +399,43 @@ OtbnTraceEntry::trace_type_t OtbnTraceEntry::hdr_to_trace_type(
   }
 }
 
-bool OtbnIssTraceEntry::from_iss_trace(const std::vector<std::string> &lines) {
-  // Read FSM. state 0 = read header; state 1 = read mnemonic (for E
-  // lines); state 2 = read writes
-  int state = 0;
-
-  std::regex re("# @0x([0-9a-f]{8}): (.*)");
-  std::smatch match;
-
-  for (const std::string &line : lines) {
-    switch (state) {
-      case 0:
-        hdr_ = line;
-        trace_type_ = hdr_to_trace_type(hdr_);
-        state = (!line.empty() && line[0] == 'E') ? 1 : 2;
-        break;
-
-      case 1:
-        // This some "special" extra data from the ISS that we use for
-        // functional coverage calculations. The line should be of the form
-        //
-        //  # @ADDR: MNEMONIC
-        //
-        // where ADDR is an 8-digit instruction address (in hex) and mnemonic
-        // is the string mnemonic.
-        if (!std::regex_match(line, match, re)) {
-          std::cerr << "Bad 'special' line for ISS trace with header `" << hdr_
-                    << "': `" << line << "'.\n";
-          return false;
-        }
-        assert(match.size() == 3);
-        data_.insn_addr =
-            (uint32_t)strtoul(match[1].str().c_str(), nullptr, 16);
-        data_.mnemonic = match[2].str();
-        state = 2;
-        break;
-
-      default: {
-        assert(state == 2);
-        // Ignore '!' lines (which are used to tell the simulation about
-        // external register changes, not tracked by the RTL core simulation)
-        bool is_bang = (line.size() > 0 && line[0] == '!');
-        if (!is_bang) {
-          OtbnTraceBodyLine parsed_line;
-          if (!parsed_line.fill_from_string("ISS", line)) {
-            return false;
-          }
-          writes_[parsed_line.get_loc()].push_back(parsed_line);
-        }
-        break;
-      }
-    }
+bool OtbnIssTraceEntry::start_iss_trace(const char *hdr, size_t hdr_len,
+                                        uint32_t insn_addr,
+                                        const char *mnemonic,
+                                        size_t mnemonic_len) {
+  hdr_.assign(hdr, hdr_len);
+  trace_type_ = hdr_to_trace_type(hdr_);
+  writes_.clear();
+
+  // An E line should come with the address and mnemonic of the instruction
+  // that executed. This is some "special" extra data from the ISS that we use
+  // for functional coverage calculations.
+  if ((trace_type_ == Exec) != (mnemonic != nullptr)) {
+    std::cerr << "ISS trace with header `" << hdr_ << "' "
+              << (mnemonic ? "has" : "has no")
+              << " instruction address and mnemonic.\n";
+    return false;
   }
 
-  // We shouldn't be in state 1 here: that would mean an E line with no
-  // follow-up '#' line.
-  if (state == 1) {
-    std::cerr << "No 'special' line for ISS trace with header `" << hdr_
-              << "'.\n";
-    return false;
+  if (mnemonic) {
+    data_.insn_addr = insn_addr;
+    data_.mnemonic.assign(mnemonic, mnemonic_len);
   }
+  return true;
+}
 
+bool OtbnIssTraceEntry::add_iss_write(uint16_t loc, const char *value,
+                                      size_t value_len) {
+  writes_.emplace_back();
+  if (!writes_.back().fill("ISS", '>', loc, value, value_len)) {
+    writes_.pop_back();
+    return false;
+  }
   return true;
 }
+
+void OtbnIssTraceEntry::swap(OtbnIssTraceEntry &other) {
+  OtbnTraceEntry::swap(other);
+  std::swap(data_.insn_addr, other.data_.insn_addr);
+  data_.mnemonic.swap(other.data_.mnemonic);
+}
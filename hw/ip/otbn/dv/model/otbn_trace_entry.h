@@ -4,7 +4,9 @@
 #ifndef OPENTITAN_HW_IP_OTBN_DV_MODEL_OTBN_TRACE_ENTRY_H_
 #define OPENTITAN_HW_IP_OTBN_DV_MODEL_OTBN_TRACE_ENTRY_H_
 
-#include <map>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
 #include <string>
 #include <vector>
 
@@ -16,26 +18,51 @@
 // and we parse them accordingly here. The point is that we want to merge
 // successive writes to the same location and thus need to unpack things enough
 // to see them.
+//
+// Trace lines are handled for every instruction on both the RTL and the ISS
+// side, so this is stored compactly and without any heap allocation. The
+// location is interned (see intern_loc) and the value is kept in a fixed-size
+// buffer, which is big enough for a 256-bit value in the tracer's format. RTL
+// lines are parsed from text; the ISS sends the parts separately (see
+// stepped.py), so its lines are filled in directly with fill().
 class OtbnTraceBodyLine {
  public:
-  // Parse a line into this object, based on the format above. On success,
-  // return true. On failure, write an error message to stderr (using src to
-  // say where the line came from) and return false.
-  bool fill_from_string(const std::string &src, const std::string &line);
-
+  // The longest value that we support
+  static const size_t kMaxValueLen = 80;
+
+  // Parse a line (of length len) into this object, based on the format
+  // above. On success, return true. On failure, write an error message to
+  // stderr (using src to say where the line came from) and return false.
+  bool fill_from_string(const char *src, const char *line, size_t len);
+
+  // Fill in this object from a type, an interned location and a value (of
+  // length value_len). On success, return true. If the value is too long,
+  // write an error message to stderr (using src as above) and return false.
+  bool fill(const char *src, char type, uint16_t loc, const char *value,
+            size_t value_len);
+
+  // Two lines are equal if they have the same type and location and their
+  // values match, treating an 'x' digit on either side as a wildcard.
   bool operator==(const OtbnTraceBodyLine &other) const;
 
   // Return the location that is being read or written
-  const std::string &get_loc() const { return loc_; }
+  uint16_t get_loc() const { return loc_; }
+
+  // Print the line in its original string format
+  void print(std::ostream &os) const;
 
-  // Return the original string format for the entry
-  const std::string &get_string() const { return raw_; }
+  // Return the interned ID for the location name at loc (of length len),
+  // allocating a new ID if necessary.
+  static uint16_t intern_loc(const char *loc, size_t len);
+
+  // Return the name of an interned location
+  static const std::string &loc_name(uint16_t loc);
 
  private:
-  std::string raw_;
   char type_;
-  std::string loc_;
-  std::string value_;
+  uint8_t value_len_;
+  uint16_t loc_;
+  char value_[kMaxValueLen];
 };
 
 class OtbnTraceEntry {
@@ -50,9 +77,10 @@ class OtbnTraceEntry {
 
   virtual ~OtbnTraceEntry(){};
 
-  // Parse a trace entry from the RTL into this object. On an error, print a
-  // message to stderr and return false.
-  bool from_rtl_trace(const std::string &trace);
+  // Parse a trace entry from the RTL (len bytes at trace, with lines
+  // separated by newlines) into this object, replacing any previous contents.
+  // On an error, print a message to stderr and return false.
+  bool from_rtl_trace(const char *trace, size_t len);
 
   bool compare_rtl_iss_entries(const OtbnTraceEntry &other,
                                bool no_sec_wipe_data_chk,
@@ -62,6 +90,9 @@ class OtbnTraceEntry {
 
   void take_writes(const OtbnTraceEntry &other, bool other_first);
 
+  // Exchange contents with other (without copying the writes)
+  void swap(OtbnTraceEntry &other);
+
   trace_type_t trace_type() const { return trace_type_; }
 
   // True if this is an acceptable line to follow other (assumed to
@@ -75,23 +106,41 @@ class OtbnTraceEntry {
   bool is_final() const;
 
  protected:
-  static bool check_entries_compatible(
-      trace_type_t type, const std::string &key,
-      const std::vector<OtbnTraceBodyLine> &rtl_lines,
-      const std::vector<OtbnTraceBodyLine> &iss_lines,
-      bool no_sec_wipe_data_chk, std::string *err_desc);
+  // Parse a body line and add it to writes_. Returns false on error.
+  bool add_write(const char *src, const char *line, size_t len);
+
+  static bool check_entries_compatible(trace_type_t type, uint16_t loc,
+                                       const OtbnTraceEntry &rtl,
+                                       const OtbnTraceEntry &iss,
+                                       bool no_sec_wipe_data_chk,
+                                       std::string *err_desc);
 
   static trace_type_t hdr_to_trace_type(const std::string &hdr);
 
   trace_type_t trace_type_;
   std::string hdr_;
-  // The register writes for this trace entry, keyed by destination
-  std::map<std::string, std::vector<OtbnTraceBodyLine>> writes_;
+  // The register writes for this trace entry, in the order that they happened.
+  // There may be several writes to a location, in which case the last one is
+  // the one that counts.
+  std::vector<OtbnTraceBodyLine> writes_;
 };
 
 class OtbnIssTraceEntry : public OtbnTraceEntry {
  public:
-  bool from_iss_trace(const std::vector<std::string> &lines);
+  // Start a trace entry from the ISS, replacing any previous contents. hdr is
+  // the header line (of length hdr_len). If an instruction executed, mnemonic
+  // is its mnemonic (of length mnemonic_len) and insn_addr is its address;
+  // otherwise mnemonic is null. On an error, print a message to stderr and
+  // return false.
+  bool start_iss_trace(const char *hdr, size_t hdr_len, uint32_t insn_addr,
+                       const char *mnemonic, size_t mnemonic_len);
+
+  // Add a register write to a trace entry from the ISS. loc is an interned
+  // location (see OtbnTraceBodyLine::intern_loc) and value is in the tracer's
+  // format. On an error, print a message to stderr and return false.
+  bool add_iss_write(uint16_t loc, const char *value, size_t value_len);
+
+  void swap(OtbnIssTraceEntry &other);
 
   // Fields that are populated from the "special" line for ISS entries
   struct IssData {
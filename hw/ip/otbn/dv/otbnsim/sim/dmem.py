@@ -130,6 +130,39 @@ class Dmem:
         else:
             self._load_4byte_le_words(data)
 
+    def load_words(self, words: Sequence[int], valid: bytes) -> None:
+        '''Replace the start of memory with words
+
+        valid has a byte for each word, which is 1 if the word has valid
+        integrity bits and 0 otherwise.
+
+        '''
+        assert len(words) == len(valid)
+        if len(words) > len(self.data):
+            raise ValueError('Trying to load {} words of data, but DMEM '
+                             'is only {} words long.'
+                             .format(len(words), len(self.data)))
+
+        for idx32, (u32, vld) in enumerate(zip(words, valid)):
+            if vld not in [0, 1]:
+                raise ValueError('The validity byte for 32-bit word {} '
+                                 'in the input data is {}, not 0 or 1.'
+                                 .format(idx32, vld))
+            self.data[idx32] = u32 if vld else None
+
+    def peek_words(self) -> List[Optional[int]]:
+        '''Return the contents of memory as a list of 32-bit words
+
+        An entry is None if the word has invalid integrity bits. If there's a
+        pending store, it is applied. This matches the RTL, where we only
+        observe the memory after that store has landed.
+
+        '''
+        ret = self.data.copy()
+        for idx, u32 in self.pending.items():
+            ret[idx] = u32
+        return ret
+
     def dump_le_words(self) -> bytes:
         '''Return the contents of memory as bytes.
 
@@ -138,11 +171,7 @@ class Dmem:
 
         '''
         ret = b''
-        for idx, u32 in enumerate(self.data):
-            # If there's a pending store, apply it. This matches the RTL, where
-            # we only observe the memory after that store has landed.
-            u32 = self.pending.get(idx, u32)
-
+        for u32 in self.peek_words():
             if u32 is None:
                 ret += struct.pack('<BI', 0, 0)
             else:
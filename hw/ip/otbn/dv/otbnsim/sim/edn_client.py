@@ -47,6 +47,10 @@ class EdnClient:
             # previous OTBN run), but we now actually want the results.
             self._retry = True
 
+    def pending(self) -> bool:
+        '''True if there is a request that hasn't completed yet'''
+        return self._acc is not None
+
     def poison(self) -> None:
         '''Mark any current request as "poisoned" and clear the retry flag'''
         if self._acc is not None:
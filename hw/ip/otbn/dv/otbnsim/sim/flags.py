@@ -2,7 +2,7 @@
 # Licensed under the Apache License, Version 2.0, see LICENSE for details.
 # SPDX-License-Identifier: Apache-2.0
 
-from typing import List, Optional, cast
+from typing import List, Optional, Tuple, cast
 
 from .trace import Trace
 
@@ -20,10 +20,10 @@ class TraceFlags(Trace):
                         int(self.value.L),
                         int(self.value.Z)))
 
-    def rtl_trace(self) -> str:
-        return ('> FLAGS{}: {{C: {}, M: {}, L: {}, Z: {}}}'
-                .format(self.group,
-                        int(self.value.C),
+    def rtl_write(self) -> Tuple[str, str]:
+        return ('FLAGS{}'.format(self.group),
+                '{{C: {}, M: {}, L: {}, Z: {}}}'
+                .format(int(self.value.C),
                         int(self.value.M),
                         int(self.value.L),
                         int(self.value.Z)))
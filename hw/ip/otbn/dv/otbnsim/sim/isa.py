@@ -104,14 +104,16 @@ class OTBNInsn:
         assert -(1 << 31) <= value < (1 << 31)
         return (1 << 32) + value if value < 0 else value
 
-    def rtl_trace(self, pc: int) -> str:
-        '''Return the RTL trace entry for executing this insn'''
+    def rtl_trace_hdr(self, pc: int) -> str:
+        '''Return the header line of the RTL trace entry for this insn'''
         if self.has_bits:
-            return (f'E PC: {pc:#010x}, insn: {self.raw:#010x}\n'
-                    f'# @{pc:#010x}: {self.insn.mnemonic}')
+            return f'E PC: {pc:#010x}, insn: {self.raw:#010x}'
         else:
-            return (f'E PC: {pc:#010x}, insn: ??\n'
-                    f'# @{pc:#010x}: ??')
+            return f'E PC: {pc:#010x}, insn: ??'
+
+    def rtl_mnemonic(self) -> str:
+        '''Return the mnemonic that goes in the RTL trace entry'''
+        return self.insn.mnemonic if self.has_bits else '??'
 
 
 class RV32RegReg(OTBNInsn):
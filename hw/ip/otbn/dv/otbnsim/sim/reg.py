@@ -2,7 +2,7 @@
 # Licensed under the Apache License, Version 2.0, see LICENSE for details.
 # SPDX-License-Identifier: Apache-2.0
 
-from typing import List, Optional, Set
+from typing import List, Optional, Set, Tuple
 
 from .trace import Trace
 
@@ -20,9 +20,8 @@ class TraceRegister(Trace):
         else:
             return '0x' + 'x' * (self.width // 4)
 
-    def rtl_trace(self) -> str:
-        return '> {}: {}'.format(self.name,
-                                 Trace.hex_value(self.new_value, self.width))
+    def rtl_write(self) -> Tuple[str, str]:
+        return (self.name, Trace.hex_value(self.new_value, self.width))
 
 
 class Reg:
@@ -188,6 +188,15 @@ class OTBNState:
 
         self.wsrs.URND.set_seed(w64s)
 
+    def waiting_for_edn(self) -> bool:
+        '''True if there is an EDN request (for RND or URND) in flight
+
+        Until it completes, this model can't make progress without input from
+        outside (or is prefetching RND, which will need that input soon).
+        '''
+        return (self._urnd_client.pending() or
+                self.ext_regs.read('RND_REQ', True) != 0)
+
     def start_init_sec_wipe(self) -> None:
         self._init_sec_wipe_state = InitSecWipeState.IN_PROGRESS
         # OTBN will request a new URND value, so the model has to do the same.
@@ -2,7 +2,7 @@
 # Licensed under the Apache License, Version 2.0, see LICENSE for details.
 # SPDX-License-Identifier: Apache-2.0
 
-from typing import Optional
+from typing import Optional, Tuple
 
 
 class Trace:
@@ -21,7 +21,22 @@ class Trace:
 
         This is used by the stepped interface (which gets compared with the RTL
         model). Return None if the RTL trace doesn't have an entry for this
-        item (the default behaviour).
+        item. By default, this is a "> LOC: VALUE" line if rtl_write() returns
+        something and None otherwise.
+
+        '''
+        write = self.rtl_write()
+        if write is None:
+            return None
+        return '> {}: {}'.format(*write)
+
+    def rtl_write(self) -> Optional[Tuple[str, str]]:
+        '''Return the location and value of a register write for RTL tracing
+
+        The value is formatted as in the RTL trace. The binary stepped
+        interface sends these pairs rather than a formatted line. Return None
+        if this item isn't a register write that the RTL traces (the default
+        behaviour).
 
         '''
         return None
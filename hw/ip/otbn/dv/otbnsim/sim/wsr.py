@@ -22,9 +22,8 @@ class TraceWSR(Trace):
             s += '{:#x}'.format(self.new_value)
         return s
 
-    def rtl_trace(self) -> str:
-        return '> {}: {}'.format(self.wsr_name,
-                                 Trace.hex_value(self.new_value, 256))
+    def rtl_write(self) -> Tuple[str, str]:
+        return (self.wsr_name, Trace.hex_value(self.new_value, 256))
 
 
 class WSR:
@@ -37,6 +37,24 @@ prefixed with "0x" if they are hexadecimal.
     dump_d <path>           Write the current contents of DMEM to <path> (same
                             format as for load).
 
+    attach_shm <path> <dmem_words> <imem_words>
+
+                            Map the file at <path> as a region of memory
+                            shared with the caller, which is used to pass the
+                            contents of DMEM and IMEM without further file I/O
+                            (see below). <dmem_words> and <imem_words> are the
+                            sizes of the two memories in 32-bit words. The
+                            caller may unlink the file once this returns.
+
+    load_d_shm <num_words>  Replace the start of DMEM with the first
+                            <num_words> words of the DMEM area of shared memory
+
+    load_i_shm <num_words>  Replace the start of IMEM with the first
+                            <num_words> words of the IMEM area of shared memory
+
+    dump_d_shm              Write the current contents of DMEM to the DMEM area
+                            of shared memory
+
     print_regs              Write the hex contents of all registers to stdout
 
     edn_rnd_step            Send 32b RND Data to the model.
@@ -70,15 +88,135 @@ prefixed with "0x" if they are hexadecimal.
     send_err_escalation     React to an injected error.
 
     set_software_errs_fatal Set software_errs_fatal bit.
+
+The shared memory region has a DMEM area followed by an IMEM area. Each area
+holds an array of little-endian 32-bit words, followed by an array with a
+validity byte (0 or 1) for each word. With D = <dmem_words> and I =
+<imem_words>, the region looks like this:
+
+    [0, 4D)               DMEM words
+    [4D, 5D)              DMEM validity bytes
+    [5D, 5D + 4I)         IMEM words
+    [5D + 4I, 5D + 5I)    IMEM validity bytes
+
+If run with --binary, the simulator instead reads and writes length-prefixed
+binary frames, which is how the C++ wrapper (iss_wrapper.cc) drives it. Each
+frame is a little-endian u32 giving the number of bytes that follow, then
+those bytes. A request frame starts with a u8 opcode:
+
+    BIN_OP_STEP     Followed by a u32 <max_cycles>. Run at least one cycle and
+                    at most <max_cycles>, stopping early after a cycle that
+                    makes an externally visible change (anything other than
+                    INSN_CNT), that leaves OTBN idle or locked, or that ends
+                    with an EDN request in flight (since the data for that
+                    comes from outside). Other commands are only handled
+                    between steps, so the caller should only use
+                    <max_cycles> > 1 if it doesn't mind them arriving late.
+                    The response is a u32 cycle count and then a record for
+                    each cycle:
+
+                        u8   length of the trace header, then the header
+                        u8   1 if an instruction executed, otherwise 0
+                        if 1: u32 instruction address, u8 length of the
+                              mnemonic, then the mnemonic
+                        u8   number of new trace locations
+                        for each: u8 length of the name, then the name
+                        u16  number of register writes
+                        for each: u8 location, u8 length of the value, then
+                                  the value
+                        u8   number of external register updates
+                        for each update: u8 register (BIN_EXT_REGS), u32 value
+
+                    This carries the same information as the output of the
+                    text step command, but split up so that the caller
+                    doesn't have to parse it. The header is the first line
+                    (empty if there is nothing to trace) and the instruction
+                    address and mnemonic are from the "#" line. A register
+                    write is a "> LOC: VALUE" line, where VALUE is sent as
+                    text and LOC is a number. Locations are numbered from
+                    zero in the order that they first appear and the record
+                    where that happens gives the new names, in order, before
+                    its writes. External register updates (the "!" lines)
+                    are sent in binary. Strings are ASCII.
+
+    BIN_OP_CMD      Followed by a command line in the text format above. The
+                    response is the text that command would print, without
+                    the terminating '.' line.
+
+    BIN_OP_POST     Like BIN_OP_CMD, but there is no response. This is for
+                    commands that provide inputs, which the C++ side can then
+                    send together with the next step in a single write.
 '''
 
 import binascii
+import io
+import mmap
+import struct
 import sys
-from typing import List, Optional
+from typing import BinaryIO, Dict, List, Optional, Tuple
 
-from sim.decode import decode_file
+from sim.decode import decode_file, decode_words
+from sim.ext_regs import TraceExtRegChange
 from sim.load_elf import load_elf
 from sim.sim import OTBNSim
+from sim.trace import Trace
+
+BIN_OP_STEP = 0
+BIN_OP_CMD = 1
+BIN_OP_POST = 2
+
+# The external registers whose updates are sent by BIN_OP_STEP. The index in
+# this list is the register number in a step record. Updates to other
+# registers aren't sent.
+BIN_EXT_REGS = ['STATUS', 'INSN_CNT', 'ERR_BITS', 'STOP_PC',
+                'RND_REQ', 'WIPE_START']
+_BIN_EXT_REG_IDX = {name: idx for idx, name in enumerate(BIN_EXT_REGS)}
+
+# The numbers that BIN_OP_STEP has given to trace locations so far. Like
+# _SHARED_MEMS below, this lives for as long as the process (the caller keeps a
+# matching table), so it isn't reset with the simulator.
+_BIN_TRACE_LOCS = {}  # type: Dict[str, int]
+
+
+class SharedMems:
+    '''The shared memory region set up by attach_shm'''
+    def __init__(self, path: str, dmem_words: int, imem_words: int) -> None:
+        self.dmem_words = dmem_words
+        self.imem_words = imem_words
+        with open(path, 'r+b') as handle:
+            self.buf = mmap.mmap(handle.fileno(), 5 * (dmem_words + imem_words))
+
+    def _area(self, is_imem: bool) -> Tuple[int, int]:
+        '''Return the offset and number of words for DMEM or IMEM'''
+        if is_imem:
+            return (5 * self.dmem_words, self.imem_words)
+        return (0, self.dmem_words)
+
+    def read(self, is_imem: bool,
+             num_words: int) -> Tuple[Tuple[int, ...], bytes]:
+        '''Read words and validity bytes from the start of an area'''
+        offset, size = self._area(is_imem)
+        if num_words > size:
+            raise ValueError('Cannot read {} words from a shared memory area '
+                             'of {} words.'.format(num_words, size))
+        words = struct.unpack_from('<{}I'.format(num_words), self.buf, offset)
+        vld_offset = offset + 4 * size
+        return (words, self.buf[vld_offset:vld_offset + num_words])
+
+    def write(self, is_imem: bool, data: List[Optional[int]]) -> None:
+        '''Write a whole area, with None for words with invalid integrity'''
+        offset, size = self._area(is_imem)
+        assert len(data) == size
+        struct.pack_into('<{}I'.format(size), self.buf, offset,
+                         *[0 if u32 is None else u32 for u32 in data])
+        vld_offset = offset + 4 * size
+        self.buf[vld_offset:vld_offset + size] = \
+            bytes(0 if u32 is None else 1 for u32 in data)
+
+
+# The shared memory region, if attach_shm has been called. This is kept
+# outside the simulator object, which gets replaced on reset.
+_SHARED_MEMS = None  # type: Optional[SharedMems]
 
 
 def read_word(arg_name: str, word_data: str, bits: int) -> int:
@@ -132,10 +270,17 @@ def on_start_operation(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     return None
 
 
-def on_step(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
-    '''Step one instruction'''
-    check_arg_count('step', 0, args)
+def step_trace(sim: OTBNSim) -> Tuple[Optional[str],
+                                      Optional[Tuple[int, str]],
+                                      List[Trace]]:
+    '''Step one cycle, returning a trace header, insn and the traced changes
+
+    The second element is the address and mnemonic of the instruction that
+    executed, if there was one. The changes are those that have an RTL trace.
+    If the header is None then there is nothing to trace (and the list of
+    changes is empty).
 
+    '''
     pc = sim.state.pc
     assert 0 == pc & 3
 
@@ -143,8 +288,10 @@ def on_step(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
 
     insn, changes = sim.step(verbose=False)
 
+    executed = None  # type: Optional[Tuple[int, str]]
     if insn is not None:
-        hdr = insn.rtl_trace(pc)  # type: Optional[str]
+        hdr = insn.rtl_trace_hdr(pc)  # type: Optional[str]
+        executed = (pc, insn.rtl_mnemonic())
     elif was_wiping:
         # The trailing space is a bit naff but matches the behaviour in the RTL
         # tracer, where it's rather difficult to change.
@@ -158,11 +305,7 @@ def on_step(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     if sim.state.lock_immediately and hdr in ['V ', 'STALL']:
         hdr = None
 
-    rtl_changes = []
-    for c in changes:
-        rt = c.rtl_trace()
-        if rt is not None:
-            rtl_changes.append(rt)
+    rtl_changes = [c for c in changes if c.rtl_trace() is not None]
 
     # This is a bit of a hack. Very occasionally, we'll see traced changes when
     # there's not actually an instruction in flight. For example, this happens
@@ -173,10 +316,20 @@ def on_step(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     if hdr is None and rtl_changes:
         hdr = 'STALL'
 
+    return (hdr, executed, rtl_changes)
+
+
+def on_step(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
+    '''Step one instruction'''
+    check_arg_count('step', 0, args)
+
+    hdr, executed, rtl_changes = step_trace(sim)
     if hdr is not None:
         print(hdr)
-        for rt in rtl_changes:
-            print(rt)
+        if executed is not None:
+            print('# @{:#010x}: {}'.format(*executed))
+        for c in rtl_changes:
+            print(c.rtl_trace())
 
     return None
 
@@ -265,6 +418,79 @@ def on_dump_d(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     return None
 
 
+def get_shared_mems(cmd: str) -> SharedMems:
+    if _SHARED_MEMS is None:
+        raise RuntimeError(f'{cmd} called before attach_shm.')
+    return _SHARED_MEMS
+
+
+def on_attach_shm(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
+    '''Map a shared memory region for passing DMEM and IMEM contents'''
+    global _SHARED_MEMS
+
+    check_arg_count('attach_shm', 3, args)
+
+    path = args[0]
+    dmem_words = int(args[1], 0)
+    imem_words = int(args[2], 0)
+
+    if dmem_words != len(sim.state.dmem.data):
+        raise ValueError('attach_shm has {} DMEM words, but DMEM is {} words '
+                         'long.'.format(dmem_words, len(sim.state.dmem.data)))
+    if 4 * imem_words != sim.state.imem_size:
+        raise ValueError('attach_shm has {} IMEM words, but IMEM is {} bytes '
+                         'long.'.format(imem_words, sim.state.imem_size))
+
+    print('ATTACH_SHM {!r}'.format(path))
+    _SHARED_MEMS = SharedMems(path, dmem_words, imem_words)
+
+    return None
+
+
+def on_load_d_shm(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
+    '''Load contents of data memory from shared memory'''
+    check_arg_count('load_d_shm', 1, args)
+    mems = get_shared_mems('load_d_shm')
+
+    print('LOAD_D_SHM')
+    words, valid = mems.read(False, int(args[0], 0))
+    sim.state.dmem.load_words(words, valid)
+
+    return None
+
+
+def on_load_i_shm(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
+    '''Load contents of insn memory from shared memory'''
+    check_arg_count('load_i_shm', 1, args)
+    mems = get_shared_mems('load_i_shm')
+
+    print('LOAD_I_SHM')
+    words, valid = mems.read(True, int(args[0], 0))
+
+    data = []
+    for idx32, (vld, u32) in enumerate(zip(valid, words)):
+        if vld not in [0, 1]:
+            raise ValueError('The validity byte for 32-bit word {} '
+                             'in shared memory is {}, not 0 or 1.'
+                             .format(idx32, vld))
+        data.append((vld == 1, u32))
+
+    sim.load_program(decode_words(0, data))
+
+    return None
+
+
+def on_dump_d_shm(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
+    '''Dump contents of data memory to shared memory'''
+    check_arg_count('dump_d_shm', 0, args)
+    mems = get_shared_mems('dump_d_shm')
+
+    print('DUMP_D_SHM')
+    mems.write(False, sim.state.dmem.peek_words())
+
+    return None
+
+
 def on_print_regs(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     '''Print registers to stdout'''
     check_arg_count('print_regs', 0, args)
@@ -411,6 +637,10 @@ _HANDLERS = {
     'load_d': on_load_d,
     'load_i': on_load_i,
     'dump_d': on_dump_d,
+    'attach_shm': on_attach_shm,
+    'load_d_shm': on_load_d_shm,
+    'load_i_shm': on_load_i_shm,
+    'dump_d_shm': on_dump_d_shm,
     'print_regs': on_print_regs,
     'print_call_stack': on_print_call_stack,
     'reset': on_reset,
@@ -450,9 +680,124 @@ def on_input(sim: OTBNSim, line: str) -> Optional[OTBNSim]:
     return ret
 
 
+def bin_pack_str(text: str) -> bytes:
+    '''Pack an ASCII string with a u8 length for BIN_OP_STEP'''
+    data = text.encode('ascii')
+    assert len(data) < 256
+    return struct.pack('<B', len(data)) + data
+
+
+def bin_step(sim: OTBNSim, max_cycles: int) -> bytes:
+    '''Run up to max_cycles cycles for BIN_OP_STEP, returning the response'''
+    records = []
+    for _ in range(max(max_cycles, 1)):
+        hdr, executed, rtl_changes = step_trace(sim)
+
+        new_locs = []
+        writes = []
+        ext_updates = []
+        visible = False
+        for c in rtl_changes:
+            if isinstance(c, TraceExtRegChange):
+                idx = _BIN_EXT_REG_IDX.get(c.name)
+                if idx is not None:
+                    ext_updates.append(struct.pack('<BI', idx,
+                                                   c.erc.new_value))
+                visible = visible or c.name != 'INSN_CNT'
+                continue
+
+            write = c.rtl_write()
+            assert write is not None
+            loc, value = write
+            loc_id = _BIN_TRACE_LOCS.get(loc)
+            if loc_id is None:
+                loc_id = len(_BIN_TRACE_LOCS)
+                assert loc_id < 256
+                _BIN_TRACE_LOCS[loc] = loc_id
+                new_locs.append(bin_pack_str(loc))
+            writes.append(struct.pack('<B', loc_id) + bin_pack_str(value))
+
+        parts = [bin_pack_str(hdr or '')]
+        if executed is None:
+            parts.append(struct.pack('<B', 0))
+        else:
+            insn_addr, mnemonic = executed
+            parts.append(struct.pack('<BI', 1, insn_addr))
+            parts.append(bin_pack_str(mnemonic))
+        parts.append(struct.pack('<B', len(new_locs)))
+        parts += new_locs
+        parts.append(struct.pack('<H', len(writes)))
+        parts += writes
+        parts.append(struct.pack('<B', len(ext_updates)))
+        parts += ext_updates
+        records.append(b''.join(parts))
+
+        if visible or not (sim.state.executing() or sim.state.wiping()):
+            break
+        if sim.state.waiting_for_edn():
+            break
+
+    return struct.pack('<I', len(records)) + b''.join(records)
+
+
+def bin_read_exact(stream: BinaryIO, length: int) -> Optional[bytes]:
+    '''Read exactly length bytes, or return None on EOF'''
+    data = b''
+    while len(data) < length:
+        chunk = stream.read(length - len(data))
+        if not chunk:
+            return None
+        data += chunk
+    return data
+
+
+def bin_main(sim: OTBNSim) -> int:
+    '''Run the simulator with the binary protocol on stdin/stdout'''
+    in_stream = sys.stdin.buffer
+    out_stream = sys.stdout.buffer
+
+    # The text handlers print their responses. Collect that output in a buffer
+    # for BIN_OP_CMD and make sure nothing else can get into the binary stream.
+    text_out = io.StringIO()
+    sys.stdout = text_out
+
+    while True:
+        hdr = bin_read_exact(in_stream, 4)
+        if hdr is None:
+            return 0
+        frame = bin_read_exact(in_stream, struct.unpack('<I', hdr)[0])
+        if not frame:
+            raise RuntimeError('Truncated or empty request frame.')
+
+        op = frame[0]
+        if op == BIN_OP_STEP:
+            (max_cycles,) = struct.unpack_from('<I', frame, 1)
+            rsp = bin_step(sim, max_cycles)
+        elif op in [BIN_OP_CMD, BIN_OP_POST]:
+            text_out.seek(0)
+            text_out.truncate()
+            ret = on_input(sim, frame[1:].decode())
+            if ret is not None:
+                sim = ret
+            if op == BIN_OP_POST:
+                continue
+            # Drop the '.' that on_input printed to end the command.
+            text = text_out.getvalue()
+            assert text.endswith('.\n')
+            rsp = text[:-2].encode()
+        else:
+            raise RuntimeError('Unknown binary opcode: {}'.format(op))
+
+        out_stream.write(struct.pack('<I', len(rsp)) + rsp)
+        out_stream.flush()
+
+
 def main() -> int:
     sim = OTBNSim()
     try:
+        if sys.argv[1:] == ['--binary']:
+            return bin_main(sim)
+
         for line in sys.stdin:
             ret = on_input(sim, line)
             if ret is not None:
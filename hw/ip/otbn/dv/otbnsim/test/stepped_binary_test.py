@@ -0,0 +1,224 @@
+# Copyright lowRISC contributors.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+'''Test the binary protocol of stepped.py (as used by iss_wrapper.cc).'''
+
+import struct
+from typing import List, Tuple
+
+import py
+
+from sim.constants import Status
+from testutil import (BIN_OP_CMD, BIN_OP_POST, EXT_ERR_BITS, EXT_INSN_CNT,
+                      EXT_STATUS, BinarySim, StepRecord)
+
+# addi x2, x0, 5; addi x3, x0, 7; ecall
+PROGRAM = [0x00500113, 0x00700193, 0x00000073]
+
+
+def test_cmd_and_post(tmpdir: py.path.local) -> None:
+    '''Check that CMD gets a response and that POST doesn't'''
+    sim = BinarySim(tmpdir)
+
+    # A posted command runs, but doesn't send anything back. If it did, we'd
+    # see its response ("LOAD_D ...") instead of the one for print_regs. The
+    # response to a command is its text output without the final '.'
+    load_path = sim.write_words_file('dmem_in', [0x11111111], b'\x01')
+    sim.post('load_d {}'.format(load_path))
+    regs = sim.cmd('print_regs').split('\n')
+    assert regs[0] == 'PRINT_REGS'
+    assert regs[-1] == ''
+    assert ' x2  = 0x00000000' in regs
+
+    # Check that the posted command actually ran
+    dump_path = str(tmpdir.join('dmem_out'))
+    assert sim.cmd('dump_d {}'.format(dump_path)) == \
+        'DUMP_D {!r}\n'.format(dump_path)
+    with open(dump_path, 'rb') as handle:
+        assert struct.unpack_from('<BI', handle.read()) == (1, 0x11111111)
+
+    assert sim.close() == 0
+
+
+def test_batched_frames(tmpdir: py.path.local) -> None:
+    '''Check that requests can be sent in bulk and split across writes'''
+    sim = BinarySim(tmpdir)
+
+    # Send several frames in one write, without waiting for any responses.
+    # The responses come back in order, one for each CMD.
+    load_path = sim.write_words_file('dmem_in', [0x12345678], b'\x01')
+    dump_path = str(tmpdir.join('dmem_out'))
+    load_cmd = 'load_d {}'.format(load_path).encode()
+    dump_cmd = 'dump_d {}'.format(dump_path).encode()
+    sim.send_raw(sim.frame(BIN_OP_CMD, b'print_regs') +
+                 sim.frame(BIN_OP_POST, load_cmd) +
+                 sim.frame(BIN_OP_CMD, dump_cmd))
+    rsp = sim.recv()
+    assert rsp is not None and rsp.startswith(b'PRINT_REGS\n')
+    assert sim.recv() == 'DUMP_D {!r}\n'.format(dump_path).encode()
+    with open(dump_path, 'rb') as handle:
+        assert struct.unpack_from('<BI', handle.read()) == (1, 0x12345678)
+
+    # A frame that arrives a byte at a time is still a single request.
+    for byte in sim.frame(BIN_OP_CMD, b'print_regs'):
+        sim.send_raw(bytes([byte]))
+    rsp = sim.recv()
+    assert rsp is not None and rsp.startswith(b'PRINT_REGS\n')
+
+    assert sim.close() == 0
+
+
+def test_bad_frames(tmpdir: py.path.local) -> None:
+    '''Check that an empty frame or an unknown opcode is an error'''
+    for frame in [struct.pack('<I', 0), BinarySim.frame(3, b'')]:
+        sim = BinarySim(tmpdir)
+        sim.send_raw(frame)
+        assert sim.recv() is None
+        assert sim.close() != 0
+
+
+def test_post_eof(tmpdir: py.path.local) -> None:
+    '''Check that a posted command that fails gives EOF and no response'''
+    sim = BinarySim(tmpdir)
+
+    # Nothing comes back for the posted command. The simulator dies, so the
+    # caller sees EOF when it next waits for a response.
+    sim.post('no_such_command')
+    assert sim.recv() is None
+    assert sim.close() != 0
+
+
+def test_step_records(tmpdir: py.path.local) -> None:
+    '''Single-step a short program, checking each step record'''
+    sim = BinarySim(tmpdir)
+    sim.load_program(PROGRAM)
+    sim.run_secure_wipe()
+
+    assert sim.cmd('start_operation Execute') == 'START\n'
+
+    # On the first cycle, OTBN stalls waiting for URND.
+    assert sim.step(1) == [('STALL', None, [], [])]
+    sim.send_urnd()
+
+    # Step one cycle at a time until the ecall has executed, which sets
+    # ERR_BITS (to zero) as execution finishes.
+    records = []  # type: List[StepRecord]
+    while True:
+        assert len(records) < 100
+        step = sim.step(1)
+        assert len(step) == 1
+        records += step
+        if any(reg == EXT_ERR_BITS for reg, _ in step[0][3]):
+            break
+
+    # OTBN should go busy, then execute the 3 instructions in order, with
+    # INSN_CNT counting up.
+    assert (EXT_STATUS, Status.BUSY_EXECUTE) in records[0][3]
+    execs = [rec for rec in records if rec[0].startswith('E ')]
+    assert [hdr for hdr, _, _, _ in execs] == [
+        'E PC: 0x{:08x}, insn: 0x{:08x}'.format(4 * idx, insn)
+        for idx, insn in enumerate(PROGRAM)
+    ]
+    assert [insn for _, insn, _, _ in execs] == [(0, 'addi'),
+                                                 (4, 'addi'),
+                                                 (8, 'ecall')]
+    assert execs[0][2] == [('x02', '0x00000005')]
+    assert execs[1][2] == [('x03', '0x00000007')]
+    assert execs[2][2] == []
+    for idx, (_, _, _, updates) in enumerate(execs):
+        assert (EXT_INSN_CNT, idx + 1) in updates
+
+    # Each location name is sent once, the first time that it is written.
+    assert len(set(sim.trace_locs)) == len(sim.trace_locs)
+    assert 'x02' in sim.trace_locs
+
+    assert sim.close() == 0
+
+
+def test_trace_loc_interning(tmpdir: py.path.local) -> None:
+    '''Check that each trace location name is only sent once'''
+    sim = BinarySim(tmpdir)
+
+    # addi x2, x0, 5; addi x2, x2, 7; ecall
+    sim.load_program([0x00500113, 0x00710113, 0x00000073])
+    sim.run_secure_wipe()
+    assert sim.cmd('start_operation Execute') == 'START\n'
+    assert sim.step(1) == [('STALL', None, [], [])]
+    sim.send_urnd()
+
+    # Both addi instructions write to x2. The secure wipe has already written
+    # to every register, so x2 has a number and neither step names it again.
+    assert 'x02' in sim.trace_locs
+    num_locs = len(sim.trace_locs)
+    writes = []  # type: List[Tuple[str, str]]
+    while True:
+        step = sim.step(1)
+        if step[0][1] is not None and step[0][1][1] == 'addi':
+            writes += step[0][2]
+        if step[0][1] == (8, 'ecall'):
+            break
+        assert len(writes) <= 2
+
+    assert writes == [('x02', '0x00000005'), ('x02', '0x0000000c')]
+    assert len(sim.trace_locs) == num_locs
+    assert len(set(sim.trace_locs)) == len(sim.trace_locs)
+
+    assert sim.close() == 0
+
+
+def test_step_multi_cycle(tmpdir: py.path.local) -> None:
+    '''Check that a step with max_cycles > 1 stops on visible changes'''
+    sim = BinarySim(tmpdir)
+    sim.load_program(PROGRAM)
+
+    # The initial secure wipe starts by requesting URND. The step stops after
+    # a single cycle because OTBN is waiting for EDN.
+    assert sim.cmd('initial_secure_wipe') == ''
+    assert len(sim.step(10000)) == 1
+
+    # Stepping again without sending URND stalls for another cycle and stops
+    # again, rather than running on for max_cycles.
+    assert len(sim.step(10000)) == 1
+    sim.send_urnd()
+
+    # With URND, the first round of the wipe can run. A step never runs for
+    # more than max_cycles cycles.
+    records = sim.step(5)
+    assert len(records) == 5
+
+    # The rest of the round runs in one step, which stops on the EDN request
+    # for the second round.
+    records = sim.step(10000)
+    assert len(records) > 1
+    assert all(updates == [] for _, _, _, updates in records)
+    sim.send_urnd()
+
+    # The second round runs to the end of the wipe, which stops on the
+    # visible change to STATUS.
+    records = sim.step(10000)
+    assert len(records) > 1
+    assert records[-1][3] == [(EXT_STATUS, Status.IDLE)]
+    assert all(updates == [] for _, _, _, updates in records[:-1])
+
+    # Start the program. The first step stalls for URND, as above.
+    assert sim.cmd('start_operation Execute') == 'START\n'
+    assert [hdr for hdr, _, _, _ in sim.step(10000)] == ['STALL']
+    sim.send_urnd()
+
+    # OTBN goes busy, which is visible, so that's a step on its own.
+    records = sim.step(10000)
+    assert len(records) == 1
+    assert (EXT_STATUS, Status.BUSY_EXECUTE) in records[0][3]
+
+    # The next step runs all three instructions. INSN_CNT changes don't stop
+    # a step, but the ecall sets ERR_BITS, which does.
+    records = sim.step(10000)
+    execs = [insn for _, insn, _, _ in records if insn is not None]
+    assert execs == [(0, 'addi'), (4, 'addi'), (8, 'ecall')]
+    assert records[-1][1] == (8, 'ecall')
+    assert any(reg == EXT_ERR_BITS for reg, _ in records[-1][3])
+    for _, _, _, updates in records[:-1]:
+        assert all(reg == EXT_INSN_CNT for reg, _ in updates)
+
+    assert sim.close() == 0
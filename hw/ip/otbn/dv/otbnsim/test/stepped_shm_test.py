@@ -0,0 +1,147 @@
+# Copyright lowRISC contributors.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+'''Test the shared memory commands of stepped.py (used by iss_wrapper.cc).'''
+
+import mmap
+import struct
+from typing import List, Sequence, Tuple
+
+import py
+
+from shared.mem_layout import get_memory_layout
+from testutil import BinarySim, StepRecord
+
+# addi x2, x0, 5; addi x3, x0, 7; ecall
+PROGRAM = [0x00500113, 0x00700193, 0x00000073]
+
+
+class ShmSim(BinarySim):
+    '''A BinarySim with a shared memory region attached'''
+    def __init__(self, tmpdir: py.path.local) -> None:
+        super().__init__(tmpdir)
+
+        layout = get_memory_layout()
+        self.dmem_words = layout.dmem_size_bytes // 4
+        self.imem_words = layout.imem_size_bytes // 4
+
+        shm_path = str(tmpdir.join('shm'))
+        with open(shm_path, 'wb') as handle:
+            handle.truncate(5 * (self.dmem_words + self.imem_words))
+        with open(shm_path, 'r+b') as handle:
+            self.shm = mmap.mmap(handle.fileno(), 0)
+
+        assert self.cmd('attach_shm {} {} {}'
+                        .format(shm_path,
+                                self.dmem_words,
+                                self.imem_words)).startswith('ATTACH_SHM ')
+
+    def close(self) -> int:
+        ret = super().close()
+        self.shm.close()
+        return ret
+
+    def write_shm(self, is_imem: bool,
+                  words: Sequence[int], valid: bytes) -> None:
+        '''Write words and validity bytes to the start of a shm area'''
+        offset, size = self._area(is_imem)
+        struct.pack_into('<{}I'.format(len(words)), self.shm, offset, *words)
+        self.shm[offset + 4 * size:offset + 4 * size + len(valid)] = valid
+
+    def read_shm(self, is_imem: bool) -> Tuple[List[int], bytes]:
+        '''Read a whole shm area, returning words and validity bytes'''
+        offset, size = self._area(is_imem)
+        words = list(struct.unpack_from('<{}I'.format(size),
+                                        self.shm, offset))
+        return (words, self.shm[offset + 4 * size:offset + 5 * size])
+
+    def _area(self, is_imem: bool) -> Tuple[int, int]:
+        if is_imem:
+            return (5 * self.dmem_words, self.imem_words)
+        return (0, self.dmem_words)
+
+
+def test_shm_round_trip(tmpdir: py.path.local) -> None:
+    '''Load DMEM through shared memory and then dump it back'''
+    sim = ShmSim(tmpdir)
+
+    words = [0x100 * idx + 0xab for idx in range(16)]
+    valid = bytes([0 if idx in [3, 10] else 1 for idx in range(16)])
+    sim.write_shm(False, words, valid)
+    assert sim.cmd('load_d_shm {}'.format(len(words))) == 'LOAD_D_SHM\n'
+
+    # Clear the area so that we can see what dump_d_shm writes
+    sim.write_shm(False,
+                  [0xffffffff] * sim.dmem_words, bytes([2] * sim.dmem_words))
+    assert sim.cmd('dump_d_shm') == 'DUMP_D_SHM\n'
+
+    dumped_words, dumped_valid = sim.read_shm(False)
+    for idx in range(len(words)):
+        if valid[idx]:
+            assert dumped_words[idx] == words[idx]
+            assert dumped_valid[idx] == 1
+        else:
+            # Words with bad integrity are dumped as zero
+            assert dumped_words[idx] == 0
+            assert dumped_valid[idx] == 0
+
+    # Nothing has been written to the rest of DMEM, so it has no valid data.
+    assert set(dumped_words[len(words):]) == {0}
+    assert set(dumped_valid[len(words):]) == {0}
+
+    assert sim.close() == 0
+
+
+def test_posted_load_d_shm(tmpdir: py.path.local) -> None:
+    '''Post load_d_shm, as OtbnModel does when it starts an operation'''
+    sim = ShmSim(tmpdir)
+
+    sim.write_shm(False, [0x11111111], b'\x01')
+    sim.post('load_d_shm 1')
+
+    # The response to print_regs shows that the posted command has run, so we
+    # can now safely overwrite shared memory.
+    assert sim.cmd('print_regs').startswith('PRINT_REGS\n')
+    sim.write_shm(False, [0], b'\x00')
+    assert sim.cmd('dump_d_shm') == 'DUMP_D_SHM\n'
+    words, valid = sim.read_shm(False)
+    assert words[0] == 0x11111111
+    assert valid[0] == 1
+
+    assert sim.close() == 0
+
+
+def test_load_i_shm(tmpdir: py.path.local) -> None:
+    '''Load a program through shared memory and run it'''
+    sim = ShmSim(tmpdir)
+
+    sim.write_shm(True, PROGRAM, bytes([1] * len(PROGRAM)))
+    assert sim.cmd('load_i_shm {}'.format(len(PROGRAM))) == 'LOAD_I_SHM\n'
+    sim.run_secure_wipe()
+
+    # Execution starts by waiting for URND.
+    assert sim.cmd('start_operation Execute') == 'START\n'
+    assert [hdr for hdr, _, _, _ in sim.step(10000)] == ['STALL']
+    sim.send_urnd()
+    records = []  # type: List[StepRecord]
+    while not any(insn == (8, 'ecall') for _, insn, _, _ in records):
+        assert len(records) < 100
+        records += sim.step(10000)
+
+    execs = [insn for _, insn, _, _ in records if insn is not None]
+    assert execs == [(0, 'addi'), (4, 'addi'), (8, 'ecall')]
+
+    assert sim.close() == 0
+
+
+def test_load_i_shm_bad_validity(tmpdir: py.path.local) -> None:
+    '''A validity byte other than 0 or 1 in IMEM is an error'''
+    sim = ShmSim(tmpdir)
+
+    sim.write_shm(True, PROGRAM, bytes([1, 2, 1]))
+    sim.post('load_i_shm {}'.format(len(PROGRAM)))
+
+    # The error kills the simulator without a response.
+    assert sim.recv() is None
+    assert sim.close() != 0
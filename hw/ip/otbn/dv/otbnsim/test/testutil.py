@@ -3,10 +3,14 @@
 # SPDX-License-Identifier: Apache-2.0
 
 import os
+import struct
 import subprocess
+import sys
 import tempfile
+from typing import List, Optional, Sequence, Tuple
 
 import py
+from sim.constants import Status
 from sim.load_elf import load_elf
 from sim.standalonesim import StandaloneSim
 
@@ -60,3 +64,157 @@ def prepare_sim_for_asm_str(assembly: str, tmpdir: py.path.local,
         fp.write(assembly)
         fp.flush()
         return prepare_sim_for_asm_file(fp.name, tmpdir, collect_stats)
+
+
+# Opcodes for the binary protocol of stepped.py
+BIN_OP_STEP = 0
+BIN_OP_CMD = 1
+BIN_OP_POST = 2
+
+# Register indices from BIN_EXT_REGS in stepped.py
+EXT_STATUS = 0
+EXT_INSN_CNT = 1
+EXT_ERR_BITS = 2
+
+# A step record: (header, (insn_addr, mnemonic) or None,
+#                 [(location, value), ...], [(register, value), ...])
+StepRecord = Tuple[str, Optional[Tuple[int, str]],
+                   List[Tuple[str, str]], List[Tuple[int, int]]]
+
+
+class BinarySim:
+    '''A stepped.py process that is driven with the binary protocol'''
+    def __init__(self, tmpdir: py.path.local) -> None:
+        self.tmpdir = tmpdir
+
+        # The names of the trace locations that the simulator has numbered so
+        # far
+        self.trace_locs = []  # type: List[str]
+
+        self.proc = subprocess.Popen([sys.executable,
+                                      os.path.join(SIM_DIR, 'stepped.py'),
+                                      '--binary'],
+                                     stdin=subprocess.PIPE,
+                                     stdout=subprocess.PIPE)
+
+    def close(self) -> int:
+        '''Close the simulator's stdin and return its exit code'''
+        assert self.proc.stdin is not None
+        self.proc.stdin.close()
+        ret = self.proc.wait(timeout=60)
+        assert self.proc.stdout is not None
+        self.proc.stdout.close()
+        return ret
+
+    def _parse_step_response(self, rsp: bytes) -> List[StepRecord]:
+        offset = 0
+
+        def take(fmt: str) -> int:
+            nonlocal offset
+            (value,) = struct.unpack_from(fmt, rsp, offset)
+            offset += struct.calcsize(fmt)
+            return value
+
+        def take_str() -> str:
+            nonlocal offset
+            length = take('<B')
+            offset += length
+            return rsp[offset - length:offset].decode('ascii')
+
+        records = []
+        for _ in range(take('<I')):
+            hdr = take_str()
+            insn = None
+            if take('<B'):
+                insn_addr = take('<I')
+                insn = (insn_addr, take_str())
+            for _ in range(take('<B')):
+                self.trace_locs.append(take_str())
+            writes = []
+            for _ in range(take('<H')):
+                loc = self.trace_locs[take('<B')]
+                writes.append((loc, take_str()))
+            updates = []
+            for _ in range(take('<B')):
+                reg = take('<B')
+                updates.append((reg, take('<I')))
+            records.append((hdr, insn, writes, updates))
+
+        assert offset == len(rsp)
+        return records
+
+    @staticmethod
+    def frame(op: int, payload: bytes) -> bytes:
+        '''Return a length-prefixed request frame'''
+        frame = bytes([op]) + payload
+        return struct.pack('<I', len(frame)) + frame
+
+    def send_raw(self, data: bytes) -> None:
+        '''Write bytes to the simulator's stdin'''
+        assert self.proc.stdin is not None
+        self.proc.stdin.write(data)
+        self.proc.stdin.flush()
+
+    def recv(self) -> Optional[bytes]:
+        '''Read a response frame, or return None on EOF'''
+        assert self.proc.stdout is not None
+        hdr = self.proc.stdout.read(4)
+        if not hdr:
+            return None
+        assert len(hdr) == 4
+        (length,) = struct.unpack('<I', hdr)
+        data = self.proc.stdout.read(length)
+        assert len(data) == length
+        return data
+
+    def _recv(self) -> bytes:
+        data = self.recv()
+        assert data is not None, 'EOF from stepped.py'
+        return data
+
+    def cmd(self, line: str) -> str:
+        '''Run a command and return its response'''
+        self.send_raw(self.frame(BIN_OP_CMD, line.encode()))
+        return self._recv().decode()
+
+    def post(self, line: str) -> None:
+        '''Run a command without waiting for (or getting) a response'''
+        self.send_raw(self.frame(BIN_OP_POST, line.encode()))
+
+    def step(self, max_cycles: int) -> List[StepRecord]:
+        '''Step the simulation by up to max_cycles cycles'''
+        self.send_raw(self.frame(BIN_OP_STEP, struct.pack('<I', max_cycles)))
+        return self._parse_step_response(self._recv())
+
+    def send_urnd(self) -> None:
+        '''Post the commands that answer an EDN request for URND'''
+        for idx in range(8):
+            self.post('edn_urnd_step 0x{:08x}'.format(0x01234567 + idx))
+        self.post('edn_urnd_cdc_done')
+
+    def write_words_file(self, name: str,
+                         words: Sequence[int], valid: bytes) -> str:
+        '''Write words in the format of load_d and load_i to a file'''
+        path = str(self.tmpdir.join(name))
+        with open(path, 'wb') as handle:
+            for vld, word in zip(valid, words):
+                handle.write(struct.pack('<BI', vld, word))
+        return path
+
+    def load_program(self, words: Sequence[int]) -> None:
+        '''Load a program into IMEM with load_i'''
+        path = self.write_words_file('imem', words, bytes([1] * len(words)))
+        assert self.cmd('load_i {}'.format(path)).startswith('LOAD_I ')
+
+    def run_secure_wipe(self) -> None:
+        '''Run the initial secure wipe'''
+        # The initial secure wipe has two rounds, each of which starts by
+        # waiting for URND. Every step before the end stops on one of those
+        # EDN requests.
+        assert self.cmd('initial_secure_wipe') == ''
+        for _ in range(3):
+            records = self.step(10000)
+            if (EXT_STATUS, Status.IDLE) in records[-1][3]:
+                return
+            self.send_urnd()
+        assert False, 'Initial secure wipe did not finish.'
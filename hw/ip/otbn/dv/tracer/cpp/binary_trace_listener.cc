@@ -0,0 +1,44 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "binary_trace_listener.h"
+
+#include <cassert>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// The magic string at the start of a binary trace log. The final character is
+// a format version number.
+static const char kMagic[8] = {'O', 'T', 'B', 'N', 'T', 'R', 'C', '1'};
+
+// Write val to buf as a little-endian 32-bit number
+static void pack_u32(uint32_t val, char *buf) {
+  for (int i = 0; i < 4; ++i) {
+    buf[i] = (char)(val >> (8 * i));
+  }
+}
+
+BinaryTraceListener::BinaryTraceListener(const std::string &log_filename)
+    : trace_log(log_filename, std::fstream::out | std::fstream::binary) {
+  if (!trace_log.is_open()) {
+    std::ostringstream oss;
+    oss << "Could not open log file: " << log_filename;
+    throw std::runtime_error(oss.str());
+  }
+  trace_log.write(kMagic, sizeof kMagic);
+}
+
+void BinaryTraceListener::AcceptTraceString(const std::string &trace,
+                                            unsigned int cycle_count) {
+  assert(trace_log.is_open());
+
+  char hdr[8];
+  pack_u32(cycle_count, hdr);
+  pack_u32(trace.size(), hdr + 4);
+
+  trace_log.write(hdr, sizeof hdr);
+  trace_log.write(trace.data(), trace.size());
+}
@@ -0,0 +1,42 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_BINARY_TRACE_LISTENER_H_
+#define OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_BINARY_TRACE_LISTENER_H_
+
+#include <fstream>
+#include <string>
+
+#include "otbn_trace_listener.h"
+
+/**
+ * An OtbnTraceListener that dumps the trace to a binary log file.
+ *
+ * This is a cheaper alternative to LogTraceListener for long simulations. It
+ * doesn't split or format the trace, but writes each trace output as a record
+ * that can be decoded offline (see hw/ip/otbn/util/otbn_trace_tool.py, which
+ * can turn the log back into LogTraceListener's text format).
+ *
+ * The file starts with the 8-byte magic string "OTBNTRC1". This is followed by
+ * one record for each call to AcceptTraceString, consisting of:
+ *
+ *   - The cycle count (u32, little-endian)
+ *   - The length of the trace output in bytes (u32, little-endian)
+ *   - The trace output itself
+ */
+class BinaryTraceListener : public OtbnTraceListener {
+ private:
+  std::ofstream trace_log;
+
+ public:
+  /**
+   * Constructor that takes a log filename to write trace output to. It throws
+   * std::runtime_error if the file cannot be opened.
+   */
+  BinaryTraceListener(const std::string &log_filename);
+  void AcceptTraceString(const std::string &trace,
+                         unsigned int cycle_count) override;
+};
+
+#endif  // OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_BINARY_TRACE_LISTENER_H_
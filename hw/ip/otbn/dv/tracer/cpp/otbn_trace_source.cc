@@ -34,6 +34,11 @@ void OtbnTraceSource::Broadcast(const std::string &trace,
   }
 }
 
+void OtbnTraceSource::Broadcast(const char *trace, unsigned cycle_count) {
+  trace_buf_.assign(trace);
+  Broadcast(trace_buf_, cycle_count);
+}
+
 extern "C" void accept_otbn_trace_string(const char *trace,
                                          unsigned int cycle_count) {
   assert(trace != nullptr);
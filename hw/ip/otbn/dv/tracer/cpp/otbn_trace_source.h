@@ -4,6 +4,7 @@
 #ifndef OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_OTBN_TRACE_SOURCE_H_
 #define OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_OTBN_TRACE_SOURCE_H_
 
+#include <string>
 #include <vector>
 
 #include "otbn_trace_listener.h"
@@ -31,8 +32,14 @@ class OtbnTraceSource {
   // Send a trace string to all listeners
   void Broadcast(const std::string &trace, unsigned cycle_count);
 
+  // Send a trace string from the simulation to all listeners. This copies it
+  // into a buffer that is reused for each call, avoiding an allocation per
+  // cycle.
+  void Broadcast(const char *trace, unsigned cycle_count);
+
  private:
   std::vector<OtbnTraceListener *> listeners_;
+  std::string trace_buf_;
 };
 
 #endif  // OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_OTBN_TRACE_SOURCE_H_
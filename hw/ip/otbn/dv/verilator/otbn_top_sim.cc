@@ -11,6 +11,7 @@
 #include <svdpi.h>
 
 #include "Votbn_top_sim__Syms.h"
+#include "binary_trace_listener.h"
 #include "log_trace_listener.h"
 #include "otbn_memutil.h"
 #include "otbn_model.h"
@@ -31,13 +32,15 @@ extern int otbn_core_get_stop_pc();
 }
 
 /**
- * SimCtrlExtension that adds a '--otbn-trace-file' command line option. If set
- * it sets up a LogTraceListener that will dump out the trace to the given log
- * file
+ * SimCtrlExtension that adds '--otbn-trace-file' and '--otbn-bin-trace-file'
+ * command line options. If set they set up a LogTraceListener or a
+ * BinaryTraceListener (respectively) that will dump out the trace to the given
+ * log file
  */
 class OtbnTraceUtil : public SimCtrlExtension {
  private:
   std::unique_ptr<LogTraceListener> log_trace_listener_;
+  std::unique_ptr<BinaryTraceListener> bin_trace_listener_;
 
   bool SetupTraceLog(const std::string &log_filename) {
     try {
@@ -53,16 +56,33 @@ class OtbnTraceUtil : public SimCtrlExtension {
     return false;
   }
 
+  bool SetupBinaryTraceLog(const std::string &log_filename) {
+    try {
+      bin_trace_listener_.reset(new BinaryTraceListener(log_filename));
+      OtbnTraceSource::get().AddListener(bin_trace_listener_.get());
+      return true;
+    } catch (const std::runtime_error &err) {
+      std::cerr << "ERROR: Failed to set up binary trace log: " << err.what()
+                << std::endl;
+      return false;
+    }
+  }
+
   void PrintHelp() {
     std::cout << "Trace log utilities:\n\n"
                  "--otbn-trace-file=FILE\n"
-                 "  Write OTBN trace log to FILE\n\n";
+                 "  Write OTBN trace log to FILE\n\n"
+                 "--otbn-bin-trace-file=FILE\n"
+                 "  Write OTBN trace log to FILE in a binary format (decode it "
+                 "with\n"
+                 "  hw/ip/otbn/util/otbn_trace_tool.py)\n\n";
   }
 
  public:
   virtual bool ParseCLIArguments(int argc, char **argv, bool &exit_app) {
     const struct option long_options[] = {
         {"otbn-trace-file", required_argument, nullptr, 'l'},
+        {"otbn-bin-trace-file", required_argument, nullptr, 'b'},
         {"help", no_argument, nullptr, 'h'},
         {nullptr, no_argument, nullptr, 0}};
 
@@ -80,7 +100,13 @@ class OtbnTraceUtil : public SimCtrlExtension {
         case 1:
           break;
         case 'l':
-          return SetupTraceLog(optarg);
+          if (!SetupTraceLog(optarg))
+            return false;
+          break;
+        case 'b':
+          if (!SetupBinaryTraceLog(optarg))
+            return false;
+          break;
         case 'h':
           PrintHelp();
           break;
@@ -90,9 +116,13 @@ class OtbnTraceUtil : public SimCtrlExtension {
     return true;
   }
 
+  std::string GetName() const override { return "otbn_trace"; }
+
   ~OtbnTraceUtil() {
     if (log_trace_listener_)
       OtbnTraceSource::get().RemoveListener(log_trace_listener_.get());
+    if (bin_trace_listener_)
+      OtbnTraceSource::get().RemoveListener(bin_trace_listener_.get());
   }
 };
 
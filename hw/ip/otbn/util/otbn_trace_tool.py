@@ -0,0 +1,277 @@
+#!/usr/bin/env python3
+# Copyright lowRISC contributors.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+'''Decode and profile binary OTBN trace logs
+
+These are written by the BinaryTraceListener in hw/ip/otbn/dv/tracer (see
+the --otbn-bin-trace-file option for otbn_top_sim). The "decode" command
+converts a log to the same text format as the --otbn-trace-file option. The
+"profile" command uses the symbols in the ELF file that was run to count the
+instructions, stalls and cycles spent in each function.
+
+'''
+
+import argparse
+import bisect
+import re
+import struct
+import sys
+from typing import BinaryIO, Dict, Iterator, List, Optional, TextIO, Tuple
+
+from elftools.elf.constants import SH_FLAGS  # type: ignore
+from elftools.elf.elffile import ELFFile, SymbolTableSection  # type: ignore
+
+_MAGIC = b'OTBNTRC1'
+_RECORD_HDR = struct.Struct('<II')
+
+_EXEC_STALL_RE = re.compile(r'([ES]) PC: 0x([0-9a-f]{8})')
+
+
+def read_records(handle: BinaryIO) -> Iterator[Tuple[int, str]]:
+    '''Yield the (cycle_count, trace) records in a binary trace log'''
+    magic = handle.read(len(_MAGIC))
+    if magic != _MAGIC:
+        raise ValueError('File does not start with the magic string {!r}, '
+                         'so is not a binary OTBN trace log.'
+                         .format(_MAGIC.decode()))
+
+    while True:
+        hdr = handle.read(_RECORD_HDR.size)
+        if not hdr:
+            return
+        if len(hdr) < _RECORD_HDR.size:
+            raise ValueError('Truncated record header at end of trace log.')
+
+        cycle_count, length = _RECORD_HDR.unpack(hdr)
+        trace = handle.read(length)
+        if len(trace) < length:
+            raise ValueError('Truncated record at cycle {} at end of trace '
+                             'log.'.format(cycle_count))
+
+        yield (cycle_count, trace.decode('ascii', errors='replace'))
+
+
+def split_trace_lines(trace: str) -> List[str]:
+    '''Split a trace into lines like OtbnTraceListener::SplitTraceLines'''
+    lines = trace.split('\n')
+    # std::getline doesn't yield an empty final line for a trailing newline
+    # (or for an empty trace).
+    if lines[-1] == '':
+        lines.pop()
+    return lines
+
+
+def decode(records: Iterator[Tuple[int, str]], out: TextIO) -> None:
+    '''Write records in the same format as LogTraceListener'''
+    for cycle_count, trace in records:
+        for idx, line in enumerate(split_trace_lines(trace)):
+            if idx > 0:
+                out.write('    {}\n'.format(line))
+                continue
+
+            if len(line) <= 1:
+                out.write('ERR: Bad line at {} line should be more than 1 '
+                          'character: {}\n'.format(cycle_count, line))
+                continue
+
+            if line[0] in 'ES':
+                out.write('{} {:09}{}\n'
+                          .format(line[0], cycle_count, line[1:]))
+            else:
+                out.write('! {:09}\n    {}\n'.format(cycle_count, line))
+
+
+class FuncTable:
+    '''Maps PCs to the function that contains them'''
+    def __init__(self, symbols: List[Tuple[int, str]]) -> None:
+        symbols = sorted(symbols)
+        self.addrs = [addr for addr, _ in symbols]
+        self.names = [name for _, name in symbols]
+
+    def lookup(self, pc: int) -> str:
+        idx = bisect.bisect_right(self.addrs, pc) - 1
+        return self.names[idx] if idx >= 0 else '<unknown>'
+
+
+def read_func_symbols(path: str, all_labels: bool) -> List[Tuple[int, str]]:
+    '''Read the code symbols in an OTBN ELF file
+
+    OTBN assembly doesn't usually mark functions with .type, so we take each
+    label in an executable section as the start of a function. Unless
+    all_labels is true, we skip labels starting with an underscore (which our
+    code uses for labels inside a function) or a dot (assembler local labels).
+
+    '''
+    ret = {}  # type: Dict[int, str]
+    with open(path, 'rb') as handle:
+        elf_file = ELFFile(handle)
+        symtab = elf_file.get_section_by_name('.symtab')
+        if not isinstance(symtab, SymbolTableSection):
+            raise RuntimeError('ELF file at {!r} has no symbol table.'
+                               .format(path))
+
+        for sym in symtab.iter_symbols():
+            if sym['st_info']['type'] not in ['STT_NOTYPE', 'STT_FUNC']:
+                continue
+            shndx = sym['st_shndx']
+            if not isinstance(shndx, int):
+                continue
+            section = elf_file.get_section(shndx)
+            if not section['sh_flags'] & SH_FLAGS.SHF_EXECINSTR:
+                continue
+            if not sym.name or sym.name[0] == '.':
+                continue
+            if sym.name[0] == '_' and not all_labels:
+                continue
+
+            # If several labels have the same address, pick the first in
+            # alphabetical order so that the output is deterministic.
+            addr = sym['st_value']
+            if addr not in ret or sym.name < ret[addr]:
+                ret[addr] = sym.name
+
+    return [(addr, name) for addr, name in ret.items()]
+
+
+class FuncCounts:
+    '''Cycle counts for a function (or for a single PC)
+
+    Each cycle is either an instruction executing, an instruction stalling, or
+    something else (such as secure wipe).
+
+    '''
+    def __init__(self) -> None:
+        self.insns = 0
+        self.stalls = 0
+        self.other = 0
+
+    @property
+    def cycles(self) -> int:
+        return self.insns + self.stalls + self.other
+
+
+def _get_exec_or_stall(trace: str) -> Optional[Tuple[bool, int]]:
+    '''Find an E or S line in the trace and return (is_exec, pc)'''
+    for line in split_trace_lines(trace):
+        match = _EXEC_STALL_RE.match(line)
+        if match is not None:
+            return (match.group(1) == 'E', int(match.group(2), 16))
+    return None
+
+
+def profile(records: Iterator[Tuple[int, str]],
+            funcs: FuncTable) -> Tuple[Dict[str, FuncCounts],
+                                       Dict[int, FuncCounts],
+                                       int]:
+    '''Count instructions and stalls for each function and PC
+
+    Returns a tuple (by_func, by_pc, other_cycles), where other_cycles is the
+    number of cycles with a trace record that didn't contain an instruction
+    (such as cycles spent in secure wipe).
+
+    '''
+    by_func = {}  # type: Dict[str, FuncCounts]
+    by_pc = {}  # type: Dict[int, FuncCounts]
+    other_cycles = 0
+
+    for _, trace in records:
+        exec_or_stall = _get_exec_or_stall(trace)
+        if exec_or_stall is None:
+            other_cycles += 1
+            continue
+
+        is_exec, pc = exec_or_stall
+        func_counts = by_func.setdefault(funcs.lookup(pc), FuncCounts())
+        pc_counts = by_pc.setdefault(pc, FuncCounts())
+        for counts in [func_counts, pc_counts]:
+            if is_exec:
+                counts.insns += 1
+            else:
+                counts.stalls += 1
+
+    return (by_func, by_pc, other_cycles)
+
+
+def _print_table(rows: List[Tuple[str, FuncCounts]],
+                 total_cycles: int, title: str, out: TextIO) -> None:
+    name_width = max([len(title)] + [len(name) for name, _ in rows])
+    out.write('{:<{w}} {:>10} {:>10} {:>10} {:>7}\n'
+              .format(title, 'Insns', 'Stalls', 'Cycles', '% Cyc',
+                      w=name_width))
+    for name, counts in rows:
+        pct = 100.0 * counts.cycles / total_cycles if total_cycles else 0.0
+        out.write('{:<{w}} {:>10} {:>10} {:>10} {:>7.2f}\n'
+                  .format(name, counts.insns, counts.stalls, counts.cycles,
+                          pct, w=name_width))
+
+
+def print_profile(by_func: Dict[str, FuncCounts],
+                  by_pc: Optional[Dict[int, FuncCounts]],
+                  other_cycles: int,
+                  funcs: FuncTable,
+                  out: TextIO) -> None:
+    '''Print the results of profile() as tables, most expensive first'''
+    total_cycles = other_cycles + sum(c.cycles for c in by_func.values())
+
+    func_rows = sorted(by_func.items(), key=lambda kv: (-kv[1].cycles, kv[0]))
+    if other_cycles:
+        other = FuncCounts()
+        other.other = other_cycles
+        func_rows.append(('<no instruction>', other))
+    _print_table(func_rows, total_cycles, 'Function', out)
+
+    if by_pc is not None:
+        out.write('\n')
+        pc_rows = [('{:#010x} {}'.format(pc, funcs.lookup(pc)), counts)
+                   for pc, counts in sorted(by_pc.items(),
+                                            key=lambda kv: (-kv[1].cycles,
+                                                            kv[0]))]
+        _print_table(pc_rows, total_cycles, 'PC', out)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(
+        description='Decode and profile binary OTBN trace logs.')
+    subparsers = parser.add_subparsers(dest='command', required=True)
+
+    decode_parser = subparsers.add_parser(
+        'decode', help='Convert a binary trace log to text.')
+    decode_parser.add_argument('trace', help='The binary trace log.')
+    decode_parser.add_argument('-o', '--output',
+                               type=argparse.FileType('w'), default=sys.stdout,
+                               help='Where to write the text trace.')
+
+    profile_parser = subparsers.add_parser(
+        'profile',
+        help='Count instructions, stalls and cycles for each function.')
+    profile_parser.add_argument('trace', help='The binary trace log.')
+    profile_parser.add_argument('elf', help='The ELF file that was run.')
+    profile_parser.add_argument('--all-labels', action='store_true',
+                                help=('Treat every code label as a function, '
+                                      'including ones starting with _.'))
+    profile_parser.add_argument('--by-pc', action='store_true',
+                                help='Also print counts for each PC.')
+
+    args = parser.parse_args()
+
+    try:
+        with open(args.trace, 'rb') as handle:
+            if args.command == 'decode':
+                decode(read_records(handle), args.output)
+                return 0
+
+            funcs = FuncTable(read_func_symbols(args.elf, args.all_labels))
+            by_func, by_pc, other_cycles = profile(read_records(handle),
+                                                   funcs)
+            print_profile(by_func, by_pc if args.by_pc else None,
+                          other_cycles, funcs, sys.stdout)
+            return 0
+    except (OSError, ValueError, RuntimeError) as err:
+        print('Error: {}'.format(err), file=sys.stderr)
+        return 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -6,295 +6,466 @@
 
 #include <algorithm>
 #include <cassert>
-#include <functional>
-#include <iostream>
 #include <stdint.h>
 #include <vector>
 
-#include "prince_ref.h"
+// All of the state in this model is held in 64-bit integers, with bit 0 of
+// the integer corresponding to bit 0 of the (little-endian) byte vectors in
+// the public API. Values narrower than 64 bits are always kept zero-extended.
 
-uint8_t PRESENT_SBOX4[] = {0xc, 0x5, 0x6, 0xb, 0x9, 0x0, 0xa, 0xd,
-                           0x3, 0xe, 0xf, 0x8, 0x4, 0x7, 0x1, 0x2};
+static const uint8_t PRESENT_SBOX4[] = {0xc, 0x5, 0x6, 0xb, 0x9, 0x0,
+                                        0xa, 0xd, 0x3, 0xe, 0xf, 0x8,
+                                        0x4, 0x7, 0x1, 0x2};
 
-uint8_t PRESENT_SBOX4_INV[] = {0x5, 0xe, 0xf, 0x8, 0xc, 0x1, 0x2, 0xd,
-                               0xb, 0x4, 0x6, 0x3, 0x0, 0x7, 0x9, 0xa};
+static const uint8_t PRESENT_SBOX4_INV[] = {0x5, 0xe, 0xf, 0x8, 0xc, 0x1,
+                                            0x2, 0xd, 0xb, 0x4, 0x6, 0x3,
+                                            0x0, 0x7, 0x9, 0xa};
+
+static const uint8_t PRINCE_SBOX4[] = {0xb, 0xf, 0x3, 0x2, 0xa, 0xc, 0x9, 0x1,
+                                       0x6, 0x7, 0x8, 0x0, 0xe, 0x5, 0xd, 0x4};
+
+static const uint8_t PRINCE_SBOX4_INV[] = {0xb, 0x7, 0x3, 0x2, 0xf, 0xd,
+                                           0x8, 0x9, 0xa, 0x6, 0x4, 0x0,
+                                           0x5, 0xe, 0xc, 0x1};
+
+static const uint64_t PRINCE_RC[] = {
+    0x0000000000000000, 0x13198a2e03707344, 0xa4093822299f31d0,
+    0x082efa98ec4e6c89, 0x452821e638d01377, 0xbe5466cf34e90c6c,
+    0x7ef84f78fd955cb1, 0x85840851f1ac43aa, 0xc882d32f25323c54,
+    0x64a51195e0e3610d, 0xd3b5a399ca0c2399, 0xc0ac29b7c97c50dd};
+
+// PRINCE's 16 bit matrices M0 and M1 (see prince_m_prime_layer in
+// prince_ref.h). Entry i is the output for an input with just bit i set.
+static const uint16_t PRINCE_M16[2][16] = {
+    {0x0111, 0x2220, 0x4404, 0x8088, 0x1011, 0x0222, 0x4440, 0x8808, 0x1101,
+     0x2022, 0x0444, 0x8880, 0x1110, 0x2202, 0x4044, 0x0888},
+    {0x1110, 0x2202, 0x4044, 0x0888, 0x0111, 0x2220, 0x4404, 0x8088, 0x1011,
+     0x0222, 0x4440, 0x8808, 0x1101, 0x2022, 0x0444, 0x8880}};
 
 static const uint32_t kNumAddrSubstPermRounds = 2;
 static const uint32_t kNumDataSubstPermRounds = 2;
 static const uint32_t kNumPrinceHalfRounds = 2;
 
-static std::vector<uint8_t> byte_reverse_vector(
-    const std::vector<uint8_t> &vec_in) {
-  std::vector<uint8_t> vec_out(vec_in.size());
-
-  std::reverse_copy(std::begin(vec_in), std::end(vec_in), std::begin(vec_out));
+namespace {
+// Lookup tables derived from the constants above. The S-box tables apply a
+// 4-bit S-box to both nibbles of a byte at once. The M' tables give the result
+// of multiplying one nibble of a 16-bit chunk by M0 or M1; since the
+// multiplication is linear, the result for a whole chunk is the XOR of the
+// results for its four nibbles.
+struct ScrambleTables {
+  uint8_t present_sbox8[256];
+  uint8_t present_sbox8_inv[256];
+  uint8_t prince_sbox8[256];
+  uint8_t prince_sbox8_inv[256];
+  uint16_t prince_m16_nibble[2][4][16];
+
+  ScrambleTables() {
+    for (unsigned b = 0; b < 256; ++b) {
+      present_sbox8[b] = PRESENT_SBOX4[b & 0xf] | PRESENT_SBOX4[b >> 4] << 4;
+      present_sbox8_inv[b] =
+          PRESENT_SBOX4_INV[b & 0xf] | PRESENT_SBOX4_INV[b >> 4] << 4;
+      prince_sbox8[b] = PRINCE_SBOX4[b & 0xf] | PRINCE_SBOX4[b >> 4] << 4;
+      prince_sbox8_inv[b] =
+          PRINCE_SBOX4_INV[b & 0xf] | PRINCE_SBOX4_INV[b >> 4] << 4;
+    }
 
-  return vec_out;
-}
+    for (unsigned m = 0; m < 2; ++m) {
+      for (unsigned nib = 0; nib < 4; ++nib) {
+        for (unsigned v = 0; v < 16; ++v) {
+          uint16_t out = 0;
+          for (unsigned bit = 0; bit < 4; ++bit) {
+            if ((v >> bit) & 1) {
+              out ^= PRINCE_M16[m][4 * nib + bit];
+            }
+          }
+          prince_m16_nibble[m][nib][v] = out;
+        }
+      }
+    }
+  }
+};
+}  // namespace
 
-static uint8_t read_vector_bit(const std::vector<uint8_t> &vec,
-                               uint32_t bit_pos) {
-  assert(bit_pos / 8 < vec.size());
+static const ScrambleTables tables;
 
-  return (vec[bit_pos / 8] >> (bit_pos % 8)) & 1;
+// A mask for the bottom width bits of a uint64_t (0 < width <= 64)
+static uint64_t low_mask(uint32_t width) {
+  assert(0 < width && width <= 64);
+  return (width == 64) ? ~(uint64_t)0 : (((uint64_t)1 << width) - 1);
 }
 
-static void or_vector_bit(std::vector<uint8_t> &vec, uint32_t bit_pos,
-                          uint8_t bit) {
-  assert(bit_pos / 8 < vec.size());
-
-  vec[bit_pos / 8] |= bit << (bit_pos % 8);
+// Apply an S-box table (as built in ScrambleTables) to each byte of x
+static uint64_t sbox8_layer(uint64_t x, const uint8_t sbox8[256]) {
+  uint64_t out = 0;
+  for (unsigned i = 0; i < 64; i += 8) {
+    out |= (uint64_t)sbox8[(x >> i) & 0xff] << i;
+  }
+  return out;
 }
 
-static std::vector<uint8_t> xor_vectors(const std::vector<uint8_t> &vec_a,
-                                        const std::vector<uint8_t> &vec_b) {
-  assert(vec_a.size() == vec_b.size());
+static uint64_t reverse_bits64(uint64_t x) {
+  x = ((x >> 1) & 0x5555555555555555) | ((x & 0x5555555555555555) << 1);
+  x = ((x >> 2) & 0x3333333333333333) | ((x & 0x3333333333333333) << 2);
+  x = ((x >> 4) & 0x0f0f0f0f0f0f0f0f) | ((x & 0x0f0f0f0f0f0f0f0f) << 4);
+  x = ((x >> 8) & 0x00ff00ff00ff00ff) | ((x & 0x00ff00ff00ff00ff) << 8);
+  x = ((x >> 16) & 0x0000ffff0000ffff) | ((x & 0x0000ffff0000ffff) << 16);
+  return (x >> 32) | (x << 32);
+}
 
-  std::vector<uint8_t> vec_out(vec_a.size());
+// Gather the even bits of x into the bottom 32 bits of the result
+static uint64_t gather_even_bits(uint64_t x) {
+  x &= 0x5555555555555555;
+  x = (x | (x >> 1)) & 0x3333333333333333;
+  x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0f;
+  x = (x | (x >> 4)) & 0x00ff00ff00ff00ff;
+  x = (x | (x >> 8)) & 0x0000ffff0000ffff;
+  x = (x | (x >> 16)) & 0x00000000ffffffff;
+  return x;
+}
 
-  std::transform(vec_a.begin(), vec_a.end(), vec_b.begin(), vec_out.begin(),
-                 std::bit_xor<uint8_t>{});
+// Spread the bottom 32 bits of x into the even bits of the result
+static uint64_t spread_even_bits(uint64_t x) {
+  x &= 0x00000000ffffffff;
+  x = (x | (x << 16)) & 0x0000ffff0000ffff;
+  x = (x | (x << 8)) & 0x00ff00ff00ff00ff;
+  x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0f;
+  x = (x | (x << 2)) & 0x3333333333333333;
+  x = (x | (x << 1)) & 0x5555555555555555;
+  return x;
+}
 
-  return vec_out;
+// Run each 4-bit chunk of `in` through the SBOX. Where `bit_width` isn't a
+// multiple of 4 the remaining bits are just copied straight through.
+static uint64_t scramble_sbox_layer(uint64_t in, uint32_t bit_width,
+                                    const uint8_t sbox8[256]) {
+  uint64_t sbox_mask = (bit_width < 4) ? 0 : low_mask(bit_width & ~3u);
+  return (sbox8_layer(in, sbox8) & sbox_mask) | (in & ~sbox_mask);
 }
 
-// Run each 4-bit chunk of bytes from `in` through the SBOX. Where `bit_width`
-// isn't a multiple of 4 the remaining bits are just copied straight through.
-// `invert` choose whether to use the inverted SBOX or not.
-static std::vector<uint8_t> scramble_sbox_layer(const std::vector<uint8_t> &in,
-                                                uint32_t bit_width,
-                                                uint8_t sbox[16]) {
-  assert(in.size() == ((bit_width + 7) / 8));
-  std::vector<uint8_t> out(in.size(), 0);
+// Reverse the bottom bit_width bits of `in`
+static uint64_t scramble_flip_layer(uint64_t in, uint32_t bit_width) {
+  return reverse_bits64(in) >> (64 - bit_width);
+}
 
-  // Iterate through each 4 bit chunk of the data and apply the appropriate SBOX
-  for (uint32_t i = 0; i < bit_width / 4; ++i) {
-    uint8_t sbox_in, sbox_out;
+// Apply butterfly to `in`. Even bits are placed in the lower half of the
+// output, odd bits are placed in the upper half of the output. Where bit_width
+// isn't even, the final bit is copied across to the same position.
+static uint64_t scramble_perm_layer(uint64_t in, uint32_t bit_width,
+                                    bool invert) {
+  uint32_t half = bit_width / 2;
+  uint64_t out = (bit_width % 2) ? (in & ((uint64_t)1 << (bit_width - 1))) : 0;
+  if (!half) {
+    return out;
+  }
 
-    sbox_in = in[i / 2];
+  if (invert) {
+    uint64_t lo = in & low_mask(half);
+    uint64_t hi = (in >> half) & low_mask(half);
+    out |= spread_even_bits(lo) | (spread_even_bits(hi) << 1);
+  } else {
+    uint64_t body = in & low_mask(2 * half);
+    out |= gather_even_bits(body) | (gather_even_bits(body >> 1) << half);
+  }
 
-    int shift = (i % 2) ? 4 : 0;
-    sbox_in = (sbox_in >> shift) & 0xf;
+  return out;
+}
 
-    sbox_out = sbox[sbox_in];
+// Apply a full set of substitution/permutation rounds for encrypt
+static uint64_t scramble_subst_perm_enc(uint64_t in, uint64_t key,
+                                        uint32_t bit_width,
+                                        uint32_t num_rounds) {
+  uint64_t state = in;
 
-    out[i / 2] |= sbox_out << shift;
-  }
+  for (uint32_t i = 0; i < num_rounds; ++i) {
+    state ^= key;
 
-  // Where bit_width is not a multiple of 4 copy over the remaining bits
-  if (bit_width % 4) {
-    int shift = ((bit_width % 8) >= 4) ? 4 : 0;
-    uint8_t nibble = (in[bit_width / 8] >> shift) & 0xf;
-    out[bit_width / 8] |= nibble << shift;
+    state = scramble_sbox_layer(state, bit_width, tables.present_sbox8);
+    state = scramble_flip_layer(state, bit_width);
+    state = scramble_perm_layer(state, bit_width, false);
   }
 
-  return out;
+  return state ^ key;
 }
 
-// Reverse bits from incoming byte vector
-static std::vector<uint8_t> scramble_flip_layer(const std::vector<uint8_t> &in,
-                                                uint32_t bit_width) {
-  assert(in.size() == ((bit_width + 7) / 8));
-  std::vector<uint8_t> out(in.size(), 0);
+// Apply a full set of substitution/permutation rounds for decrypt
+static uint64_t scramble_subst_perm_dec(uint64_t in, uint64_t key,
+                                        uint32_t bit_width,
+                                        uint32_t num_rounds) {
+  uint64_t state = in;
 
-  for (uint32_t i = 0; i < bit_width; ++i) {
-    or_vector_bit(out, bit_width - i - 1, read_vector_bit(in, i));
+  for (uint32_t i = 0; i < num_rounds; ++i) {
+    state ^= key;
+
+    state = scramble_perm_layer(state, bit_width, true);
+    state = scramble_flip_layer(state, bit_width);
+    state = scramble_sbox_layer(state, bit_width, tables.present_sbox8_inv);
   }
 
-  return out;
+  return state ^ key;
 }
 
-// Apply butterfly to incoming byte vector. Even bits are placed in the lower
-// half of the output, odd bits are placed in the upper half of the output.
-static std::vector<uint8_t> scramble_perm_layer(const std::vector<uint8_t> &in,
-                                                uint32_t bit_width,
-                                                bool invert) {
-  assert(in.size() == ((bit_width + 7) / 8));
-  std::vector<uint8_t> out(in.size(), 0);
-
-  for (uint32_t i = 0; i < bit_width / 2; ++i) {
-    if (invert) {
-      or_vector_bit(out, i * 2, read_vector_bit(in, i));
-      or_vector_bit(out, i * 2 + 1, read_vector_bit(in, i + (bit_width / 2)));
-    } else {
-      or_vector_bit(out, i, read_vector_bit(in, i * 2));
-      or_vector_bit(out, i + (bit_width / 2), read_vector_bit(in, i * 2 + 1));
+// The M' step of the PRINCE cipher
+static uint64_t prince_m_prime_layer(uint64_t in) {
+  uint64_t out = 0;
+  for (unsigned chunk = 0; chunk < 4; ++chunk) {
+    // Chunks 0 and 3 use M0; chunks 1 and 2 use M1.
+    unsigned m = (chunk == 1 || chunk == 2) ? 1 : 0;
+    uint64_t chunk_out = 0;
+    for (unsigned nib = 0; nib < 4; ++nib) {
+      unsigned v = (in >> (16 * chunk + 4 * nib)) & 0xf;
+      chunk_out ^= tables.prince_m16_nibble[m][nib][v];
     }
+    out |= chunk_out << (16 * chunk);
   }
+  return out;
+}
 
-  if (bit_width % 2) {
-    // Where bit_width isn't even, the final bit is copied across to the same
-    // position
-    or_vector_bit(out, bit_width - 1, read_vector_bit(in, bit_width - 1));
+// The shift row and inverse shift row of the PRINCE cipher
+static uint64_t prince_shift_rows(uint64_t in, bool inverse) {
+  const uint64_t row_mask = 0xF000F000F000F000;
+  uint64_t out = in & row_mask;
+  for (unsigned i = 1; i < 4; i++) {
+    const uint64_t row = in & (row_mask >> (4 * i));
+    const unsigned shift = inverse ? i * 16 : 64 - i * 16;
+    out |= (row >> shift) | (row << (64 - shift));
   }
-
   return out;
 }
 
-// Apply a full set of subsitution/permutation rounds for encrypt to the
-// incoming byte vector
-static std::vector<uint8_t> scramble_subst_perm_enc(
-    const std::vector<uint8_t> &in, const std::vector<uint8_t> &key,
-    uint32_t bit_width, uint32_t num_rounds) {
-  assert(in.size() == ((bit_width + 7) / 8));
-  assert(key.size() == ((bit_width + 7) / 8));
-
-  std::vector<uint8_t> state(in);
+// PRINCE encryption with the new key schedule (equivalent to
+// prince_enc_dec_uint64 in prince_ref.h with decrypt = 0 and
+// old_key_schedule = 0).
+static uint64_t prince_encrypt(uint64_t input, uint64_t k0, uint64_t k1,
+                               int num_half_rounds) {
+  const uint64_t k0_prime = ((k0 >> 1) | (k0 << 63)) ^ (k0 >> 63);
+
+  uint64_t state = input ^ k0 ^ k1 ^ PRINCE_RC[0];
+  for (int round = 1; round <= num_half_rounds; round++) {
+    state = sbox8_layer(state, tables.prince_sbox8);
+    state = prince_shift_rows(prince_m_prime_layer(state), false);
+    state ^= ((round % 2 == 1) ? k0 : k1) ^ PRINCE_RC[round];
+  }
 
-  for (uint32_t i = 0; i < num_rounds; ++i) {
-    state = xor_vectors(state, key);
+  state = sbox8_layer(state, tables.prince_sbox8);
+  state = prince_m_prime_layer(state);
+  state = sbox8_layer(state, tables.prince_sbox8_inv);
 
-    state = scramble_sbox_layer(state, bit_width, PRESENT_SBOX4);
-    state = scramble_flip_layer(state, bit_width);
-    state = scramble_perm_layer(state, bit_width, false);
+  for (int round = 1; round <= num_half_rounds; round++) {
+    const int constant_idx = 10 - num_half_rounds + round;
+    state ^= (((num_half_rounds + round + 1) % 2 == 1) ? k0 : k1) ^
+             PRINCE_RC[constant_idx];
+    state = prince_m_prime_layer(prince_shift_rows(state, true));
+    state = sbox8_layer(state, tables.prince_sbox8_inv);
   }
 
-  state = xor_vectors(state, key);
+  return state ^ k1 ^ PRINCE_RC[11] ^ k0_prime;
+}
+
+// Read count bits (count <= 64) from a little-endian array of 64-bit words,
+// starting at bit_pos
+static uint64_t get_bits(const uint64_t *words, uint32_t bit_pos,
+                         uint32_t count) {
+  uint32_t idx = bit_pos / 64, off = bit_pos % 64;
+  uint64_t ret = words[idx] >> off;
+  if (off && off + count > 64) {
+    ret |= words[idx + 1] << (64 - off);
+  }
+  return ret & low_mask(count);
+}
 
-  return state;
+// OR count bits from value (which must be zero above count bits) into a
+// little-endian array of 64-bit words, starting at bit_pos
+static void or_bits(uint64_t *words, uint32_t bit_pos, uint32_t count,
+                    uint64_t value) {
+  uint32_t idx = bit_pos / 64, off = bit_pos % 64;
+  words[idx] |= value << off;
+  if (off && off + count > 64) {
+    words[idx + 1] |= value >> (64 - off);
+  }
 }
 
-// Apply a full set of substitution/permutation rounds for decrypt to the
-// incoming byte vector
-static std::vector<uint8_t> scramble_subst_perm_dec(
-    const std::vector<uint8_t> &in, const std::vector<uint8_t> &key,
-    uint32_t bit_width, uint32_t num_rounds) {
-  assert(in.size() == ((bit_width + 7) / 8));
-  assert(key.size() == ((bit_width + 7) / 8));
+// Read the bits of a little-endian byte array into 64-bit words. words must
+// have space for at least (num_bytes + 7) / 8 words.
+static void bytes_to_words(const uint8_t *bytes, uint32_t num_bytes,
+                           uint64_t *words) {
+  std::fill(words, words + (num_bytes + 7) / 8, 0);
+  for (uint32_t i = 0; i < num_bytes; ++i) {
+    words[i / 8] |= (uint64_t)bytes[i] << (8 * (i % 8));
+  }
+}
 
-  std::vector<uint8_t> state(in);
+static void words_to_bytes(const uint64_t *words, uint32_t num_bytes,
+                           uint8_t *bytes) {
+  for (uint32_t i = 0; i < num_bytes; ++i) {
+    bytes[i] = words[i / 8] >> (8 * (i % 8));
+  }
+}
 
-  for (uint32_t i = 0; i < num_rounds; ++i) {
-    state = xor_vectors(state, key);
+// Read count bits (count <= 64) from a byte vector, starting at bit_pos
+static uint64_t get_vector_bits(const std::vector<uint8_t> &vec,
+                                uint32_t bit_pos, uint32_t count) {
+  assert((bit_pos + count + 7) / 8 <= vec.size());
 
-    state = scramble_perm_layer(state, bit_width, true);
-    state = scramble_flip_layer(state, bit_width);
-    state = scramble_sbox_layer(state, bit_width, PRESENT_SBOX4_INV);
+  uint64_t ret = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t pos = bit_pos + i;
+    ret |= (uint64_t)((vec[pos / 8] >> (pos % 8)) & 1) << i;
   }
+  return ret;
+}
 
-  state = xor_vectors(state, key);
+static uint64_t vector_to_uint64(const std::vector<uint8_t> &vec) {
+  assert(vec.size() <= 8);
 
-  return state;
+  uint64_t ret = 0;
+  for (size_t i = 0; i < vec.size(); ++i) {
+    ret |= (uint64_t)vec[i] << (8 * i);
+  }
+  return ret;
 }
 
-// Generate a keystream for XORing with data using PRINCE.
-// If repeat_keystream is set to true, the output from one PRINCE instance is
-// repeated when the keystream is greater than a single PRINCE width (64bit).
-// Otherwise, multiple PRINCEs are instantiated to form the keystream.
-static std::vector<uint8_t> scramble_gen_keystream(
-    const std::vector<uint8_t> &addr, uint32_t addr_width,
-    const std::vector<uint8_t> &nonce, const std::vector<uint8_t> &key,
-    uint32_t keystream_width, uint32_t num_half_rounds, bool repeat_keystream) {
+ScrambleModel::ScrambleModel(uint32_t addr_width, uint32_t data_width,
+                             uint32_t subst_perm_width,
+                             const std::vector<uint8_t> &nonce,
+                             uint32_t nonce_width,
+                             const std::vector<uint8_t> &key,
+                             bool repeat_keystream)
+    : addr_width_(addr_width),
+      data_width_(data_width),
+      subst_perm_width_(subst_perm_width),
+      repeat_keystream_(repeat_keystream),
+      addr_key_(0),
+      prince_k0_(0),
+      prince_k1_(0) {
+  assert(0 < addr_width && addr_width <= 32);
+  assert(0 < data_width && data_width <= kScrMaxDataWidth);
+  assert(0 < subst_perm_width && subst_perm_width <= 64);
   assert(key.size() == (kPrinceWidthByte * 2));
+  assert(addr_width <= nonce_width);
+
+  // The address is scrambled with the top addr_width bits of the nonce as a
+  // key.
+  addr_key_ = get_vector_bits(nonce, nonce_width - addr_width, addr_width);
+
+  // The bottom addr_width bits of each PRINCE IV are the address. The other
+  // bits are taken from the nonce, with each PRINCE instance using different
+  // nonce bits.
+  uint32_t num_princes =
+      repeat_keystream ? 1 : (data_width + kPrinceWidth - 1) / kPrinceWidth;
+  uint32_t nonce_bits_per_iv = kPrinceWidth - addr_width;
+  for (uint32_t i = 0; i < kMaxPrinces; ++i) {
+    iv_nonce_[i] =
+        (i < num_princes)
+            ? get_vector_bits(nonce, i * nonce_bits_per_iv, nonce_bits_per_iv)
+                  << addr_width
+            : 0;
+  }
 
-  // Determine how many PRINCE replications are required
-  uint32_t num_princes, num_repetitions;
-  if (repeat_keystream) {
-    num_princes = 1;
-    num_repetitions = (keystream_width + kPrinceWidth - 1) / kPrinceWidth;
-  } else {
-    num_princes = (keystream_width + kPrinceWidth - 1) / kPrinceWidth;
-    num_repetitions = 1;
+  // The PRINCE reference model takes the key in big-endian byte order, so the
+  // top 8 bytes of our little-endian key form K0.
+  std::vector<uint8_t> key_lo(key.begin(), key.begin() + kPrinceWidthByte);
+  std::vector<uint8_t> key_hi(key.begin() + kPrinceWidthByte, key.end());
+  prince_k0_ = vector_to_uint64(key_hi);
+  prince_k1_ = vector_to_uint64(key_lo);
+}
+
+uint32_t ScrambleModel::ScrambleAddr(uint32_t addr) const {
+  return scramble_subst_perm_enc(addr & low_mask(addr_width_), addr_key_,
+                                 addr_width_, kNumAddrSubstPermRounds);
+}
+
+void ScrambleModel::ScrambleAddrs(const uint32_t *addrs, uint32_t *phys_addrs,
+                                  size_t count) const {
+  for (size_t i = 0; i < count; ++i) {
+    phys_addrs[i] = ScrambleAddr(addrs[i]);
   }
+}
 
-  std::vector<uint8_t> keystream;
-
-  for (uint32_t i = 0; i < num_princes; ++i) {
-    // Initial vector is data for PRINCE to encrypt. Formed from nonce and data
-    // address
-    std::vector<uint8_t> iv(8, 0);
-
-    for (uint32_t j = 0; j < kPrinceWidth; ++j) {
-      if (j < addr_width) {
-        // Bottom addr_width bits of IV are address
-        or_vector_bit(iv, j, read_vector_bit(addr, j));
-      } else {
-        // Other bits are taken from nonce. Each PRINCE instantiation will use
-        // different nonce bits.
-        int nonce_bit = (j - addr_width) + i * (kPrinceWidth - addr_width);
-        or_vector_bit(iv, j, read_vector_bit(nonce, nonce_bit));
-      }
-    }
+void ScrambleModel::GenKeystream(uint32_t addr,
+                                 uint64_t keystream[kMaxDataWords]) const {
+  uint64_t addr_bits = addr & low_mask(addr_width_);
+  uint32_t num_blocks = (data_width_ + kPrinceWidth - 1) / kPrinceWidth;
 
-    // PRINCE C reference model works on big-endian byte order
-    iv = byte_reverse_vector(iv);
-    auto key_be = byte_reverse_vector(key);
-
-    // Apply PRINCE to IV to produce keystream
-    std::vector<uint8_t> keystream_block(kPrinceWidthByte);
-    prince_enc_dec(&iv[0], &key_be[0], &keystream_block[0], 0, num_half_rounds,
-                   0);
-
-    // Flip keystream into little endian order and add to keystream vector
-    keystream_block = byte_reverse_vector(keystream_block);
-    // Repeat the output of a single PRINCE instance if needed
-    for (uint32_t k = 0; k < num_repetitions; ++k) {
-      keystream.insert(keystream.end(), keystream_block.begin(),
-                       keystream_block.end());
+  uint64_t block = 0;
+  for (uint32_t i = 0; i < kMaxDataWords; ++i) {
+    if (i < num_blocks && (i == 0 || !repeat_keystream_)) {
+      block = prince_encrypt(addr_bits | iv_nonce_[i], prince_k0_, prince_k1_,
+                             kNumPrinceHalfRounds);
     }
+    keystream[i] = (i < num_blocks) ? block : 0;
   }
 
-  // Total keystream bits generated are some multiple of kPrinceWidth. This can
-  // result in unused keystream bits. Remove the unused bytes from the keystream
-  // vector and zero out top unused bits in the final byte if required.
-  uint32_t keystream_bytes = (keystream_width + 7) / 8;
-  uint32_t keystream_bytes_to_erase = keystream.size() - keystream_bytes;
-  if (keystream_bytes_to_erase) {
-    keystream.erase(keystream.end() - keystream_bytes_to_erase,
-                    keystream.end());
+  // Zero any unused keystream bits at the top
+  if (data_width_ % 64) {
+    keystream[num_blocks - 1] &= low_mask(data_width_ % 64);
   }
+}
 
-  if (keystream_width % 8) {
-    keystream[keystream.size() - 1] &= (1 << (keystream_width % 8)) - 1;
+void ScrambleModel::SubstPermData(const uint64_t in[kMaxDataWords],
+                                  uint64_t out[kMaxDataWords], bool enc) const {
+  std::fill(out, out + kMaxDataWords, 0);
+
+  // Where data_width_ does not evenly divide into subst_perm_width_ the final
+  // block is smaller.
+  for (uint32_t pos = 0; pos < data_width_; pos += subst_perm_width_) {
+    uint32_t block_width = std::min(subst_perm_width_, data_width_ - pos);
+    uint64_t block = get_bits(in, pos, block_width);
+    block = enc ? scramble_subst_perm_enc(block, 0, block_width,
+                                          kNumDataSubstPermRounds)
+                : scramble_subst_perm_dec(block, 0, block_width,
+                                          kNumDataSubstPermRounds);
+    or_bits(out, pos, block_width, block);
   }
-
-  return keystream;
 }
 
-// Split incoming data into subst_perm_width chunks and individually apply the
-// substitution/permutation layer to each
-static std::vector<uint8_t> scramble_subst_perm_full_width(
-    const std::vector<uint8_t> &in, uint32_t bit_width,
-    uint32_t subst_perm_width, bool enc) {
-  assert(in.size() == ((bit_width + 7) / 8));
-
-  // Determine how many bytes each subst_perm_width chunk is and how many
-  // chunks are needed to cover the full bit_width.
-  uint32_t subst_perm_bytes = (subst_perm_width + 7) / 8;
-  uint32_t subst_perm_blocks =
-      (bit_width + subst_perm_width - 1) / subst_perm_width;
+void ScrambleModel::EncryptData(const uint8_t *data_in, uint8_t *data_out,
+                                uint32_t addr) const {
+  uint64_t keystream[kMaxDataWords];
+  GenKeystream(addr, keystream);
+  EncryptDataWithKeystream(data_in, data_out, keystream);
+}
 
-  std::vector<uint8_t> out(in.size(), 0);
-  std::vector<uint8_t> zero_key(subst_perm_bytes, 0);
+void ScrambleModel::DecryptData(const uint8_t *data_in, uint8_t *data_out,
+                                uint32_t addr) const {
+  uint64_t keystream[kMaxDataWords];
+  GenKeystream(addr, keystream);
+  DecryptDataWithKeystream(data_in, data_out, keystream);
+}
 
-  auto sp_scrambler = enc ? scramble_subst_perm_enc : scramble_subst_perm_dec;
+void ScrambleModel::EncryptDataWithKeystream(
+    const uint8_t *data_in, uint8_t *data_out,
+    const uint64_t keystream[kMaxDataWords]) const {
+  // One spare word at the end so that get_bits can always read idx + 1.
+  uint64_t data[kMaxDataWords + 1] = {0};
+  uint64_t scrambled[kMaxDataWords + 1] = {0};
 
-  for (uint32_t i = 0; i < subst_perm_blocks; ++i) {
-    // Where bit_width does not evenly divide into subst_perm_width the
-    // final block is smaller.
-    uint32_t bits_so_far = subst_perm_width * i;
-    uint32_t block_width = std::min(subst_perm_width, bit_width - bits_so_far);
+  // Data is encrypted by XORing with keystream then applying
+  // substitution/permutation layer
+  bytes_to_words(data_in, GetDataWidthByte(), data);
+  for (uint32_t i = 0; i < kMaxDataWords; ++i) {
+    data[i] ^= keystream[i];
+  }
 
-    std::vector<uint8_t> subst_perm_data(subst_perm_bytes, 0);
+  SubstPermData(data, scrambled, true);
+  words_to_bytes(scrambled, GetDataWidthByte(), data_out);
+}
 
-    // Extract bits from in for this chunk
-    for (uint32_t j = 0; j < block_width; ++j) {
-      or_vector_bit(subst_perm_data, j,
-                    read_vector_bit(in, j + i * subst_perm_width));
-    }
+void ScrambleModel::DecryptDataWithKeystream(
+    const uint8_t *data_in, uint8_t *data_out,
+    const uint64_t keystream[kMaxDataWords]) const {
+  uint64_t data[kMaxDataWords + 1] = {0};
+  uint64_t unscrambled[kMaxDataWords + 1] = {0};
 
-    // Apply the substitution/permutation layer to the chunk
-    auto subst_perm_out = sp_scrambler(subst_perm_data, zero_key, block_width,
-                                       kNumDataSubstPermRounds);
+  // Data is decrypted by reversing substitution/permutation layer then XORing
+  // with keystream
+  bytes_to_words(data_in, GetDataWidthByte(), data);
+  SubstPermData(data, unscrambled, false);
 
-    // Write the result to the `out` vector
-    for (uint32_t j = 0; j < block_width; ++j) {
-      or_vector_bit(out, j + i * subst_perm_width,
-                    read_vector_bit(subst_perm_out, j));
-    }
+  for (uint32_t i = 0; i < kMaxDataWords; ++i) {
+    unscrambled[i] ^= keystream[i];
   }
 
-  return out;
+  words_to_bytes(unscrambled, GetDataWidthByte(), data_out);
 }
 
 std::vector<uint8_t> scramble_addr(const std::vector<uint8_t> &addr_in,
@@ -302,22 +473,25 @@ std::vector<uint8_t> scramble_addr(const std::vector<uint8_t> &addr_in,
                                    const std::vector<uint8_t> &nonce,
                                    uint32_t nonce_width) {
   assert(addr_in.size() == ((addr_width + 7) / 8));
-
-  std::vector<uint8_t> addr_enc_nonce(addr_in.size(), 0);
-
-  // Address is scrambled by using substitution/permutation layer with the nonce
-  // used as a key.
-  // Extract relevant nonce bits for key
-  for (uint32_t i = 0; i < addr_width; ++i) {
-    or_vector_bit(addr_enc_nonce, i,
-                  read_vector_bit(nonce, nonce_width - addr_width + i));
+  assert(addr_width <= 64);
+
+  // Address is scrambled by using substitution/permutation layer with the
+  // top addr_width bits of the nonce used as a key.
+  uint64_t key = get_vector_bits(nonce, nonce_width - addr_width, addr_width);
+  uint64_t addr = get_vector_bits(addr_in, 0, addr_width);
+  uint64_t addr_enc =
+      scramble_subst_perm_enc(addr, key, addr_width, kNumAddrSubstPermRounds);
+
+  std::vector<uint8_t> ret(addr_in.size());
+  for (size_t i = 0; i < ret.size(); ++i) {
+    ret[i] = addr_enc >> (8 * i);
   }
-
-  // Apply substitution/permutation layer
-  return scramble_subst_perm_enc(addr_in, addr_enc_nonce, addr_width,
-                                 kNumAddrSubstPermRounds);
+  return ret;
 }
 
+// The data functions below don't use the address scrambling key, so they
+// construct a ScrambleModel with the full nonce width and the lowest
+// addr_width bits of the address.
 std::vector<uint8_t> scramble_encrypt_data(
     const std::vector<uint8_t> &data_in, uint32_t data_width,
     uint32_t subst_perm_width, const std::vector<uint8_t> &addr,
@@ -326,17 +500,13 @@ std::vector<uint8_t> scramble_encrypt_data(
   assert(data_in.size() == ((data_width + 7) / 8));
   assert(addr.size() == ((addr_width + 7) / 8));
 
-  // Data is encrypted by XORing with keystream then applying
-  // substitution/permutation layer
-
-  auto keystream =
-      scramble_gen_keystream(addr, addr_width, nonce, key, data_width,
-                             kNumPrinceHalfRounds, repeat_keystream);
+  ScrambleModel model(addr_width, data_width, subst_perm_width, nonce,
+                      8 * nonce.size(), key, repeat_keystream);
 
-  auto data_enc = xor_vectors(data_in, keystream);
-
-  return scramble_subst_perm_full_width(data_enc, data_width, subst_perm_width,
-                                        true);
+  std::vector<uint8_t> ret(data_in.size());
+  model.EncryptData(&data_in[0], &ret[0],
+                    get_vector_bits(addr, 0, addr_width));
+  return ret;
 }
 
 std::vector<uint8_t> scramble_decrypt_data(
@@ -347,16 +517,11 @@ std::vector<uint8_t> scramble_decrypt_data(
   assert(data_in.size() == ((data_width + 7) / 8));
   assert(addr.size() == ((addr_width + 7) / 8));
 
-  // Data is decrypted by reversing substitution/permutation layer then XORing
-  // with keystream
-  auto data_sp_out = scramble_subst_perm_full_width(data_in, data_width,
-                                                    subst_perm_width, false);
-
-  auto keystream =
-      scramble_gen_keystream(addr, addr_width, nonce, key, data_width,
-                             kNumPrinceHalfRounds, repeat_keystream);
-
-  auto data_dec = xor_vectors(data_sp_out, keystream);
+  ScrambleModel model(addr_width, data_width, subst_perm_width, nonce,
+                      8 * nonce.size(), key, repeat_keystream);
 
-  return data_dec;
+  std::vector<uint8_t> ret(data_in.size());
+  model.DecryptData(&data_in[0], &ret[0],
+                    get_vector_bits(addr, 0, addr_width));
+  return ret;
 }
@@ -5,12 +5,18 @@
 #ifndef OPENTITAN_HW_IP_PRIM_DV_PRIM_RAM_SCR_CPP_SCRAMBLE_MODEL_H_
 #define OPENTITAN_HW_IP_PRIM_DV_PRIM_RAM_SCR_CPP_SCRAMBLE_MODEL_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <vector>
 
 const uint32_t kPrinceWidth = 64;
 const uint32_t kPrinceWidthByte = kPrinceWidth / 8;
 
+// The widest data word supported by ScrambleModel. This matches the maximum
+// nonce width in prim_util_get_scramble_key_nonce.svh.
+const uint32_t kScrMaxDataWidth = 320;
+const uint32_t kScrMaxDataWidthByte = kScrMaxDataWidth / 8;
+
 // C++ model of memory scrambling. All byte vectors are in little endian byte
 // order (least significant byte at index 0).
 
@@ -68,4 +74,94 @@ std::vector<uint8_t> scramble_encrypt_data(
     uint32_t addr_width, const std::vector<uint8_t> &nonce,
     const std::vector<uint8_t> &key, bool repeat_keystream);
 
+/** Scrambling state for a single memory
+ *
+ * The functions above take byte vectors and unpack the key and nonce again on
+ * every call. This class does that once, when it is constructed, and then does
+ * all of its work on fixed-width integers without allocating. It gives the
+ * same results as the functions above.
+ *
+ * Data words are little-endian byte arrays of <tt>(data_width + 7) / 8</tt>
+ * bytes. Addresses are integers that must fit in addr_width bits.
+ */
+class ScrambleModel {
+ public:
+  /**
+   * @param addr_width       Width of the address in bits (at most 32)
+   * @param data_width       Width of data in bits (at most kScrMaxDataWidth)
+   * @param subst_perm_width Width over which the substitution/permutation
+   *                         network is applied (at most 64)
+   * @param nonce            Byte vector of scrambling nonce
+   * @param nonce_width      Width of scramble nonce in bits
+   * @param key              Byte vector of scrambling key
+   * @param repeat_keystream See scramble_encrypt_data
+   */
+  ScrambleModel(uint32_t addr_width, uint32_t data_width,
+                uint32_t subst_perm_width, const std::vector<uint8_t> &nonce,
+                uint32_t nonce_width, const std::vector<uint8_t> &key,
+                bool repeat_keystream);
+
+  /** Scramble an address (equivalent to scramble_addr) */
+  uint32_t ScrambleAddr(uint32_t addr) const;
+
+  /** Scramble count addresses from addrs, writing the results to phys_addrs */
+  void ScrambleAddrs(const uint32_t *addrs, uint32_t *phys_addrs,
+                     size_t count) const;
+
+  /** Encrypt the data word at data_in, which will be stored at the logical
+   * address addr, and write the result to data_out. The two buffers may be
+   * the same. */
+  void EncryptData(const uint8_t *data_in, uint8_t *data_out,
+                   uint32_t addr) const;
+
+  /** Decrypt the data word at data_in, which was stored at the logical address
+   * addr, and write the result to data_out. The two buffers may be the same. */
+  void DecryptData(const uint8_t *data_in, uint8_t *data_out,
+                   uint32_t addr) const;
+
+  // The number of 64-bit words in a keystream
+  static const uint32_t kKeystreamWords = kScrMaxDataWidth / 64;
+
+  /** Compute the keystream for addr, packed into little-endian 64-bit words.
+   *
+   * The keystream only depends on the key, nonce and address, so callers that
+   * scramble the same addresses repeatedly can compute it once and then use
+   * EncryptDataWithKeystream() and DecryptDataWithKeystream(). */
+  void GenKeystream(uint32_t addr, uint64_t keystream[kKeystreamWords]) const;
+
+  /** Equivalent to EncryptData, with a keystream from GenKeystream() */
+  void EncryptDataWithKeystream(
+      const uint8_t *data_in, uint8_t *data_out,
+      const uint64_t keystream[kKeystreamWords]) const;
+
+  /** Equivalent to DecryptData, with a keystream from GenKeystream() */
+  void DecryptDataWithKeystream(
+      const uint8_t *data_in, uint8_t *data_out,
+      const uint64_t keystream[kKeystreamWords]) const;
+
+  uint32_t GetDataWidthByte() const { return (data_width_ + 7) / 8; }
+
+ private:
+  static const uint32_t kMaxPrinces = kScrMaxDataWidth / kPrinceWidth;
+  static const uint32_t kMaxDataWords = kKeystreamWords;
+
+  // Apply the data substitution/permutation network to each chunk of
+  // subst_perm_width_ bits.
+  void SubstPermData(const uint64_t in[kMaxDataWords],
+                     uint64_t out[kMaxDataWords], bool enc) const;
+
+  uint32_t addr_width_;
+  uint32_t data_width_;
+  uint32_t subst_perm_width_;
+  bool repeat_keystream_;
+
+  // The nonce bits used as a key for address scrambling
+  uint64_t addr_key_;
+  // The nonce bits for each PRINCE instance's IV, already shifted up above
+  // the address bits
+  uint64_t iv_nonce_[kMaxPrinces];
+  // PRINCE key halves
+  uint64_t prince_k0_, prince_k1_;
+};
+
 #endif  // OPENTITAN_HW_IP_PRIM_DV_PRIM_RAM_SCR_CPP_SCRAMBLE_MODEL_H_
@@ -0,0 +1,539 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Throughput benchmark and cross-check for the scrambling model.
+//
+// This compares scramble_model.cc against the original reference model, which
+// worked on one bit at a time on byte vectors and is kept below in namespace
+// ref. The only (optional) argument is the number of words to scramble, which
+// defaults to 65536.
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <stdint.h>
+#include <vector>
+
+#include "prince_ref.h"
+#include "scramble_model.h"
+
+namespace ref {
+
+static uint8_t PRESENT_SBOX4[] = {0xc, 0x5, 0x6, 0xb, 0x9, 0x0, 0xa, 0xd,
+                           0x3, 0xe, 0xf, 0x8, 0x4, 0x7, 0x1, 0x2};
+
+static uint8_t PRESENT_SBOX4_INV[] = {0x5, 0xe, 0xf, 0x8, 0xc, 0x1, 0x2, 0xd,
+                               0xb, 0x4, 0x6, 0x3, 0x0, 0x7, 0x9, 0xa};
+
+static const uint32_t kNumAddrSubstPermRounds = 2;
+static const uint32_t kNumDataSubstPermRounds = 2;
+static const uint32_t kNumPrinceHalfRounds = 2;
+
+static std::vector<uint8_t> byte_reverse_vector(
+    const std::vector<uint8_t> &vec_in) {
+  std::vector<uint8_t> vec_out(vec_in.size());
+
+  std::reverse_copy(std::begin(vec_in), std::end(vec_in), std::begin(vec_out));
+
+  return vec_out;
+}
+
+static uint8_t read_vector_bit(const std::vector<uint8_t> &vec,
+                               uint32_t bit_pos) {
+  assert(bit_pos / 8 < vec.size());
+
+  return (vec[bit_pos / 8] >> (bit_pos % 8)) & 1;
+}
+
+static void or_vector_bit(std::vector<uint8_t> &vec, uint32_t bit_pos,
+                          uint8_t bit) {
+  assert(bit_pos / 8 < vec.size());
+
+  vec[bit_pos / 8] |= bit << (bit_pos % 8);
+}
+
+static std::vector<uint8_t> xor_vectors(const std::vector<uint8_t> &vec_a,
+                                        const std::vector<uint8_t> &vec_b) {
+  assert(vec_a.size() == vec_b.size());
+
+  std::vector<uint8_t> vec_out(vec_a.size());
+
+  std::transform(vec_a.begin(), vec_a.end(), vec_b.begin(), vec_out.begin(),
+                 std::bit_xor<uint8_t>{});
+
+  return vec_out;
+}
+
+// Run each 4-bit chunk of bytes from `in` through the SBOX. Where `bit_width`
+// isn't a multiple of 4 the remaining bits are just copied straight through.
+// `invert` choose whether to use the inverted SBOX or not.
+static std::vector<uint8_t> scramble_sbox_layer(const std::vector<uint8_t> &in,
+                                                uint32_t bit_width,
+                                                uint8_t sbox[16]) {
+  assert(in.size() == ((bit_width + 7) / 8));
+  std::vector<uint8_t> out(in.size(), 0);
+
+  // Iterate through each 4 bit chunk of the data and apply the appropriate SBOX
+  for (uint32_t i = 0; i < bit_width / 4; ++i) {
+    uint8_t sbox_in, sbox_out;
+
+    sbox_in = in[i / 2];
+
+    int shift = (i % 2) ? 4 : 0;
+    sbox_in = (sbox_in >> shift) & 0xf;
+
+    sbox_out = sbox[sbox_in];
+
+    out[i / 2] |= sbox_out << shift;
+  }
+
+  // Where bit_width is not a multiple of 4 copy over the remaining bits
+  if (bit_width % 4) {
+    int shift = ((bit_width % 8) >= 4) ? 4 : 0;
+    uint8_t nibble = (in[bit_width / 8] >> shift) & 0xf;
+    out[bit_width / 8] |= nibble << shift;
+  }
+
+  return out;
+}
+
+// Reverse bits from incoming byte vector
+static std::vector<uint8_t> scramble_flip_layer(const std::vector<uint8_t> &in,
+                                                uint32_t bit_width) {
+  assert(in.size() == ((bit_width + 7) / 8));
+  std::vector<uint8_t> out(in.size(), 0);
+
+  for (uint32_t i = 0; i < bit_width; ++i) {
+    or_vector_bit(out, bit_width - i - 1, read_vector_bit(in, i));
+  }
+
+  return out;
+}
+
+// Apply butterfly to incoming byte vector. Even bits are placed in the lower
+// half of the output, odd bits are placed in the upper half of the output.
+static std::vector<uint8_t> scramble_perm_layer(const std::vector<uint8_t> &in,
+                                                uint32_t bit_width,
+                                                bool invert) {
+  assert(in.size() == ((bit_width + 7) / 8));
+  std::vector<uint8_t> out(in.size(), 0);
+
+  for (uint32_t i = 0; i < bit_width / 2; ++i) {
+    if (invert) {
+      or_vector_bit(out, i * 2, read_vector_bit(in, i));
+      or_vector_bit(out, i * 2 + 1, read_vector_bit(in, i + (bit_width / 2)));
+    } else {
+      or_vector_bit(out, i, read_vector_bit(in, i * 2));
+      or_vector_bit(out, i + (bit_width / 2), read_vector_bit(in, i * 2 + 1));
+    }
+  }
+
+  if (bit_width % 2) {
+    // Where bit_width isn't even, the final bit is copied across to the same
+    // position
+    or_vector_bit(out, bit_width - 1, read_vector_bit(in, bit_width - 1));
+  }
+
+  return out;
+}
+
+// Apply a full set of subsitution/permutation rounds for encrypt to the
+// incoming byte vector
+static std::vector<uint8_t> scramble_subst_perm_enc(
+    const std::vector<uint8_t> &in, const std::vector<uint8_t> &key,
+    uint32_t bit_width, uint32_t num_rounds) {
+  assert(in.size() == ((bit_width + 7) / 8));
+  assert(key.size() == ((bit_width + 7) / 8));
+
+  std::vector<uint8_t> state(in);
+
+  for (uint32_t i = 0; i < num_rounds; ++i) {
+    state = xor_vectors(state, key);
+
+    state = scramble_sbox_layer(state, bit_width, PRESENT_SBOX4);
+    state = scramble_flip_layer(state, bit_width);
+    state = scramble_perm_layer(state, bit_width, false);
+  }
+
+  state = xor_vectors(state, key);
+
+  return state;
+}
+
+// Apply a full set of substitution/permutation rounds for decrypt to the
+// incoming byte vector
+static std::vector<uint8_t> scramble_subst_perm_dec(
+    const std::vector<uint8_t> &in, const std::vector<uint8_t> &key,
+    uint32_t bit_width, uint32_t num_rounds) {
+  assert(in.size() == ((bit_width + 7) / 8));
+  assert(key.size() == ((bit_width + 7) / 8));
+
+  std::vector<uint8_t> state(in);
+
+  for (uint32_t i = 0; i < num_rounds; ++i) {
+    state = xor_vectors(state, key);
+
+    state = scramble_perm_layer(state, bit_width, true);
+    state = scramble_flip_layer(state, bit_width);
+    state = scramble_sbox_layer(state, bit_width, PRESENT_SBOX4_INV);
+  }
+
+  state = xor_vectors(state, key);
+
+  return state;
+}
+
+// Generate a keystream for XORing with data using PRINCE.
+// If repeat_keystream is set to true, the output from one PRINCE instance is
+// repeated when the keystream is greater than a single PRINCE width (64bit).
+// Otherwise, multiple PRINCEs are instantiated to form the keystream.
+static std::vector<uint8_t> scramble_gen_keystream(
+    const std::vector<uint8_t> &addr, uint32_t addr_width,
+    const std::vector<uint8_t> &nonce, const std::vector<uint8_t> &key,
+    uint32_t keystream_width, uint32_t num_half_rounds, bool repeat_keystream) {
+  assert(key.size() == (kPrinceWidthByte * 2));
+
+  // Determine how many PRINCE replications are required
+  uint32_t num_princes, num_repetitions;
+  if (repeat_keystream) {
+    num_princes = 1;
+    num_repetitions = (keystream_width + kPrinceWidth - 1) / kPrinceWidth;
+  } else {
+    num_princes = (keystream_width + kPrinceWidth - 1) / kPrinceWidth;
+    num_repetitions = 1;
+  }
+
+  std::vector<uint8_t> keystream;
+
+  for (uint32_t i = 0; i < num_princes; ++i) {
+    // Initial vector is data for PRINCE to encrypt. Formed from nonce and data
+    // address
+    std::vector<uint8_t> iv(8, 0);
+
+    for (uint32_t j = 0; j < kPrinceWidth; ++j) {
+      if (j < addr_width) {
+        // Bottom addr_width bits of IV are address
+        or_vector_bit(iv, j, read_vector_bit(addr, j));
+      } else {
+        // Other bits are taken from nonce. Each PRINCE instantiation will use
+        // different nonce bits.
+        int nonce_bit = (j - addr_width) + i * (kPrinceWidth - addr_width);
+        or_vector_bit(iv, j, read_vector_bit(nonce, nonce_bit));
+      }
+    }
+
+    // PRINCE C reference model works on big-endian byte order
+    iv = byte_reverse_vector(iv);
+    auto key_be = byte_reverse_vector(key);
+
+    // Apply PRINCE to IV to produce keystream
+    std::vector<uint8_t> keystream_block(kPrinceWidthByte);
+    prince_enc_dec(&iv[0], &key_be[0], &keystream_block[0], 0, num_half_rounds,
+                   0);
+
+    // Flip keystream into little endian order and add to keystream vector
+    keystream_block = byte_reverse_vector(keystream_block);
+    // Repeat the output of a single PRINCE instance if needed
+    for (uint32_t k = 0; k < num_repetitions; ++k) {
+      keystream.insert(keystream.end(), keystream_block.begin(),
+                       keystream_block.end());
+    }
+  }
+
+  // Total keystream bits generated are some multiple of kPrinceWidth. This can
+  // result in unused keystream bits. Remove the unused bytes from the keystream
+  // vector and zero out top unused bits in the final byte if required.
+  uint32_t keystream_bytes = (keystream_width + 7) / 8;
+  uint32_t keystream_bytes_to_erase = keystream.size() - keystream_bytes;
+  if (keystream_bytes_to_erase) {
+    keystream.erase(keystream.end() - keystream_bytes_to_erase,
+                    keystream.end());
+  }
+
+  if (keystream_width % 8) {
+    keystream[keystream.size() - 1] &= (1 << (keystream_width % 8)) - 1;
+  }
+
+  return keystream;
+}
+
+// Split incoming data into subst_perm_width chunks and individually apply the
+// substitution/permutation layer to each
+static std::vector<uint8_t> scramble_subst_perm_full_width(
+    const std::vector<uint8_t> &in, uint32_t bit_width,
+    uint32_t subst_perm_width, bool enc) {
+  assert(in.size() == ((bit_width + 7) / 8));
+
+  // Determine how many bytes each subst_perm_width chunk is and how many
+  // chunks are needed to cover the full bit_width.
+  uint32_t subst_perm_bytes = (subst_perm_width + 7) / 8;
+  uint32_t subst_perm_blocks =
+      (bit_width + subst_perm_width - 1) / subst_perm_width;
+
+  std::vector<uint8_t> out(in.size(), 0);
+  std::vector<uint8_t> zero_key(subst_perm_bytes, 0);
+
+  auto sp_scrambler = enc ? scramble_subst_perm_enc : scramble_subst_perm_dec;
+
+  for (uint32_t i = 0; i < subst_perm_blocks; ++i) {
+    // Where bit_width does not evenly divide into subst_perm_width the
+    // final block is smaller.
+    uint32_t bits_so_far = subst_perm_width * i;
+    uint32_t block_width = std::min(subst_perm_width, bit_width - bits_so_far);
+
+    std::vector<uint8_t> subst_perm_data(subst_perm_bytes, 0);
+
+    // Extract bits from in for this chunk
+    for (uint32_t j = 0; j < block_width; ++j) {
+      or_vector_bit(subst_perm_data, j,
+                    read_vector_bit(in, j + i * subst_perm_width));
+    }
+
+    // Apply the substitution/permutation layer to the chunk
+    auto subst_perm_out = sp_scrambler(subst_perm_data, zero_key, block_width,
+                                       kNumDataSubstPermRounds);
+
+    // Write the result to the `out` vector
+    for (uint32_t j = 0; j < block_width; ++j) {
+      or_vector_bit(out, j + i * subst_perm_width,
+                    read_vector_bit(subst_perm_out, j));
+    }
+  }
+
+  return out;
+}
+
+static std::vector<uint8_t> scramble_addr(const std::vector<uint8_t> &addr_in,
+                                   uint32_t addr_width,
+                                   const std::vector<uint8_t> &nonce,
+                                   uint32_t nonce_width) {
+  assert(addr_in.size() == ((addr_width + 7) / 8));
+
+  std::vector<uint8_t> addr_enc_nonce(addr_in.size(), 0);
+
+  // Address is scrambled by using substitution/permutation layer with the nonce
+  // used as a key.
+  // Extract relevant nonce bits for key
+  for (uint32_t i = 0; i < addr_width; ++i) {
+    or_vector_bit(addr_enc_nonce, i,
+                  read_vector_bit(nonce, nonce_width - addr_width + i));
+  }
+
+  // Apply substitution/permutation layer
+  return scramble_subst_perm_enc(addr_in, addr_enc_nonce, addr_width,
+                                 kNumAddrSubstPermRounds);
+}
+
+static std::vector<uint8_t> scramble_encrypt_data(
+    const std::vector<uint8_t> &data_in, uint32_t data_width,
+    uint32_t subst_perm_width, const std::vector<uint8_t> &addr,
+    uint32_t addr_width, const std::vector<uint8_t> &nonce,
+    const std::vector<uint8_t> &key, bool repeat_keystream) {
+  assert(data_in.size() == ((data_width + 7) / 8));
+  assert(addr.size() == ((addr_width + 7) / 8));
+
+  // Data is encrypted by XORing with keystream then applying
+  // substitution/permutation layer
+
+  auto keystream =
+      scramble_gen_keystream(addr, addr_width, nonce, key, data_width,
+                             kNumPrinceHalfRounds, repeat_keystream);
+
+  auto data_enc = xor_vectors(data_in, keystream);
+
+  return scramble_subst_perm_full_width(data_enc, data_width, subst_perm_width,
+                                        true);
+}
+
+static std::vector<uint8_t> scramble_decrypt_data(
+    const std::vector<uint8_t> &data_in, uint32_t data_width,
+    uint32_t subst_perm_width, const std::vector<uint8_t> &addr,
+    uint32_t addr_width, const std::vector<uint8_t> &nonce,
+    const std::vector<uint8_t> &key, bool repeat_keystream) {
+  assert(data_in.size() == ((data_width + 7) / 8));
+  assert(addr.size() == ((addr_width + 7) / 8));
+
+  // Data is decrypted by reversing substitution/permutation layer then XORing
+  // with keystream
+  auto data_sp_out = scramble_subst_perm_full_width(data_in, data_width,
+                                                    subst_perm_width, false);
+
+  auto keystream =
+      scramble_gen_keystream(addr, addr_width, nonce, key, data_width,
+                             kNumPrinceHalfRounds, repeat_keystream);
+
+  auto data_dec = xor_vectors(data_sp_out, keystream);
+
+  return data_dec;
+}
+}  // namespace ref
+
+// A scrambled memory configuration. The nonce is as wide as the keystream,
+// rounded up to whole PRINCE instances, like in prim_ram_1p_scr.
+struct ScrConfig {
+  uint32_t addr_width;
+  uint32_t data_width;
+  uint32_t subst_perm_width;
+  bool repeat_keystream;
+
+  uint32_t NonceWidth() const {
+    return kPrinceWidth * ((data_width + kPrinceWidth - 1) / kPrinceWidth);
+  }
+};
+
+// The configuration used by OTBN's DMEM: 256-bit words stored as eight 39-bit
+// ECC-protected 32-bit words. This is the one that gets timed.
+static const ScrConfig kBenchConfig = {10, 8 * 39, 39, false};
+
+// Configurations that are only cross-checked. These cover address widths
+// that fit in a single byte (and ones that don't), data words narrower than a
+// PRINCE instance and a repeated keystream.
+static const ScrConfig kCheckConfigs[] = {
+    {1, 32, 32, false},  {4, 39, 39, false},   {8, 39, 39, false},
+    {9, 64, 64, false},  {13, 78, 39, false},  {16, 156, 39, false},
+    {6, 128, 64, true},  {17, 312, 39, false}, {32, 16, 16, false},
+};
+
+static double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+static std::vector<uint8_t> AddrToBytes(uint32_t addr, uint32_t addr_width) {
+  std::vector<uint8_t> ret((addr_width + 7) / 8);
+  for (size_t i = 0; i < ret.size(); ++i) {
+    ret[i] = addr >> (8 * i);
+  }
+  return ret;
+}
+
+static uint32_t AddrFromBytes(const std::vector<uint8_t> &bytes) {
+  uint32_t ret = 0;
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    ret |= (uint32_t)bytes[i] << (8 * i);
+  }
+  return ret;
+}
+
+// Encrypt num_words random words and scramble their addresses with both the
+// reference model and ScrambleModel, then decrypt them again. Returns the
+// number of results that differ. If ref_secs and new_secs are not null, they
+// are set to the time each model took to encrypt and scramble.
+static uint32_t CompareModels(const ScrConfig &cfg, uint32_t num_words,
+                              std::mt19937 &rng, double *ref_secs,
+                              double *new_secs) {
+  uint32_t data_bytes = (cfg.data_width + 7) / 8;
+  uint32_t nonce_width = cfg.NonceWidth();
+
+  std::uniform_int_distribution<int> byte_dist(0, 255);
+  auto rand_bytes = [&](size_t n) {
+    std::vector<uint8_t> ret(n);
+    for (auto &b : ret) {
+      b = byte_dist(rng);
+    }
+    return ret;
+  };
+
+  std::vector<uint8_t> key = rand_bytes(2 * kPrinceWidthByte);
+  std::vector<uint8_t> nonce = rand_bytes(nonce_width / 8);
+  std::vector<std::vector<uint8_t>> words(num_words);
+  for (auto &word : words) {
+    word = rand_bytes(data_bytes);
+    word.back() &= (1 << (cfg.data_width % 8 ? cfg.data_width % 8 : 8)) - 1;
+  }
+
+  const uint32_t addr_mask =
+      cfg.addr_width < 32 ? (1u << cfg.addr_width) - 1 : ~0u;
+  std::vector<std::vector<uint8_t>> ref_out(num_words);
+  std::vector<uint32_t> ref_addrs(num_words);
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < num_words; ++i) {
+    std::vector<uint8_t> addr = AddrToBytes(i & addr_mask, cfg.addr_width);
+    ref_out[i] = ref::scramble_encrypt_data(
+        words[i], cfg.data_width, cfg.subst_perm_width, addr, cfg.addr_width,
+        nonce, key, cfg.repeat_keystream);
+    ref_addrs[i] = AddrFromBytes(
+        ref::scramble_addr(addr, cfg.addr_width, nonce, nonce_width));
+  }
+  if (ref_secs) {
+    *ref_secs = SecondsSince(start);
+  }
+
+  std::vector<uint8_t> out(data_bytes);
+  uint32_t mismatches = 0;
+
+  start = std::chrono::steady_clock::now();
+  ScrambleModel model(cfg.addr_width, cfg.data_width, cfg.subst_perm_width,
+                      nonce, nonce_width, key, cfg.repeat_keystream);
+  for (uint32_t i = 0; i < num_words; ++i) {
+    model.EncryptData(&words[i][0], &out[0], i & addr_mask);
+    uint32_t phys = model.ScrambleAddr(i & addr_mask);
+    mismatches += (out != ref_out[i]) || (phys != ref_addrs[i]);
+  }
+  if (new_secs) {
+    *new_secs = SecondsSince(start);
+  }
+
+  // Check that decryption matches too (and gets us back to where we started)
+  for (uint32_t i = 0; i < num_words; ++i) {
+    model.DecryptData(&ref_out[i][0], &out[0], i & addr_mask);
+    std::vector<uint8_t> ref_dec = ref::scramble_decrypt_data(
+        ref_out[i], cfg.data_width, cfg.subst_perm_width,
+        AddrToBytes(i & addr_mask, cfg.addr_width), cfg.addr_width, nonce, key,
+        cfg.repeat_keystream);
+    mismatches += (out != words[i]) || (ref_dec != words[i]);
+  }
+
+  return mismatches;
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t num_words = (argc > 1) ? strtoul(argv[1], NULL, 0) : 65536;
+
+  std::mt19937 rng(1234);
+
+  double ref_secs, new_secs;
+  uint32_t mismatches =
+      CompareModels(kBenchConfig, num_words, rng, &ref_secs, &new_secs);
+
+  printf("%u words of %u bits (encrypt data + scramble address):\n",
+         num_words, kBenchConfig.data_width);
+  printf("  Reference model:  %8.3f s (%10.0f words/s)\n", ref_secs,
+         num_words / ref_secs);
+  printf("  ScrambleModel:    %8.3f s (%10.0f words/s)\n", new_secs,
+         num_words / new_secs);
+  printf("  Speedup:          %8.1fx\n", ref_secs / new_secs);
+
+  // The other configurations only need enough words to wrap around a small
+  // address space a few times.
+  const uint32_t check_words = std::min(num_words, 4096u);
+  for (const ScrConfig &cfg : kCheckConfigs) {
+    uint32_t cfg_mismatches = CompareModels(cfg, check_words, rng, NULL, NULL);
+    if (cfg_mismatches) {
+      printf("ERROR: %u results differ from the reference model with "
+             "addr_width %u, data_width %u, subst_perm_width %u, "
+             "nonce_width %u%s.\n",
+             cfg_mismatches, cfg.addr_width, cfg.data_width,
+             cfg.subst_perm_width, cfg.NonceWidth(),
+             cfg.repeat_keystream ? " and a repeated keystream" : "");
+    }
+    mismatches += cfg_mismatches;
+  }
+  printf("Cross-checked %u other configurations with %u words each.\n",
+         (unsigned)(sizeof kCheckConfigs / sizeof kCheckConfigs[0]),
+         check_words);
+
+  if (mismatches) {
+    printf("ERROR: %u results differ from the reference model.\n",
+           mismatches);
+    return 1;
+  }
+  return 0;
+}
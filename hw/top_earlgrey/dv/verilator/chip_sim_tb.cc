@@ -2,7 +2,6 @@
 // Licensed under the Apache License, Version 2.0, see LICENSE for details.
 // SPDX-License-Identifier: Apache-2.0
 
-#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -42,10 +41,8 @@ int main(int argc, char **argv) {
           "gen_generic.u_impl_generic",
       0x80000 / 8, 8);
   // Start with the flash region erased. Future loads can overwrite.
-  std::vector<uint8_t> all_ones(flash0.GetSizeBytes());
-  std::fill(all_ones.begin(), all_ones.end(), 0xffu);
-  flash0.Write(/*word_offset=*/0, all_ones);
-  flash1.Write(/*word_offset=*/0, all_ones);
+  flash0.Fill({0xffu}, /*word_offset=*/0, flash0.GetSizeWords());
+  flash1.Fill({0xffu}, /*word_offset=*/0, flash1.GetSizeWords());
 
   MemArea otp(top_scope + ".u_otp_ctrl.u_otp.gen_generic.u_impl_generic." +
                   ram1p_adv_scope,